@@ -3,15 +3,27 @@
 #include "Command.hpp"
 #include "Rustify/Result.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <cerrno>
 #include <chrono>
+#include <csignal>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
 #include <optional>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <thread>
+#include <unistd.h>
 #include <utility>
+#include <vector>
 
 namespace cabin {
 
@@ -44,45 +56,170 @@ std::string replaceAll(std::string str, const std::string_view from,
   return str;
 }
 
+std::string_view trim(std::string_view str) noexcept {
+  const auto isSpace = [](const char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+  };
+  while (!str.empty() && isSpace(str.front())) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && isSpace(str.back())) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+std::vector<std::string_view> splitLines(const std::string_view text) {
+  std::vector<std::string_view> lines;
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    std::size_t end = text.find('\n', pos);
+    if (end == std::string_view::npos) {
+      end = text.size();
+    }
+    lines.push_back(text.substr(pos, end - pos));
+    pos = end + 1;
+  }
+  return lines;
+}
+
 Result<ExitStatus> execCmd(const Command& cmd) noexcept {
   spdlog::debug("Running `{}`", cmd.toString());
   return Try(cmd.spawn()).wait();
 }
 
-Result<std::string> getCmdOutput(const Command& cmd,
+static bool isTransientFailure(const CommandOutput& cmdOut) noexcept {
+  // Likely the OOM killer.  Other signals, like a crashing compiler's
+  // SIGSEGV, would come again.
+  if (cmdOut.exitStatus.killedBySignal()
+      && cmdOut.exitStatus.termSignal() == SIGKILL) {
+    return true;
+  }
+  // Failures of execvp() in the child are reported through stderr.
+  for (const int errnum : { EAGAIN, ETXTBSY }) {
+    if (cmdOut.stdErr.find(std::strerror(errnum)) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Result<std::string> getCmdOutput(const Command& cmd, const RetryPolicy policy,
                                  const std::size_t retry) noexcept {
   spdlog::trace("Running `{}`", cmd.toString());
 
-  ExitStatus exitStatus;
-  std::string stdErr;
+  const std::size_t maxAttempts =
+      policy == RetryPolicy::Never ? 1 : std::max<std::size_t>(retry, 1);
   int waitTime = 1;
-  for (std::size_t i = 0; i < retry; ++i) {
-    const auto cmdOut = Try(cmd.output());
-    if (cmdOut.exitStatus.success()) {
-      return Ok(cmdOut.stdOut);
+  for (std::size_t attempt = 1;; ++attempt) {
+    Command piped = cmd;
+    piped.setStdOutConfig(Command::IOConfig::Piped);
+    piped.setStdErrConfig(Command::IOConfig::Piped);
+    auto child = piped.trySpawn();
+    if (child.is_err()) {
+      // fork() may fail with EAGAIN when the process table is full.
+      const SpawnError& err = child.unwrap_err();
+      if (err.errnum != EAGAIN || attempt >= maxAttempts) {
+        Bail("{}", err.toString());
+      }
+    } else {
+      auto cmdOut = child.unwrap().waitWithOutput();
+      if (cmdOut.is_err()) {
+        return Err(cmdOut.unwrap_err());
+      }
+      const CommandOutput& output = cmdOut.unwrap();
+      if (output.exitStatus.success()) {
+        return Ok(output.stdOut);
+      } else if (attempt >= maxAttempts || !isTransientFailure(output)) {
+        return Result<std::string>(Err(anyhow::anyhow(
+                   "Command `{}` {}", cmd.toString(), output.exitStatus)))
+            .with_context(
+                [stdErr = output.stdErr] { return anyhow::anyhow(stdErr); });
+      }
     }
-    exitStatus = cmdOut.exitStatus;
-    stdErr = cmdOut.stdErr;
+
+    spdlog::debug("Command `{}` failed transiently; retrying in {}s",
+                  cmd.toString(), waitTime);
 
     // Sleep for an exponential backoff.
     std::this_thread::sleep_for(std::chrono::seconds(waitTime));
     waitTime *= 2;
   }
+}
+
+// Search PATH for `cmd` the same way execvp(3) does, without spawning
+// `which` for every lookup.
+std::optional<std::filesystem::path>
+findExecutable(const std::string_view cmd) noexcept {
+  namespace fs = std::filesystem;
+
+  const auto isExecutable = [](const fs::path& path) {
+    std::error_code ec;
+    return fs::is_regular_file(path, ec) && access(path.c_str(), X_OK) == 0;
+  };
+
+  if (cmd.empty()) {
+    return std::nullopt;
+  }
+  if (cmd.find('/') != std::string_view::npos) {
+    if (isExecutable(cmd)) {
+      return fs::path(cmd);
+    }
+    return std::nullopt;
+  }
+
+  const char* pathEnv = std::getenv("PATH");
+  if (pathEnv == nullptr) {
+    return std::nullopt;
+  }
+
+  const std::string_view paths = pathEnv;
+  std::size_t start = 0;
+  while (start <= paths.size()) {
+    std::size_t end = paths.find(':', start);
+    if (end == std::string_view::npos) {
+      end = paths.size();
+    }
 
-  return Result<std::string>(
-             Err(anyhow::anyhow("Command `{}` {}", cmd.toString(), exitStatus)))
-      .with_context(
-          [stdErr = std::move(stdErr)] { return anyhow::anyhow(stdErr); });
+    // An empty entry means the current directory.
+    const std::string_view dir = paths.substr(start, end - start);
+    const fs::path candidate = fs::path(dir.empty() ? "." : dir) / cmd;
+    if (isExecutable(candidate)) {
+      return candidate;
+    }
+    start = end + 1;
+  }
+  return std::nullopt;
 }
 
 bool commandExists(const std::string_view cmd) noexcept {
-  return Command("which")
-      .addArg(cmd)
-      .setStdOutConfig(Command::IOConfig::Null)
-      .spawn()
-      .and_then(&Child::wait)
-      .map(&ExitStatus::success)
-      .unwrap_or(false);
+  return findExecutable(cmd).has_value();
+}
+
+Result<void> writeFileAtomically(const std::filesystem::path& path,
+                                 const std::string_view content) noexcept {
+  namespace fs = std::filesystem;
+
+  static std::atomic<std::uint64_t> counter{ 0 };
+  fs::path tmpPath = path;
+  tmpPath += fmt::format(".tmp.{}.{}", ::getpid(), counter++);
+
+  std::error_code ec;
+  {
+    std::ofstream ofs(tmpPath, std::ios::binary);
+    ofs << content;
+    if (!ofs) {
+      fs::remove(tmpPath, ec);
+      Bail("failed to write {}", tmpPath.string());
+    }
+  }
+  fs::rename(tmpPath, path, ec);
+  if (ec) {
+    const std::string msg = ec.message();
+    fs::remove(tmpPath, ec);
+    Bail("failed to write {}: {}", path.string(), msg);
+  }
+  return Ok();
 }
 
 } // namespace cabin
@@ -92,6 +229,9 @@ bool commandExists(const std::string_view cmd) noexcept {
 #  include "Rustify/Tests.hpp"
 
 #  include <array>
+#  include <fmt/format.h>
+#  include <fstream>
+#  include <iterator>
 #  include <limits>
 
 namespace tests {
@@ -99,7 +239,7 @@ namespace tests {
 using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
 using std::string_view_literals::operator""sv;
 
-static void testToLower() {
+CABIN_TEST_CASE(testToLower) {
   static_assert(toLower('A') == 'a');
   static_assert(toLower('Z') == 'z');
   static_assert(toLower('M') == 'm');
@@ -120,7 +260,7 @@ static void testToLower() {
   pass();
 }
 
-static void testLevDistance() {
+CABIN_TEST_CASE(testLevDistance) {
   // Test bytelength agnosticity
   for (char c = 0; c < std::numeric_limits<char>::max(); ++c) {
     const std::string str(1, c);
@@ -130,7 +270,7 @@ static void testLevDistance() {
   pass();
 }
 
-static void testLevDistance2() {
+CABIN_TEST_CASE(testLevDistance2) {
   constexpr std::string_view str1 = "\nMäry häd ä little lämb\n\nLittle lämb\n";
   constexpr std::string_view str2 = "\nMary häd ä little lämb\n\nLittle lämb\n";
   constexpr std::string_view str3 = "Mary häd ä little lämb\n\nLittle lämb\n";
@@ -158,7 +298,7 @@ static void testLevDistance2() {
 // ref:
 // https://github.com/llvm/llvm-project/commit/a247ba9d15635d96225ef39c8c150c08f492e70a#diff-fd993637669817b267190e7de029b75af5a0328d43d9b70c2e8dd512512091a2
 
-static void testFindSimilarStr() {
+CABIN_TEST_CASE(testFindSimilarStr) {
   constexpr std::array<std::string_view, 8> candidates{
     "if", "ifdef", "ifndef", "elif", "else", "endif", "elifdef", "elifndef"
   };
@@ -182,7 +322,7 @@ static void testFindSimilarStr() {
   pass();
 }
 
-static void testFindSimilarStr2() {
+CABIN_TEST_CASE(testFindSimilarStr2) {
   constexpr std::array<std::string_view, 2> candidates{ "aaab", "aaabc" };
   static_assert(findSimilarStr("aaaa", candidates) == "aaab"sv);
   static_assert(!findSimilarStr("1111111111", candidates).has_value());
@@ -193,14 +333,101 @@ static void testFindSimilarStr2() {
   pass();
 }
 
+CABIN_TEST_CASE(testTrim) {
+  assertEq(trim("  foo bar\t\r"), "foo bar");
+  assertEq(trim(" \t "), "");
+  assertEq(trim(""), "");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testSplitLines) {
+  assertEq(splitLines("a\n\nb\n"),
+           std::vector<std::string_view>{ "a", "", "b" });
+  assertEq(splitLines("a\nb"), std::vector<std::string_view>{ "a", "b" });
+  assertTrue(splitLines("").empty());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testIsTransientFailure) {
+  const CommandOutput killed{ .exitStatus = ExitStatus{ SIGKILL },
+                              .stdOut = "",
+                              .stdErr = "" };
+  assertTrue(isTransientFailure(killed));
+
+  // A crash would happen again.
+  const CommandOutput crashed{ .exitStatus = ExitStatus{ SIGSEGV },
+                               .stdOut = "",
+                               .stdErr = "" };
+  assertFalse(isTransientFailure(crashed));
+
+  const CommandOutput busy{ .exitStatus = ExitStatus{ 1 << 8 },
+                            .stdOut = "",
+                            .stdErr = fmt::format("execvp() failed: {}\n",
+                                                  std::strerror(ETXTBSY)) };
+  assertTrue(isTransientFailure(busy));
+
+  const CommandOutput compileError{
+    .exitStatus = ExitStatus{ 1 << 8 },
+    .stdOut = "",
+    .stdErr = "main.cc:1:1: error: expected unqualified-id\n"
+  };
+  assertFalse(isTransientFailure(compileError));
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFindExecutable) {
+  assertTrue(findExecutable("sh").has_value());
+  assertTrue(findExecutable("/bin/sh").has_value());
+  assertFalse(findExecutable("cabin-surely-does-not-exist").has_value());
+  assertFalse(findExecutable("").has_value());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFnv1aHash) {
+  static_assert(fnv1aHash("") == 0xcbf29ce484222325);
+  assertEq(fnv1aHash("a"), 0xaf63dc4c8601ec8c);
+  assertEq(fnv1aHash("foobar"), 0x85944171f73967e8);
+  assertNe(fnv1aHash("ab"), fnv1aHash("ba"));
+  assertEq(fnv1aHash("bar", fnv1aHash("foo")), fnv1aHash("foobar"));
+
+  pass();
+}
+
+CABIN_TEST_CASE(testWriteFileAtomically) {
+  namespace fs = std::filesystem;
+
+  const fs::path dir = fs::temp_directory_path()
+                       / fmt::format("cabin-test-write-atomic-{}", getpid());
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  const fs::path path = dir / "file.txt";
+
+  assertTrue(writeFileAtomically(path, "first").is_ok());
+  assertTrue(writeFileAtomically(path, "second").is_ok());
+  {
+    std::ifstream ifs(path);
+    const std::string content((std::istreambuf_iterator<char>(ifs)),
+                              std::istreambuf_iterator<char>());
+    assertEq(content, "second");
+  }
+  // No temporary file is left behind.
+  assertEq(std::distance(fs::directory_iterator(dir), fs::directory_iterator{}),
+           1L);
+
+  assertTrue(writeFileAtomically(dir / "missing" / "file.txt", "").is_err());
+
+  fs::remove_all(dir);
+  pass();
+}
+
 } // namespace tests
 
-int main() {
-  tests::testToLower();
-  tests::testLevDistance();
-  tests::testLevDistance2();
-  tests::testFindSimilarStr();
-  tests::testFindSimilarStr2();
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
 }
 
 #endif
@@ -5,6 +5,8 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <filesystem>
 #include <optional>
 #include <span>
 #include <string>
@@ -16,12 +18,37 @@ namespace cabin {
 std::string toMacroName(std::string_view name) noexcept;
 std::string replaceAll(std::string str, std::string_view from,
                        std::string_view to) noexcept;
+// `str` without leading and trailing whitespace.
+std::string_view trim(std::string_view str) noexcept;
+// The lines of `text` without their newlines.  A final newline doesn't
+// start another line.
+std::vector<std::string_view> splitLines(std::string_view text);
+
+/// How `getCmdOutput` reacts to a failed command.
+enum class RetryPolicy : uint8_t {
+  /// Fail on the first error.  Suitable for deterministic tools like the
+  /// compiler or pkg-config, where running the same command again would
+  /// yield the same result.
+  Never,
+  /// Retry with an exponential backoff, but only when the failure looks
+  /// transient (EAGAIN, ETXTBSY, or the process being killed by SIGKILL).
+  Transient,
+};
 
 Result<ExitStatus> execCmd(const Command& cmd) noexcept;
-Result<std::string> getCmdOutput(const Command& cmd,
-                                 std::size_t retry = 3) noexcept;
+Result<std::string>
+getCmdOutput(const Command& cmd, RetryPolicy policy = RetryPolicy::Transient,
+             std::size_t retry = 3) noexcept;
+std::optional<std::filesystem::path>
+findExecutable(std::string_view cmd) noexcept;
 bool commandExists(std::string_view cmd) noexcept;
 
+// Writes `content` to a uniquely named file next to `path` and renames it
+// into place, so that readers, including other cabin processes, never see a
+// partially written file.
+Result<void> writeFileAtomically(const std::filesystem::path& path,
+                                 std::string_view content) noexcept;
+
 constexpr char toLower(char c) noexcept {
   return (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c;
 }
@@ -71,6 +98,21 @@ constexpr bool equalsInsensitive(const std::string_view lhs,
   });
 }
 
+inline constexpr std::uint64_t FNV1A_OFFSET_BASIS = 0xcbf29ce484222325;
+
+/// 64-bit FNV-1a.  Unlike std::hash, the result is stable across runs and
+/// platforms, so it's suitable for naming cache entries on disk.  Pass the
+/// previous result as `hash` to hash data in chunks.
+constexpr std::uint64_t
+fnv1aHash(const std::string_view str,
+          std::uint64_t hash = FNV1A_OFFSET_BASIS) noexcept {
+  for (const char c : str) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
 // ref: https://reviews.llvm.org/differential/changeset/?ref=3315514
 /// Find a similar string in `candidates`.
 ///
@@ -0,0 +1,586 @@
+#include "AsmListing.hpp"
+
+#include "Algos.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <fmt/core.h>
+#include <map>
+#include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static bool isSymbolChar(const char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '.'
+         || c == '$';
+}
+
+static std::string demangleSymbol(const std::string_view mangled) {
+  const std::string name(mangled);
+  int status = 0;
+  const std::unique_ptr<char, decltype(&std::free)> demangled(
+      abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status),
+      &std::free);
+  if (status == 0 && demangled != nullptr) {
+    return demangled.get();
+  }
+  // Demanglers that don't know a suffix like `.constprop.0`.
+  if (const std::size_t dot = mangled.find('.');
+      dot != std::string_view::npos && dot > 0) {
+    const std::string_view base = mangled.substr(0, dot);
+    if (std::string demangledBase = demangleSymbol(base);
+        demangledBase != base) {
+      return fmt::format("{} [clone {}]", demangledBase, mangled.substr(dot));
+    }
+  }
+  return name;
+}
+
+std::string demangleSymbols(const std::string_view text) {
+  std::string result;
+  result.reserve(text.size());
+  std::size_t pos = 0;
+  while (pos < text.size()) {
+    const bool atStart = pos == 0 || !isSymbolChar(text[pos - 1]);
+    // Mach-O prefixes C++ symbols with another underscore.
+    const std::size_t prefix =
+        text.substr(pos).starts_with("__Z") ? 1 : 0;
+    if (!atStart || !text.substr(pos + prefix).starts_with("_Z")) {
+      result += text[pos++];
+      continue;
+    }
+    std::size_t end = pos + prefix;
+    while (end < text.size() && isSymbolChar(text[end])) {
+      ++end;
+    }
+    const std::string_view mangled =
+        text.substr(pos + prefix, end - pos - prefix);
+    const std::string demangled = demangleSymbol(mangled);
+    result += demangled == mangled ? text.substr(pos, end - pos) : demangled;
+    pos = end;
+  }
+  return result;
+}
+
+// The quoted strings among the arguments of a directive, unescaped.
+static std::vector<std::string> quotedStrings(const std::string_view args) {
+  std::vector<std::string> strings;
+  std::size_t pos = args.find('"');
+  while (pos != std::string_view::npos) {
+    std::string str;
+    std::size_t end = pos + 1;
+    for (; end < args.size() && args[end] != '"'; ++end) {
+      if (args[end] == '\\' && end + 1 < args.size()) {
+        ++end;
+      }
+      str += args[end];
+    }
+    strings.push_back(std::move(str));
+    pos = end + 1 < args.size() ? args.find('"', end + 1)
+                                : std::string_view::npos;
+  }
+  return strings;
+}
+
+// The leading unsigned integers among space-separated `args`.
+static std::vector<std::size_t> leadingNumbers(std::string_view args) {
+  std::vector<std::size_t> numbers;
+  while (true) {
+    args = trim(args);
+    if (args.empty() || !std::isdigit(static_cast<unsigned char>(args[0]))) {
+      return numbers;
+    }
+    std::size_t number = 0;
+    std::size_t i = 0;
+    for (; i < args.size() && std::isdigit(static_cast<unsigned char>(args[i]));
+         ++i) {
+      number = number * 10 + static_cast<std::size_t>(args[i] - '0');
+    }
+    numbers.push_back(number);
+    args.remove_prefix(i);
+  }
+}
+
+// Collects the local labels, like `.L3`, that `line` refers to.
+static void collectLabelRefs(const std::string_view line,
+                             std::unordered_set<std::string>& refs) {
+  for (std::size_t pos = line.find(".L"); pos != std::string_view::npos;
+       pos = line.find(".L", pos + 2)) {
+    if (pos > 0 && isSymbolChar(line[pos - 1])) {
+      continue;
+    }
+    std::size_t end = pos + 2;
+    while (end < line.size() && isSymbolChar(line[end])) {
+      ++end;
+    }
+    refs.emplace(line.substr(pos, end - pos));
+  }
+}
+
+namespace {
+
+struct AsmLine {
+  enum class Kind : std::uint8_t { Label, Source, Instruction };
+
+  Kind kind;
+  std::string text;
+};
+
+struct AsmFunction {
+  std::string name;
+  std::vector<AsmLine> lines;
+};
+
+} // namespace
+
+AsmListing formatAsm(const std::string_view assembly,
+                     const std::string_view symbol,
+                     const SourceLookup& lookupSource) {
+  std::vector<AsmFunction> functions;
+  std::map<std::size_t, fs::path> files;
+  fs::path compDir;
+  std::unordered_set<std::string> labelRefs;
+  std::string section = ".text";
+  // The file and line the next instruction came from, and the last ones
+  // shown.
+  std::optional<std::pair<std::size_t, std::size_t>> loc;
+  std::optional<std::pair<std::size_t, std::size_t>> shownLoc;
+
+  const auto inText = [&] { return section.starts_with(".text"); };
+
+  for (const std::string_view line : splitLines(assembly)) {
+    const std::string_view trimmed = trim(line);
+    if (trimmed.empty() || trimmed.starts_with('#')
+        || trimmed.starts_with("//") || trimmed.starts_with(';')) {
+      continue;
+    }
+
+    // A label starts at the first column.
+    const std::size_t colon = line.find(':');
+    if (line.front() != ' ' && line.front() != '\t'
+        && colon != std::string_view::npos
+        && line.substr(0, colon).find_first_of(" \t")
+               == std::string_view::npos) {
+      if (!inText()) {
+        continue;
+      }
+      std::string_view label = line.substr(0, colon);
+      if (label.size() >= 2 && label.front() == '"' && label.back() == '"') {
+        label = label.substr(1, label.size() - 2);
+      }
+      if (label.starts_with(".L") || label.starts_with('L')
+          || label.starts_with("ltmp")) {
+        if (!functions.empty()) {
+          functions.back().lines.push_back(
+              AsmLine{ .kind = AsmLine::Kind::Label,
+                       .text = fmt::format("{}:", label) });
+        }
+      } else {
+        functions.push_back(AsmFunction{ .name = std::string(label),
+                                         .lines = {} });
+        shownLoc.reset();
+      }
+      continue;
+    }
+
+    if (trimmed.starts_with('.')) {
+      const std::size_t nameEnd =
+          std::min(trimmed.find_first_of(" \t"), trimmed.size());
+      const std::string_view directive = trimmed.substr(0, nameEnd);
+      const std::string_view args = trim(trimmed.substr(nameEnd));
+      if (directive == ".text") {
+        section = ".text";
+      } else if (directive == ".data" || directive == ".bss") {
+        section = directive;
+      } else if (directive == ".section") {
+        // Mach-O names the segment first, as in `__TEXT,__text,regular`.
+        if (args.starts_with("__TEXT,__text")) {
+          section = ".text";
+        } else {
+          section = trim(args.substr(0, args.find(',')));
+        }
+      } else if (directive == ".file") {
+        const std::vector<std::size_t> numbers = leadingNumbers(args);
+        const std::vector<std::string> strings = quotedStrings(args);
+        if (numbers.empty() || strings.empty()) {
+          continue;
+        }
+        // Either "name" or "dir" "name".
+        fs::path path = strings.back();
+        if (strings.size() >= 2) {
+          path = fs::path(strings[0]) / path;
+        }
+        if (numbers[0] == 0 && strings.size() >= 2) {
+          compDir = strings[0];
+        }
+        if (path.is_relative() && !compDir.empty()) {
+          path = compDir / path;
+        }
+        files[numbers[0]] = path;
+      } else if (directive == ".loc") {
+        const std::vector<std::size_t> numbers = leadingNumbers(args);
+        if (numbers.size() >= 2) {
+          loc.emplace(numbers[0], numbers[1]);
+        }
+      } else if (!section.starts_with(".debug") && section != "__DWARF") {
+        // Jump tables refer to labels from data.
+        collectLabelRefs(args, labelRefs);
+      }
+      continue;
+    }
+
+    if (!inText() || functions.empty()) {
+      continue;
+    }
+    AsmFunction& function = functions.back();
+    // Line 0 marks code that doesn't come from any line.
+    if (loc.has_value() && loc != shownLoc && loc->second != 0
+        && files.contains(loc->first)) {
+      if (const auto source =
+              lookupSource(files.at(loc->first), loc->second)) {
+        function.lines.push_back(AsmLine{
+            .kind = AsmLine::Kind::Source,
+            .text = fmt::format("# {}:{}: {}", source->first, loc->second,
+                                trim(source->second)),
+        });
+      }
+      shownLoc = loc;
+    }
+    collectLabelRefs(trimmed, labelRefs);
+    function.lines.push_back(AsmLine{ .kind = AsmLine::Kind::Instruction,
+                                      .text = demangleSymbols(line) });
+  }
+
+  AsmListing listing;
+  for (const AsmFunction& function : functions) {
+    const std::string name = demangleSymbols(function.name);
+    listing.functions.push_back(name);
+    if (!symbol.empty() && name.find(symbol) == std::string::npos
+        && function.name != symbol) {
+      continue;
+    }
+
+    if (listing.numShown++ > 0) {
+      listing.text += '\n';
+    }
+    listing.text += fmt::format("{}:\n", name);
+    for (const AsmLine& line : function.lines) {
+      if (line.kind == AsmLine::Kind::Label
+          && !labelRefs.contains(line.text.substr(0, line.text.size() - 1))) {
+        continue;
+      }
+      listing.text += line.text;
+      listing.text += '\n';
+    }
+  }
+  return listing;
+}
+
+AsmListing formatLlvmIr(const std::string_view ir,
+                        const std::string_view symbol) {
+  AsmListing listing;
+  bool inDefine = false;
+  bool shown = false;
+  for (const std::string_view line : splitLines(ir)) {
+    if (!inDefine && line.starts_with("define ")) {
+      inDefine = true;
+
+      std::string_view name = line.substr(line.find('@') + 1);
+      if (name.starts_with('"')) {
+        name = name.substr(1, name.find('"', 1) - 1);
+      } else {
+        name = name.substr(0, name.find('('));
+      }
+      const std::string demangled = demangleSymbols(name);
+      listing.functions.push_back(demangled);
+      shown = symbol.empty() || demangled.find(symbol) != std::string::npos
+              || name == symbol;
+      if (shown) {
+        if (listing.numShown++ > 0) {
+          listing.text += '\n';
+        }
+        listing.text += fmt::format("; {}\n", demangled);
+      }
+    }
+    if (inDefine && shown) {
+      listing.text += line;
+      listing.text += '\n';
+    }
+    if (inDefine && line == "}") {
+      inDefine = false;
+    }
+  }
+  return listing;
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testDemangleSymbols) {
+  assertEq(demangleSymbols("call\t_ZN3app3sumERKSt6vectorIiSaIiEE@PLT"),
+           "call\tapp::sum(std::vector<int, std::allocator<int> > const&)@PLT");
+  assertEq(demangleSymbols("_Z3fooi _Z3barv"), "foo(int) bar()");
+  assertEq(demangleSymbols("bl\t__Z3fooi"), "bl\tfoo(int)");
+  assertEq(demangleSymbols("bl\t__Z3fooi@PAGE"), "bl\tfoo(int)@PAGE");
+  assertEq(demangleSymbols("_Z3fooi.cold:"), "foo(int) [clone .cold]:");
+  // Not at the start of a symbol, or not a valid mangled name.
+  assertEq(demangleSymbols("x_Z3fooi .L_Z3fooi _Zoops"),
+           "x_Z3fooi .L_Z3fooi _Zoops");
+  assertEq(demangleSymbols(""), "");
+
+  pass();
+}
+
+// Trimmed from what GCC 12 emits for:
+//
+//   1  namespace app {
+//   2  int sum(const int* v, int n) {
+//   3    int s = 0;
+//   4    for (int i = 0; i < n; ++i) s += v[i];
+//   5    return s;
+//   6  }
+//   7  }
+//   8  int twice(int x) { return app::sum(&x, 1) * 2; }
+static constexpr std::string_view GCC_ASM = R"(	.file	"main.cc"
+	.text
+.Ltext0:
+	.file 0 "/proj/cabin-out/dev" "/proj/src/main.cc"
+	.p2align 4
+	.globl	_ZN3app3sumEPKii
+	.type	_ZN3app3sumEPKii, @function
+_ZN3app3sumEPKii:
+.LVL0:
+.LFB0:
+	.file 1 "/proj/src/main.cc"
+	.loc 1 2 30 view -0
+	.cfi_startproc
+	.loc 1 3 3 view .LVU1
+	.loc 1 4 3 view .LVU2
+	testl	%esi, %esi
+	jle	.L4
+	.loc 1 4 21 is_stmt 0 view .LVU3
+	xorl	%eax, %eax
+.LVL1:
+.L3:
+	.loc 1 4 33 is_stmt 1 discriminator 3 view .LVU4
+	addl	(%rdi), %eax
+	addq	$4, %rdi
+	.loc 1 4 21 discriminator 3 view .LVU5
+	cmpl	%esi, %eax
+	jne	.L3
+	ret
+.L4:
+	.loc 1 3 7 is_stmt 0 view .LVU6
+	xorl	%eax, %eax
+	.loc 1 5 3 is_stmt 1 view .LVU7
+	ret
+	.cfi_endproc
+.LFE0:
+	.size	_ZN3app3sumEPKii, .-_ZN3app3sumEPKii
+	.p2align 4
+	.globl	_Z5twicei
+	.type	_Z5twicei, @function
+_Z5twicei:
+.LFB1:
+	.loc 1 8 20 view -0
+	.cfi_startproc
+	leal	(%rdi,%rdi), %eax
+	ret
+	.cfi_endproc
+.LFE1:
+	.size	_Z5twicei, .-_Z5twicei
+	.section	.rodata
+_ZL5table:
+	.long	.L4
+	.section	.debug_info,"",@progbits
+.Ldebug_info0:
+	.long	.LFB0
+	.quad	.LVL1
+)";
+
+static std::optional<std::pair<std::string, std::string>>
+lookupTestSource(const fs::path& file, const std::size_t line) {
+  static const std::vector<std::string> lines{
+    "namespace app {",
+    "int sum(const int* v, int n) {",
+    "  int s = 0;",
+    "  for (int i = 0; i < n; ++i) s += v[i];",
+    "  return s;",
+    "}",
+    "}",
+    "int twice(int x) { return app::sum(&x, 1) * 2; }",
+  };
+  if (file != "/proj/src/main.cc" || line == 0 || line > lines.size()) {
+    return std::nullopt;
+  }
+  return std::pair{ std::string("src/main.cc"), lines[line - 1] };
+}
+
+CABIN_TEST_CASE(testFormatAsm) {
+  const AsmListing all = formatAsm(GCC_ASM, "", lookupTestSource);
+  assertEq(all.functions.size(), 2UL);
+  assertEq(all.functions[0], "app::sum(int const*, int)");
+  assertEq(all.functions[1], "twice(int)");
+  assertEq(all.numShown, 2UL);
+  assertEq(all.text,
+           "app::sum(int const*, int):\n"
+           "# src/main.cc:4: for (int i = 0; i < n; ++i) s += v[i];\n"
+           "\ttestl\t%esi, %esi\n"
+           "\tjle\t.L4\n"
+           "\txorl\t%eax, %eax\n"
+           ".L3:\n"
+           "\taddl\t(%rdi), %eax\n"
+           "\taddq\t$4, %rdi\n"
+           "\tcmpl\t%esi, %eax\n"
+           "\tjne\t.L3\n"
+           "\tret\n"
+           ".L4:\n"
+           "# src/main.cc:3: int s = 0;\n"
+           "\txorl\t%eax, %eax\n"
+           "# src/main.cc:5: return s;\n"
+           "\tret\n"
+           "\n"
+           "twice(int):\n"
+           "# src/main.cc:8: int twice(int x) { return app::sum(&x, 1) * 2; }\n"
+           "\tleal\t(%rdi,%rdi), %eax\n"
+           "\tret\n");
+
+  const AsmListing sum = formatAsm(GCC_ASM, "app::sum", lookupTestSource);
+  assertEq(sum.numShown, 1UL);
+  assertTrue(sum.text.starts_with("app::sum(int const*, int):\n"));
+  assertEq(formatAsm(GCC_ASM, "_Z5twicei", lookupTestSource).numShown, 1UL);
+
+  const AsmListing none = formatAsm(GCC_ASM, "missing", lookupTestSource);
+  assertEq(none.numShown, 0UL);
+  assertTrue(none.text.empty());
+  assertEq(none.functions.size(), 2UL);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatAsmClang) {
+  // Clang names files relative to the compilation directory and comments
+  // its labels.
+  const AsmListing listing = formatAsm(
+      "\t.text\n"
+      "\t.file\t\"main.cc\"\n"
+      "\t.file\t0 \"/proj/src\" \"main.cc\" md5 0x0123\n"
+      "\t.globl\t_Z5twicei                       # -- Begin function\n"
+      "_Z5twicei:                              # @_Z5twicei\n"
+      ".Lfunc_begin0:\n"
+      "\t.loc\t0 8 0                           # main.cc:8:0\n"
+      "\t.cfi_startproc\n"
+      "# %bb.0:\n"
+      "\tleal\t(%rdi,%rdi), %eax\n"
+      "\t.loc\t0 8 37 prologue_end            # main.cc:8:37\n"
+      "\tretq\n"
+      ".Lfunc_end0:\n",
+      "", lookupTestSource);
+  assertEq(listing.text,
+           "twice(int):\n"
+           "# src/main.cc:8: int twice(int x) { return app::sum(&x, 1) * 2; }\n"
+           "\tleal\t(%rdi,%rdi), %eax\n"
+           "\tretq\n");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatAsmMachO) {
+  // Mach-O names sections after their segment and prefixes symbols with
+  // another underscore.
+  const AsmListing listing = formatAsm(
+      "\t.section\t__TEXT,__text,regular,pure_instructions\n"
+      "\t.build_version macos, 14, 0\tsdk_version 14, 2\n"
+      "\t.file\t0 \"/proj/src\" \"main.cc\" md5 0x0123\n"
+      "\t.globl\t__Z5twicei                      ; -- Begin function\n"
+      "\t.p2align\t2\n"
+      "__Z5twicei:                             ; @_Z5twicei\n"
+      "Lfunc_begin0:\n"
+      "\t.loc\t0 8 0                           ; main.cc:8:0\n"
+      "\t.cfi_startproc\n"
+      "; %bb.0:\n"
+      "\tlsl\tw0, w0, #1\n"
+      "\t.loc\t0 8 37 prologue_end            ; main.cc:8:37\n"
+      "\tret\n"
+      "Lfunc_end0:\n"
+      "\t.section\t__TEXT,__cstring,cstring_literals\n"
+      "l_.str:\n"
+      "\t.asciz\t\"twice\"\n"
+      "\t.section\t__DWARF,__debug_abbrev,regular,debug\n"
+      "Lsection_abbrev:\n"
+      "\t.byte\t1\n",
+      "", lookupTestSource);
+  assertEq(listing.functions.size(), 1UL);
+  assertEq(listing.text,
+           "twice(int):\n"
+           "# src/main.cc:8: int twice(int x) { return app::sum(&x, 1) * 2; }\n"
+           "\tlsl\tw0, w0, #1\n"
+           "\tret\n");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatLlvmIr) {
+  static constexpr std::string_view ir = R"(; ModuleID = 'main.cc'
+source_filename = "main.cc"
+
+define dso_local noundef i32 @_Z5twicei(i32 noundef %0) #0 {
+  %2 = shl nsw i32 %0, 1
+  ret i32 %2
+}
+
+define dso_local noundef i32 @"_ZN3app3sumEPKii"(ptr %0, i32 %1) #0 {
+  ret i32 0
+}
+
+attributes #0 = { mustprogress }
+)";
+
+  const AsmListing all = formatLlvmIr(ir, "");
+  assertEq(all.numShown, 2UL);
+  assertEq(all.text,
+           "; twice(int)\n"
+           "define dso_local noundef i32 @_Z5twicei(i32 noundef %0) #0 {\n"
+           "  %2 = shl nsw i32 %0, 1\n"
+           "  ret i32 %2\n"
+           "}\n"
+           "\n"
+           "; app::sum(int const*, int)\n"
+           "define dso_local noundef i32 @\"_ZN3app3sumEPKii\"(ptr %0, i32 %1) "
+           "#0 {\n"
+           "  ret i32 0\n"
+           "}\n");
+
+  const AsmListing sum = formatLlvmIr(ir, "sum");
+  assertEq(sum.numShown, 1UL);
+  assertEq(sum.functions.size(), 2UL);
+  assertTrue(sum.text.starts_with("; app::sum(int const*, int)\n"));
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
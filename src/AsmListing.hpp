@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// Demangles every Itanium C++ ABI symbol in `text`, like c++filt.
+std::string demangleSymbols(std::string_view text);
+
+// Looks up a line of a file named in the debug info, returning how to refer
+// to the file and the text of the line, or nothing to leave it out.
+using SourceLookup = std::function<std::optional<
+    std::pair<std::string, std::string>>(const fs::path&, std::size_t)>;
+
+struct AsmListing {
+  std::string text;
+  // The demangled names of every function in the input.
+  std::vector<std::string> functions;
+  std::size_t numShown = 0;
+};
+
+// Makes the output of `-S -g` readable: the functions whose demangled name
+// contains `symbol`, or all of them if it's empty, with their names
+// demangled, each run of instructions preceded by the source line it came
+// from, and without the directives and the labels no instruction refers
+// to.
+AsmListing formatAsm(std::string_view assembly, std::string_view symbol,
+                     const SourceLookup& lookupSource);
+
+// The definitions in the output of `-S -emit-llvm` whose demangled name
+// contains `symbol`, or all of them if it's empty, each preceded by its
+// demangled name.
+AsmListing formatLlvmIr(std::string_view ir, std::string_view symbol);
+
+} // namespace cabin
@@ -0,0 +1,565 @@
+#include "BenchResult.hpp"
+
+#include "Algos.hpp"
+#include "Rustify/PerfCounters.hpp"
+#include "Rustify/Result.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static double medianOf(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::ranges::sort(values);
+  const std::size_t mid = values.size() / 2;
+  if (values.size() % 2 == 1) {
+    return values[mid];
+  }
+  return (values[mid - 1] + values[mid]) / 2;
+}
+
+double BenchResult::median() const { return medianOf(samples); }
+
+double BenchResult::mad() const {
+  const double med = median();
+  std::vector<double> deviations;
+  deviations.reserve(samples.size());
+  for (const double sample : samples) {
+    deviations.push_back(std::abs(sample - med));
+  }
+  return medianOf(std::move(deviations));
+}
+
+double BenchResult::throughput() const {
+  const double med = median();
+  if (bytes == 0 || med <= 0.0) {
+    return 0.0;
+  }
+  return static_cast<double>(bytes) / med * 1e9;
+}
+
+std::vector<BenchResult> parseBenchReport(const std::string_view report) {
+  std::vector<BenchResult> results;
+  for (const std::string_view line : splitLines(report)) {
+    const nlohmann::json json =
+        nlohmann::json::parse(line, nullptr, /*allow_exceptions=*/false);
+    if (!json.is_object() || !json.contains("name")
+        || !json.contains("samples") || !json["samples"].is_array()) {
+      continue;
+    }
+    std::map<std::string, double> counters;
+    if (json.contains("counters") && json["counters"].is_object()) {
+      counters = json["counters"].get<std::map<std::string, double>>();
+    }
+    results.push_back(BenchResult{
+        .name = json["name"].get<std::string>(),
+        .bytes = json.value("bytes", std::uint64_t{ 0 }),
+        .samples = json["samples"].get<std::vector<double>>(),
+        .counters = std::move(counters),
+    });
+  }
+  return results;
+}
+
+bool BenchChange::isSignificant() const {
+  return pValue < SIGNIFICANCE_LEVEL && std::abs(change) > NOISE_THRESHOLD;
+}
+
+// The two-sided p-value of the Mann-Whitney U test, using the normal
+// approximation with a correction for ties.  Unlike a t-test, it doesn't
+// assume the samples are normally distributed, which timings rarely are.
+static double mannWhitneyPValue(const std::vector<double>& lhs,
+                                const std::vector<double>& rhs) {
+  const auto n1 = static_cast<double>(lhs.size());
+  const auto n2 = static_cast<double>(rhs.size());
+  if (lhs.empty() || rhs.empty()) {
+    return 1.0;
+  }
+
+  // (value, whether it is from lhs)
+  std::vector<std::pair<double, bool>> all;
+  all.reserve(lhs.size() + rhs.size());
+  for (const double value : lhs) {
+    all.emplace_back(value, true);
+  }
+  for (const double value : rhs) {
+    all.emplace_back(value, false);
+  }
+  std::ranges::sort(all);
+
+  // Tied values share the average of their ranks.
+  double lhsRankSum = 0.0;
+  double tieSum = 0.0;
+  for (std::size_t i = 0; i < all.size();) {
+    std::size_t j = i;
+    while (j < all.size() && all[j].first == all[i].first) {
+      ++j;
+    }
+    const double rank = static_cast<double>(i + j + 1) / 2;
+    for (std::size_t k = i; k < j; ++k) {
+      if (all[k].second) {
+        lhsRankSum += rank;
+      }
+    }
+    const auto ties = static_cast<double>(j - i);
+    tieSum += ties * ties * ties - ties;
+    i = j;
+  }
+
+  const double n = n1 + n2;
+  const double u = lhsRankSum - n1 * (n1 + 1) / 2;
+  const double mean = n1 * n2 / 2;
+  const double variance = n1 * n2 / 12 * ((n + 1) - tieSum / (n * (n - 1)));
+  if (variance <= 0.0) {
+    return 1.0;
+  }
+  const double z =
+      std::max(std::abs(u - mean) - 0.5, 0.0) / std::sqrt(variance);
+  return std::erfc(z / std::sqrt(2.0));
+}
+
+BenchChange compareBench(const BenchResult& baseline,
+                         const BenchResult& current) {
+  const double baseMedian = baseline.median();
+  return BenchChange{
+    .change = baseMedian > 0.0 ? current.median() / baseMedian - 1.0 : 0.0,
+    .pValue = mannWhitneyPValue(baseline.samples, current.samples),
+  };
+}
+
+BenchSpeedup estimateSpeedup(const BenchResult& baseline,
+                             const BenchResult& current) {
+  constexpr std::size_t numResamples = 1000;
+
+  const double currentMedian = current.median();
+  if (baseline.samples.empty() || currentMedian <= 0.0) {
+    return BenchSpeedup{};
+  }
+  const double ratio = baseline.median() / currentMedian;
+  BenchSpeedup speedup{ .ratio = ratio, .lower = ratio, .upper = ratio };
+
+  // A fixed seed gives the same interval for the same samples.
+  std::mt19937_64 rng(0);
+  const auto resample = [&rng](const std::vector<double>& samples) {
+    std::uniform_int_distribution<std::size_t> pick(0, samples.size() - 1);
+    std::vector<double> resampled(samples.size());
+    for (double& sample : resampled) {
+      sample = samples[pick(rng)];
+    }
+    return medianOf(std::move(resampled));
+  };
+
+  std::vector<double> ratios;
+  ratios.reserve(numResamples);
+  for (std::size_t i = 0; i < numResamples; ++i) {
+    const double baseMedian = resample(baseline.samples);
+    const double curMedian = resample(current.samples);
+    if (curMedian > 0.0) {
+      ratios.push_back(baseMedian / curMedian);
+    }
+  }
+  if (ratios.empty()) {
+    return speedup;
+  }
+  std::ranges::sort(ratios);
+  const auto last = static_cast<double>(ratios.size() - 1);
+  speedup.lower = ratios[static_cast<std::size_t>(std::floor(0.025 * last))];
+  speedup.upper = ratios[static_cast<std::size_t>(std::ceil(0.975 * last))];
+  return speedup;
+}
+
+std::optional<bool> exceedsSlowdown(const BenchResult& baseline,
+                                    const BenchResult& current,
+                                    const double threshold) {
+  const BenchSpeedup speedup = estimateSpeedup(baseline, current);
+  // Being `threshold` slower is a speedup of 1 / (1 + threshold).
+  const double limit = 1.0 / (1.0 + threshold);
+  if (speedup.upper < limit) {
+    return true;
+  } else if (speedup.lower > limit) {
+    return false;
+  }
+  return std::nullopt;
+}
+
+static Result<fs::path> baselinePath(const fs::path& outDir,
+                                     const std::string_view name) {
+  Ensure(!name.empty() && name.find('/') == std::string_view::npos
+             && name != "." && name != "..",
+         "invalid baseline name: `{}`", name);
+  return Ok(outDir / BenchBaseline::DIR_NAME / fmt::format("{}.json", name));
+}
+
+Result<BenchBaseline> BenchBaseline::load(const fs::path& outDir,
+                                          const std::string_view name) {
+  const fs::path path = Try(baselinePath(outDir, name));
+  std::ifstream ifs(path);
+  Ensure(ifs, "no baseline named `{}` was saved", name);
+
+  BenchBaseline baseline;
+  try {
+    const nlohmann::json json = nlohmann::json::parse(ifs);
+    for (const auto& item : json.at("benches").items()) {
+      const nlohmann::json& bench = item.value();
+      baseline.results.emplace(
+          item.key(),
+          BenchResult{
+              .name = item.key(),
+              .bytes = bench.at("bytes").get<std::uint64_t>(),
+              .samples = bench.at("samples").get<std::vector<double>>(),
+              .counters = bench.value("counters",
+                                      std::map<std::string, double>{}),
+          });
+    }
+  } catch (const std::exception& e) {
+    Bail("failed to parse {}: {}", path.string(), e.what());
+  }
+  return Ok(baseline);
+}
+
+Result<void> BenchBaseline::save(const fs::path& outDir,
+                                 const std::string_view name) const {
+  const fs::path path = Try(baselinePath(outDir, name));
+  nlohmann::json json;
+  json["benches"] = nlohmann::json::object();
+  for (const auto& [benchName, result] : results) {
+    json["benches"][benchName] = {
+      { "bytes", result.bytes },
+      { "samples", result.samples },
+      { "counters", result.counters },
+    };
+  }
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  return writeFileAtomically(path, json.dump(2) + '\n');
+}
+
+std::string formatDuration(const double ns) {
+  if (ns < 1e3) {
+    return fmt::format("{:.2f} ns", ns);
+  } else if (ns < 1e6) {
+    return fmt::format("{:.2f} µs", ns / 1e3);
+  } else if (ns < 1e9) {
+    return fmt::format("{:.2f} ms", ns / 1e6);
+  }
+  return fmt::format("{:.2f} s", ns / 1e9);
+}
+
+std::string formatThroughput(const double bytesPerSec) {
+  constexpr double kib = 1024.0;
+  if (bytesPerSec < kib) {
+    return fmt::format("{:.2f} B/s", bytesPerSec);
+  } else if (bytesPerSec < kib * kib) {
+    return fmt::format("{:.2f} KiB/s", bytesPerSec / kib);
+  } else if (bytesPerSec < kib * kib * kib) {
+    return fmt::format("{:.2f} MiB/s", bytesPerSec / (kib * kib));
+  }
+  return fmt::format("{:.2f} GiB/s", bytesPerSec / (kib * kib * kib));
+}
+
+static std::string formatCount(const double count) {
+  if (count < 10) {
+    return fmt::format("{:.2f}", count);
+  } else if (count < 100) {
+    return fmt::format("{:.1f}", count);
+  } else if (count < 1e3) {
+    return fmt::format("{:.0f}", count);
+  } else if (count < 1e6) {
+    return fmt::format("{:.2f}k", count / 1e3);
+  } else if (count < 1e9) {
+    return fmt::format("{:.2f}M", count / 1e6);
+  }
+  return fmt::format("{:.2f}G", count / 1e9);
+}
+
+static std::optional<double>
+instructionsPerCycle(const std::map<std::string, double>& counters) {
+  const auto cycles = counters.find("cycles");
+  const auto instructions = counters.find("instructions");
+  if (cycles == counters.end() || instructions == counters.end()
+      || cycles->second <= 0.0) {
+    return std::nullopt;
+  }
+  return instructions->second / cycles->second;
+}
+
+std::string formatCounters(const std::map<std::string, double>& counters,
+                           const std::map<std::string, double>& baseline) {
+  const auto describe = [](const std::string_view name, const double count,
+                           const std::string& formatted,
+                           const std::optional<double> base) {
+    std::string desc = fmt::format("{} {}", name, formatted);
+    if (base.has_value() && base.value() > 0.0) {
+      desc += fmt::format(" ({:+.1f}%)", (count / base.value() - 1) * 100);
+    }
+    return desc;
+  };
+
+  std::vector<std::string> parts;
+  for (const std::string_view name : perf::COUNTER_NAMES) {
+    const auto itr = counters.find(std::string(name));
+    if (itr == counters.end()) {
+      continue;
+    }
+    std::optional<double> base;
+    if (const auto baseItr = baseline.find(itr->first);
+        baseItr != baseline.end()) {
+      base = baseItr->second;
+    }
+    parts.push_back(
+        describe(name, itr->second, formatCount(itr->second), base));
+
+    if (name == "instructions") {
+      if (const std::optional<double> ipc = instructionsPerCycle(counters)) {
+        parts.push_back(describe("IPC", ipc.value(),
+                                 fmt::format("{:.2f}", ipc.value()),
+                                 instructionsPerCycle(baseline)));
+      }
+    }
+  }
+  return fmt::format("{}", fmt::join(parts, ", "));
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <unistd.h>
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testBenchResultStats) {
+  const BenchResult odd{ .name = "odd",
+                         .bytes = 1000,
+                         .samples = { 5.0, 1.0, 3.0, 2.0, 100.0 },
+                         .counters = {} };
+  assertEq(odd.median(), 3.0);
+  // Deviations: 2, 2, 0, 1, 97
+  assertEq(odd.mad(), 2.0);
+  assertEq(odd.throughput(), 1000.0 / 3.0 * 1e9);
+
+  const BenchResult even{ .name = "even",
+                          .bytes = 0,
+                          .samples = { 4.0, 1.0, 3.0, 2.0 },
+                          .counters = {} };
+  assertEq(even.median(), 2.5);
+  assertEq(even.throughput(), 0.0);
+
+  assertEq(BenchResult{}.median(), 0.0);
+  assertEq(BenchResult{}.mad(), 0.0);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseBenchReport) {
+  assertTrue(parseBenchReport("").empty());
+
+  const std::vector<BenchResult> results = parseBenchReport(
+      R"({"name":"parse","bytes":5,"iterations":100,"samples":[1.5,2]})"
+      "\n"
+      R"({"name":"noBytes","iterations":1,"samples":[3]})"
+      "\n"
+      R"({"name":"counted","samples":[4],"counters":{"cycles":8.5}})"
+      "\n"
+      R"({"name":"cut","samp)");
+  assertEq(results.size(), 3UL);
+  assertTrue(results[0]
+             == BenchResult{ .name = "parse",
+                             .bytes = 5,
+                             .samples = { 1.5, 2.0 },
+                             .counters = {} });
+  assertTrue(results[1]
+             == BenchResult{ .name = "noBytes",
+                             .bytes = 0,
+                             .samples = { 3.0 },
+                             .counters = {} });
+  assertTrue(results[2].counters
+             == std::map<std::string, double>{ { "cycles", 8.5 } });
+
+  pass();
+}
+
+CABIN_TEST_CASE(testCompareBench) {
+  BenchResult baseline{
+    .name = "foo", .bytes = 0, .samples = {}, .counters = {}
+  };
+  BenchResult same = baseline;
+  BenchResult slower = baseline;
+  BenchResult noisy = baseline;
+  for (int i = 0; i < 30; ++i) {
+    const double jitter = (i % 5) * 0.1;
+    baseline.samples.push_back(100.0 + jitter);
+    same.samples.push_back(100.0 + (4 - (i % 5)) * 0.1);
+    slower.samples.push_back(110.0 + jitter);
+    noisy.samples.push_back(i % 2 == 0 ? 60.0 : 150.0);
+  }
+
+  const BenchChange unchanged = compareBench(baseline, same);
+  assertEq(unchanged.change, 0.0);
+  assertFalse(unchanged.isSignificant());
+
+  const BenchChange regressed = compareBench(baseline, slower);
+  assertTrue(regressed.change > 0.09 && regressed.change < 0.11);
+  assertTrue(regressed.pValue < 0.001);
+  assertTrue(regressed.isRegression());
+  assertFalse(regressed.isImprovement());
+
+  const BenchChange improved = compareBench(slower, baseline);
+  assertTrue(improved.isImprovement());
+
+  // The median moved, but the samples overlap too much to tell.
+  const BenchChange unsure = compareBench(baseline, noisy);
+  assertTrue(unsure.change > BenchChange::NOISE_THRESHOLD);
+  assertFalse(unsure.isSignificant());
+
+  // Identical samples, all tied.
+  assertEq(compareBench(same, same).pValue, 1.0);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testEstimateSpeedup) {
+  BenchResult baseline{
+    .name = "foo", .bytes = 0, .samples = {}, .counters = {}
+  };
+  BenchResult same = baseline;
+  BenchResult faster = baseline;
+  for (int i = 0; i < 30; ++i) {
+    baseline.samples.push_back(100.0 + i);
+    same.samples.push_back(129.0 - i);
+    faster.samples.push_back(50.0 + i / 2.0);
+  }
+
+  const BenchSpeedup unchanged = estimateSpeedup(baseline, same);
+  assertEq(unchanged.ratio, 1.0);
+  assertTrue(unchanged.lower < 1.0 && unchanged.upper > 1.0);
+
+  const BenchSpeedup twice = estimateSpeedup(baseline, faster);
+  assertEq(twice.ratio, 2.0);
+  assertTrue(twice.lower > 1.8 && twice.lower <= 2.0);
+  assertTrue(twice.upper >= 2.0 && twice.upper < 2.2);
+
+  // The same samples give the same interval.
+  const BenchSpeedup again = estimateSpeedup(baseline, faster);
+  assertEq(again.lower, twice.lower);
+  assertEq(again.upper, twice.upper);
+
+  const BenchResult constant{ .name = "bar",
+                              .bytes = 0,
+                              .samples = { 4.0, 4.0, 4.0 },
+                              .counters = {} };
+  const BenchSpeedup exact = estimateSpeedup(constant, constant);
+  assertEq(exact.lower, 1.0);
+  assertEq(exact.upper, 1.0);
+
+  const BenchSpeedup empty = estimateSpeedup(BenchResult{}, constant);
+  assertEq(empty.ratio, 1.0);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testExceedsSlowdown) {
+  BenchResult baseline{
+    .name = "foo", .bytes = 0, .samples = {}, .counters = {}
+  };
+  BenchResult same = baseline;
+  BenchResult slower = baseline;
+  BenchResult borderline = baseline;
+  for (int i = 0; i < 30; ++i) {
+    baseline.samples.push_back(100.0 + i);
+    same.samples.push_back(129.0 - i);
+    slower.samples.push_back((100.0 + i) * 1.5);
+    borderline.samples.push_back((100.0 + i) * 1.1);
+  }
+
+  assertTrue(exceedsSlowdown(baseline, slower, 0.1) == true);
+  assertTrue(exceedsSlowdown(baseline, same, 0.1) == false);
+  assertTrue(exceedsSlowdown(slower, baseline, 0.1) == false);
+  assertFalse(exceedsSlowdown(baseline, borderline, 0.1).has_value());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testBenchBaseline) {
+  const fs::path outDir = fs::temp_directory_path()
+                          / fmt::format("cabin-test-bench-{}", getpid());
+  fs::remove_all(outDir);
+
+  assertEq(BenchBaseline::load(outDir, "main").unwrap_err()->what(),
+           "no baseline named `main` was saved");
+  assertEq(BenchBaseline::load(outDir, "../x").unwrap_err()->what(),
+           "invalid baseline name: `../x`");
+
+  BenchBaseline baseline;
+  baseline.results["src/Foo.cc::parse"] = BenchResult{
+    .name = "src/Foo.cc::parse",
+    .bytes = 16,
+    .samples = { 1.25, 2.5 },
+    .counters = { { "cycles", 3.0 } },
+  };
+  assertTrue(baseline.save(outDir, "main").is_ok());
+  assertTrue(BenchBaseline::load(outDir, "main").unwrap().results
+             == baseline.results);
+
+  fs::remove_all(outDir);
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatBench) {
+  assertEq(formatDuration(12.345), "12.35 ns");
+  assertEq(formatDuration(1234.5), "1.23 µs");
+  assertEq(formatDuration(2.5e6), "2.50 ms");
+  assertEq(formatDuration(3e9), "3.00 s");
+
+  assertEq(formatThroughput(512), "512.00 B/s");
+  assertEq(formatThroughput(2048), "2.00 KiB/s");
+  assertEq(formatThroughput(3.0 * 1024 * 1024), "3.00 MiB/s");
+  assertEq(formatThroughput(1024.0 * 1024 * 1024), "1.00 GiB/s");
+
+  const std::map<std::string, double> counters{
+    { "cycles", 2000.0 },
+    { "instructions", 5000.0 },
+    { "context-switches", 0.5 },
+  };
+  assertEq(formatCounters(counters, {}),
+           "cycles 2.00k, instructions 5.00k, IPC 2.50, "
+           "context-switches 0.50");
+  assertEq(formatCounters(counters,
+                          { { "cycles", 1000.0 }, { "instructions", 5000.0 } }),
+           "cycles 2.00k (+100.0%), instructions 5.00k (+0.0%), "
+           "IPC 2.50 (-50.0%), context-switches 0.50");
+  assertEq(formatCounters({}, counters), "");
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
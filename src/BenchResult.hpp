@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Rustify/Result.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// The samples of one benchmark.
+struct BenchResult {
+  std::string name;
+  // Bytes processed per iteration, or 0 if the benchmark doesn't say.
+  std::uint64_t bytes = 0;
+  // Nanoseconds per iteration.
+  std::vector<double> samples;
+  // Mean performance counts per iteration, keyed by perf::COUNTER_NAMES, if
+  // they were recorded.
+  std::map<std::string, double> counters;
+
+  bool operator==(const BenchResult&) const = default;
+
+  double median() const;
+  // The median absolute deviation from the median.
+  double mad() const;
+  // In bytes per second, or 0 if unknown.
+  double throughput() const;
+};
+
+// Parses the report a benchmark binary writes to $CABIN_BENCH_REPORT, one
+// JSON object per line.  See bench::runBenches().  Lines that can't be
+// parsed are skipped.
+std::vector<BenchResult> parseBenchReport(std::string_view report);
+
+// How a benchmark changed from a baseline.
+struct BenchChange {
+  // Relative change of the median: 0.1 is 10% slower, -0.1 10% faster.
+  double change = 0.0;
+  // Two-sided p-value of the Mann-Whitney U test on the samples: how likely
+  // samples this different are if nothing changed.
+  double pValue = 1.0;
+
+  // Changes smaller than this are noise even when they are significant.
+  static constexpr double NOISE_THRESHOLD = 0.02;
+  static constexpr double SIGNIFICANCE_LEVEL = 0.05;
+
+  bool isSignificant() const;
+  bool isRegression() const { return isSignificant() && change > 0.0; }
+  bool isImprovement() const { return isSignificant() && change < 0.0; }
+};
+
+BenchChange compareBench(const BenchResult& baseline,
+                         const BenchResult& current);
+
+// How many times faster `current` is than `baseline`, as the ratio of their
+// medians, with a 95% bootstrap confidence interval.
+struct BenchSpeedup {
+  double ratio = 1.0;
+  double lower = 1.0;
+  double upper = 1.0;
+};
+
+BenchSpeedup estimateSpeedup(const BenchResult& baseline,
+                             const BenchResult& current);
+
+// Whether `current` is more than `threshold` slower than `baseline`, where
+// 0.05 is 5%.  std::nullopt while the confidence interval of the speedup
+// still straddles the threshold.
+std::optional<bool> exceedsSlowdown(const BenchResult& baseline,
+                                    const BenchResult& current,
+                                    double threshold);
+
+// Benchmark results saved under a name in the bench profile's out directory,
+// to compare later runs against.
+struct BenchBaseline {
+  static constexpr std::string_view DIR_NAME = "baselines";
+
+  // Keyed by benchmark name.
+  std::map<std::string, BenchResult> results;
+
+  static Result<BenchBaseline> load(const fs::path& outDir,
+                                    std::string_view name);
+  Result<void> save(const fs::path& outDir, std::string_view name) const;
+};
+
+// Formats nanoseconds with a unit that keeps a few significant digits.
+std::string formatDuration(double ns);
+std::string formatThroughput(double bytesPerSec);
+// Formats performance counts, with their change from `baseline` when it has
+// them, and the instructions per cycle (IPC) when both are there.
+std::string formatCounters(const std::map<std::string, double>& counters,
+                           const std::map<std::string, double>& baseline);
+
+} // namespace cabin
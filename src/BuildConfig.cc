@@ -2,9 +2,14 @@
 
 #include "Algos.hpp"
 #include "Builder/Compiler.hpp"
+#include "Builder/Toolchain.hpp"
 #include "Command.hpp"
+#include "Dependency.hpp"
 #include "Diag.hpp"
+#include "FileLock.hpp"
 #include "Git2.hpp"
+#include "GlobalCache.hpp"
+#include "Lockfile.hpp"
 #include "Manifest.hpp"
 #include "Parallelism.hpp"
 
@@ -18,6 +23,8 @@
 #include <fmt/ranges.h>
 #include <fstream>
 #include <iomanip>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <ostream>
@@ -27,6 +34,7 @@
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <tbb/blocked_range.h>
 #include <tbb/concurrent_vector.h>
 #include <tbb/parallel_for.h>
@@ -34,6 +42,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace cabin {
@@ -104,8 +113,64 @@ static std::vector<fs::path> listSourceFilePaths(const fs::path& dir) {
   return sourceFilePaths;
 }
 
-Result<BuildConfig> BuildConfig::init(const Manifest& manifest,
-                                      const BuildProfile& buildProfile) {
+// The sources of a source dependency's library and the objects they're
+// compiled to in `buildDir`.  The entry point of the dependency's binary is
+// not part of its library.
+static std::vector<std::pair<fs::path, fs::path>>
+mapDepLibObjs(const fs::path& srcDir, const fs::path& buildDir) {
+  std::vector<std::pair<fs::path, fs::path>> objs;
+  for (const fs::path& sourceFile : listSourceFilePaths(srcDir)) {
+    if (sourceFile.parent_path() == srcDir && sourceFile.stem() == "main") {
+      continue;
+    }
+    fs::path obj = buildDir / fs::relative(sourceFile, srcDir);
+    obj += ".o";
+    objs.emplace_back(sourceFile, std::move(obj));
+  }
+  return objs;
+}
+
+// Everything that affects the objects of a source dependency goes into the
+// name of the directory they're built in, so an existing build is reused as
+// is.
+static std::string depBuildDirName(const std::string_view depName,
+                                   const std::string_view hashInput) {
+  return fmt::format("{}-{:016x}", replaceAll(std::string(depName), "/", "-"),
+                     fnv1aHash(hashInput));
+}
+
+// Locks the build directory of a source dependency against `cabin cache gc`
+// and other builds.  Workspace members may build the same dependency, and
+// locking it again from this process would wait forever, so they share the
+// lock instead.
+static Result<std::shared_ptr<FileLock>>
+lockDepBuildDir(const fs::path& buildDir) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::weak_ptr<FileLock>> locks;
+  const std::scoped_lock guard(mutex);
+  std::weak_ptr<FileLock>& held = locks[buildDir.string()];
+  if (std::shared_ptr<FileLock> lock = held.lock()) {
+    return Ok(std::move(lock));
+  }
+  auto lock = std::make_shared<FileLock>(Try(lockCacheEntry(buildDir)));
+  held = lock;
+  return Ok(std::move(lock));
+}
+
+// `flags` with the -std= flag set to `edition`.
+static std::vector<std::string> withEdition(std::vector<std::string> flags,
+                                            const std::string_view edition) {
+  for (std::string& flag : flags) {
+    if (flag.starts_with("-std=")) {
+      flag = fmt::format("-std=c++{}", edition);
+    }
+  }
+  return flags;
+}
+
+Result<BuildConfig>
+BuildConfig::init(const Manifest& manifest, const BuildProfile& buildProfile,
+                  const std::optional<fs::path>& workspaceOutDir) {
   using std::string_view_literals::operator""sv;
 
   std::string libName;
@@ -115,9 +180,13 @@ Result<BuildConfig> BuildConfig::init(const Manifest& manifest,
     libName = fmt::format("lib{}.a", manifest.package.name);
   }
 
-  Project project = Try(Project::init(buildProfile, manifest));
+  Project project =
+      workspaceOutDir.has_value()
+          ? Try(Project::init(buildProfile, manifest, workspaceOutDir.value()))
+          : Try(Project::init(buildProfile, manifest));
+  ToolchainCache::instance().load(project.outBasePath.parent_path());
   return Ok(BuildConfig(buildProfile, std::move(libName), std::move(project),
-                        Try(Compiler::init())));
+                        Try(Compiler::init()), workspaceOutDir.has_value()));
 }
 
 bool BuildConfig::isUpToDate(const std::string_view fileName) const {
@@ -134,6 +203,29 @@ bool BuildConfig::isUpToDate(const std::string_view fileName) const {
       return false;
     }
   }
+  // Adding or removing a source file of a path dependency, or changing its
+  // edition, changes its subninja.
+  for (const SourceDep& dep : sourceDeps) {
+    const fs::path depManifestPath = dep.rootDir / Manifest::FILE_NAME;
+    if (fs::exists(depManifestPath)
+        && fs::last_write_time(depManifestPath) > configTime) {
+      return false;
+    }
+    for (const auto& entry :
+         fs::recursive_directory_iterator(dep.rootDir / "src")) {
+      if (entry.is_directory()
+          && fs::last_write_time(entry.path()) > configTime) {
+        return false;
+      }
+    }
+  }
+  // A locked revision of a git dependency changes the paths to build.
+  const fs::path lockfilePath =
+      project.rootPath / std::string(Lockfile::FILE_NAME);
+  if (fs::exists(lockfilePath)
+      && fs::last_write_time(lockfilePath) > configTime) {
+    return false;
+  }
   return fs::last_write_time(project.manifest.path) <= configTime;
 }
 
@@ -149,6 +241,67 @@ std::string BuildConfig::mapHeaderToObj(const fs::path& headerPath) const {
   return objBase.generic_string();
 }
 
+std::vector<std::string> BuildConfig::getTestTargetsAffectedBy(
+    const std::unordered_set<std::string>& changedFiles) const {
+  // Paths from -MM outputs are relative to the out directory, where the
+  // compiler ran.
+  const auto isChanged = [&](const fs::path& path) {
+    std::error_code ec;
+    const fs::path canonical = fs::weakly_canonical(outBasePath / path, ec);
+    return !ec && changedFiles.contains(canonical.string());
+  };
+  if (isChanged(project.manifest.path)
+      || isChanged(project.rootPath / std::string(Lockfile::FILE_NAME))) {
+    return testTargets;
+  }
+  for (const SourceDep& dep : sourceDeps) {
+    std::error_code ec;
+    const std::string prefix =
+        fs::weakly_canonical(dep.rootDir, ec).string() + '/';
+    if (std::ranges::any_of(changedFiles, [&](const std::string& changed) {
+          return changed.starts_with(prefix);
+        })) {
+      return testTargets;
+    }
+  }
+
+  std::unordered_set<std::string> affectedObjs;
+  for (const auto& [objTarget, unit] : compileUnits) {
+    if (isChanged(unit.source)
+        || std::ranges::any_of(unit.dependencies, isChanged)) {
+      affectedObjs.insert(objTarget);
+    }
+  }
+
+  // The reverse of collectBinDepObjs: a test is affected if it links an
+  // affected object.
+  std::vector<std::string> affected;
+  for (const NinjaEdge& edge : ninjaEdges) {
+    if (edge.rule != "cxx_link" || edge.outputs.size() != 1
+        || !testSources.contains(edge.outputs.front())) {
+      continue;
+    }
+    if (std::ranges::any_of(edge.inputs, [&](const std::string& input) {
+          return affectedObjs.contains(input);
+        })) {
+      affected.push_back(edge.outputs.front());
+    }
+  }
+  std::ranges::sort(affected);
+  return affected;
+}
+
+Result<void> BuildConfig::lockOutDir() {
+  outDirLock = std::make_shared<FileLock>(Try(FileLock::acquire(
+      outBasePath / ".cabin-lock", fmt::format("build directory `{}`",
+                                               outBasePath.string()))));
+  return Ok();
+}
+
+void BuildConfig::shareOutDirLock(const BuildConfig& other) {
+  outDirLock = other.outDirLock;
+}
+
 void BuildConfig::addEdge(NinjaEdge edge) {
   ninjaEdges.push_back(std::move(edge));
 }
@@ -167,46 +320,135 @@ void BuildConfig::registerCompileUnit(
   edge.implicitInputs.assign(dependencies.begin(), dependencies.end());
   std::ranges::sort(edge.implicitInputs);
   edge.bindings.emplace_back("out_dir", parentDirOrDot(objTarget));
-  edge.bindings.emplace_back("extra_flags", isTest ? "-DCABIN_TEST" : "");
+  edge.bindings.emplace_back(
+      "extra_flags", isTest ? fmt::format("-D{}", harnessMacro()) : "");
   addEdge(std::move(edge));
 }
 
-void BuildConfig::writeBuildFiles() const {
-  writeBuildNinja();
-  writeConfigNinja();
-  writeRulesNinja();
-  writeTargetsNinja();
+Result<BuildConfig::CompileCommand>
+BuildConfig::getCompileCommand(const fs::path& sourceFile) const {
+  std::error_code ec;
+  const fs::path target = fs::weakly_canonical(sourceFile, ec);
+  const CompileUnit* found = nullptr;
+  for (const auto& [objTarget, unit] : compileUnits) {
+    if (fs::weakly_canonical(outBasePath / unit.source, ec) == target
+        && (found == nullptr || (found->isTest && !unit.isTest))) {
+      found = &unit;
+    }
+  }
+  Ensure(found != nullptr, "`{}` is not a source file of {}",
+         sourceFile.string(), project.manifest.package.name);
+
+  // The same flags as the cxx_compile rule, in the same order.
+  Command command(compiler.cxx);
+  command.addArgs(project.compilerOpts.cFlags.macros)
+      .addArgs(project.compilerOpts.cFlags.includeDirs)
+      .addArgs(project.compilerOpts.cFlags.others);
+  if (found->isTest) {
+    command.addArg(fmt::format("-D{}", harnessMacro()));
+  }
+  command.addArg(found->source).setWorkingDirectory(outBasePath);
+
+  std::vector<fs::path> inputs{ outBasePath / found->source };
+  for (const std::string& dep : found->dependencies) {
+    inputs.push_back(outBasePath / dep);
+  }
+  return Ok(CompileCommand{ .command = std::move(command),
+                            .inputs = std::move(inputs) });
+}
+
+void BuildConfig::writeEdge(std::ostream& os, const NinjaEdge& edge) {
+  os << "build " << joinFlags(edge.outputs);
+  os << ": " << edge.rule;
+  if (!edge.inputs.empty()) {
+    os << ' ' << joinFlags(edge.inputs);
+  }
+  if (!edge.implicitInputs.empty()) {
+    os << " | " << joinFlags(edge.implicitInputs);
+  }
+  if (!edge.orderOnlyInputs.empty()) {
+    os << " || " << joinFlags(edge.orderOnlyInputs);
+  }
+  os << '\n';
+  for (const auto& [key, value] : edge.bindings) {
+    os << "  " << key << " = " << value << '\n';
+  }
+  os << '\n';
+}
+
+// Build files are replaced atomically, so that neither an interrupted run
+// nor a concurrent ninja ever reads a truncated one.
+static Result<void> writeNinjaFile(const fs::path& path,
+                                   const std::ostringstream& contents) {
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  return writeFileAtomically(path, contents.str());
+}
+
+Result<void> BuildConfig::writeBuildFiles() const {
+  Try(writeDepNinjas());
+  if (isWorkspaceMember) {
+    // The workspace writes the rest.
+    return writeMemberNinja();
+  }
+  Try(writeConfigNinja());
+  Try(writeRulesNinja());
+  Try(writeTargetsNinja());
+  // Written last since it's what ninja reads first.
+  return writeBuildNinja();
 }
 
-void BuildConfig::writeBuildNinja() const {
-  std::ofstream buildFile(outBasePath / "build.ninja");
+Result<void> BuildConfig::writeBuildNinja() const {
+  std::ostringstream buildFile;
   buildFile << "# Generated by Cabin\n";
   buildFile << "ninja_required_version = 1.11\n\n";
   buildFile << "include config.ninja\n";
   buildFile << "include rules.ninja\n";
-  buildFile << "include targets.ninja\n\n";
+  buildFile << "include targets.ninja\n";
+  for (const DepNinja& depNinja : depNinjas) {
+    buildFile << "subninja " << depNinja.fileName << '\n';
+  }
+  buildFile << '\n';
   if (!defaultTargets.empty()) {
     buildFile << "default " << joinFlags(defaultTargets) << '\n';
   }
+  return writeNinjaFile(outBasePath / "build.ninja", buildFile);
 }
 
-void BuildConfig::writeConfigNinja() const {
-  std::ofstream cfg(outBasePath / "config.ninja");
-  cfg << "# Build variables\n";
-  cfg << "CXX = " << compiler.cxx << '\n';
-  cfg << "CXXFLAGS = " << cxxFlags << '\n';
-  cfg << "DEFINES = " << defines << '\n';
-  cfg << "INCLUDES = " << includes << '\n';
-  cfg << "LDFLAGS = " << ldFlags << '\n';
-  cfg << "LIBS = " << libs << '\n';
+void BuildConfig::writeVariables(std::ostream& os) const {
+  os << "# Build variables\n";
+  os << "CXX = " << compiler.cxx << '\n';
+  os << "CXXFLAGS = " << cxxFlags << '\n';
+  os << "DEFINES = " << defines << '\n';
+  os << "INCLUDES = " << includes << '\n';
+  os << "LDFLAGS = " << ldFlags << '\n';
+  os << "LIBS = " << libs << '\n';
 }
 
-void BuildConfig::writeRulesNinja() const {
-  std::ofstream rules(outBasePath / "rules.ninja");
+Result<void> BuildConfig::writeConfigNinja() const {
+  std::ostringstream cfg;
+  writeVariables(cfg);
+  return writeNinjaFile(outBasePath / "config.ninja", cfg);
+}
+
+Result<void> BuildConfig::writeRulesNinja() const {
+  std::ostringstream rules;
 
   rules << "rule cxx_compile\n";
-  rules << "  command = $CXX $DEFINES $INCLUDES $CXXFLAGS $extra_flags -c $in "
-           "-o $out\n";
+  rules << "  command = ";
+  if (!compileReportExt.empty()) {
+    // GCC appends to an existing report.
+    rules << "rm -f $out" << compileReportExt << " && ";
+  }
+  rules << "$CXX $DEFINES $INCLUDES $CXXFLAGS $extra_flags";
+  if (!compileReportFlags.empty()) {
+    rules << ' ' << compileReportFlags;
+  }
+  rules << " -c $in -o $out";
+  if (!compileReportRedirect.empty()) {
+    rules << ' ' << compileReportRedirect;
+  }
+  rules << '\n';
   rules << "  description = CXX $out\n\n";
 
   rules << "rule cxx_link\n";
@@ -216,28 +458,52 @@ void BuildConfig::writeRulesNinja() const {
   rules << "rule ar_archive\n";
   rules << "  command = ar rcs $out $in\n";
   rules << "  description = AR $out\n\n";
+
+  // Dependencies are built into the shared cache, where a command log from
+  // another project's build directory doesn't apply.  Generator edges are
+  // only rebuilt when their inputs change, and the directory they're built
+  // in already encodes the flags.
+  //
+  // Other projects may build the same dependency at the same time, so each
+  // output is written under a name unique to the process ($$$$ is the
+  // shell's $$) and renamed into place.
+  rules << "rule dep_cxx_compile\n";
+  rules << "  command = $CXX $dep_flags -MMD -MT $out -MF $out.d.$$$$ "
+           "-c $in -o $out.$$$$ && mv -f $out.d.$$$$ $out.d "
+           "&& mv -f $out.$$$$ $out\n";
+  rules << "  depfile = $out.d\n";
+  rules << "  description = CXX $out\n";
+  rules << "  generator = 1\n\n";
+
+  rules << "rule dep_archive\n";
+  rules << "  command = rm -f $out.$$$$ && ar rcs $out.$$$$ $in "
+           "&& mv -f $out.$$$$ $out\n";
+  rules << "  description = AR $out\n";
+  rules << "  generator = 1\n\n";
+  return writeNinjaFile(outBasePath / "rules.ninja", rules);
+}
+
+Result<void> BuildConfig::writeDepNinjas() const {
+  for (const DepNinja& depNinja : depNinjas) {
+    std::ostringstream depFile;
+    depFile << "# Generated by Cabin\n";
+    // The compiler is part of the hash naming the build directory, and a
+    // workspace's build.ninja defines no CXX of its own.
+    depFile << "CXX = " << compiler.cxx << '\n';
+    depFile << "dep_flags = " << depNinja.flags << "\n\n";
+    for (const NinjaEdge& edge : depNinja.edges) {
+      writeEdge(depFile, edge);
+    }
+    Try(writeNinjaFile(outBasePath / depNinja.fileName, depFile));
+  }
+  return Ok();
 }
 
-void BuildConfig::writeTargetsNinja() const {
-  std::ofstream targetsFile(outBasePath / "targets.ninja");
+Result<void> BuildConfig::writeTargetsNinja() const {
+  std::ostringstream targetsFile;
 
   for (const NinjaEdge& edge : ninjaEdges) {
-    targetsFile << "build " << joinFlags(edge.outputs);
-    targetsFile << ": " << edge.rule;
-    if (!edge.inputs.empty()) {
-      targetsFile << ' ' << joinFlags(edge.inputs);
-    }
-    if (!edge.implicitInputs.empty()) {
-      targetsFile << " | " << joinFlags(edge.implicitInputs);
-    }
-    if (!edge.orderOnlyInputs.empty()) {
-      targetsFile << " || " << joinFlags(edge.orderOnlyInputs);
-    }
-    targetsFile << '\n';
-    for (const auto& [key, value] : edge.bindings) {
-      targetsFile << "  " << key << " = " << value << '\n';
-    }
-    targetsFile << '\n';
+    writeEdge(targetsFile, edge);
   }
 
   if (!defaultTargets.empty()) {
@@ -248,16 +514,76 @@ void BuildConfig::writeTargetsNinja() const {
     targetsFile << "build tests: phony " << joinFlags(testTargets) << '\n'
                 << '\n';
   }
+  return writeNinjaFile(outBasePath / "targets.ninja", targetsFile);
+}
+
+std::string BuildConfig::memberNinjaFileName() const {
+  return (fs::relative(project.buildOutPath, outBasePath) / "build.ninja")
+      .generic_string();
+}
+
+Result<void> BuildConfig::writeMemberNinja() const {
+  // Included as a subninja, so the variables are scoped to this member.
+  std::ostringstream memberFile;
+  memberFile << "# Generated by Cabin\n";
+  writeVariables(memberFile);
+  memberFile << '\n';
+  for (const NinjaEdge& edge : ninjaEdges) {
+    writeEdge(memberFile, edge);
+  }
+  return writeNinjaFile(outBasePath / memberNinjaFileName(), memberFile);
+}
+
+Result<void>
+BuildConfig::writeWorkspaceNinja(const std::vector<BuildConfig>& members) {
+  if (members.empty()) {
+    return Ok();
+  }
+  const BuildConfig& first = members.front();
+  Try(first.writeRulesNinja());
+
+  std::vector<std::string> defaults;
+  std::vector<std::string> tests;
+  std::unordered_set<std::string> depFileNames;
+  std::ostringstream buildFile;
+  buildFile << "# Generated by Cabin\n";
+  buildFile << "ninja_required_version = 1.11\n\n";
+  buildFile << "include rules.ninja\n";
+  for (const BuildConfig& member : members) {
+    // Members with the same dependency and flags share its build.
+    for (const DepNinja& depNinja : member.depNinjas) {
+      if (depFileNames.insert(depNinja.fileName).second) {
+        buildFile << "subninja " << depNinja.fileName << '\n';
+      }
+    }
+    buildFile << "subninja " << member.memberNinjaFileName() << '\n';
+    defaults.insert(defaults.end(), member.defaultTargets.begin(),
+                    member.defaultTargets.end());
+    tests.insert(tests.end(), member.testTargets.begin(),
+                 member.testTargets.end());
+  }
+  buildFile << '\n';
+
+  if (!defaults.empty()) {
+    buildFile << "build all: phony " << joinFlags(defaults) << "\n\n";
+  }
+  if (!tests.empty()) {
+    buildFile << "build tests: phony " << joinFlags(tests) << "\n\n";
+  }
+  if (!defaults.empty()) {
+    buildFile << "default " << joinFlags(defaults) << '\n';
+  }
+  return writeNinjaFile(first.outBasePath / "build.ninja", buildFile);
 }
 
 Result<std::string> BuildConfig::runMM(const std::string& sourceFile,
                                        const bool isTest) const {
   Command command = compiler.makeMMCmd(project.compilerOpts, sourceFile);
   if (isTest) {
-    command.addArg("-DCABIN_TEST");
+    command.addArg(fmt::format("-D{}", harnessMacro()));
   }
   command.setWorkingDirectory(outBasePath);
-  return getCmdOutput(command);
+  return getCmdOutput(command, RetryPolicy::Never);
 }
 
 static std::unordered_set<std::string>
@@ -325,13 +651,15 @@ BuildConfig::containsTestCode(const std::string& sourceFile) const {
   std::ifstream ifs(sourceFile);
   std::string line;
   while (std::getline(ifs, line)) {
-    if (line.find("CABIN_TEST") != std::string::npos) {
+    if (line.find(harnessMacro()) != std::string::npos) {
       Command command =
           compiler.makePreprocessCmd(project.compilerOpts, sourceFile);
-      const std::string src = Try(getCmdOutput(command));
+      const std::string src =
+          Try(getCmdOutput(command, RetryPolicy::Never));
 
-      command.addArg("-DCABIN_TEST");
-      const std::string testSrc = Try(getCmdOutput(command));
+      command.addArg(fmt::format("-D{}", harnessMacro()));
+      const std::string testSrc =
+          Try(getCmdOutput(command, RetryPolicy::Never));
 
       // If the source file contains CABIN_TEST, by processing the source
       // file with -E, we can check if the source file contains CABIN_TEST
@@ -439,10 +767,12 @@ void BuildConfig::collectBinDepObjs( // NOLINT(misc-no-recursion)
 
     Command command =
         compiler.makePreprocessCmd(project.compilerOpts, sourceFile);
-    const std::string src = Try(getCmdOutput(command));
+    const std::string src =
+        Try(getCmdOutput(command, RetryPolicy::Never));
 
     command.addArg("-DCABIN_TEST");
-    const std::string testSrc = Try(getCmdOutput(command));
+    const std::string testSrc =
+        Try(getCmdOutput(command, RetryPolicy::Never));
 
     const bool containsTest = src != testSrc;
     if (containsTest) {
@@ -526,7 +856,8 @@ Result<void> BuildConfig::processUnittestSrc(
 
   const fs::path targetBaseDir =
       fs::relative(sourceFilePath.parent_path(), project.rootPath / "src");
-  fs::path testTargetBaseDir = project.unittestOutPath;
+  fs::path testTargetBaseDir =
+      isBench() ? project.benchOutPath : project.unittestOutPath;
   if (targetBaseDir != ".") {
     testTargetBaseDir /= targetBaseDir;
   }
@@ -535,7 +866,8 @@ Result<void> BuildConfig::processUnittestSrc(
   const std::string testObjTarget =
       fs::relative(testObjOutput, outBasePath).generic_string();
   const fs::path testBinaryPath =
-      (testTargetBaseDir / sourceFilePath.filename()).concat(".test");
+      (testTargetBaseDir / sourceFilePath.filename())
+          .concat(isBench() ? ".bench" : ".test");
   const std::string testBinary =
       fs::relative(testBinaryPath, outBasePath).generic_string();
 
@@ -545,6 +877,7 @@ Result<void> BuildConfig::processUnittestSrc(
 
   std::vector<std::string> linkInputs(deps.begin(), deps.end());
   std::ranges::sort(linkInputs);
+  linkInputs.insert(linkInputs.end(), depArchives.begin(), depArchives.end());
 
   NinjaEdge linkEdge;
   linkEdge.outputs = { testBinary };
@@ -559,6 +892,7 @@ Result<void> BuildConfig::processUnittestSrc(
                       /*isTest=*/true);
   addEdge(std::move(linkEdge));
   testBinaryTargets.insert(testBinary);
+  testSources[testBinary] = sourceFilePath;
   if (mtx) {
     mtx->unlock();
   }
@@ -597,11 +931,136 @@ void BuildConfig::collectBinDepObjs(
 }
 
 Result<void> BuildConfig::installDeps(const bool includeDevDeps) {
-  const std::vector<CompilerOpts> depsCompOpts =
+  const std::vector<InstalledDep> installedDeps =
       Try(project.manifest.installDeps(includeDevDeps));
 
-  for (const CompilerOpts& depOpts : depsCompOpts) {
-    project.compilerOpts.merge(depOpts);
+  depsCompilerOpts = CompilerOpts();
+  sourceDeps.clear();
+  std::unordered_set<std::string> installedNames;
+  for (const InstalledDep& dep : installedDeps) {
+    project.compilerOpts.merge(dep.compilerOpts);
+    depsCompilerOpts.merge(dep.compilerOpts);
+    installedNames.insert(dep.name);
+  }
+
+  for (const InstalledDep& dep : installedDeps) {
+    if (!dep.rootDir.has_value()
+        || !fs::is_directory(dep.rootDir.value() / "src")) {
+      continue;
+    }
+    SourceDep sourceDep{ .name = dep.name,
+                         .rootDir = dep.rootDir.value(),
+                         .edition = std::nullopt };
+
+    const fs::path depManifestPath =
+        dep.rootDir.value() / Manifest::FILE_NAME;
+    if (fs::exists(depManifestPath)) {
+      const Manifest depManifest =
+          Try(Manifest::tryParse(depManifestPath, /*findParents=*/false)
+                  .with_context([&] {
+                    return anyhow::anyhow("failed to read the manifest of {}",
+                                          dep.name);
+                  }));
+      sourceDep.edition = depManifest.package.edition.str;
+      // The dependencies of a dependency aren't installed for it; they're
+      // compiled with those of the package.
+      for (const Dependency& depDep : depManifest.dependencies) {
+        const std::string& depDepName = std::visit(
+            [](const auto& d) -> const std::string& { return d.name; },
+            depDep);
+        if (!installedNames.contains(depDepName)) {
+          Diag::warn("{} depends on {}, which is not installed for it; add "
+                     "it to the [dependencies] of {}",
+                     dep.name, depDepName, project.manifest.package.name);
+        }
+      }
+    }
+    sourceDeps.push_back(std::move(sourceDep));
+  }
+  return Ok();
+}
+
+Result<void> BuildConfig::configureSourceDeps() {
+  depNinjas.clear();
+  depArchives.clear();
+  depBuildLocks.clear();
+
+  // The CABIN_<PKG>_* macros describe the root package.  Leaving them out
+  // lets every project with the same flags share the dependency builds.
+  std::vector<Macro> macros;
+  for (const Macro& macro : project.compilerOpts.cFlags.macros) {
+    if (!macro.name.starts_with("CABIN_")) {
+      macros.push_back(macro);
+    }
+  }
+  const std::vector<std::string>& others = project.compilerOpts.cFlags.others;
+  std::vector<std::string> hashedOthers;
+  for (const std::string& flag : others) {
+    if (!flag.starts_with("-fdiagnostics-color")) {
+      hashedOthers.push_back(flag);
+    }
+  }
+
+  for (const SourceDep& dep : sourceDeps) {
+    const fs::path srcDir = dep.rootDir / "src";
+    std::vector<IncludeDir> includeDirs = {
+      IncludeDir{ srcDir, /*isSystem=*/false },
+    };
+    includeDirs.insert(includeDirs.end(),
+                       depsCompilerOpts.cFlags.includeDirs.begin(),
+                       depsCompilerOpts.cFlags.includeDirs.end());
+
+    // A dependency is compiled in its own edition, with the profile of the
+    // package like Cargo does.
+    const std::vector<std::string> depOthers =
+        dep.edition.has_value() ? withEdition(others, dep.edition.value())
+                                : others;
+    const std::vector<std::string> depHashedOthers =
+        dep.edition.has_value()
+            ? withEdition(hashedOthers, dep.edition.value())
+            : hashedOthers;
+
+    const std::string baseFlags =
+        combineFlags({ joinFlags(macros), joinFlags(includeDirs) });
+    const std::string flags =
+        combineFlags({ baseFlags, joinFlags(depOthers) });
+
+    const std::string hashInput =
+        fmt::format("{}\n{}\n{}\n{}", compiler.cxx, baseFlags,
+                    joinFlags(depHashedOthers), dep.rootDir.generic_string());
+    const fs::path buildDir =
+        getCacheDir() / "build" / depBuildDirName(dep.name, hashInput);
+
+    DepNinja depNinja{ .fileName = {}, .flags = flags, .edges = {} };
+    std::vector<std::string> objs;
+    for (const auto& [sourceFile, obj] : mapDepLibObjs(srcDir, buildDir)) {
+      NinjaEdge edge;
+      edge.outputs = { obj.generic_string() };
+      edge.rule = "dep_cxx_compile";
+      edge.inputs = { sourceFile.generic_string() };
+      depNinja.edges.push_back(std::move(edge));
+      objs.push_back(obj.generic_string());
+    }
+    if (objs.empty()) {
+      continue;
+    }
+
+    const std::string archive =
+        (buildDir / fmt::format("lib{}.a", replaceAll(dep.name, "/", "-")))
+            .generic_string();
+    NinjaEdge archiveEdge;
+    archiveEdge.outputs = { archive };
+    archiveEdge.rule = "dep_archive";
+    archiveEdge.inputs = std::move(objs);
+    depNinja.edges.push_back(std::move(archiveEdge));
+    depNinja.fileName =
+        fmt::format("deps/{}.ninja", buildDir.filename().string());
+
+    spdlog::debug("building {} in {}", dep.name, buildDir.string());
+    depBuildLocks.push_back(Try(lockDepBuildDir(buildDir)));
+    recordCacheUse(buildDir);
+    depNinjas.push_back(std::move(depNinja));
+    depArchives.push_back(archive);
   }
   return Ok();
 }
@@ -611,6 +1070,74 @@ void BuildConfig::enableCoverage() {
   project.compilerOpts.ldFlags.others.emplace_back("--coverage");
 }
 
+Result<void> BuildConfig::enableCompileReport(const CompileReport report) {
+  switch (report) {
+  case CompileReport::None:
+    compileReportFlags.clear();
+    compileReportExt.clear();
+    compileReportRedirect.clear();
+    break;
+  case CompileReport::OptRemarks:
+    if (Try(compiler.supportsFlag("-foptimization-record-file=/dev/null"))) {
+      compileReportExt = ".opt.yaml";
+      compileReportFlags = "-fsave-optimization-record "
+                           "-foptimization-record-file=$out.opt.yaml";
+    } else if (Try(compiler.supportsFlag("-fopt-info-missed"))) {
+      compileReportExt = ".opt-info";
+      compileReportFlags = "-fopt-info-missed=$out.opt-info";
+    } else {
+      Bail("{} cannot save optimization remarks", compiler.cxx);
+    }
+    break;
+  case CompileReport::TimeTrace:
+    if (Try(compiler.supportsFlag("-ftime-trace=/dev/null"))) {
+      compileReportExt = ".time-trace.json";
+      compileReportFlags = "-ftime-trace=$out.time-trace.json";
+    } else if (Try(compiler.supportsFlag("-ftime-trace"))) {
+      // Before Clang 16, the trace is written next to the object, named
+      // after it with the extension replaced.
+      compileReportExt = ".time-trace.json";
+      compileReportFlags = "-ftime-trace";
+      compileReportRedirect =
+          "&& mv -f $$(dirname $out)/$$(basename $out .o).json "
+          "$out.time-trace.json";
+    } else if (Try(compiler.getVersion()).find("clang") == std::string::npos
+               && Try(compiler.supportsFlag("-ftime-report"))) {
+      // GCC prints the report after the diagnostics, which still have to
+      // reach the terminal.  Clang's report looks nothing like it.
+      compileReportExt = ".time-report";
+      compileReportFlags = "-ftime-report";
+      compileReportRedirect =
+          "2> $out.time-report; status=$$?; "
+          "sed -e '/^Time variable/,$$d' -e '/^$$/d' $out.time-report >&2; "
+          "exit $$status";
+    } else {
+      Bail("{} cannot trace its time; Clang 9+ or GCC is needed",
+           compiler.cxx);
+    }
+    break;
+  }
+  return Ok();
+}
+
+std::vector<std::pair<fs::path, fs::path>>
+BuildConfig::getCompileReports() const {
+  std::vector<std::pair<fs::path, fs::path>> reports;
+  if (compileReportExt.empty()) {
+    return reports;
+  }
+  for (const auto& [objTarget, unit] : compileUnits) {
+    fs::path report = outBasePath / objTarget;
+    report += compileReportExt;
+    if (!unit.isTest && fs::exists(report)) {
+      reports.emplace_back((outBasePath / unit.source).lexically_normal(),
+                           std::move(report));
+    }
+  }
+  std::ranges::sort(reports);
+  return reports;
+}
+
 Result<void> BuildConfig::configureBuild() {
   const fs::path srcDir = project.rootPath / "src";
   if (!fs::exists(srcDir)) {
@@ -673,6 +1200,7 @@ Result<void> BuildConfig::configureBuild() {
   ninjaEdges.clear();
   defaultTargets.clear();
   testTargets.clear();
+  testSources.clear();
 
   cxxFlags = joinFlags(project.compilerOpts.cFlags.others);
   defines = joinFlags(project.compilerOpts.cFlags.macros);
@@ -682,6 +1210,8 @@ Result<void> BuildConfig::configureBuild() {
   ldFlags = combineFlags({ ldOthers, libDirs });
   libs = joinFlags(project.compilerOpts.ldFlags.libs);
 
+  Try(configureSourceDeps());
+
   std::vector<fs::path> sourceFilePaths = listSourceFilePaths(srcDir);
   for (const fs::path& sourceFilePath : sourceFilePaths) {
     if (sourceFilePath != mainSource && isMainSource(sourceFilePath)) {
@@ -740,6 +1270,7 @@ Result<void> BuildConfig::configureBuild() {
 
     std::vector<std::string> inputs(deps.begin(), deps.end());
     std::ranges::sort(inputs);
+    inputs.insert(inputs.end(), depArchives.begin(), depArchives.end());
 
     NinjaEdge linkEdge;
     linkEdge.outputs = { project.manifest.package.name };
@@ -814,9 +1345,7 @@ static Result<void> generateCompdb(const fs::path& outDir) {
   const CommandOutput output = Try(compdbCmd.output());
   Ensure(output.exitStatus.success(), "ninja -t compdb {}", output.exitStatus);
 
-  std::ofstream compdbFile(outDir / "compile_commands.json");
-  compdbFile << output.stdOut;
-  return Ok();
+  return writeFileAtomically(outDir / "compile_commands.json", output.stdOut);
 }
 
 Result<void> BuildConfig::configureModuleSupport() {
@@ -863,12 +1392,12 @@ Result<void> BuildConfig::configureModuleSupport() {
     project.compilerOpts.ldFlags.others.emplace_back("-stdlib=libc++");
 
     const std::string stdPcmPath = (project.buildOutPath / "std.pcm").string();
+    const fs::path stdModulePath = Try(compiler.getStdModulePath());
 
     defineTarget(stdPcmPath,
                  { fmt::format("@mkdir -p $(@D) && "
-                               "$(CXX) $(CXXFLAGS) --precompile -o {} "
-                               "/usr/share/libc++/v1/std.cppm",
-                               stdPcmPath) },
+                               "$(CXX) $(CXXFLAGS) --precompile -o {} {}",
+                               stdPcmPath, stdModulePath.string()) },
                  {});
 
     project.compilerOpts.cFlags.others.emplace_back(
@@ -886,28 +1415,83 @@ Result<BuildConfig> emitMakefile(const Manifest& manifest,
                                  const bool includeDevDeps,
                                  const bool enableCoverage) {
   const Profile& profile = manifest.profiles.at(buildProfile);
-Result<BuildConfig> emitNinja(const Manifest& manifest,
-                              const BuildProfile& buildProfile,
-                              const bool includeDevDeps,
-                              const bool enableCoverage) {
+Result<BuildConfig>
+emitNinja(const Manifest& manifest, const BuildProfile& buildProfile,
+          const bool includeDevDeps, const bool enableCoverage,
+          const CompileReport compileReport) {
   auto config = Try(BuildConfig::init(manifest, buildProfile));
+  Try(config.lockOutDir());
 
   Try(config.installDeps(includeDevDeps));
   if (enableCoverage) {
     config.enableCoverage();
   }
+  Try(config.enableCompileReport(compileReport));
   const bool buildProj = !config.ninjaIsUpToDate();
   spdlog::debug("build.ninja is {}up to date", buildProj ? "NOT " : "");
 
   Try(config.configureBuild());
   if (buildProj) {
-    config.writeBuildFiles();
+    Try(config.writeBuildFiles());
+  } else {
+    // The flags and rules depend on options like --coverage, not only on
+    // the sources.
+    Try(config.writeConfigNinja());
+    Try(config.writeRulesNinja());
+  }
+  ToolchainCache::instance().save();
+  // Tools reading the database expect the commands of a plain build.
+  if (compileReport == CompileReport::None) {
+    Try(generateCompdb(config.outBasePath));
   }
-  Try(generateCompdb(config.outBasePath));
 
   return Ok(config);
 }
 
+Result<std::vector<BuildConfig>>
+emitWorkspaceNinja(const Workspace& workspace, const BuildProfile& buildProfile,
+                   const bool includeDevDeps, const bool enableCoverage) {
+  const fs::path outDir = workspace.outBasePath(buildProfile);
+
+  std::vector<BuildConfig> members;
+  members.reserve(workspace.members.size());
+  const fs::path buildNinja = outDir / "build.ninja";
+  const fs::path rootManifest = workspace.rootPath / Manifest::FILE_NAME;
+  bool buildProj = !fs::exists(buildNinja)
+                   || fs::last_write_time(rootManifest)
+                          > fs::last_write_time(buildNinja);
+  for (const Manifest& manifest : workspace.members) {
+    auto config = Try(BuildConfig::init(manifest, buildProfile, outDir));
+    if (members.empty()) {
+      Try(config.lockOutDir());
+    } else {
+      config.shareOutDirLock(members.front());
+    }
+    Try(config.installDeps(includeDevDeps));
+    if (enableCoverage) {
+      config.enableCoverage();
+    }
+    // Every member is checked against the workspace's build.ninja.
+    buildProj = buildProj || !config.ninjaIsUpToDate();
+    members.push_back(std::move(config));
+  }
+  spdlog::debug("build.ninja is {}up to date", buildProj ? "NOT " : "");
+
+  for (BuildConfig& config : members) {
+    Try(config.configureBuild());
+    if (buildProj) {
+      Try(config.writeBuildFiles());
+    }
+  }
+  if (buildProj) {
+    Try(BuildConfig::writeWorkspaceNinja(members));
+  }
+  ToolchainCache::instance().save();
+  Try(generateCompdb(outDir));
+
+  return Ok(members);
+}
+
 Result<std::string> emitCompdb(const Manifest& manifest,
                                const BuildProfile& buildProfile,
                                const bool includeDevDeps) {
@@ -955,11 +1539,13 @@ Result<bool> ninjaNeedsWork(const fs::path& outDir,
 
 #  include "Rustify/Tests.hpp"
 
+#  include <unistd.h>
+
 namespace tests {
 
 using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
 
-static void testJoinFlags() {
+CABIN_TEST_CASE(testJoinFlags) {
   const std::vector<std::string> flags{ "-Ifoo", "-Ibar" };
   assertEq(joinFlags(flags), "-Ifoo -Ibar");
 
@@ -969,21 +1555,21 @@ static void testJoinFlags() {
   pass();
 }
 
-static void testCombineFlags() {
+CABIN_TEST_CASE(testCombineFlags) {
   const std::string combined = combineFlags({ "-O2", "", "-fno-rtti", "-g" });
   assertEq(combined, "-O2 -fno-rtti -g");
 
   pass();
 }
 
-static void testParentDirOrDot() {
+CABIN_TEST_CASE(testParentDirOrDot) {
   assertEq(parentDirOrDot("objs/main.o"), "objs");
   assertEq(parentDirOrDot("main.o"), ".");
 
   pass();
 }
 
-static void testParseMMOutput() {
+CABIN_TEST_CASE(testParseMMOutput) {
   const std::string input =
       "main.o: src/main.cc include/foo.hpp include/bar.hpp \\\n"
       " include/baz.hh\n";
@@ -998,13 +1584,47 @@ static void testParseMMOutput() {
   pass();
 }
 
+CABIN_TEST_CASE(testMapDepLibObjs) {
+  const fs::path srcDir =
+      fs::temp_directory_path() / fmt::format("cabin-test-dep-{}", getpid());
+  fs::create_directories(srcDir / "cli");
+  for (const char* file : { "main.cc", "lib.cc", "lib.hpp", "cli/main.cc" }) {
+    std::ofstream(srcDir / file) << "\n";
+  }
+
+  const auto objs = mapDepLibObjs(srcDir, "/cache/build/foo-0123");
+  assertEq(objs.size(), 2UL);
+  assertEq(objs[0].first, srcDir / "cli/main.cc");
+  assertEq(objs[0].second, fs::path("/cache/build/foo-0123/cli/main.cc.o"));
+  assertEq(objs[1].first, srcDir / "lib.cc");
+  assertEq(objs[1].second, fs::path("/cache/build/foo-0123/lib.cc.o"));
+
+  fs::remove_all(srcDir);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testDepBuildDirName) {
+  const std::string name = depBuildDirName("org/foo", "g++\n-O2");
+  assertTrue(name.starts_with("org-foo-"));
+  assertEq(name, depBuildDirName("org/foo", "g++\n-O2"));
+  assertNe(name, depBuildDirName("org/foo", "g++\n-O3"));
+
+  pass();
+}
+
+CABIN_TEST_CASE(testWithEdition) {
+  assertEq(withEdition({ "-std=c++23", "-O2" }, "17"),
+           std::vector<std::string>{ "-std=c++17", "-O2" });
+  assertEq(withEdition({ "-g" }, "20"), std::vector<std::string>{ "-g" });
+
+  pass();
+}
+
 } // namespace tests
 
-int main() {
-  tests::testJoinFlags();
-  tests::testCombineFlags();
-  tests::testParentDirOrDot();
-  tests::testParseMMOutput();
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
 }
 
 #endif
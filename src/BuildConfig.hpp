@@ -3,9 +3,11 @@
 #include "Builder/BuildProfile.hpp"
 #include "Builder/Project.hpp"
 #include "Command.hpp"
+#include "FileLock.hpp"
 #include "Manifest.hpp"
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
@@ -27,6 +29,16 @@ inline const std::unordered_set<std::string> HEADER_FILE_EXTS{
 };
 // clang-format on
 
+// A report `cabin build` can have the compiler write next to each object of
+// the package.
+enum class CompileReport : std::uint8_t {
+  None,
+  // The optimizations the compiler missed, like loops left unvectorized.
+  OptRemarks,
+  // Where the compiler spent its time.
+  TimeTrace,
+};
+
 class BuildConfig {
 public:
   // NOLINTNEXTLINE(*-non-private-member-variables-in-classes)
@@ -40,6 +52,7 @@ private:
 
   bool hasBinaryTarget{ false };
   bool hasLibraryTarget{ false };
+  bool isWorkspaceMember{ false };
 
   struct CompileUnit {
     std::string source;
@@ -56,10 +69,46 @@ private:
     std::vector<std::pair<std::string, std::string>> bindings;
   };
 
+  // A git or path dependency that ships sources under src/.
+  struct SourceDep {
+    std::string name;
+    fs::path rootDir;
+    // From its own cabin.toml, if it has one.
+    std::optional<std::string> edition;
+  };
+
+  // The subninja file building one source dependency into the cache.
+  struct DepNinja {
+    std::string fileName;
+    std::string flags;
+    std::vector<NinjaEdge> edges;
+  };
+
   std::unordered_map<std::string, CompileUnit> compileUnits;
   std::vector<NinjaEdge> ninjaEdges;
   std::vector<std::string> defaultTargets;
   std::vector<std::string> testTargets;
+  std::unordered_map<std::string, fs::path> testSources;
+
+  // Compiler options contributed by dependencies only, which is what source
+  // dependencies are compiled with.
+  CompilerOpts depsCompilerOpts;
+  std::vector<SourceDep> sourceDeps;
+  std::vector<DepNinja> depNinjas;
+  std::vector<std::string> depArchives;
+  // Held until the dependencies are built, like `outDirLock`.
+  std::vector<std::shared_ptr<FileLock>> depBuildLocks;
+
+  // Shared by copies of this config and by the members of a workspace.
+  std::shared_ptr<FileLock> outDirLock;
+
+  // What the cxx_compile rule adds for the compile report.  The flags can
+  // name the report after the object with $out; it goes to $out followed
+  // by `compileReportExt`.  The redirect follows the compiler's arguments,
+  // for compilers that print the report or name it themselves.
+  std::string compileReportFlags;
+  std::string compileReportExt;
+  std::string compileReportRedirect;
 
   std::string cxxFlags;
   std::string defines;
@@ -67,6 +116,14 @@ private:
   std::string ldFlags;
   std::string libs;
 
+  // The bench profile builds benchmarks from CABIN_BENCH code the way the
+  // others build unit tests from CABIN_TEST code.  The benchmarks then take
+  // the place of the test targets.
+  bool isBench() const { return buildProfile == BuildProfile::Bench; }
+  std::string_view harnessMacro() const {
+    return isBench() ? "CABIN_BENCH" : "CABIN_TEST";
+  }
+
   bool isUpToDate(std::string_view fileName) const;
   std::string mapHeaderToObj(const fs::path& headerPath) const;
 
@@ -75,21 +132,30 @@ private:
                            const std::string& sourceFile,
                            const std::unordered_set<std::string>& dependencies,
                            bool isTest);
-  void writeBuildNinja() const;
-  void writeConfigNinja() const;
-  void writeRulesNinja() const;
-  void writeTargetsNinja() const;
+  Result<void> configureSourceDeps();
+
+  static void writeEdge(std::ostream& os, const NinjaEdge& edge);
+  void writeVariables(std::ostream& os) const;
+  Result<void> writeBuildNinja() const;
+  Result<void> writeDepNinjas() const;
+  Result<void> writeConfigNinja() const;
+  Result<void> writeRulesNinja() const;
+  Result<void> writeTargetsNinja() const;
+  Result<void> writeMemberNinja() const;
+  std::string memberNinjaFileName() const;
 
   explicit BuildConfig(BuildProfile buildProfile, std::string libName,
-                       Project project, Compiler compiler)
+                       Project project, Compiler compiler,
+                       const bool isWorkspaceMember)
       : outBasePath(project.outBasePath), project(std::move(project)),
         compiler(std::move(compiler)), buildProfile(std::move(buildProfile)),
-        libName(std::move(libName)) {}
+        libName(std::move(libName)), isWorkspaceMember(isWorkspaceMember) {}
 
 public:
   static Result<BuildConfig>
   init(const Manifest& manifest,
-       const BuildProfile& buildProfile = BuildProfile::Dev);
+       const BuildProfile& buildProfile = BuildProfile::Dev,
+       const std::optional<fs::path>& workspaceOutDir = std::nullopt);
 
   bool hasBinTarget() const { return hasBinaryTarget; }
   bool hasLibTarget() const { return hasLibraryTarget; }
@@ -98,12 +164,46 @@ public:
   bool ninjaIsUpToDate() const { return isUpToDate("build.ninja"); }
   bool compdbIsUpToDate() const { return isUpToDate("compile_commands.json"); }
 
+  const std::vector<std::string>& getDefaultTargets() const {
+    return defaultTargets;
+  }
   const std::vector<std::string>& getTestTargets() const { return testTargets; }
+  // The source file a test target was built from.
+  const fs::path& getTestSource(const std::string& testTarget) const {
+    return testSources.at(testTarget);
+  }
+
+  // The test targets a change to `changedFiles`, given as canonical paths,
+  // can affect: those linking an object whose source or any header it
+  // includes changed.  A change to the manifest, the lockfile, or a source
+  // dependency affects every test.
+  std::vector<std::string> getTestTargetsAffectedBy(
+      const std::unordered_set<std::string>& changedFiles) const;
+
+  // How the cxx_compile edge compiles `sourceFile`, preferring it outside
+  // of the unit tests, up to but excluding `-c <in> -o <out>`.  Like
+  // ninja, the command runs in the output directory.
+  struct CompileCommand {
+    Command command;
+    // The source file and the headers it includes.
+    std::vector<fs::path> inputs;
+  };
+  Result<CompileCommand> getCompileCommand(const fs::path& sourceFile) const;
+
+  // Keeps other cabin processes out of the output directory for as long as
+  // this config, or a copy of it, lives.
+  Result<void> lockOutDir();
+  void shareOutDirLock(const BuildConfig& other);
 
   Result<void> installDeps(bool includeDevDeps);
   void setVariables();
   Result<void> configureModuleSupport();
   void enableCoverage();
+  Result<void> enableCompileReport(CompileReport report);
+  // The source file and the compile report of each of the package's
+  // objects that has one, from this build or, for the objects that were up
+  // to date, from an earlier one.
+  std::vector<std::pair<fs::path, fs::path>> getCompileReports() const;
 
   Result<void> processSrc(const fs::path& sourceFilePath,
                           std::unordered_set<std::string>& buildObjTargets,
@@ -129,12 +229,19 @@ public:
                             bool isTest = false) const;
   Result<bool> containsTestCode(const std::string& sourceFile) const;
 
-  void writeBuildFiles() const;
+  Result<void> writeBuildFiles() const;
+  // Writes the build.ninja that pulls in the members' ninja files.
+  static Result<void>
+  writeWorkspaceNinja(const std::vector<BuildConfig>& members);
 };
 
-Result<BuildConfig> emitNinja(const Manifest& manifest,
-                              const BuildProfile& buildProfile,
-                              bool includeDevDeps, bool enableCoverage = false);
+Result<BuildConfig>
+emitNinja(const Manifest& manifest, const BuildProfile& buildProfile,
+          bool includeDevDeps, bool enableCoverage = false,
+          CompileReport compileReport = CompileReport::None);
+Result<std::vector<BuildConfig>>
+emitWorkspaceNinja(const Workspace& workspace, const BuildProfile& buildProfile,
+                   bool includeDevDeps, bool enableCoverage = false);
 Result<std::string> emitCompdb(const Manifest& manifest,
                                const BuildProfile& buildProfile,
                                bool includeDevDeps);
@@ -16,6 +16,8 @@ public:
     Dev,
     Release,
     Test,
+    Bench,
+    Profiling,
   };
   using enum Type;
 
@@ -58,6 +60,10 @@ struct fmt::formatter<cabin::BuildProfile> {
         return fmt::format_to(ctx.out(), "release");
       case cabin::BuildProfile::Test:
         return fmt::format_to(ctx.out(), "test");
+      case cabin::BuildProfile::Bench:
+        return fmt::format_to(ctx.out(), "bench");
+      case cabin::BuildProfile::Profiling:
+        return fmt::format_to(ctx.out(), "profiling");
       }
       __builtin_unreachable();
     } else {
@@ -2,36 +2,34 @@
 
 #include "Algos.hpp"
 #include "Command.hpp"
+#include "PkgConfig.hpp"
 #include "Rustify/Result.hpp"
+#include "Toolchain.hpp"
 
 #include <array>
 #include <cstdlib>
+#include <exception>
+#include <fmt/format.h>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <span>
+#include <spdlog/spdlog.h>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <tuple>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace cabin {
 
-// TODO: The parsing of pkg-config output might not be robust.  It assumes
-// that there wouldn't be backquotes or double quotes in the output, (should
-// be treated as a single flag).  The current code just splits the output by
-// space.
-
-Result<CFlags>
-CFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
-  const Command pkgConfigCmd =
-      Command("pkg-config").addArg("--cflags").addArg(pkgConfigVer);
-  std::string output = Try(getCmdOutput(pkgConfigCmd));
-  output.pop_back(); // remove '\n'
-
+CFlags CFlags::fromFlags(const std::span<const std::string> flags) noexcept {
   std::vector<Macro> macros;           // -D<name>=<val>
   std::vector<IncludeDir> includeDirs; // -I<dir>
   std::vector<std::string> others;     // e.g., -pthread, -fPIC
 
-  const auto parseCFlag = [&](const std::string& flag) {
+  for (const std::string& flag : flags) {
     if (flag.starts_with("-D")) {
       const std::string macro = flag.substr(2);
       const std::size_t eqPos = macro.find('=');
@@ -45,27 +43,19 @@ CFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
     } else {
       others.emplace_back(flag);
     }
-  };
-
-  std::string flag;
-  for (const char i : output) {
-    if (i != ' ') {
-      flag += i;
-    } else {
-      if (flag.empty()) {
-        continue;
-      }
-
-      parseCFlag(flag);
-      flag.clear();
-    }
-  }
-  if (!flag.empty()) {
-    parseCFlag(flag);
   }
 
-  return Ok(CFlags( //
-      std::move(macros), std::move(includeDirs), std::move(others)));
+  return CFlags( //
+      std::move(macros), std::move(includeDirs), std::move(others));
+}
+
+Result<CFlags>
+CFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
+  const Command pkgConfigCmd =
+      Command("pkg-config").addArg("--cflags").addArg(pkgConfigVer);
+  const std::string output =
+      Try(getCmdOutput(pkgConfigCmd, RetryPolicy::Never));
+  return Ok(fromFlags(splitPkgConfigFlags(output)));
 }
 
 void CFlags::merge(const CFlags& other) noexcept {
@@ -75,18 +65,12 @@ void CFlags::merge(const CFlags& other) noexcept {
   others.insert(others.end(), other.others.begin(), other.others.end());
 }
 
-Result<LdFlags>
-LdFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
-  const Command pkgConfigCmd =
-      Command("pkg-config").addArg("--libs").addArg(pkgConfigVer);
-  std::string output = Try(getCmdOutput(pkgConfigCmd));
-  output.pop_back(); // remove '\n'
-
+LdFlags LdFlags::fromFlags(const std::span<const std::string> flags) noexcept {
   std::vector<LibDir> libDirs;     // -L<dir>
   std::vector<Lib> libs;           // -l<lib>
   std::vector<std::string> others; // e.g., -Wl,...
 
-  const auto parseLdFlag = [&](const std::string& flag) {
+  for (const std::string& flag : flags) {
     if (flag.starts_with("-L")) {
       libDirs.emplace_back(flag.substr(2));
     } else if (flag.starts_with("-l")) {
@@ -94,26 +78,18 @@ LdFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
     } else {
       others.emplace_back(flag);
     }
-  };
-
-  std::string flag;
-  for (const char i : output) {
-    if (i != ' ') {
-      flag += i;
-    } else {
-      if (flag.empty()) {
-        continue;
-      }
-
-      parseLdFlag(flag);
-      flag.clear();
-    }
-  }
-  if (!flag.empty()) {
-    parseLdFlag(flag);
   }
 
-  return Ok(LdFlags(std::move(libDirs), std::move(libs), std::move(others)));
+  return LdFlags(std::move(libDirs), std::move(libs), std::move(others));
+}
+
+Result<LdFlags>
+LdFlags::parsePkgConfig(const std::string_view pkgConfigVer) noexcept {
+  const Command pkgConfigCmd =
+      Command("pkg-config").addArg("--libs").addArg(pkgConfigVer);
+  const std::string output =
+      Try(getCmdOutput(pkgConfigCmd, RetryPolicy::Never));
+  return Ok(fromFlags(splitPkgConfigFlags(output)));
 }
 
 LdFlags::LdFlags(std::vector<LibDir> libDirs, std::vector<Lib> libs,
@@ -167,14 +143,18 @@ Compiler Compiler::init(std::string cxx) noexcept {
 }
 
 Result<Compiler> Compiler::init() noexcept {
+  ToolchainCache& toolchain = ToolchainCache::instance();
   if (const char* cxxP = std::getenv("CXX")) {
+    // Record the fingerprint of $CXX so that replacing the binary
+    // invalidates what we know about it.
+    std::ignore = toolchain.findTool(cxxP);
     return Ok(Compiler::init(std::string(cxxP)));
   }
 
   static constexpr std::array<std::string_view, 3> candidates{ "c++", "g++",
                                                                "clang++" };
   for (const std::string_view candidate : candidates) {
-    if (commandExists(candidate)) {
+    if (toolchain.findTool(candidate).has_value()) {
       return Ok(Compiler::init(std::string(candidate)));
     }
   }
@@ -216,13 +196,16 @@ Command Compiler::makePreprocessCmd(const CompilerOpts& opts,
 }
 
 Result<std::string> Compiler::getVersion() const noexcept {
-  const Command versionCmd = Command(cxx).addArg("--version");
-  const auto result = Try(versionCmd.output());
-  return Ok(result.stdOut);
+  return ToolchainCache::instance().probe(
+      cxx, "version", [this]() -> Result<std::string> {
+        const Command versionCmd = Command(cxx).addArg("--version");
+        const auto result = Try(versionCmd.output());
+        return Ok(result.stdOut);
+      });
 }
 
-Result<bool> Compiler::supportsModules() const noexcept {
-  const std::string versionOutput = Try(getVersion());
+static bool versionSupportsModules(const std::string_view cxx,
+                                   const std::string& versionOutput) {
 
   if (cxx.find("gcc") != std::string::npos
       || cxx.find("g++") != std::string::npos) {
@@ -245,9 +228,9 @@ Result<bool> Compiler::supportsModules() const noexcept {
         if (dotPos != std::string::npos) {
           try {
             int majorVersion = std::stoi(versionStr.substr(0, dotPos));
-            return Ok(majorVersion >= 14);
+            return majorVersion >= 14;
           } catch (...) {
-            return Ok(false);
+            return false;
           }
         }
       }
@@ -271,16 +254,88 @@ Result<bool> Compiler::supportsModules() const noexcept {
         if (dotPos != std::string::npos) {
           try {
             int majorVersion = std::stoi(versionStr.substr(0, dotPos));
-            return Ok(majorVersion >= 17);
+            return majorVersion >= 17;
           } catch (...) {
-            return Ok(false);
+            return false;
           }
         }
       }
     }
   }
 
-  return Ok(false);
+  return false;
+}
+
+Result<bool> Compiler::supportsModules() const noexcept {
+  const std::string supported = Try(ToolchainCache::instance().probe(
+      cxx, "modules", [this]() -> Result<std::string> {
+        const std::string versionOutput = Try(getVersion());
+        return Ok(versionSupportsModules(cxx, versionOutput) ? "true"
+                                                             : "false");
+      }));
+  return Ok(supported == "true");
+}
+
+Result<bool>
+Compiler::supportsFlag(const std::string_view flag) const noexcept {
+  const std::string supported = Try(ToolchainCache::instance().probe(
+      cxx, fmt::format("flag:{}", flag), [&]() -> Result<std::string> {
+        // Compile an empty translation unit; -Werror turns warnings about
+        // unknown or unused flags into failures.
+        const Command probeCmd = Command(cxx)
+                                     .addArg("-Werror")
+                                     .addArg(flag)
+                                     .addArg("-x")
+                                     .addArg("c++")
+                                     .addArg("-c")
+                                     .addArg("/dev/null")
+                                     .addArg("-o")
+                                     .addArg("/dev/null");
+        const CommandOutput output = Try(probeCmd.output());
+        return Ok(output.exitStatus.success() ? "true" : "false");
+      }));
+  return Ok(supported == "true");
+}
+
+Result<fs::path> Compiler::getStdModulePath() const noexcept {
+  static constexpr std::string_view fallback = "/usr/share/libc++/v1/std.cppm";
+
+  const std::string path = Try(ToolchainCache::instance().probe(
+      cxx, "std-module", [this]() -> Result<std::string> {
+        // libc++ describes where its std module sources are installed in
+        // libc++.modules.json (LLVM 18+).
+        const Command printCmd =
+            Command(cxx)
+                .addArg("-stdlib=libc++")
+                .addArg("-print-file-name=libc++.modules.json");
+        const CommandOutput output = Try(printCmd.output());
+        std::string manifestPath = output.stdOut;
+        if (!manifestPath.empty() && manifestPath.back() == '\n') {
+          manifestPath.pop_back();
+        }
+        if (!output.exitStatus.success()
+            || !fs::is_regular_file(manifestPath)) {
+          return Ok(std::string(fallback));
+        }
+
+        try {
+          std::ifstream ifs(manifestPath);
+          const nlohmann::json manifest = nlohmann::json::parse(ifs);
+          for (const nlohmann::json& module : manifest.at("modules")) {
+            if (module.at("logical-name") == "std") {
+              const fs::path sourcePath =
+                  module.at("source-path").get<std::string>();
+              return Ok((fs::path(manifestPath).parent_path() / sourcePath)
+                            .lexically_normal()
+                            .string());
+            }
+          }
+        } catch (const std::exception& e) {
+          spdlog::debug("Failed to parse {}: {}", manifestPath, e.what());
+        }
+        return Ok(std::string(fallback));
+      }));
+  return Ok(fs::path(path));
 }
 
 } // namespace cabin
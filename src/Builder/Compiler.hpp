@@ -7,6 +7,7 @@
 #include <filesystem>
 #include <fmt/format.h>
 #include <fmt/std.h>
+#include <span>
 #include <string>
 #include <string_view>
 #include <utility>
@@ -44,6 +45,7 @@ struct CFlags {
       : macros(std::move(macros)), includeDirs(std::move(includeDirs)),
         others(std::move(others)) {}
 
+  static CFlags fromFlags(std::span<const std::string> flags) noexcept;
   static Result<CFlags> parsePkgConfig(std::string_view pkgConfigVer) noexcept;
 
   void merge(const CFlags& other) noexcept;
@@ -71,6 +73,7 @@ struct LdFlags {
   LdFlags(std::vector<LibDir> libDirs, std::vector<Lib> libs,
           std::vector<std::string> others) noexcept;
 
+  static LdFlags fromFlags(std::span<const std::string> flags) noexcept;
   static Result<LdFlags> parsePkgConfig(std::string_view pkgConfigVer) noexcept;
 
   void merge(const LdFlags& other) noexcept;
@@ -106,6 +109,8 @@ public:
                             const std::string& sourceFile) const;
   Result<std::string> getVersion() const noexcept;
   Result<bool> supportsModules() const noexcept;
+  Result<bool> supportsFlag(std::string_view flag) const noexcept;
+  Result<fs::path> getStdModulePath() const noexcept;
 
 private:
   explicit Compiler(std::string cxx) noexcept : cxx(std::move(cxx)) {}
@@ -0,0 +1,941 @@
+#include "PkgConfig.hpp"
+
+#include "Algos.hpp"
+#include "Builder/Compiler.hpp"
+#include "Builder/Toolchain.hpp"
+#include "Command.hpp"
+#include "Dependency.hpp"
+#include "Rustify/Result.hpp"
+#include "Semver.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <ranges>
+#include <set>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static constexpr std::string_view CACHE_FILE_NAME = "pkg-config.json";
+
+std::vector<std::string> splitPkgConfigFlags(const std::string_view str) {
+  std::vector<std::string> result;
+  std::string buffer;
+  bool hasToken = false; // to keep empty quoted strings, e.g., ""
+
+  bool foundBackslash = false;
+  bool isInQuote = false;
+  char quoteChar = ' ';
+
+  for (const char c : str) {
+    if (foundBackslash) {
+      buffer += c;
+      foundBackslash = false;
+    } else if (isInQuote) {
+      if (c == quoteChar) {
+        isInQuote = false;
+      } else if (c == '\\' && quoteChar == '"') {
+        foundBackslash = true;
+      } else {
+        buffer += c;
+      }
+    } else if (c == '\'' || c == '"') {
+      isInQuote = true;
+      hasToken = true;
+      quoteChar = c;
+    } else if (c == '\\') {
+      foundBackslash = true;
+      hasToken = true;
+    } else if (std::isspace(static_cast<unsigned char>(c))) {
+      if (hasToken || !buffer.empty()) {
+        result.push_back(std::move(buffer));
+        buffer.clear();
+        hasToken = false;
+      }
+    } else {
+      buffer += c;
+    }
+  }
+  if (hasToken || !buffer.empty()) {
+    result.push_back(std::move(buffer));
+  }
+  return result;
+}
+
+static std::string toLowerStr(const std::string_view str) {
+  std::string lower(str);
+  std::ranges::transform(lower, lower.begin(), toLower);
+  return lower;
+}
+
+Result<PkgConfigFile> PkgConfigFile::parse(const fs::path& path) {
+  std::ifstream ifs(path);
+  Ensure(ifs, "failed to open {}", path.string());
+
+  PkgConfigFile pcFile;
+  pcFile.path = path;
+  pcFile.variables.emplace("pcfiledir", path.parent_path().string());
+
+  std::string line;
+  std::string logicalLine;
+  while (std::getline(ifs, line)) {
+    // A trailing backslash continues the line.
+    if (!line.empty() && line.back() == '\\') {
+      line.pop_back();
+      logicalLine += line;
+      continue;
+    }
+    logicalLine += line;
+    line = std::move(logicalLine);
+    logicalLine.clear();
+
+    if (const std::size_t commentPos = line.find('#');
+        commentPos != std::string::npos) {
+      line.erase(commentPos);
+    }
+    const std::string_view trimmed = trim(line);
+    if (trimmed.empty()) {
+      continue;
+    }
+
+    std::size_t pos = 0;
+    while (pos < trimmed.size()
+           && (std::isalnum(static_cast<unsigned char>(trimmed[pos]))
+               || trimmed[pos] == '_' || trimmed[pos] == '.')) {
+      ++pos;
+    }
+    const std::string key(trimmed.substr(0, pos));
+    const std::string_view rest = trim(trimmed.substr(pos));
+    Ensure(!key.empty() && !rest.empty()
+               && (rest.front() == '=' || rest.front() == ':'),
+           "{}: malformed line `{}`", path.string(), trimmed);
+
+    std::string value(trim(rest.substr(1)));
+    if (rest.front() == '=') {
+      pcFile.variables.insert_or_assign(key, std::move(value));
+    } else {
+      // Keywords are case-insensitive, e.g., both Cflags and CFlags appear in
+      // the wild.
+      pcFile.fields.insert_or_assign(toLowerStr(key), std::move(value));
+    }
+  }
+  return Ok(std::move(pcFile));
+}
+
+Result<std::string> PkgConfigFile::expand(const std::string_view value) const {
+  // Guard against self-referencing variables.
+  static constexpr int MAX_DEPTH = 64;
+  const std::function<Result<std::string>(std::string_view, int)> expandImpl =
+      [&](const std::string_view str, const int depth) -> Result<std::string> {
+    Ensure(depth < MAX_DEPTH, "{}: variables are defined recursively",
+           path.string());
+
+    std::string result;
+    for (std::size_t i = 0; i < str.size(); ++i) {
+      if (str[i] == '$' && i + 1 < str.size() && str[i + 1] == '$') {
+        result += '$';
+        ++i;
+      } else if (str[i] == '$' && i + 1 < str.size() && str[i + 1] == '{') {
+        const std::size_t end = str.find('}', i + 2);
+        Ensure(end != std::string_view::npos, "{}: unterminated `${{` in `{}`",
+               path.string(), str);
+
+        const std::string name(str.substr(i + 2, end - i - 2));
+        const auto it = variables.find(name);
+        Ensure(it != variables.end(), "{}: undefined variable `{}`",
+               path.string(), name);
+        result += Try(expandImpl(it->second, depth + 1));
+        i = end;
+      } else {
+        result += str[i];
+      }
+    }
+    return Ok(result);
+  };
+  return expandImpl(value, 0);
+}
+
+Result<std::string> PkgConfigFile::get(const std::string_view field) const {
+  const auto it = fields.find(toLowerStr(field));
+  if (it == fields.end()) {
+    return Ok(std::string());
+  }
+  return expand(it->second);
+}
+
+// Compares two versions with the rpmvercmp() algorithm pkg-config uses:
+// alphanumeric segments are compared one by one, numerically if both are
+// digits and lexicographically otherwise.
+static int comparePkgVersions(std::string_view lhs, std::string_view rhs) {
+  const auto isAlnum = [](const char c) {
+    return std::isalnum(static_cast<unsigned char>(c)) != 0;
+  };
+  const auto isDigit = [](const char c) {
+    return std::isdigit(static_cast<unsigned char>(c)) != 0;
+  };
+
+  while (!lhs.empty() || !rhs.empty()) {
+    while (!lhs.empty() && !isAlnum(lhs.front())) {
+      lhs.remove_prefix(1);
+    }
+    while (!rhs.empty() && !isAlnum(rhs.front())) {
+      rhs.remove_prefix(1);
+    }
+    if (lhs.empty() || rhs.empty()) {
+      break;
+    }
+
+    const bool isNum = isDigit(lhs.front());
+    const auto segmentEnd = [&](std::string_view str) {
+      std::size_t end = 0;
+      while (end < str.size()
+             && (isNum ? isDigit(str[end])
+                       : std::isalpha(static_cast<unsigned char>(str[end])))) {
+        ++end;
+      }
+      return end;
+    };
+    const std::size_t lhsEnd = segmentEnd(lhs);
+    const std::size_t rhsEnd = segmentEnd(rhs);
+    if (rhsEnd == 0) {
+      // Numeric segments are newer than alphabetic ones.
+      return isNum ? 1 : -1;
+    }
+
+    std::string_view lhsSeg = lhs.substr(0, lhsEnd);
+    std::string_view rhsSeg = rhs.substr(0, rhsEnd);
+    lhs.remove_prefix(lhsEnd);
+    rhs.remove_prefix(rhsEnd);
+
+    if (isNum) {
+      while (lhsSeg.size() > 1 && lhsSeg.front() == '0') {
+        lhsSeg.remove_prefix(1);
+      }
+      while (rhsSeg.size() > 1 && rhsSeg.front() == '0') {
+        rhsSeg.remove_prefix(1);
+      }
+      if (lhsSeg.size() != rhsSeg.size()) {
+        return lhsSeg.size() < rhsSeg.size() ? -1 : 1;
+      }
+    }
+    if (const int cmp = lhsSeg.compare(rhsSeg); cmp != 0) {
+      return cmp < 0 ? -1 : 1;
+    }
+  }
+
+  if (lhs.empty() && rhs.empty()) {
+    return 0;
+  }
+  return lhs.empty() ? -1 : 1;
+}
+
+struct PkgRequirement {
+  std::string name;
+  std::string op; // empty if any version is acceptable
+  std::string version;
+
+  bool satisfiedBy(const std::string_view ver) const {
+    if (op.empty()) {
+      return true;
+    }
+    const int cmp = comparePkgVersions(ver, version);
+    if (op == "=") {
+      return cmp == 0;
+    } else if (op == "!=") {
+      return cmp != 0;
+    } else if (op == "<") {
+      return cmp < 0;
+    } else if (op == "<=") {
+      return cmp <= 0;
+    } else if (op == ">") {
+      return cmp > 0;
+    } else {
+      return cmp >= 0;
+    }
+  }
+};
+
+// Parses a Requires field, e.g., `glib-2.0 >= 2.50, gobject-2.0`.
+static Result<std::vector<PkgRequirement>>
+parseRequires(const std::string_view reqsStr) {
+  static const std::unordered_set<std::string_view> operators{
+    "=", "!=", "<", "<=", ">", ">="
+  };
+
+  std::vector<std::string> tokens;
+  std::string token;
+  const auto flush = [&] {
+    if (!token.empty()) {
+      tokens.push_back(std::move(token));
+      token.clear();
+    }
+  };
+  for (std::size_t i = 0; i < reqsStr.size(); ++i) {
+    const char c = reqsStr[i];
+    if (c == ',' || std::isspace(static_cast<unsigned char>(c))) {
+      flush();
+    } else if (c == '<' || c == '>' || c == '=' || c == '!') {
+      flush();
+      token += c;
+      if (i + 1 < reqsStr.size() && reqsStr[i + 1] == '=') {
+        token += '=';
+        ++i;
+      }
+      flush();
+    } else {
+      token += c;
+    }
+  }
+  flush();
+
+  std::vector<PkgRequirement> reqs;
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    Ensure(!operators.contains(tokens[i]),
+           "unexpected `{}` in Requires: `{}`", tokens[i], reqsStr);
+
+    PkgRequirement req{ .name = tokens[i], .op = "", .version = "" };
+    if (i + 1 < tokens.size() && operators.contains(tokens[i + 1])) {
+      Ensure(i + 2 < tokens.size(), "missing version after `{}` in `{}`",
+             tokens[i + 1], reqsStr);
+      req.op = tokens[i + 1];
+      req.version = tokens[i + 2];
+      i += 2;
+    }
+    reqs.push_back(std::move(req));
+  }
+  return Ok(reqs);
+}
+
+// Versions in .pc files are not necessarily semver, e.g., `2021.8` or
+// `1.10`.  Pad missing components with zeros so VersionReq can check them.
+static std::optional<Version> parseLenientVersion(const std::string_view str) {
+  std::array<uint64_t, 3> nums{};
+  std::size_t numIdx = 0;
+  std::size_t pos = 0;
+  while (numIdx < nums.size() && pos < str.size()
+         && std::isdigit(static_cast<unsigned char>(str[pos]))) {
+    uint64_t num = 0;
+    while (pos < str.size()
+           && std::isdigit(static_cast<unsigned char>(str[pos]))) {
+      num = num * 10 + static_cast<uint64_t>(str[pos] - '0');
+      ++pos;
+    }
+    nums[numIdx++] = num;
+    if (pos < str.size() && str[pos] == '.') {
+      ++pos;
+    } else {
+      break;
+    }
+  }
+  if (numIdx == 0) {
+    return std::nullopt;
+  }
+
+  Version version;
+  version.major = nums[0];
+  version.minor = nums[1];
+  version.patch = nums[2];
+  return version;
+}
+
+static std::vector<fs::path> splitSearchPath(const char* env) {
+  std::vector<fs::path> dirs;
+  if (env == nullptr) {
+    return dirs;
+  }
+  for (const std::string_view dir :
+       std::string_view(env) | std::views::split(':')
+           | std::views::transform([](auto&& rng) {
+               return std::string_view(rng.begin(), rng.end());
+             })) {
+    if (!dir.empty()) {
+      dirs.emplace_back(dir);
+    }
+  }
+  return dirs;
+}
+
+// Variables like the default search path are compiled into pkg-config; ask
+// it once and remember the answer with the rest of the toolchain.
+static std::string getPkgConfigVariable(const std::string_view name,
+                                        const std::string_view fallback) {
+  ToolchainCache& toolchain = ToolchainCache::instance();
+  if (!toolchain.findTool("pkg-config").has_value()) {
+    return std::string(fallback);
+  }
+
+  const std::string value =
+      toolchain
+          .probe("pkg-config", name,
+                 [name]() -> Result<std::string> {
+                   const std::string output = Try(getCmdOutput(
+                       Command("pkg-config")
+                           .addArg("--variable")
+                           .addArg(name)
+                           .addArg("pkg-config"),
+                       RetryPolicy::Never));
+                   return Ok(std::string(trim(output)));
+                 })
+          .unwrap_or(std::string());
+  return value.empty() ? std::string(fallback) : value;
+}
+
+// The environment variables that change what pkg-config resolves, with the
+// values they have.  The resolver reads them from here rather than from the
+// process environment.
+using PkgConfigEnv = std::unordered_map<std::string, std::string>;
+
+static constexpr std::array<const char*, 7> PKG_CONFIG_ENV_VARS{
+  "PKG_CONFIG_PATH",
+  "PKG_CONFIG_LIBDIR",
+  "PKG_CONFIG_SYSROOT_DIR",
+  "PKG_CONFIG_ALLOW_SYSTEM_CFLAGS",
+  "PKG_CONFIG_ALLOW_SYSTEM_LIBS",
+  "PKG_CONFIG_SYSTEM_INCLUDE_PATH",
+  "PKG_CONFIG_SYSTEM_LIBRARY_PATH",
+};
+
+static PkgConfigEnv readPkgConfigEnv() {
+  PkgConfigEnv env;
+  for (const char* name : PKG_CONFIG_ENV_VARS) {
+    if (const char* value = std::getenv(name)) {
+      env.emplace(name, value);
+    }
+  }
+  return env;
+}
+
+// Identifies `env` in the cache.
+static std::string formatPkgConfigEnv(const PkgConfigEnv& env) {
+  std::string str;
+  for (const char* name : PKG_CONFIG_ENV_VARS) {
+    if (const auto it = env.find(name); it != env.end()) {
+      str += fmt::format("{}={}\n", name, it->second);
+    }
+  }
+  return str;
+}
+
+static const char* lookupEnv(const PkgConfigEnv& env, const char* name) {
+  const auto it = env.find(name);
+  return it != env.end() ? it->second.c_str() : nullptr;
+}
+
+static std::vector<fs::path> getSearchPath(const PkgConfigEnv& env) {
+  std::vector<fs::path> searchPath =
+      splitSearchPath(lookupEnv(env, "PKG_CONFIG_PATH"));
+
+  std::string defaultPath;
+  if (const char* libDir = lookupEnv(env, "PKG_CONFIG_LIBDIR")) {
+    defaultPath = libDir;
+  } else {
+    defaultPath = getPkgConfigVariable(
+        "pc_path", "/usr/local/lib/pkgconfig:/usr/local/share/pkgconfig:"
+                   "/usr/lib/pkgconfig:/usr/share/pkgconfig");
+  }
+
+  const std::vector<fs::path> defaultDirs =
+      splitSearchPath(defaultPath.c_str());
+  searchPath.insert(searchPath.end(), defaultDirs.begin(), defaultDirs.end());
+  return searchPath;
+}
+
+struct ResolvedPkg {
+  std::vector<std::string> cflags;
+  std::vector<std::string> libs;
+  std::vector<fs::path> files;
+};
+
+class PkgConfigResolver {
+  std::vector<fs::path> searchPath;
+  std::unordered_map<std::string, std::optional<PkgConfigFile>> loaded;
+
+  std::unordered_set<std::string> systemIncludeDirs;
+  std::unordered_set<std::string> systemLibDirs;
+  std::string sysroot;
+
+public:
+  PkgConfigResolver(std::vector<fs::path> searchPath, const PkgConfigEnv& env)
+      : searchPath(std::move(searchPath)) {
+    if (const char* dir = lookupEnv(env, "PKG_CONFIG_SYSROOT_DIR")) {
+      sysroot = dir;
+      while (sysroot.size() > 1 && sysroot.back() == '/') {
+        sysroot.pop_back();
+      }
+    }
+    // Like pkg-config, drop flags pointing to directories the compiler
+    // searches anyway; `-isystem /usr/include` would break #include_next.
+    if (lookupEnv(env, "PKG_CONFIG_ALLOW_SYSTEM_CFLAGS") == nullptr) {
+      const char* path = lookupEnv(env, "PKG_CONFIG_SYSTEM_INCLUDE_PATH");
+      const std::string dirs =
+          path != nullptr
+              ? path
+              : getPkgConfigVariable("pc_system_includedirs", "/usr/include");
+      for (const fs::path& dir : splitSearchPath(dirs.c_str())) {
+        systemIncludeDirs.insert(dir.lexically_normal().string());
+      }
+    }
+    if (lookupEnv(env, "PKG_CONFIG_ALLOW_SYSTEM_LIBS") == nullptr) {
+      const char* path = lookupEnv(env, "PKG_CONFIG_SYSTEM_LIBRARY_PATH");
+      const std::string dirs =
+          path != nullptr ? path
+                          : getPkgConfigVariable("pc_system_libdirs",
+                                                 "/usr/lib:/lib:/usr/lib64:"
+                                                 "/lib64");
+      for (const fs::path& dir : splitSearchPath(dirs.c_str())) {
+        systemLibDirs.insert(dir.lexically_normal().string());
+      }
+    }
+  }
+
+  Result<const PkgConfigFile*> find(const std::string& name) {
+    if (const auto it = loaded.find(name); it != loaded.end()) {
+      Ensure(it->second.has_value(), "{}.pc was not found", name);
+      return Ok(&it->second.value());
+    }
+
+    for (const fs::path& dir : searchPath) {
+      const fs::path pcPath = dir / (name + ".pc");
+      if (fs::is_regular_file(pcPath)) {
+        PkgConfigFile pcFile = Try(PkgConfigFile::parse(pcPath));
+        const auto [it, inserted] = loaded.emplace(name, std::move(pcFile));
+        return Ok(&it->second.value());
+      }
+    }
+    loaded.emplace(name, std::nullopt);
+    Bail("{}.pc was not found", name);
+  }
+
+  Result<ResolvedPkg> resolve(const SystemDependency& dep) {
+    const PkgConfigFile& pcFile = *Try(find(dep.name));
+    const std::string versionStr = Try(pcFile.get("Version"));
+    const std::optional<Version> version = parseLenientVersion(versionStr);
+    Ensure(version.has_value(), "{}: unsupported version `{}`",
+           pcFile.path.string(), versionStr);
+    Ensure(dep.versionReq.satisfiedBy(version.value()),
+           "{} {} does not satisfy {}", dep.name, versionStr,
+           dep.versionReq.toString());
+
+    ResolvedPkg resolved;
+    std::unordered_set<std::string> visited;
+    Try(collect(dep.name, /*publicOnly=*/false, visited, resolved.cflags,
+                resolved.files, "Cflags"));
+    visited.clear();
+    std::vector<fs::path> libFiles;
+    Try(collect(dep.name, /*publicOnly=*/true, visited, resolved.libs,
+                libFiles, "Libs"));
+
+    // Like pkg-config, a library that several packages link comes after
+    // all of them.
+    removeDuplicateFlags(resolved.cflags, /*keepLast=*/false);
+    removeDuplicateFlags(resolved.libs, /*keepLast=*/true);
+    filterSystemDirs(resolved.cflags, "-I", systemIncludeDirs);
+    filterSystemDirs(resolved.libs, "-L", systemLibDirs);
+    prefixSysroot(resolved.cflags, "-I", sysroot);
+    prefixSysroot(resolved.libs, "-L", sysroot);
+    return Ok(std::move(resolved));
+  }
+
+private:
+  // Collect `field` of `name` and of what it requires.  Cflags follow both
+  // Requires and Requires.private, while Libs follow only Requires as we
+  // don't link statically.
+  Result<void> collect( // NOLINT(misc-no-recursion)
+      const std::string& name, const bool publicOnly,
+      std::unordered_set<std::string>& visited, std::vector<std::string>& flags,
+      std::vector<fs::path>& files, const std::string_view field) {
+    if (!visited.insert(name).second) {
+      return Ok();
+    }
+
+    const PkgConfigFile& pcFile = *Try(find(name));
+    files.push_back(pcFile.path);
+    std::vector<std::string> fieldFlags =
+        splitPkgConfigFlags(Try(pcFile.get(field)));
+    flags.insert(flags.end(), std::make_move_iterator(fieldFlags.begin()),
+                 std::make_move_iterator(fieldFlags.end()));
+
+    std::vector<PkgRequirement> reqs =
+        Try(parseRequires(Try(pcFile.get("Requires"))));
+    if (!publicOnly) {
+      std::vector<PkgRequirement> privateReqs =
+          Try(parseRequires(Try(pcFile.get("Requires.private"))));
+      reqs.insert(reqs.end(), std::make_move_iterator(privateReqs.begin()),
+                  std::make_move_iterator(privateReqs.end()));
+    }
+    for (const PkgRequirement& req : reqs) {
+      const PkgConfigFile& reqFile = *Try(find(req.name));
+      const std::string reqVersion = Try(reqFile.get("Version"));
+      Ensure(req.satisfiedBy(reqVersion),
+             "{} requires {} {} {} but found {}", name, req.name, req.op,
+             req.version, reqVersion);
+      Try(collect(req.name, publicOnly, visited, flags, files, field));
+    }
+    return Ok();
+  }
+
+  // Removes repeated flags, keeping the first or last occurrence.  A flag
+  // taking its argument as the next token, like `-framework Foo`, counts as
+  // one with its argument.
+  static void removeDuplicateFlags(std::vector<std::string>& flags,
+                                   const bool keepLast) {
+    static const std::unordered_set<std::string_view> flagsWithArg{
+      "-framework", "-weak_framework", "-isystem", "-idirafter",
+      "-iquote",    "-include",        "-Xlinker", "-arch",
+    };
+    std::vector<std::vector<std::string>> groups;
+    for (std::size_t i = 0; i < flags.size(); ++i) {
+      std::vector<std::string> group{ std::move(flags[i]) };
+      if (flagsWithArg.contains(group.front()) && i + 1 < flags.size()) {
+        group.push_back(std::move(flags[++i]));
+      }
+      groups.push_back(std::move(group));
+    }
+    if (keepLast) {
+      std::ranges::reverse(groups);
+    }
+    std::set<std::vector<std::string>> seen;
+    std::erase_if(groups, [&](const std::vector<std::string>& group) {
+      return !seen.insert(group).second;
+    });
+    if (keepLast) {
+      std::ranges::reverse(groups);
+    }
+
+    flags.clear();
+    for (std::vector<std::string>& group : groups) {
+      flags.insert(flags.end(), std::make_move_iterator(group.begin()),
+                   std::make_move_iterator(group.end()));
+    }
+  }
+
+  static void filterSystemDirs(std::vector<std::string>& flags,
+                               const std::string_view prefix,
+                               const std::unordered_set<std::string>& dirs) {
+    std::erase_if(flags, [&](const std::string& flag) {
+      return flag.starts_with(prefix)
+             && dirs.contains(fs::path(flag.substr(prefix.size()))
+                                  .lexically_normal()
+                                  .string());
+    });
+  }
+
+  // Like pkg-config, point the directories of a cross build into
+  // PKG_CONFIG_SYSROOT_DIR.  System directories were already dropped by
+  // their host path.
+  static void prefixSysroot(std::vector<std::string>& flags,
+                            const std::string_view prefix,
+                            const std::string_view sysroot) {
+    if (sysroot.empty() || sysroot == "/") {
+      return;
+    }
+    const std::string sysrootDir = fmt::format("{}/", sysroot);
+    for (std::string& flag : flags) {
+      if (!flag.starts_with(prefix)) {
+        continue;
+      }
+      const std::string dir = flag.substr(prefix.size());
+      if (dir.starts_with('/') && !(dir + '/').starts_with(sysrootDir)) {
+        flag = fmt::format("{}{}{}", prefix, sysroot, dir);
+      }
+    }
+  }
+};
+
+static std::int64_t getMtime(const fs::path& path) {
+  std::error_code ec;
+  const fs::file_time_type mtime = fs::last_write_time(path, ec);
+  if (ec) {
+    return -1;
+  }
+  return static_cast<std::int64_t>(mtime.time_since_epoch().count());
+}
+
+static std::optional<ResolvedPkg> lookupCache(const nlohmann::json& cache,
+                                              const std::string& key,
+                                              const std::string& env) {
+  try {
+    if (!cache.contains(key)) {
+      return std::nullopt;
+    }
+    const nlohmann::json& entry = cache.at(key);
+    if (entry.at("env").get<std::string>() != env) {
+      return std::nullopt;
+    }
+
+    ResolvedPkg resolved;
+    for (const auto& item : entry.at("files").items()) {
+      if (getMtime(item.key()) != item.value().get<std::int64_t>()) {
+        return std::nullopt;
+      }
+      resolved.files.emplace_back(item.key());
+    }
+    resolved.cflags = entry.at("cflags").get<std::vector<std::string>>();
+    resolved.libs = entry.at("libs").get<std::vector<std::string>>();
+    return resolved;
+  } catch (const std::exception& e) {
+    spdlog::debug("Ignoring corrupted pkg-config cache entry: {}", e.what());
+    return std::nullopt;
+  }
+}
+
+static void writeCache(const fs::path& cacheDir, const nlohmann::json& cache) {
+  std::error_code ec;
+  fs::create_directories(cacheDir, ec);
+  const fs::path cachePath = cacheDir / CACHE_FILE_NAME;
+  const Result<void> res =
+      writeFileAtomically(cachePath, cache.dump(2) + '\n');
+  if (res.is_err()) {
+    spdlog::debug("{}", res.unwrap_err()->what());
+  }
+}
+
+Result<std::vector<CompilerOpts>>
+resolveSystemDeps(const std::span<const SystemDependency> deps,
+                  const fs::path& cacheDir) {
+  std::vector<CompilerOpts> results;
+  if (deps.empty()) {
+    return Ok(results);
+  }
+
+  nlohmann::json cache = nlohmann::json::object();
+  if (std::ifstream ifs(cacheDir / CACHE_FILE_NAME); ifs) {
+    try {
+      cache = nlohmann::json::parse(ifs);
+    } catch (const std::exception& e) {
+      spdlog::debug("Ignoring corrupted pkg-config cache: {}", e.what());
+    }
+  }
+
+  const PkgConfigEnv pkgConfigEnv = readPkgConfigEnv();
+  const std::string env = formatPkgConfigEnv(pkgConfigEnv);
+  std::optional<PkgConfigResolver> resolver;
+  bool cacheUpdated = false;
+  for (const SystemDependency& dep : deps) {
+    const std::string key = dep.versionReq.toPkgConfigString(dep.name);
+    std::optional<ResolvedPkg> resolved = lookupCache(cache, key, env);
+    if (resolved.has_value()) {
+      spdlog::trace("Using cached pkg-config result for `{}`", key);
+    } else {
+      if (!resolver.has_value()) {
+        resolver.emplace(getSearchPath(pkgConfigEnv), pkgConfigEnv);
+      }
+
+      auto native = resolver->resolve(dep);
+      if (native.is_err()) {
+        spdlog::debug("Falling back to pkg-config for `{}`: {}", key,
+                      native.unwrap_err()->what());
+        results.emplace_back(
+            Try(CompilerOpts::parsePkgConfig(dep.versionReq, dep.name)));
+        continue;
+      }
+      resolved = std::move(native.unwrap());
+
+      nlohmann::json files = nlohmann::json::object();
+      for (const fs::path& file : resolved->files) {
+        files[file.string()] = getMtime(file);
+      }
+      cache[key] = { { "env", env },
+                     { "files", std::move(files) },
+                     { "cflags", resolved->cflags },
+                     { "libs", resolved->libs } };
+      cacheUpdated = true;
+    }
+
+    results.emplace_back(CFlags::fromFlags(resolved->cflags),
+                         LdFlags::fromFlags(resolved->libs));
+  }
+
+  if (cacheUpdated) {
+    writeCache(cacheDir, cache);
+  }
+  return Ok(results);
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <fmt/ranges.h>
+#  include <unistd.h>
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testSplitPkgConfigFlags) {
+  assertEq(splitPkgConfigFlags("-I/usr/include/foo  -DFOO=1 "),
+           std::vector<std::string>{ "-I/usr/include/foo", "-DFOO=1" });
+  assertEq(splitPkgConfigFlags(R"(-I/opt/my\ dir -DMSG="hello world")"),
+           std::vector<std::string>{ "-I/opt/my dir", "-DMSG=hello world" });
+  assertEq(splitPkgConfigFlags(R"(-DEMPTY='' '-I/a b')"),
+           std::vector<std::string>{ "-DEMPTY=", "-I/a b" });
+  assertEq(splitPkgConfigFlags(""), std::vector<std::string>{});
+
+  pass();
+}
+
+CABIN_TEST_CASE(testComparePkgVersions) {
+  assertEq(comparePkgVersions("1.2.3", "1.2.3"), 0);
+  assertEq(comparePkgVersions("1.10", "1.9"), 1);
+  assertEq(comparePkgVersions("1.2", "1.2.1"), -1);
+  assertEq(comparePkgVersions("2021.8.0", "2021.10.0"), -1);
+  assertEq(comparePkgVersions("1.0a", "1.0"), 1);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseRequires) {
+  const auto reqs = parseRequires("glib-2.0 >= 2.50, gobject-2.0 zlib<2")
+                        .unwrap();
+  assertEq(reqs.size(), 3UL);
+  assertEq(reqs[0].name, "glib-2.0");
+  assertEq(reqs[0].op, ">=");
+  assertEq(reqs[0].version, "2.50");
+  assertEq(reqs[1].name, "gobject-2.0");
+  assertTrue(reqs[1].op.empty());
+  assertEq(reqs[2].name, "zlib");
+  assertEq(reqs[2].op, "<");
+  assertEq(reqs[2].version, "2");
+
+  assertTrue(reqs[0].satisfiedBy("2.72.4"));
+  assertFalse(reqs[0].satisfiedBy("2.48"));
+
+  assertTrue(parseRequires(">= 1.0").is_err());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParsePkgConfigFile) {
+  const fs::path dir =
+      fs::temp_directory_path() / fmt::format("cabin-test-pc-{}", getpid());
+  fs::create_directories(dir);
+  {
+    std::ofstream ofs(dir / "foo.pc");
+    ofs << "# comment\n"
+           "prefix=/opt/foo\n"
+           "includedir=${prefix}/include # trailing comment\n"
+           "libdir=${prefix}/lib\n"
+           "\n"
+           "Name: foo\n"
+           "Version: 1.2\n"
+           "CFlags: -I${includedir} \\\n"
+           "  -DFOO_PRICE=$$5\n"
+           "Libs: -L${libdir} -lfoo\n";
+  }
+
+  const PkgConfigFile pcFile = PkgConfigFile::parse(dir / "foo.pc").unwrap();
+  assertEq(pcFile.get("Version").unwrap(), "1.2");
+  assertEq(pcFile.get("Cflags").unwrap(),
+           "-I/opt/foo/include   -DFOO_PRICE=$5");
+  assertEq(pcFile.get("Libs").unwrap(), "-L/opt/foo/lib -lfoo");
+  assertEq(pcFile.get("Requires").unwrap(), "");
+  assertEq(pcFile.expand("${pcfiledir}").unwrap(), dir.string());
+  assertTrue(pcFile.expand("${undefined}").is_err());
+
+  fs::remove_all(dir);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testResolveWithSysroot) {
+  const fs::path dir = fs::temp_directory_path()
+                       / fmt::format("cabin-test-sysroot-{}", getpid());
+  fs::create_directories(dir);
+  {
+    std::ofstream ofs(dir / "bar.pc");
+    ofs << "prefix=/usr\n"
+           "Name: bar\n"
+           "Version: 2.0\n"
+           "Cflags: -I${prefix}/include -I${prefix}/include/bar -DBAR\n"
+           "Libs: -L${prefix}/lib -L/sysroot/opt/lib -lbar\n";
+  }
+
+  PkgConfigResolver resolver(
+      { dir }, { { "PKG_CONFIG_SYSROOT_DIR", "/sysroot/" },
+                 { "PKG_CONFIG_SYSTEM_INCLUDE_PATH", "/usr/include" },
+                 { "PKG_CONFIG_SYSTEM_LIBRARY_PATH", "/usr/lib" } });
+  const ResolvedPkg resolved =
+      resolver
+          .resolve(SystemDependency("bar", VersionReq::parse(">=2").unwrap()))
+          .unwrap();
+
+  assertEq(resolved.cflags,
+           std::vector<std::string>{ "-I/sysroot/usr/include/bar", "-DBAR" });
+  assertEq(resolved.libs, std::vector<std::string>{ "-L/sysroot/opt/lib",
+                                                    "-lbar" });
+
+  fs::remove_all(dir);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testResolveRemovesDuplicateFlags) {
+  const fs::path dir = fs::temp_directory_path()
+                       / fmt::format("cabin-test-pc-dups-{}", getpid());
+  fs::create_directories(dir);
+  {
+    std::ofstream ofs(dir / "app.pc");
+    ofs << "Name: app\n"
+           "Version: 1.0\n"
+           "Requires: base\n"
+           "Cflags: -I/opt/include -DAPP\n"
+           "Libs: -L/opt/lib -lapp -lbase -framework Foo\n";
+  }
+  {
+    std::ofstream ofs(dir / "base.pc");
+    ofs << "Name: base\n"
+           "Version: 1.0\n"
+           "Cflags: -I/opt/include -DBASE\n"
+           "Libs: -L/opt/lib -lbase -framework Bar\n";
+  }
+
+  PkgConfigResolver resolver(
+      { dir }, { { "PKG_CONFIG_SYSTEM_INCLUDE_PATH", "/usr/include" },
+                 { "PKG_CONFIG_SYSTEM_LIBRARY_PATH", "/usr/lib" } });
+  const ResolvedPkg resolved =
+      resolver
+          .resolve(SystemDependency("app", VersionReq::parse(">=1").unwrap()))
+          .unwrap();
+
+  assertEq(resolved.cflags,
+           std::vector<std::string>{ "-I/opt/include", "-DAPP", "-DBASE" });
+  assertEq(resolved.libs,
+           std::vector<std::string>{ "-lapp", "-framework", "Foo",
+                                     "-L/opt/lib", "-lbase", "-framework",
+                                     "Bar" });
+
+  fs::remove_all(dir);
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Builder/Compiler.hpp"
+#include "Dependency.hpp"
+#include "Rustify/Result.hpp"
+
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// Split a list of flags the way pkg-config does: on whitespace, keeping
+// quoted strings together and honoring backslash escapes.
+std::vector<std::string> splitPkgConfigFlags(std::string_view str);
+
+struct PkgConfigFile {
+  fs::path path;
+  std::unordered_map<std::string, std::string> variables;
+  // Keyword fields, e.g., Version, Cflags, Libs, or Requires.
+  std::unordered_map<std::string, std::string> fields;
+
+  static Result<PkgConfigFile> parse(const fs::path& path);
+
+  // Returns the field with all ${variable} references expanded, or an empty
+  // string if the field is missing.
+  Result<std::string> get(std::string_view field) const;
+  Result<std::string> expand(std::string_view value) const;
+};
+
+// Resolves the compiler options of all the system dependencies at once by
+// reading .pc files directly.  Results are cached in `cacheDir` and
+// invalidated when any of the .pc files they were read from changes.
+// Dependencies that can't be resolved natively fall back to running
+// pkg-config.  The returned vector is in the same order as `deps`.
+Result<std::vector<CompilerOpts>>
+resolveSystemDeps(std::span<const SystemDependency> deps,
+                  const fs::path& cacheDir);
+
+} // namespace cabin
@@ -7,6 +7,7 @@
 #include "TermColor.hpp"
 
 #include <filesystem>
+#include <optional>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <unordered_map>
@@ -76,11 +77,19 @@ static std::vector<std::string> getEnvFlags(const char* name) {
 }
 
 Project::Project(const BuildProfile& buildProfile, Manifest m,
-                 CompilerOpts opts)
+                 CompilerOpts opts,
+                 const std::optional<fs::path>& workspaceOutDir)
     : rootPath(m.path.parent_path()),
-      outBasePath(rootPath / "cabin-out" / fmt::format("{}", buildProfile)),
+      outBasePath(workspaceOutDir.value_or(
+          rootPath / "cabin-out" / fmt::format("{}", buildProfile))),
       buildOutPath(outBasePath / (m.package.name + ".d")),
-      unittestOutPath(outBasePath / "unittests"), manifest(std::move(m)),
+      unittestOutPath(workspaceOutDir.has_value()
+                          ? outBasePath / "unittests" / m.package.name
+                          : outBasePath / "unittests"),
+      benchOutPath(workspaceOutDir.has_value()
+                       ? outBasePath / "benches" / m.package.name
+                       : outBasePath / "benches"),
+      manifest(std::move(m)),
       compilerOpts(std::move(opts)) //
 {
   includeIfExist(rootPath / "src", /*isSystem=*/false);
@@ -105,6 +114,16 @@ Project::Project(const BuildProfile& buildProfile, Manifest m,
     compilerOpts.cFlags.others.emplace_back("-flto");
     compilerOpts.ldFlags.others.emplace_back("-flto");
   }
+  if (buildProfile == BuildProfile::Profiling) {
+    // Profiles need symbols for inlined frames too, but should measure the
+    // code that ships, so the DEBUG/NDEBUG macros stay those of release.
+    if (!profile.debug) {
+      compilerOpts.cFlags.others.emplace_back("-g");
+    }
+    // Lets perf walk the stacks with frame pointers instead of copying them
+    // out for DWARF unwinding.
+    compilerOpts.cFlags.others.emplace_back("-fno-omit-frame-pointer");
+  }
   for (const std::string& flag : profile.cxxflags) {
     compilerOpts.cFlags.others.emplace_back(flag);
   }
@@ -191,6 +210,12 @@ Result<Project> Project::init(const BuildProfile& buildProfile,
   return Ok(Project(buildProfile, manifest, CompilerOpts()));
 }
 
+Result<Project> Project::init(const BuildProfile& buildProfile,
+                              const Manifest& manifest,
+                              const fs::path& workspaceOutDir) {
+  return Ok(Project(buildProfile, manifest, CompilerOpts(), workspaceOutDir));
+}
+
 } // namespace cabin
 
 #ifdef CABIN_TEST
@@ -201,7 +226,7 @@ namespace tests {
 
 using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
 
-static void testParseEnvFlags() {
+CABIN_TEST_CASE(testParseEnvFlags) {
   std::vector<std::string> argsNoEscape = parseEnvFlags(" a   b c ");
   // NOLINTNEXTLINE(*-magic-numbers)
   assertEq(argsNoEscape.size(), static_cast<std::size_t>(3));
@@ -242,6 +267,8 @@ mixEverything" abc "\?\#   )-");
 
 } // namespace tests
 
-int main() { tests::testParseEnvFlags(); }
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
 
 #endif
@@ -6,6 +6,7 @@
 #include "Rustify/Result.hpp"
 
 #include <filesystem>
+#include <optional>
 
 namespace cabin {
 
@@ -13,7 +14,8 @@ namespace fs = std::filesystem;
 
 class Project {
   Project(const BuildProfile& buildProfile, Manifest manifest,
-          CompilerOpts compilerOpts);
+          CompilerOpts compilerOpts,
+          const std::optional<fs::path>& workspaceOutDir = std::nullopt);
 
   void includeIfExist(const fs::path& path, bool isSystem = false);
 
@@ -22,6 +24,7 @@ public:
   const fs::path outBasePath;
   const fs::path buildOutPath;
   const fs::path unittestOutPath;
+  const fs::path benchOutPath;
   const Manifest manifest;
   CompilerOpts compilerOpts;
 
@@ -30,6 +33,12 @@ public:
 
   static Result<Project> init(const BuildProfile& buildProfile,
                               const Manifest& manifest);
+
+  // Members of a workspace share its output directory.  Their objects are
+  // already kept apart by package name, and so are their unit tests.
+  static Result<Project> init(const BuildProfile& buildProfile,
+                              const Manifest& manifest,
+                              const fs::path& workspaceOutDir);
 };
 
 } // namespace cabin
@@ -0,0 +1,179 @@
+#include "Toolchain.hpp"
+
+#include "Algos.hpp"
+#include "Rustify/Result.hpp"
+
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <system_error>
+#include <utility>
+
+namespace cabin {
+
+static std::string getEnvOrEmpty(const char* name) {
+  if (const char* env = std::getenv(name)) {
+    return env;
+  }
+  return "";
+}
+
+std::optional<ToolchainCache::ToolFingerprint>
+ToolchainCache::ToolFingerprint::of(const fs::path& path) noexcept {
+  struct stat st {};
+  if (stat(path.c_str(), &st) != 0) {
+    return std::nullopt;
+  }
+
+  std::error_code ec;
+  const fs::file_time_type mtime = fs::last_write_time(path, ec);
+  if (ec) {
+    return std::nullopt;
+  }
+  return ToolFingerprint{ .path = path,
+                          .inode = static_cast<std::uintmax_t>(st.st_ino),
+                          .mtime = static_cast<std::int64_t>(
+                              mtime.time_since_epoch().count()) };
+}
+
+ToolchainCache& ToolchainCache::instance() noexcept {
+  static ToolchainCache instance;
+  return instance;
+}
+
+void ToolchainCache::clear() noexcept {
+  tools.clear();
+  probes.clear();
+}
+
+void ToolchainCache::load(const fs::path& cacheDir) noexcept {
+  const std::lock_guard lock(mtx);
+  this->cacheDir = cacheDir;
+
+  std::ifstream ifs(cacheDir / FILE_NAME);
+  if (!ifs) {
+    return;
+  }
+
+  try {
+    const nlohmann::json json = nlohmann::json::parse(ifs);
+    if (json.at("cxx").get<std::string>() != getEnvOrEmpty("CXX")
+        || json.at("path").get<std::string>() != getEnvOrEmpty("PATH")) {
+      spdlog::debug("Toolchain cache is stale: $CXX or $PATH changed");
+      dirty = true;
+      return;
+    }
+
+    std::map<std::string, ToolFingerprint, std::less<>> loadedTools;
+    for (const auto& item : json.at("tools").items()) {
+      const nlohmann::json& tool = item.value();
+      const ToolFingerprint recorded{
+        .path = tool.at("path").get<std::string>(),
+        .inode = tool.at("inode").get<std::uintmax_t>(),
+        .mtime = tool.at("mtime").get<std::int64_t>(),
+      };
+      if (ToolFingerprint::of(recorded.path) != recorded) {
+        spdlog::debug("Toolchain cache is stale: {} changed",
+                      recorded.path.string());
+        dirty = true;
+        return;
+      }
+      loadedTools.emplace(item.key(), recorded);
+    }
+
+    tools = std::move(loadedTools);
+    probes = json.at("probes")
+                 .get<std::map<std::string, std::map<std::string, std::string,
+                                                     std::less<>>,
+                               std::less<>>>();
+  } catch (const std::exception& e) {
+    spdlog::debug("Ignoring corrupted toolchain cache: {}", e.what());
+    clear();
+    dirty = true;
+  }
+}
+
+void ToolchainCache::save() const noexcept {
+  const std::lock_guard lock(mtx);
+  if (!dirty || cacheDir.empty()) {
+    return;
+  }
+
+  nlohmann::json json;
+  json["cxx"] = getEnvOrEmpty("CXX");
+  json["path"] = getEnvOrEmpty("PATH");
+  json["tools"] = nlohmann::json::object();
+  for (const auto& [name, tool] : tools) {
+    json["tools"][name] = { { "path", tool.path.string() },
+                            { "inode", tool.inode },
+                            { "mtime", tool.mtime } };
+  }
+  json["probes"] = probes;
+
+  // A concurrent reader never sees a half-written cache.
+  std::error_code ec;
+  fs::create_directories(cacheDir, ec);
+  const Result<void> res =
+      writeFileAtomically(cacheDir / FILE_NAME, json.dump(2) + '\n');
+  if (res.is_err()) {
+    spdlog::debug("Failed to write toolchain cache: {}",
+                  res.unwrap_err()->what());
+  }
+}
+
+std::optional<fs::path>
+ToolchainCache::findTool(const std::string_view name) noexcept {
+  {
+    const std::lock_guard lock(mtx);
+    if (const auto it = tools.find(name); it != tools.end()) {
+      return it->second.path;
+    }
+  }
+
+  const std::optional<fs::path> path = findExecutable(name);
+  if (!path.has_value()) {
+    return std::nullopt;
+  }
+
+  if (auto fingerprint = ToolFingerprint::of(path.value())) {
+    const std::lock_guard lock(mtx);
+    tools.insert_or_assign(std::string(name), std::move(fingerprint.value()));
+    dirty = true;
+  }
+  return path;
+}
+
+Result<std::string> ToolchainCache::probe(
+    const std::string_view tool, const std::string_view key,
+    const std::function<Result<std::string>()>& run) noexcept {
+  {
+    const std::lock_guard lock(mtx);
+    if (const auto toolIt = probes.find(tool); toolIt != probes.end()) {
+      if (const auto it = toolIt->second.find(key);
+          it != toolIt->second.end()) {
+        return Ok(it->second);
+      }
+    }
+  }
+
+  // The lock is not held while running the probe since probes may depend
+  // on each other, e.g., checking module support needs the compiler version.
+  std::string result = Try(run());
+
+  const std::lock_guard lock(mtx);
+  probes[std::string(tool)].insert_or_assign(std::string(key), result);
+  dirty = true;
+  return Ok(result);
+}
+
+} // namespace cabin
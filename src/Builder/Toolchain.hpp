@@ -0,0 +1,74 @@
+#pragma once
+
+#include "Rustify/Result.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// Probing the toolchain (resolving tools on PATH, asking the compiler for its
+// version or whether it accepts a flag) is cheap once but adds up when every
+// invocation repeats it.  The cache remembers the results in
+// `cabin-out/toolchain.json` and throws everything away as soon as $CXX,
+// $PATH, or the inode/mtime of any tool it resolved changes.
+class ToolchainCache {
+public:
+  static constexpr std::string_view FILE_NAME = "toolchain.json";
+
+  // ToolchainCache is a singleton
+  ToolchainCache(const ToolchainCache&) = delete;
+  ToolchainCache& operator=(const ToolchainCache&) = delete;
+  ToolchainCache(ToolchainCache&&) noexcept = delete;
+  ToolchainCache& operator=(ToolchainCache&&) noexcept = delete;
+  ~ToolchainCache() noexcept = default;
+
+  static ToolchainCache& instance() noexcept;
+
+  /// Load previously recorded probes from `cacheDir`.  Later calls to `save`
+  /// write back to the same directory.
+  void load(const fs::path& cacheDir) noexcept;
+  /// Persist the cache if a probe was recorded since it was loaded.
+  void save() const noexcept;
+
+  /// Resolve `name` on PATH, recording the tool's fingerprint.
+  std::optional<fs::path> findTool(std::string_view name) noexcept;
+
+  /// Return the recorded result of the probe `key` for `tool`, or `run` the
+  /// probe and record its result.  Failed probes are not recorded.
+  Result<std::string>
+  probe(std::string_view tool, std::string_view key,
+        const std::function<Result<std::string>()>& run) noexcept;
+
+private:
+  struct ToolFingerprint {
+    fs::path path;
+    std::uintmax_t inode = 0;
+    std::int64_t mtime = 0;
+
+    static std::optional<ToolFingerprint> of(const fs::path& path) noexcept;
+    bool operator==(const ToolFingerprint&) const = default;
+  };
+
+  mutable std::mutex mtx;
+  fs::path cacheDir;
+  bool dirty = false;
+  std::map<std::string, ToolFingerprint, std::less<>> tools;
+  std::map<std::string, std::map<std::string, std::string, std::less<>>,
+           std::less<>>
+      probes;
+
+  ToolchainCache() noexcept = default;
+
+  void clear() noexcept;
+};
+
+} // namespace cabin
@@ -2,6 +2,7 @@
 
 #include "Algos.hpp"
 #include "Diag.hpp"
+#include "Lockfile.hpp"
 #include "Rustify/Result.hpp"
 #include "TermColor.hpp"
 
@@ -368,6 +369,12 @@ Cli::handleGlobalOpts(std::forward_iterator auto& itr,
     Ensure(itr + 1 < end, "missing argument for `--color`");
     setColorMode(*++itr);
     return Ok(Continue);
+  } else if (arg == "--locked") {
+    setLocked(true);
+    return Ok(Continue);
+  } else if (arg == "--offline") {
+    setOffline(true);
+    return Ok(Continue);
   }
   return Ok(Fallthrough);
 }
@@ -731,7 +738,7 @@ namespace tests {
 
 using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
 
-static void testCliExpandOpts() {
+CABIN_TEST_CASE(testCliExpandOpts) {
   {
     const std::vector<const char*> args{ "-vvvj4" };
     const std::vector<std::string> expected{ "-vv", "-v", "-j", "4" };
@@ -829,10 +836,10 @@ For a list of commands, try 'cabin help')");
 
 } // namespace tests
 
-int main() {
+int main(int argc, char* argv[]) {
   cabin::setColorMode("never");
 
-  tests::testCliExpandOpts();
+  return tests::runTests(argc, argv);
 }
 
 #endif
@@ -1,7 +1,10 @@
 #pragma once
 
 #include "Cmd/Add.hpp"
+#include "Cmd/Asm.hpp"
+#include "Cmd/Bench.hpp"
 #include "Cmd/Build.hpp"
+#include "Cmd/Cache.hpp"
 #include "Cmd/Clean.hpp"
 #include "Cmd/Fmt.hpp"
 #include "Cmd/Help.hpp"
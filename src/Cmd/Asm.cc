@@ -0,0 +1,182 @@
+#include "Asm.hpp"
+
+#include "Algos.hpp"
+#include "AsmListing.hpp"
+#include "BuildConfig.hpp"
+#include "Builder/BuildProfile.hpp"
+#include "Cli.hpp"
+#include "Command.hpp"
+#include "Common.hpp"
+#include "Diag.hpp"
+#include "Manifest.hpp"
+#include "Rustify/Result.hpp"
+
+#include <cstddef>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+static Result<void> asmMain(CliArgsView args);
+
+const Subcmd ASM_CMD =
+    Subcmd{ "asm" }
+        .setDesc("Show the assembly generated for a source file")
+        .addOpt(OPT_RELEASE)
+        .addOpt(Opt{ "--emit-llvm" }.setDesc("Show LLVM IR instead (Clang)"))
+        .setArg(Arg{ "args" }
+                    .setDesc("A source file, then a symbol to show only the "
+                             "functions whose name contains it")
+                    .setVariadic(true))
+        .setMainFn(asmMain);
+
+// Compiles with `compileCmd` into the asm cache unless an earlier run with
+// the same flags is newer than every input, and returns the output.
+static Result<std::string>
+compileToAsm(const fs::path& cacheDir, Command compileCmd,
+             const std::vector<fs::path>& inputs, const bool emitLlvm,
+             const std::string_view sourceName) {
+  if (emitLlvm) {
+    compileCmd.addArg("-S").addArg("-emit-llvm");
+  } else {
+    // The debug info is what ties each instruction to its source line.
+    compileCmd.addArg("-S").addArg("-g");
+  }
+  const fs::path output =
+      cacheDir / fmt::format("{:016x}{}", fnv1aHash(compileCmd.toString()),
+                             emitLlvm ? ".ll" : ".s");
+
+  std::error_code ec;
+  bool upToDate = fs::exists(output, ec);
+  for (const fs::path& input : inputs) {
+    if (!upToDate) {
+      break;
+    }
+    upToDate = fs::last_write_time(input, ec) < fs::last_write_time(output);
+  }
+  if (!upToDate) {
+    fs::create_directories(cacheDir, ec);
+    Ensure(!ec, "failed to create {}: {}", cacheDir.string(), ec.message());
+
+    Diag::info("Compiling", "{}", sourceName);
+    const fs::path tmp = fs::path(output) += ".tmp";
+    compileCmd.addArg("-o").addArg(tmp.string());
+    Try(getCmdOutput(compileCmd, RetryPolicy::Never)
+            .with_context([&] {
+              return anyhow::anyhow("failed to compile {}{}", sourceName,
+                                    emitLlvm ? " (--emit-llvm needs Clang)"
+                                             : "");
+            }));
+    fs::rename(tmp, output, ec);
+    Ensure(!ec, "failed to write {}: {}", output.string(), ec.message());
+  }
+
+  std::ifstream ifs(output);
+  Ensure(ifs, "failed to read {}", output.string());
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  return Ok(oss.str());
+}
+
+static Result<void> asmMain(const CliArgsView args) {
+  // Parse args
+  BuildProfile buildProfile = BuildProfile::Dev;
+  bool emitLlvm = false;
+  std::vector<std::string_view> positionals;
+  for (auto itr = args.begin(); itr != args.end(); ++itr) {
+    const std::string_view arg = *itr;
+
+    const auto control = Try(Cli::handleGlobalOpts(itr, args.end(), "asm"));
+    if (control == Cli::Return) {
+      return Ok();
+    } else if (control == Cli::Continue) {
+      continue;
+    } else if (arg == "-r" || arg == "--release") {
+      buildProfile = BuildProfile::Release;
+    } else if (arg == "--emit-llvm") {
+      emitLlvm = true;
+    } else if (!arg.starts_with('-')) {
+      positionals.push_back(arg);
+    } else {
+      return ASM_CMD.noSuchArg(arg);
+    }
+  }
+  Ensure(!positionals.empty(), "a source file is required");
+  Ensure(positionals.size() <= 2, "unexpected argument: {}", positionals[2]);
+  const fs::path sourceFile = fs::absolute(positionals[0]);
+  const std::string symbol =
+      positionals.size() == 2 ? std::string(positionals[1]) : "";
+
+  const auto manifest = Try(Manifest::tryParse());
+  const fs::path projectRoot = manifest.path.parent_path();
+  const BuildConfig config = Try(
+      emitNinja(manifest, buildProfile, /*includeDevDeps=*/true));
+  BuildConfig::CompileCommand compileCmd =
+      Try(config.getCompileCommand(sourceFile));
+
+  const std::string output = Try(compileToAsm(
+      config.outBasePath / "asm", std::move(compileCmd.command),
+      compileCmd.inputs, emitLlvm,
+      fs::relative(sourceFile, projectRoot).string()));
+
+  AsmListing listing;
+  if (emitLlvm) {
+    listing = formatLlvmIr(output, symbol);
+  } else {
+    // Only the project's own lines are worth showing next to the assembly,
+    // not those of the standard library inlined into it.
+    const fs::path canonicalRoot = fs::weakly_canonical(projectRoot);
+    std::map<fs::path, std::vector<std::string>> files;
+    const SourceLookup lookup =
+        [&](const fs::path& file, const std::size_t line)
+        -> std::optional<std::pair<std::string, std::string>> {
+      std::error_code ec;
+      const fs::path path =
+          fs::weakly_canonical(config.outBasePath / file, ec);
+      const fs::path relPath = path.lexically_relative(canonicalRoot);
+      if (ec || relPath.empty() || *relPath.begin() == "..") {
+        return std::nullopt;
+      }
+      auto [it, inserted] = files.try_emplace(path);
+      if (inserted) {
+        std::ifstream ifs(path);
+        for (std::string text; std::getline(ifs, text);) {
+          it->second.push_back(std::move(text));
+        }
+      }
+      if (line == 0 || line > it->second.size()) {
+        return std::nullopt;
+      }
+      return std::pair{ relPath.string(), it->second[line - 1] };
+    };
+    listing = formatAsm(output, symbol, lookup);
+  }
+
+  if (listing.numShown == 0) {
+    if (listing.functions.size() > 10) {
+      listing.functions.resize(10);
+      listing.functions.emplace_back("...");
+    }
+    Ensure(!listing.functions.empty(), "{} defines no functions",
+           sourceFile.string());
+    Bail("no function matches `{}`; the functions are:\n  {}", symbol,
+         fmt::join(listing.functions, "\n  "));
+  }
+  std::cout << listing.text << std::flush;
+  return Ok();
+}
+
+} // namespace cabin
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Cli.hpp"
+
+namespace cabin {
+
+extern const Subcmd ASM_CMD;
+
+} // namespace cabin
@@ -0,0 +1,966 @@
+#include "Bench.hpp"
+
+#include "Algos.hpp"
+#include "BenchResult.hpp"
+#include "BuildConfig.hpp"
+#include "Builder/BuildProfile.hpp"
+#include "Cli.hpp"
+#include "Command.hpp"
+#include "Common.hpp"
+#include "Diag.hpp"
+#include "Git2.hpp"
+#include "Manifest.hpp"
+#include "Parallelism.hpp"
+#include "Rustify/PerfCounters.hpp"
+#include "Rustify/Result.hpp"
+#include "TermColor.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+namespace cabin {
+
+// One run of a benchmark binary.
+struct BenchRun {
+  // The samples the binary reported, if it uses bench::runBenches().
+  std::vector<BenchResult> reported;
+  // Nanoseconds the whole run took.
+  double elapsed = 0.0;
+  // Performance counts of the whole run, if recorded.
+  std::map<std::string, double> counters;
+};
+
+class Bench {
+  // The package to benchmark, or every member of a workspace.
+  std::vector<Manifest> packages;
+  std::optional<Workspace> workspace;
+  fs::path rootPath;
+  fs::path outDir;
+  // Hold the lock on the output directory from configuring until the
+  // benchmarks have run.
+  std::vector<BuildConfig> configs;
+  std::vector<std::string> benchTargets;
+  std::unordered_map<std::string, fs::path> benchSources;
+  // Substrings of the source paths or names of the benchmarks to run.
+  std::vector<std::string> filters;
+  // Compare the results with the baseline saved under this name.
+  std::optional<std::string> baseline;
+  std::string saveBaseline = "latest";
+  // Records performance counters when set.
+  perf::Counters* counters = nullptr;
+
+  explicit Bench(Manifest manifest)
+      : packages{ std::move(manifest) },
+        rootPath(packages.front().path.parent_path()) {}
+  explicit Bench(Workspace ws)
+      : packages(ws.members), workspace(std::move(ws)),
+        rootPath(workspace->rootPath) {}
+
+  std::string sourcePathOf(const std::string& target) const;
+  bool matchesFilters(const std::string& target) const;
+  Result<void> configure();
+  void warnNoBenchTargets() const;
+  Result<bool> needsBuild() const;
+  void printCompiling() const;
+  Command buildCommand() const;
+  Result<void> build() const;
+  void printFinished(std::chrono::steady_clock::time_point start) const;
+  Result<void> compileBenchTargets();
+  Result<BenchRun> runOnce(const std::string& target) const;
+  Result<void> runInTurns(const Bench& base, const std::string& target,
+                          std::size_t numRounds,
+                          std::vector<BenchRun>& baseRuns,
+                          std::vector<BenchRun>& currentRuns) const;
+  Result<std::vector<BenchResult>> runBenchTarget(const std::string& target);
+  Result<void> runBenchTargets();
+  Result<Bench> atRevision(const std::string& rev) const;
+  Result<void> compareWith(const std::string& rev);
+  Result<bool> isSlowerThan(const Bench& good, const std::string& target,
+                            const std::string& benchName,
+                            double threshold) const;
+  Result<void> bisect(const std::string& good, const std::string& bad,
+                      const std::string& benchName, double threshold);
+
+public:
+  static Result<void> exec(CliArgsView cliArgs);
+};
+
+const Subcmd BENCH_CMD = //
+    Subcmd{ "bench" }
+        .setDesc("Run the benchmarks of a local package")
+        .addOpt(OPT_JOBS)
+        .addOpt(Opt{ "--baseline" }
+                    .setDesc("Compare against the results saved under a name, "
+                             "and fail on significant regressions")
+                    .setPlaceholder("<NAME>"))
+        .addOpt(Opt{ "--save-baseline" }
+                    .setDesc("Save the results under a name")
+                    .setPlaceholder("<NAME>")
+                    .setDefault("latest"))
+        .addOpt(Opt{ "--compare" }
+                    .setDesc("Build the benchmarks at a git revision as well, "
+                             "and report the speedup of the working tree")
+                    .setPlaceholder("<REV>"))
+        .addOpt(Opt{ "--counters" }.setDesc(
+            "Record hardware performance counters as well, where available"))
+        .addOpt(Opt{ "--bisect" }
+                    .setDesc("Find the first commit in a range that made "
+                             "BENCHNAME slower than the threshold")
+                    .setPlaceholder("<GOOD>..<BAD>"))
+        .addOpt(Opt{ "--threshold" }
+                    .setDesc("Slowdown in percent that --bisect looks for")
+                    .setPlaceholder("<PERCENT>")
+                    .setDefault("5"))
+        .setArg(Arg{ "BENCHNAME" }
+                    .setDesc("Only build and run benchmarks whose source path "
+                             "or name contains one of these")
+                    .setVariadic(true)
+                    .setRequired(false))
+        .setMainFn(Bench::exec);
+
+// A benchmark binary that doesn't report its own samples is timed as a
+// whole, over this many runs.
+static constexpr std::size_t NUM_BINARY_SAMPLES = 10;
+// With --compare, a binary that reports its own samples runs this many times
+// on each side, alternating between the sides.
+static constexpr std::size_t NUM_REPORT_ROUNDS = 3;
+// With --bisect, a commit is run up to this many times as many times as with
+// --compare before falling back to comparing the medians.
+static constexpr std::size_t MAX_BISECT_BATCHES = 4;
+
+// How many times --compare runs a benchmark binary on each side.
+static std::size_t numRunsFor(const bool reported) {
+  // A binary timed as a whole needs a warm-up run on top of its samples.
+  return reported ? NUM_REPORT_ROUNDS : NUM_BINARY_SAMPLES + 1;
+}
+
+std::string Bench::sourcePathOf(const std::string& target) const {
+  return fs::relative(benchSources.at(target), rootPath).generic_string();
+}
+
+bool Bench::matchesFilters(const std::string& target) const {
+  if (filters.empty()) {
+    return true;
+  }
+  const std::string sourcePath = sourcePathOf(target);
+  return std::ranges::any_of(filters, [&](const std::string& filter) {
+    return sourcePath.find(filter) != std::string::npos
+           || target.find(filter) != std::string::npos;
+  });
+}
+
+// Emits the build files and selects the benchmarks to run, without building
+// them.
+Result<void> Bench::configure() {
+  const BuildProfile buildProfile = BuildProfile::Bench;
+  configs.clear();
+  if (workspace.has_value()) {
+    configs = Try(emitWorkspaceNinja(workspace.value(), buildProfile,
+                                     /*includeDevDeps=*/true,
+                                     /*enableCoverage=*/false));
+  } else {
+    configs.push_back(Try(emitNinja(packages.front(), buildProfile,
+                                    /*includeDevDeps=*/true,
+                                    /*enableCoverage=*/false)));
+  }
+  outDir = configs.front().outBasePath;
+
+  for (const BuildConfig& config : configs) {
+    // Under the bench profile, the test targets are the benchmarks.
+    for (const std::string& target : config.getTestTargets()) {
+      benchSources.emplace(target, config.getTestSource(target));
+      if (matchesFilters(target)) {
+        benchTargets.push_back(target);
+      }
+    }
+  }
+  return Ok();
+}
+
+void Bench::warnNoBenchTargets() const {
+  if (benchSources.empty()) {
+    Diag::warn("No benchmark targets found");
+  } else {
+    Diag::warn("No benchmark targets match {}", fmt::join(filters, ", "));
+  }
+}
+
+Result<bool> Bench::needsBuild() const {
+  if (benchTargets.empty()) {
+    return Ok(false);
+  }
+  return ninjaNeedsWork(outDir, benchTargets);
+}
+
+void Bench::printCompiling() const {
+  for (const Manifest& manifest : packages) {
+    Diag::info("Compiling", "{} v{} ({})", manifest.package.name,
+               manifest.package.version.toString(),
+               manifest.path.parent_path().string());
+  }
+}
+
+Command Bench::buildCommand() const {
+  Command buildCmd = getNinjaCommand();
+  buildCmd.addArg("-C").addArg(outDir.string());
+  for (const std::string& target : benchTargets) {
+    buildCmd.addArg(target);
+  }
+  return buildCmd;
+}
+
+void Bench::printFinished(
+    const std::chrono::steady_clock::time_point start) const {
+  const auto end = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> elapsed = end - start;
+
+  const BuildProfile buildProfile = BuildProfile::Bench;
+  const Profile& profile = packages.front().profiles.at(buildProfile);
+  Diag::info("Finished", "`{}` profile [{}] target(s) in {:.2f}s", buildProfile,
+             profile, elapsed.count());
+}
+
+Result<void> Bench::build() const {
+  if (Try(needsBuild())) {
+    printCompiling();
+    const ExitStatus exitStatus = Try(execCmd(buildCommand()));
+    Ensure(exitStatus.success(), "compilation failed");
+  }
+  return Ok();
+}
+
+Result<void> Bench::compileBenchTargets() {
+  const auto start = std::chrono::steady_clock::now();
+
+  Try(configure());
+  if (benchTargets.empty()) {
+    warnNoBenchTargets();
+    return Ok();
+  }
+
+  Try(build());
+  printFinished(start);
+  return Ok();
+}
+
+namespace {
+
+// Keeps this process, and so the benchmarks it spawns, on the CPU it is
+// running on while alive, so that the samples don't pay for migrations
+// between cores.  Builds must run outside of it to get every core.
+class CpuPin {
+public:
+  CpuPin() {
+#ifdef __linux__
+    const int cpu = sched_getcpu();
+    if (cpu < 0 || sched_getaffinity(0, sizeof(saved), &saved) != 0) {
+      return;
+    }
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+      spdlog::debug("Failed to pin to CPU {}", cpu);
+      return;
+    }
+    pinned = true;
+#endif
+  }
+  ~CpuPin() {
+#ifdef __linux__
+    if (pinned) {
+      sched_setaffinity(0, sizeof(saved), &saved);
+    }
+#endif
+  }
+
+  CpuPin(const CpuPin&) = delete;
+  CpuPin& operator=(const CpuPin&) = delete;
+  CpuPin(CpuPin&&) = delete;
+  CpuPin& operator=(CpuPin&&) = delete;
+
+private:
+#ifdef __linux__
+  cpu_set_t saved{};
+  bool pinned = false;
+#endif
+};
+
+} // namespace
+
+Result<BenchRun> Bench::runOnce(const std::string& target) const {
+  const std::string sourcePath = sourcePathOf(target);
+  const fs::path binary = outDir / target;
+  // Binaries using bench::runBenches() report their samples here.
+  const fs::path reportPath = fs::path(binary).concat(".report");
+  std::error_code ec;
+  fs::remove(reportPath, ec);
+
+  Command command(binary.string());
+  command.addEnv("CABIN_BENCH_REPORT", reportPath.string());
+  if (counters != nullptr) {
+    // Binaries using bench::runBenches() count their measured loops alone.
+    command.addEnv("CABIN_BENCH_COUNTERS", "1");
+    counters->reset();
+    counters->enable();
+  }
+  const auto start = std::chrono::steady_clock::now();
+  const CommandOutput output = Try(command.output());
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (counters != nullptr) {
+    counters->disable();
+  }
+  if (!output.exitStatus.success()) {
+    fmt::print(stderr, "{}{}", output.stdOut, output.stdErr);
+    Bail("benches {} failed: {}", sourcePath, output.exitStatus);
+  }
+
+  BenchRun run{ .reported = {}, .elapsed = elapsed.count(), .counters = {} };
+  if (counters != nullptr) {
+    run.counters = counters->read();
+  }
+  if (std::ifstream ifs(reportPath); ifs) {
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    run.reported = parseBenchReport(oss.str());
+  }
+  for (BenchResult& result : run.reported) {
+    result.name = fmt::format("{}::{}", sourcePath, result.name);
+  }
+  return Ok(run);
+}
+
+// Runs `target` on `base` and on this side `numRounds` times each.  The
+// sides take turns going first, so that neither always runs on the caches
+// and clocks the other left behind.
+Result<void> Bench::runInTurns(const Bench& base, const std::string& target,
+                               const std::size_t numRounds,
+                               std::vector<BenchRun>& baseRuns,
+                               std::vector<BenchRun>& currentRuns) const {
+  for (std::size_t i = 0; i < numRounds; ++i) {
+    if (baseRuns.size() % 2 == 0) {
+      baseRuns.push_back(Try(base.runOnce(target)));
+      currentRuns.push_back(Try(runOnce(target)));
+    } else {
+      currentRuns.push_back(Try(runOnce(target)));
+      baseRuns.push_back(Try(base.runOnce(target)));
+    }
+  }
+  return Ok();
+}
+
+// Folds `counts` into `mean`, the mean of `num` - 1 earlier counts.
+static void addToMean(std::map<std::string, double>& mean,
+                      const std::map<std::string, double>& counts,
+                      const std::size_t num) {
+  for (const auto& [name, count] : counts) {
+    double& meanCount = mean[name];
+    meanCount += (count - meanCount) / static_cast<double>(num);
+  }
+}
+
+// Pools the samples of several runs of one binary, in the order the
+// benchmarks were first reported, and averages their counters.  Unless
+// `reported`, each run is a single sample of the binary as a whole, and the
+// first run only warmed up the caches.
+static std::vector<BenchResult> mergeRuns(const std::vector<BenchRun>& runs,
+                                          const std::string& sourcePath,
+                                          const bool reported) {
+  std::vector<BenchResult> results;
+  if (!reported) {
+    BenchResult result{
+      .name = sourcePath, .bytes = 0, .samples = {}, .counters = {}
+    };
+    for (std::size_t i = 1; i < runs.size(); ++i) {
+      result.samples.push_back(runs[i].elapsed);
+      addToMean(result.counters, runs[i].counters, i);
+    }
+    results.push_back(std::move(result));
+    return results;
+  }
+
+  // How many runs reported each of `results`.
+  std::vector<std::size_t> numRuns;
+  for (const BenchRun& run : runs) {
+    for (const BenchResult& result : run.reported) {
+      const auto itr = std::ranges::find(results, result.name,
+                                         &BenchResult::name);
+      if (itr == results.end()) {
+        results.push_back(result);
+        numRuns.push_back(1);
+      } else {
+        itr->samples.insert(itr->samples.end(), result.samples.begin(),
+                            result.samples.end());
+        const auto idx = static_cast<std::size_t>(itr - results.begin());
+        addToMean(itr->counters, result.counters, ++numRuns[idx]);
+      }
+    }
+  }
+  return results;
+}
+
+Result<std::vector<BenchResult>>
+Bench::runBenchTarget(const std::string& target) {
+  const std::string sourcePath = sourcePathOf(target);
+  Diag::info("Running", "benches {}", sourcePath);
+
+  std::vector<BenchRun> runs{ Try(runOnce(target)) };
+  if (!runs.front().reported.empty()) {
+    return Ok(std::move(runs.front().reported));
+  }
+
+  spdlog::debug("{} took {:.0f}ns; timing it as a whole", sourcePath,
+                runs.front().elapsed);
+  for (std::size_t i = 0; i < NUM_BINARY_SAMPLES; ++i) {
+    runs.push_back(Try(runOnce(target)));
+  }
+  return Ok(mergeRuns(runs, sourcePath, /*reported=*/false));
+}
+
+static std::string describeChange(const BenchChange& change) {
+  const std::string percent = fmt::format("{:+.2f}%", change.change * 100);
+  const std::string pValue = fmt::format("p = {:.3f}", change.pValue);
+  if (change.isRegression()) {
+    return fmt::format("{} ({}) {}", Red(percent).toStr(), pValue,
+                       Red("regressed").toStr());
+  } else if (change.isImprovement()) {
+    return fmt::format("{} ({}) {}", Green(percent).toStr(), pValue,
+                       Green("improved").toStr());
+  }
+  return fmt::format("{} ({}) no change", percent, pValue);
+}
+
+Result<void> Bench::runBenchTargets() {
+  std::optional<BenchBaseline> base;
+  if (baseline.has_value()) {
+    base = Try(BenchBaseline::load(outDir, baseline.value()));
+  }
+
+  const CpuPin pin;
+
+  // Benchmarks run one at a time so that they don't compete for the CPU.
+  BenchBaseline current;
+  std::vector<std::string> regressions;
+  for (const std::string& target : benchTargets) {
+    for (BenchResult& result : Try(runBenchTarget(target))) {
+      std::string line = fmt::format(
+          "{} ± {}", formatDuration(result.median()),
+          formatDuration(result.mad()));
+      if (const double throughput = result.throughput(); throughput > 0.0) {
+        line += fmt::format(", {}", formatThroughput(throughput));
+      }
+      if (base.has_value()) {
+        const auto itr = base->results.find(result.name);
+        if (itr != base->results.end()) {
+          const BenchChange change = compareBench(itr->second, result);
+          line += fmt::format(", {}", describeChange(change));
+          if (change.isRegression()) {
+            regressions.push_back(result.name);
+          }
+        } else {
+          line += ", new";
+        }
+      }
+      fmt::print("    bench {} ... {}\n", result.name, line);
+      if (!result.counters.empty()) {
+        std::map<std::string, double> baseCounters;
+        if (base.has_value()) {
+          if (const auto itr = base->results.find(result.name);
+              itr != base->results.end()) {
+            baseCounters = itr->second.counters;
+          }
+        }
+        fmt::print("          {}\n",
+                   formatCounters(result.counters, baseCounters));
+      }
+
+      current.results.emplace(result.name, std::move(result));
+    }
+  }
+
+  Try(current.save(outDir, saveBaseline));
+
+  if (!regressions.empty()) {
+    Bail("{} benchmark(s) regressed against baseline `{}`: {}",
+         regressions.size(), baseline.value(), fmt::join(regressions, ", "));
+  }
+  Diag::info("Ok", "{} benchmark(s) saved as baseline `{}`",
+             current.results.size(), saveBaseline);
+  return Ok();
+}
+
+// Checks out the tree of `rev` under the out directory and loads the same
+// package, or workspace, from it.  The checkout is kept, so that its build
+// is incremental the next time the same revision is compared against.
+Result<Bench> Bench::atRevision(const std::string& rev) const {
+  fs::path pkgRoot;
+  try {
+    git2::Repository repo;
+    repo.discover(rootPath.string());
+    const std::string workdir = repo.workdir();
+    Ensure(!workdir.empty(), "{} is in a bare repository", rootPath.string());
+
+    const git2::Object treeish = repo.revparseSingle(rev);
+    const fs::path checkoutDir = outDir / "compare" / treeish.id().toString();
+    if (!fs::exists(checkoutDir)) {
+      // Check out next to it first, so that an interrupted checkout is never
+      // mistaken for a complete one.
+      const fs::path tmpDir = fs::path(checkoutDir).concat(
+          fmt::format(".tmp-{}", getpid()));
+      std::error_code ec;
+      fs::remove_all(tmpDir, ec);
+      fs::create_directories(tmpDir);
+      repo.checkoutTree(treeish, tmpDir.string());
+      fs::rename(tmpDir, checkoutDir, ec);
+      if (ec) {
+        fs::remove_all(tmpDir, ec);
+        Ensure(fs::exists(checkoutDir), "failed to check out `{}` to {}", rev,
+               checkoutDir.string());
+      }
+    }
+
+    std::error_code ec;
+    pkgRoot = checkoutDir
+              / fs::relative(fs::weakly_canonical(rootPath, ec),
+                             fs::weakly_canonical(workdir, ec));
+  } catch (const git2::Exception& e) {
+    Bail("failed to check out `{}`: {}", rev, e.what());
+  }
+
+  if (workspace.has_value()) {
+    std::optional<Workspace> ws = Try(Workspace::tryFind(pkgRoot));
+    Ensure(ws.has_value(), "no workspace found at `{}`", rev);
+    return Ok(Bench(std::move(ws.value())));
+  }
+  return Ok(Bench(Try(Manifest::tryParse(pkgRoot / Manifest::FILE_NAME,
+                                         /*findParents=*/false))));
+}
+
+static std::string describeSpeedup(const BenchSpeedup& speedup,
+                                   const BenchChange& change) {
+  std::string desc;
+  if (speedup.ratio >= 1.0) {
+    desc = fmt::format("{:.2f}x faster [{:.2f}x, {:.2f}x]", speedup.ratio,
+                       speedup.lower, speedup.upper);
+  } else {
+    desc = fmt::format("{:.2f}x slower [{:.2f}x, {:.2f}x]", 1 / speedup.ratio,
+                       1 / speedup.upper, 1 / speedup.lower);
+  }
+  const std::string pValue = fmt::format("p = {:.3f}", change.pValue);
+  if (change.isImprovement()) {
+    return fmt::format("{} ({})", Green(desc).toStr(), pValue);
+  } else if (change.isRegression()) {
+    return fmt::format("{} ({})", Red(desc).toStr(), pValue);
+  }
+  return fmt::format("{} ({}) no change", desc, pValue);
+}
+
+Result<void> Bench::compareWith(const std::string& rev) {
+  const auto start = std::chrono::steady_clock::now();
+
+  Try(configure());
+  if (benchTargets.empty()) {
+    warnNoBenchTargets();
+    return Ok();
+  }
+
+  Bench base = Try(atRevision(rev));
+  base.filters = filters;
+  base.counters = counters;
+  Try(base.configure());
+  // Only the benchmarks that also exist here are worth building there.
+  std::erase_if(base.benchTargets, [&](const std::string& target) {
+    return std::ranges::find(benchTargets, target) == benchTargets.end();
+  });
+
+  // The two sides have their own out directories, so they build at the same
+  // time.
+  std::vector<Child> builds;
+  for (const Bench* side : { &base, this }) {
+    if (Try(side->needsBuild())) {
+      side->printCompiling();
+      builds.push_back(Try(side->buildCommand().spawn()));
+    }
+  }
+  bool buildSucceeded = true;
+  for (const Child& build : builds) {
+    const ExitStatus exitStatus = Try(build.wait());
+    buildSucceeded = buildSucceeded && exitStatus.success();
+  }
+  Ensure(buildSucceeded, "compilation failed");
+  printFinished(start);
+
+  const CpuPin pin;
+
+  std::size_t numFaster = 0;
+  std::size_t numSlower = 0;
+  std::size_t numUnchanged = 0;
+  for (const std::string& target : benchTargets) {
+    const std::string sourcePath = sourcePathOf(target);
+    if (std::ranges::find(base.benchTargets, target)
+        == base.benchTargets.end()) {
+      Diag::warn("benches {} does not exist at `{}`", sourcePath, rev);
+      continue;
+    }
+    Diag::info("Running", "benches {} against `{}`", sourcePath, rev);
+
+    std::vector<BenchRun> baseRuns;
+    std::vector<BenchRun> currentRuns;
+    Try(runInTurns(base, target, 1, baseRuns, currentRuns));
+    const bool reported = !baseRuns.front().reported.empty()
+                          && !currentRuns.front().reported.empty();
+    Try(runInTurns(base, target, numRunsFor(reported) - 1, baseRuns,
+                   currentRuns));
+
+    const std::vector<BenchResult> baseResults =
+        mergeRuns(baseRuns, sourcePath, reported);
+    for (const BenchResult& result :
+         mergeRuns(currentRuns, sourcePath, reported)) {
+      const auto itr =
+          std::ranges::find(baseResults, result.name, &BenchResult::name);
+      if (itr == baseResults.end()) {
+        fmt::print("    bench {} ... {}, new\n", result.name,
+                   formatDuration(result.median()));
+        continue;
+      }
+
+      const BenchChange change = compareBench(*itr, result);
+      if (change.isImprovement()) {
+        ++numFaster;
+      } else if (change.isRegression()) {
+        ++numSlower;
+      } else {
+        ++numUnchanged;
+      }
+      fmt::print("    bench {} ... {} -> {}, {}\n", result.name,
+                 formatDuration(itr->median()),
+                 formatDuration(result.median()),
+                 describeSpeedup(estimateSpeedup(*itr, result), change));
+      if (!result.counters.empty()) {
+        fmt::print("          {}\n",
+                   formatCounters(result.counters, itr->counters));
+      }
+    }
+  }
+
+  Diag::info("Ok", "{} faster, {} slower, {} unchanged than `{}`", numFaster,
+             numSlower, numUnchanged, rev);
+  return Ok();
+}
+
+// Picks the benchmark named `name`, or the only one whose name contains it.
+static Result<BenchResult> findBenchResult(std::vector<BenchResult> results,
+                                           const std::string& name) {
+  const auto itr = std::ranges::find(results, name, &BenchResult::name);
+  if (itr != results.end()) {
+    return Ok(std::move(*itr));
+  }
+  std::erase_if(results, [&](const BenchResult& result) {
+    return result.name.find(name) == std::string::npos;
+  });
+  Ensure(!results.empty(), "no benchmark named `{}`", name);
+  if (results.size() > 1) {
+    std::vector<std::string> names;
+    for (const BenchResult& result : results) {
+      names.push_back(result.name);
+    }
+    Bail("`{}` matches several benchmarks: {}", name, fmt::join(names, ", "));
+  }
+  return Ok(std::move(results.front()));
+}
+
+// Whether `benchName` runs more than `threshold` slower here than on `good`.
+// The benchmark is run in batches until the confidence interval of the
+// speedup clears the threshold.
+Result<bool> Bench::isSlowerThan(const Bench& good, const std::string& target,
+                                 const std::string& benchName,
+                                 const double threshold) const {
+  const std::string sourcePath = sourcePathOf(target);
+  std::vector<BenchRun> goodRuns;
+  std::vector<BenchRun> currentRuns;
+  Try(runInTurns(good, target, 1, goodRuns, currentRuns));
+  const bool reported = !goodRuns.front().reported.empty()
+                        && !currentRuns.front().reported.empty();
+  const std::size_t numRuns = numRunsFor(reported);
+
+  for (std::size_t batch = 1;; ++batch) {
+    Try(runInTurns(good, target, batch * numRuns - goodRuns.size(), goodRuns,
+                   currentRuns));
+    const BenchResult goodResult = Try(
+        findBenchResult(mergeRuns(goodRuns, sourcePath, reported), benchName));
+    const BenchResult result = Try(findBenchResult(
+        mergeRuns(currentRuns, sourcePath, reported), benchName));
+
+    const std::optional<bool> slower =
+        exceedsSlowdown(goodResult, result, threshold);
+    if (!slower.has_value() && batch < MAX_BISECT_BATCHES) {
+      continue;
+    }
+
+    const BenchSpeedup speedup = estimateSpeedup(goodResult, result);
+    const bool isSlower =
+        slower.value_or(speedup.ratio < 1.0 / (1.0 + threshold));
+    if (!slower.has_value()) {
+      Diag::warn("{} is too noisy to tell with confidence; going by the "
+                 "medians",
+                 result.name);
+    }
+    fmt::print("    bench {} ... {} -> {}, {}, {}\n", result.name,
+               formatDuration(goodResult.median()),
+               formatDuration(result.median()),
+               describeSpeedup(speedup, compareBench(goodResult, result)),
+               isSlower ? Red("bad").toStr() : Green("good").toStr());
+    return Ok(isSlower);
+  }
+}
+
+// Binary-searches the first-parent history between `good` and `bad` for the
+// first commit where `benchName` got more than `threshold` slower than at
+// `good`.  Every commit is checked out and built like with --compare, and
+// measured against `good`, not against its neighbors, so that slowdowns
+// spread over several commits add up.
+Result<void> Bench::bisect(const std::string& good, const std::string& bad,
+                           const std::string& benchName,
+                           const double threshold) {
+  struct Candidate {
+    std::string id;
+    std::string summary;
+  };
+  std::string goodId;
+  // Oldest first; the last one is `bad`.
+  std::vector<Candidate> candidates;
+  try {
+    git2::Repository repo;
+    repo.discover(rootPath.string());
+    const git2::Object goodCommit = repo.revparseSingle(good + "^{commit}");
+    const git2::Object badCommit = repo.revparseSingle(bad + "^{commit}");
+    goodId = goodCommit.id().toString();
+
+    git2::Revwalk walk(repo);
+    walk.setSorting(GIT_SORT_TOPOLOGICAL | GIT_SORT_REVERSE);
+    walk.simplifyFirstParent();
+    walk.push(badCommit.id());
+    walk.hide(goodCommit.id());
+    git_oid oid;
+    while (walk.next(oid)) {
+      git2::Commit commit;
+      commit.lookup(repo, git2::Oid(&oid));
+      candidates.push_back(Candidate{ .id = git2::Oid(&oid).toString(),
+                                      .summary = commit.summary() });
+    }
+  } catch (const git2::Exception& e) {
+    Bail("failed to walk `{}..{}`: {}", good, bad, e.what());
+  }
+  Ensure(!candidates.empty(), "`{}` has no commits that `{}` does not have",
+         bad, good);
+
+  // The checkouts go under this side's out directory.
+  Try(configure());
+
+  // A benchmark name is `<source path>::<name>`; its source path selects the
+  // binary to build.
+  Bench goodSide = Try(atRevision(goodId));
+  goodSide.filters = { benchName.substr(0, benchName.find("::")) };
+  Try(goodSide.configure());
+  Ensure(!goodSide.benchTargets.empty(), "no benchmark matches `{}` at `{}`",
+         benchName, good);
+  if (goodSide.benchTargets.size() > 1) {
+    std::vector<std::string> sourcePaths;
+    for (const std::string& target : goodSide.benchTargets) {
+      sourcePaths.push_back(goodSide.sourcePathOf(target));
+    }
+    Bail("`{}` matches benchmarks in several sources: {}", benchName,
+         fmt::join(sourcePaths, ", "));
+  }
+  const std::string target = goodSide.benchTargets.front();
+  Try(goodSide.build());
+
+  const auto shortId = [](const Candidate& candidate) {
+    return candidate.id.substr(0, git2::SHORT_HASH_LEN);
+  };
+  const auto test = [&](const Candidate& candidate) -> Result<bool> {
+    Diag::info("Testing", "{} {}", shortId(candidate), candidate.summary);
+    Bench side = Try(atRevision(candidate.id));
+    side.filters = goodSide.filters;
+    Try(side.configure());
+    Ensure(side.benchSources.contains(target),
+           "benches {} does not exist at {}", goodSide.sourcePathOf(target),
+           shortId(candidate));
+    side.benchTargets = { target };
+    Try(side.build());
+    const CpuPin pin;
+    return side.isSlowerThan(goodSide, target, benchName, threshold);
+  };
+
+  Diag::info("Bisecting", "{} commit(s) between `{}` and `{}`",
+             candidates.size(), good, bad);
+  // Without a slower `bad`, the search would settle on an arbitrary commit.
+  Ensure(Try(test(candidates.back())),
+         "`{}` is not more than {}% slower than `{}` on {}", bad,
+         threshold * 100, good, benchName);
+
+  // Every commit before `lo` is good, and the one at `hi` is bad.
+  std::size_t lo = 0;
+  std::size_t hi = candidates.size() - 1;
+  while (lo < hi) {
+    Diag::info("Bisecting", "{} commit(s) left (roughly {} step(s))", hi - lo,
+               std::bit_width(hi - lo));
+    const std::size_t mid = lo + (hi - lo) / 2;
+    if (Try(test(candidates[mid]))) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  Diag::info("Found", "{} is the first commit more than {}% slower than `{}`",
+             shortId(candidates[hi]), threshold * 100, good);
+  fmt::print("    {} {}\n", candidates[hi].id, candidates[hi].summary);
+  return Ok();
+}
+
+Result<void> Bench::exec(const CliArgsView cliArgs) {
+  std::optional<std::string> baseline;
+  std::string saveBaseline = "latest";
+  std::optional<std::string> compare;
+  std::optional<std::string> bisectRange;
+  double threshold = 0.05;
+  bool withCounters = false;
+  std::vector<std::string> filters;
+
+  for (auto itr = cliArgs.begin(); itr != cliArgs.end(); ++itr) {
+    const std::string_view arg = *itr;
+
+    const auto control =
+        Try(Cli::handleGlobalOpts(itr, cliArgs.end(), "bench"));
+    if (control == Cli::Return) {
+      return Ok();
+    } else if (control == Cli::Continue) {
+      continue;
+    } else if (arg == "-j" || arg == "--jobs") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      const std::string_view nextArg = *++itr;
+
+      uint64_t numThreads{};
+      auto [ptr, ec] =
+          std::from_chars(nextArg.begin(), nextArg.end(), numThreads);
+      Ensure(ec == std::errc(), "invalid number of threads: {}", nextArg);
+      setParallelism(numThreads);
+    } else if (arg == "--baseline") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      baseline = *++itr;
+    } else if (arg == "--save-baseline") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      saveBaseline = *++itr;
+    } else if (arg == "--compare") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      compare = *++itr;
+    } else if (arg == "--counters") {
+      withCounters = true;
+    } else if (arg == "--bisect") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      bisectRange = *++itr;
+    } else if (arg == "--threshold") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      const std::string_view nextArg = *++itr;
+
+      double percent{};
+      auto [ptr, ec] = std::from_chars(nextArg.begin(), nextArg.end(), percent);
+      Ensure(ec == std::errc() && ptr == nextArg.end() && percent > 0.0,
+             "invalid threshold: {}", nextArg);
+      threshold = percent / 100;
+    } else if (!arg.starts_with('-')) {
+      filters.emplace_back(arg);
+    } else {
+      return BENCH_CMD.noSuchArg(arg);
+    }
+  }
+  Ensure(!compare.has_value() || !baseline.has_value(),
+         "--compare cannot be used with --baseline");
+  Ensure(!bisectRange.has_value()
+             || (!compare.has_value() && !baseline.has_value()),
+         "--bisect cannot be used with --compare or --baseline");
+
+  std::optional<Workspace> workspace = Try(Workspace::tryFind());
+  Bench cmd = workspace.has_value() ? Bench(std::move(workspace.value()))
+                                    : Bench(Try(Manifest::tryParse()));
+  cmd.filters = std::move(filters);
+  cmd.baseline = std::move(baseline);
+  cmd.saveBaseline = std::move(saveBaseline);
+
+  std::optional<perf::Counters> counters;
+  if (withCounters) {
+    counters.emplace();
+    if (!counters->available()) {
+      Diag::warn("Performance counters are unavailable: {}",
+                 counters->unavailableReason());
+    } else {
+      if (!counters->complete()) {
+        Diag::warn("Some performance counters are unavailable: {}",
+                   counters->unavailableReason());
+      }
+      cmd.counters = &counters.value();
+    }
+  }
+
+  if (compare.has_value()) {
+    return cmd.compareWith(compare.value());
+  }
+  if (bisectRange.has_value()) {
+    const std::size_t sep = bisectRange->find("..");
+    Ensure(sep != std::string::npos && sep != 0
+               && sep + 2 < bisectRange->size(),
+           "--bisect expects <GOOD>..<BAD>, got `{}`", bisectRange.value());
+    Ensure(cmd.filters.size() == 1,
+           "--bisect expects the name of one benchmark");
+    const std::string benchName = cmd.filters.front();
+    cmd.filters.clear();
+    return cmd.bisect(bisectRange->substr(0, sep),
+                      bisectRange->substr(sep + 2), benchName, threshold);
+  }
+
+  Try(cmd.compileBenchTargets());
+  if (cmd.benchTargets.empty()) {
+    return Ok();
+  }
+  return cmd.runBenchTargets();
+}
+
+} // namespace cabin
@@ -7,18 +7,31 @@
 #include "Command.hpp"
 #include "Common.hpp"
 #include "Diag.hpp"
+#include "Flamegraph.hpp"
 #include "Manifest.hpp"
+#include "OptRemarks.hpp"
 #include "Parallelism.hpp"
+#include "TimeTrace.hpp"
 
+#include <algorithm>
 #include <charconv>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <filesystem>
 #include <fmt/format.h>
 #include <fmt/ranges.h>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <utility>
 #include <vector>
 
 namespace cabin {
@@ -33,6 +46,15 @@ const Subcmd BUILD_CMD =
         .addOpt(Opt{ "--compdb" }.setDesc(
             "Generate compilation database instead of building"))
         .addOpt(OPT_JOBS)
+        .addOpt(Opt{ "--remarks" }.setDesc(
+            "Report the optimizations the compiler missed"))
+        .addOpt(Opt{ "--remarks-perf" }
+                    .setDesc("Rank the remarks by the self time in folded "
+                             "stacks, like those of `cabin run --profile`")
+                    .setPlaceholder("<FILE>"))
+        .addOpt(Opt{ "--time-trace" }.setDesc(
+            "Report which headers, templates, and functions take the longest "
+            "to compile"))
         .setMainFn(buildMain);
 
 Result<ExitStatus> runBuildCommand(const Manifest& manifest,
@@ -56,6 +78,33 @@ Result<ExitStatus> runBuildCommand(const Manifest& manifest,
   return Ok(exitStatus);
 }
 
+static Result<ExitStatus> buildTargets(const Manifest& manifest,
+                                       const BuildConfig& config) {
+  const std::string outDir = config.outBasePath.string();
+
+  ExitStatus exitStatus;
+  if (config.hasBinTarget()) {
+    exitStatus = Try(runBuildCommand(manifest, outDir, manifest.package.name));
+  }
+
+  if (config.hasLibTarget() && exitStatus.success()) {
+    const std::string& libName = config.getLibName();
+    exitStatus = Try(runBuildCommand(manifest, outDir, libName));
+  }
+  return Ok(exitStatus);
+}
+
+static void
+reportFinished(const Manifest& manifest, const BuildProfile& buildProfile,
+               const std::chrono::steady_clock::time_point start) {
+  const auto end = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> elapsed = end - start;
+
+  const Profile& profile = manifest.profiles.at(buildProfile);
+  Diag::info("Finished", "`{}` profile [{}] target(s) in {:.2f}s",
+             buildProfile, profile, elapsed.count());
+}
+
 Result<void> buildImpl(const Manifest& manifest, std::string& outDir,
                        const BuildProfile& buildProfile) {
   const auto start = std::chrono::steady_clock::now();
@@ -64,21 +113,196 @@ Result<void> buildImpl(const Manifest& manifest, std::string& outDir,
       Try(emitNinja(manifest, buildProfile, /*includeDevDeps=*/false));
   outDir = config.outBasePath;
 
-  ExitStatus exitStatus;
-  if (config.hasBinTarget()) {
-    exitStatus = Try(runBuildCommand(manifest, outDir, manifest.package.name));
+  const ExitStatus exitStatus = Try(buildTargets(manifest, config));
+  if (exitStatus.success()) {
+    reportFinished(manifest, buildProfile, start);
   }
+  return Ok();
+}
 
-  if (config.hasLibTarget() && exitStatus.success()) {
-    const std::string& libName = config.getLibName();
-    exitStatus = Try(runBuildCommand(manifest, outDir, libName));
+static Result<std::string> readFile(const fs::path& path) {
+  std::ifstream ifs(path);
+  Ensure(ifs, "failed to read {}", path.string());
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  return Ok(oss.str());
+}
+
+// Merges the remarks the compiler saved for each object of the package,
+// keeping those in the project's own files, and reports them.
+static Result<void> reportOptRemarks(const Manifest& manifest,
+                                     const BuildConfig& config,
+                                     const FoldedStacks& perfStacks) {
+  const fs::path projectRoot = manifest.path.parent_path();
+  const fs::path canonicalRoot = fs::weakly_canonical(projectRoot);
+
+  std::vector<OptRemark> remarks;
+  std::size_t numElsewhere = 0;
+  for (const auto& [source, report] : config.getCompileReports()) {
+    const std::string contents = Try(readFile(report));
+    std::vector<OptRemark> parsed = report.extension() == ".yaml"
+                                        ? parseClangRemarks(contents)
+                                        : parseGccRemarks(contents);
+    for (OptRemark& remark : parsed) {
+      // Relative paths are relative to where ninja runs the compiler.
+      std::error_code ec;
+      const fs::path file =
+          fs::weakly_canonical(config.outBasePath / remark.file, ec);
+      const fs::path relFile = file.lexically_relative(canonicalRoot);
+      if (ec || relFile.empty() || *relFile.begin() == "..") {
+        ++numElsewhere;
+        continue;
+      }
+      remark.file = relFile.string();
+      remarks.push_back(std::move(remark));
+    }
+  }
+  // Headers report the same remarks in every object including them.
+  std::ranges::sort(remarks);
+  const auto duplicates = std::ranges::unique(remarks);
+  remarks.erase(duplicates.begin(), duplicates.end());
+
+  const fs::path reportPath = config.outBasePath / "remarks.txt";
+  Try(writeFileAtomically(
+      reportPath,
+      fmt::format("{}\n{}",
+                  formatRemarksSummary(remarks, perfStacks,
+                                       std::numeric_limits<std::size_t>::max()),
+                  formatRemarks(remarks, perfStacks))));
+
+  std::cout << '\n' << formatRemarksSummary(remarks, perfStacks, 10);
+  if (numElsewhere > 0) {
+    std::cout << fmt::format("\n{} more in dependencies and system headers "
+                             "were left out\n",
+                             numElsewhere);
+  }
+  std::cout << '\n' << std::flush;
+  Diag::info("Wrote", "{}",
+             fs::relative(reportPath, projectRoot).string());
+  return Ok();
+}
+
+// Builds the package with the compiler writing `compileReport` for each
+// object.  The changed rule rebuilds every object once, so every one of
+// them has a report.
+static Result<BuildConfig> buildWithReport(const Manifest& manifest,
+                                           const BuildProfile& buildProfile,
+                                           const CompileReport compileReport) {
+  const auto start = std::chrono::steady_clock::now();
+
+  BuildConfig config =
+      Try(emitNinja(manifest, buildProfile, /*includeDevDeps=*/false,
+                    /*enableCoverage=*/false, compileReport));
+  const ExitStatus exitStatus = Try(buildTargets(manifest, config));
+  Ensure(exitStatus.success(), "build {}", exitStatus);
+  reportFinished(manifest, buildProfile, start);
+  return Ok(std::move(config));
+}
+
+static Result<void> buildWithRemarks(const Manifest& manifest,
+                                     const BuildProfile& buildProfile,
+                                     const FoldedStacks& perfStacks) {
+  const Profile& profile = manifest.profiles.at(buildProfile);
+  if (profile.optLevel == 0) {
+    Diag::warn("the `{}` profile doesn't optimize, so there is little to "
+               "remark on; try --release",
+               buildProfile);
+  }
+
+  const BuildConfig config =
+      Try(buildWithReport(manifest, buildProfile, CompileReport::OptRemarks));
+  return reportOptRemarks(manifest, config, perfStacks);
+}
+
+// Paths inside the project relative to its root, others as they are.
+static std::string displayPath(const fs::path& path,
+                               const fs::path& canonicalRoot) {
+  const fs::path relPath = path.lexically_relative(canonicalRoot);
+  if (relPath.empty() || *relPath.begin() == "..") {
+    return path.string();
+  }
+  return relPath.string();
+}
+
+// Merges the time traces of the package's objects into a report of where
+// compiling it takes the longest.
+static Result<void> buildWithTimeTrace(const Manifest& manifest,
+                                       const BuildProfile& buildProfile) {
+  const BuildConfig config =
+      Try(buildWithReport(manifest, buildProfile, CompileReport::TimeTrace));
+
+  const fs::path projectRoot = manifest.path.parent_path();
+  const fs::path canonicalRoot = fs::weakly_canonical(projectRoot);
+  CompileTimes times;
+  for (const auto& [source, report] : config.getCompileReports()) {
+    const std::string unit =
+        displayPath(fs::weakly_canonical(source), canonicalRoot);
+    const std::string contents = Try(readFile(report));
+    if (report.extension() == ".json") {
+      Try(addClangTimeTrace(times, unit, contents));
+    } else {
+      addGccTimeReport(times, unit, contents);
+    }
+  }
+  // Clang names headers as they were found, often relative to where ninja
+  // runs it.
+  std::map<std::string, TimeSpent> headers;
+  for (const auto& [header, time] : times.headers) {
+    std::error_code ec;
+    const fs::path path =
+        fs::weakly_canonical(config.outBasePath / header, ec);
+    TimeSpent& merged =
+        headers[ec ? header : displayPath(path, canonicalRoot)];
+    merged.micros += time.micros;
+    merged.count += time.count;
+  }
+  times.headers = std::move(headers);
+
+  const fs::path reportPath = config.outBasePath / "time-trace.txt";
+  Try(writeFileAtomically(
+      reportPath,
+      formatCompileTimes(times, std::numeric_limits<std::size_t>::max())));
+  std::cout << '\n' << formatCompileTimes(times, 10) << '\n' << std::flush;
+  Diag::info("Wrote", "{}", fs::relative(reportPath, projectRoot).string());
+  return Ok();
+}
+
+static Result<void> buildWorkspace(const Workspace& workspace,
+                                   const BuildProfile& buildProfile) {
+  const auto start = std::chrono::steady_clock::now();
+
+  const std::vector<BuildConfig> members = Try(emitWorkspaceNinja(
+      workspace, buildProfile, /*includeDevDeps=*/false));
+  const std::string outDir = members.front().outBasePath.string();
+
+  // All members go to one ninja run, so nothing waits on another package.
+  std::vector<std::string> targets;
+  for (const BuildConfig& member : members) {
+    targets.insert(targets.end(), member.getDefaultTargets().begin(),
+                   member.getDefaultTargets().end());
+  }
+
+  ExitStatus exitStatus;
+  if (Try(ninjaNeedsWork(outDir, targets))) {
+    for (const Manifest& manifest : workspace.members) {
+      Diag::info("Compiling", "{} v{} ({})", manifest.package.name,
+                 manifest.package.version.toString(),
+                 manifest.path.parent_path().string());
+    }
+    Command buildCmd = getNinjaCommand();
+    buildCmd.addArg("-C").addArg(outDir);
+    for (const std::string& target : targets) {
+      buildCmd.addArg(target);
+    }
+    exitStatus = Try(execCmd(buildCmd));
   }
 
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
 
   if (exitStatus.success()) {
-    const Profile& profile = manifest.profiles.at(buildProfile);
+    const Profile& profile =
+        workspace.members.front().profiles.at(buildProfile);
     Diag::info("Finished", "`{}` profile [{}] target(s) in {:.2f}s",
                buildProfile, profile, elapsed.count());
   }
@@ -89,6 +313,9 @@ static Result<void> buildMain(const CliArgsView args) {
   // Parse args
   BuildProfile buildProfile = BuildProfile::Dev;
   bool buildCompdb = false;
+  bool remarks = false;
+  bool timeTrace = false;
+  std::optional<fs::path> remarksPerf;
   for (auto itr = args.begin(); itr != args.end(); ++itr) {
     const std::string_view arg = *itr;
 
@@ -101,6 +328,16 @@ static Result<void> buildMain(const CliArgsView args) {
       buildProfile = BuildProfile::Release;
     } else if (arg == "--compdb") {
       buildCompdb = true;
+    } else if (arg == "--remarks") {
+      remarks = true;
+    } else if (arg == "--remarks-perf") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      remarksPerf = *++itr;
+      remarks = true;
+    } else if (arg == "--time-trace") {
+      timeTrace = true;
     } else if (arg == "-j" || arg == "--jobs") {
       if (itr + 1 == args.end()) {
         return Subcmd::missingOptArgumentFor(arg);
@@ -117,7 +354,41 @@ static Result<void> buildMain(const CliArgsView args) {
     }
   }
 
+  Ensure(!(remarks && buildCompdb),
+         "--remarks and --compdb cannot be used together");
+  Ensure(!(timeTrace && (remarks || buildCompdb)),
+         "--time-trace cannot be used with --remarks or --compdb");
+  FoldedStacks perfStacks;
+  if (remarksPerf.has_value()) {
+    perfStacks = parseFoldedStacks(Try(readFile(*remarksPerf)));
+    Ensure(!perfStacks.empty(), "{} has no folded stacks",
+           remarksPerf->string());
+  }
+
+  if (const auto workspace = Try(Workspace::tryFind())) {
+    Ensure(!remarks && !timeTrace,
+           "--remarks and --time-trace are not supported in workspaces yet; "
+           "run them in a member");
+    if (!buildCompdb) {
+      return buildWorkspace(workspace.value(), buildProfile);
+    }
+    const std::vector<BuildConfig> members =
+        Try(emitWorkspaceNinja(workspace.value(), buildProfile,
+                               /*includeDevDeps=*/false));
+    Diag::info("Generated", "{}/compile_commands.json",
+               fs::relative(members.front().outBasePath,
+                            workspace->rootPath)
+                   .string());
+    return Ok();
+  }
+
   const auto manifest = Try(Manifest::tryParse());
+  if (remarks) {
+    return buildWithRemarks(manifest, buildProfile, perfStacks);
+  }
+  if (timeTrace) {
+    return buildWithTimeTrace(manifest, buildProfile);
+  }
   if (!buildCompdb) {
     std::string outDir;
     return buildImpl(manifest, outDir, buildProfile);
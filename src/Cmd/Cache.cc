@@ -0,0 +1,129 @@
+#include "Cache.hpp"
+
+#include "Cli.hpp"
+#include "Dependency.hpp"
+#include "Diag.hpp"
+#include "GlobalCache.hpp"
+#include "Rustify/Result.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cabin {
+
+static Result<void> cacheMain(CliArgsView args);
+
+const Subcmd CACHE_CMD = //
+    Subcmd{ "cache" }
+        .setDesc("Inspect or clean up the global cache (info, gc)")
+        .addOpt(Opt{ "--max-size" }
+                    .setDesc("gc: evict entries until the cache fits")
+                    .setPlaceholder("<SIZE>"))
+        .addOpt(Opt{ "--max-age" }
+                    .setDesc("gc: evict entries unused for longer")
+                    .setPlaceholder("<AGE>"))
+        .setArg(Arg{ "COMMAND" })
+        .setMainFn(cacheMain);
+
+static std::string formatLastUse(const fs::file_time_type lastUse) {
+  const auto days = std::chrono::floor<std::chrono::days>(
+                        fs::file_time_type::clock::now() - lastUse)
+                        .count();
+  if (days <= 0) {
+    return "today";
+  } else if (days == 1) {
+    return "1 day ago";
+  }
+  return fmt::format("{} days ago", days);
+}
+
+static Result<void> cacheInfo() {
+  const fs::path& cacheDir = getCacheDir();
+  const std::vector<CacheEntry> entries = listCacheEntries(cacheDir);
+
+  std::uintmax_t totalSize = 0;
+  for (const CacheEntry& entry : entries) {
+    fmt::print("{:>10}  {:<12}  {}\n", formatByteSize(entry.size),
+               formatLastUse(entry.lastUse),
+               fs::relative(entry.path, cacheDir).string());
+    totalSize += entry.size;
+  }
+  Diag::info("Summary", "{} entries, {} in {}", entries.size(),
+             formatByteSize(totalSize), cacheDir.string());
+  return Ok();
+}
+
+static Result<void> cacheGc(const std::optional<std::uintmax_t> maxSize,
+                            const std::optional<std::chrono::seconds> maxAge) {
+  Ensure(maxSize.has_value() || maxAge.has_value(),
+         "`cabin cache gc` requires --max-size or --max-age");
+
+  const fs::path& cacheDir = getCacheDir();
+  const std::vector<CacheEntry> evictions =
+      selectEvictions(listCacheEntries(cacheDir), maxSize, maxAge,
+                      fs::file_time_type::clock::now());
+
+  std::size_t numRemoved = 0;
+  std::uintmax_t freed = 0;
+  for (const CacheEntry& entry : evictions) {
+    const std::string name = fs::relative(entry.path, cacheDir).string();
+    if (!Try(removeCacheEntry(entry))) {
+      Diag::warn("skipping {}: it is in use by another process", name);
+      continue;
+    }
+    Diag::info("Removed", "{} ({})", name, formatByteSize(entry.size));
+    ++numRemoved;
+    freed += entry.size;
+  }
+  Diag::info("Summary", "removed {} entries, {} total", numRemoved,
+             formatByteSize(freed));
+  return Ok();
+}
+
+static Result<void> cacheMain(const CliArgsView args) {
+  std::string_view command;
+  std::optional<std::uintmax_t> maxSize;
+  std::optional<std::chrono::seconds> maxAge;
+  for (auto itr = args.begin(); itr != args.end(); ++itr) {
+    const std::string_view arg = *itr;
+
+    const auto control = Try(Cli::handleGlobalOpts(itr, args.end(), "cache"));
+    if (control == Cli::Return) {
+      return Ok();
+    } else if (control == Cli::Continue) {
+      continue;
+    } else if (arg == "--max-size") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      maxSize = Try(parseByteSize(*++itr));
+    } else if (arg == "--max-age") {
+      if (itr + 1 == args.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      maxAge = Try(parseAge(*++itr));
+    } else if (command.empty()) {
+      command = arg;
+    } else {
+      return CACHE_CMD.noSuchArg(arg);
+    }
+  }
+
+  Ensure(!command.empty(),
+         "a command is required: `info` or `gc`; see `cabin help cache`");
+  if (command == "info") {
+    return cacheInfo();
+  } else if (command == "gc") {
+    return cacheGc(maxSize, maxAge);
+  }
+  Bail("expected `info` or `gc` but found `{}`", command);
+}
+
+} // namespace cabin
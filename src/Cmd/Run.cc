@@ -1,20 +1,27 @@
 #include "Run.hpp"
 
 #include "Algos.hpp"
+#include "BenchResult.hpp"
 #include "Build.hpp"
 #include "Builder/BuildProfile.hpp"
 #include "Cli.hpp"
 #include "Command.hpp"
 #include "Common.hpp"
 #include "Diag.hpp"
+#include "Flamegraph.hpp"
+#include "HeapProfile.hpp"
 #include "Manifest.hpp"
 #include "Parallelism.hpp"
+#include "Rustify/PerfCounters.hpp"
 #include "Rustify/Result.hpp"
 
 #include <charconv>
+#include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fmt/core.h>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <system_error>
@@ -30,15 +37,77 @@ const Subcmd RUN_CMD =
         .setDesc("Build and execute src/main.cc")
         .addOpt(OPT_RELEASE)
         .addOpt(OPT_JOBS)
+        .addOpt(Opt{ "--stats" }.setDesc(
+            "Print the wall time and performance counters of the program"))
+        .addOpt(Opt{ "--profile" }.setDesc(
+            "Record the program with perf (--profile=perf) and write a flame "
+            "graph"))
+        .addOpt(Opt{ "--heap-profile" }.setDesc(
+            "Report where the program allocated memory"))
         .setArg(Arg{ "args" }
                     .setDesc("Arguments passed to the program")
                     .setVariadic(true)
                     .setRequired(false))
         .setMainFn(runMain);
 
+// Runs the program under `perf record` and renders what it recorded as a
+// flame graph next to the binary.
+static Result<void>
+profileProgram(const Manifest& manifest, const std::string& outDir,
+               const std::vector<std::string>& runArgs) {
+  const fs::path binary = fs::path(outDir) / manifest.package.name;
+  const fs::path perfData = fs::path(outDir) / "perf.data";
+  const fs::path relOutDir =
+      fs::relative(outDir, manifest.path.parent_path());
+
+  Diag::info("Profiling", "`{}`",
+             (relOutDir / manifest.package.name).string());
+  const Command record = Command("perf")
+                             .addArg("record")
+                             .addArg("--call-graph=fp")
+                             .addArg("--output")
+                             .addArg(perfData.string())
+                             .addArg("--")
+                             .addArg(binary.string())
+                             .addArgs(runArgs);
+  const ExitStatus exitStatus = Try(execCmd(record));
+
+  // Render whatever was recorded even when the program failed: a profile of
+  // the run that crashed or timed out is often the one wanted.
+  if (fs::exists(perfData)) {
+    const Command script = Command("perf")
+                               .addArg("script")
+                               .addArg("--input")
+                               .addArg(perfData.string())
+                               .setStdErrConfig(Command::IOConfig::Null);
+    const std::string output =
+        Try(getCmdOutput(script, RetryPolicy::Never));
+    const FoldedStacks stacks = foldPerfScript(output);
+    if (stacks.empty()) {
+      Diag::warn("perf recorded no samples");
+    } else {
+      Try(writeFileAtomically(fs::path(outDir) / "stacks.folded",
+                              formatFoldedStacks(stacks)));
+      Try(writeFileAtomically(
+          fs::path(outDir) / "flamegraph.svg",
+          renderFlamegraph(stacks, manifest.package.name)));
+      Diag::info("Wrote", "{}", (relOutDir / "flamegraph.svg").string());
+    }
+  }
+
+  if (exitStatus.success()) {
+    return Ok();
+  } else {
+    Bail("run {}", exitStatus);
+  }
+}
+
 static Result<void> runMain(const CliArgsView args) {
   // Parse args
   BuildProfile buildProfile = BuildProfile::Dev;
+  bool stats = false;
+  bool profile = false;
+  bool heapProfile = false;
   auto itr = args.begin();
   for (; itr != args.end(); ++itr) {
     const std::string_view arg = *itr;
@@ -50,6 +119,16 @@ static Result<void> runMain(const CliArgsView args) {
       continue;
     } else if (arg == "-r" || arg == "--release") {
       buildProfile = BuildProfile::Release;
+    } else if (arg == "--stats") {
+      stats = true;
+    } else if (arg == "--profile" || arg.starts_with("--profile=")) {
+      if (const std::size_t eq = arg.find('='); eq != std::string_view::npos) {
+        const std::string_view profiler = arg.substr(eq + 1);
+        Ensure(profiler == "perf", "unsupported profiler: {}", profiler);
+      }
+      profile = true;
+    } else if (arg == "--heap-profile") {
+      heapProfile = true;
     } else if (arg == "-j" || arg == "--jobs") {
       if (itr + 1 == args.end()) {
         return Subcmd::missingOptArgumentFor(arg);
@@ -72,15 +151,68 @@ static Result<void> runMain(const CliArgsView args) {
     runArgs.emplace_back(*itr);
   }
 
+  Ensure(!(heapProfile && (profile || stats)),
+         "--heap-profile cannot be used with --profile or --stats");
+  if (profile) {
+    Ensure(!stats, "--stats and --profile cannot be used together");
+    Ensure(commandExists("perf"), "perf is required for --profile");
+    // Optimized, but with the debug info and frame pointers perf needs to
+    // walk the stacks.
+    buildProfile = BuildProfile::Profiling;
+  }
+
   const auto manifest = Try(Manifest::tryParse());
   std::string outDir;
   Try(buildImpl(manifest, outDir, buildProfile));
+  if (profile) {
+    return profileProgram(manifest, outDir, runArgs);
+  }
+
+  std::optional<HeapProfiler> heapProfiler;
+  if (heapProfile) {
+    heapProfiler = Try(HeapProfiler::init(outDir));
+  }
 
   Diag::info("Running", "`{}/{}`",
              fs::relative(outDir, manifest.path.parent_path()).string(),
              manifest.package.name);
-  const Command command(outDir + "/" + manifest.package.name, runArgs);
+  Command command(outDir + "/" + manifest.package.name, runArgs);
+  if (heapProfiler.has_value()) {
+    heapProfiler->attach(command);
+  }
+
+  // The counters are inherited by the program, and count in it once it has
+  // exited.
+  std::optional<perf::Counters> counters;
+  if (stats) {
+    counters.emplace();
+    if (!counters->available()) {
+      Diag::warn("Performance counters are unavailable: {}",
+                 counters->unavailableReason());
+    } else if (!counters->complete()) {
+      Diag::warn("Some performance counters are unavailable: {}",
+                 counters->unavailableReason());
+    }
+    counters->reset();
+    counters->enable();
+  }
+  const auto start = std::chrono::steady_clock::now();
   const ExitStatus exitStatus = Try(execCmd(command));
+  const std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  if (counters.has_value()) {
+    counters->disable();
+    std::string line =
+        fmt::format("{} wall time", formatDuration(elapsed.count()));
+    if (const auto counts = counters->read(); !counts.empty()) {
+      line += fmt::format(", {}", formatCounters(counts, {}));
+    }
+    Diag::info("Stats", "{}", line);
+  }
+  if (heapProfiler.has_value()) {
+    Try(heapProfiler->report(manifest.path.parent_path(),
+                             manifest.package.name));
+  }
   if (exitStatus.success()) {
     return Ok();
   } else {
@@ -7,31 +7,70 @@
 #include "Command.hpp"
 #include "Common.hpp"
 #include "Diag.hpp"
+#include "Git2.hpp"
+#include "HeapProfile.hpp"
 #include "Manifest.hpp"
 #include "Parallelism.hpp"
 #include "Rustify/Result.hpp"
+#include "TestHistory.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <charconv>
 #include <chrono>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <sstream>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 namespace cabin {
 
 class Test {
-  Manifest manifest;
+  // The package under test, or every member of a workspace.
+  std::vector<Manifest> packages;
+  std::optional<Workspace> workspace;
+  fs::path rootPath;
   fs::path outDir;
+  // Hold the lock on the output directory until the tests have run, since
+  // they write next to their binaries.
+  std::vector<BuildConfig> configs;
   std::vector<std::string> unittestTargets;
+  std::unordered_map<std::string, fs::path> unittestSources;
+  // Hash of the [test].data of the package each test belongs to.
+  std::unordered_map<std::string, std::uint64_t> unittestDataHashes;
   bool enableCoverage = false;
-
-  explicit Test(Manifest manifest) : manifest(std::move(manifest)) {}
-
+  bool heapProfile = false;
+  std::size_t testThreads = 1;
+  // Rerun tests that passed last time with the same binary and data.
+  bool noCache = false;
+  // Substrings of the source paths or names of the tests to build and run.
+  std::vector<std::string> filters;
+  // Only build and run the tests affected by changes since this revision.
+  std::optional<std::string> changedSince;
+
+  explicit Test(Manifest manifest)
+      : packages{ std::move(manifest) },
+        rootPath(packages.front().path.parent_path()) {}
+  explicit Test(Workspace ws)
+      : packages(ws.members), workspace(std::move(ws)),
+        rootPath(workspace->rootPath) {}
+
+  std::string sourcePathOf(const std::string& target) const;
+  bool matchesFilters(const std::string& target) const;
   Result<void> compileTestTargets();
   Result<void> runTestTargets();
 
@@ -44,20 +83,139 @@ const Subcmd TEST_CMD = //
         .setShort("t")
         .setDesc("Run the tests of a local package")
         .addOpt(OPT_JOBS)
+        .addOpt(Opt{ "--test-threads" }
+                    .setDesc("Number of test binaries to run at once "
+                             "[default: --jobs]")
+                    .setPlaceholder("<NUM>"))
         .addOpt(Opt{ "--coverage" }.setDesc("Enable code coverage analysis"))
+        .addOpt(Opt{ "--heap-profile" }.setDesc(
+            "Report where the tests allocated memory"))
+        .addOpt(Opt{ "--changed-since" }
+                    .setDesc("Only run tests affected by changes since a git "
+                             "revision")
+                    .setPlaceholder("<REV>"))
+        .addOpt(Opt{ "--no-cache" }.setDesc(
+            "Run tests even if they passed last time with the same binary"))
+        .setArg(Arg{ "TESTNAME" }
+                    .setDesc("Only build and run tests whose source path or "
+                             "name contains one of these")
+                    .setVariadic(true)
+                    .setRequired(false))
         .setMainFn(Test::exec);
 
+std::string Test::sourcePathOf(const std::string& target) const {
+  return fs::relative(unittestSources.at(target), rootPath).generic_string();
+}
+
+bool Test::matchesFilters(const std::string& target) const {
+  if (filters.empty()) {
+    return true;
+  }
+  const std::string sourcePath = sourcePathOf(target);
+  return std::ranges::any_of(filters, [&](const std::string& filter) {
+    return sourcePath.find(filter) != std::string::npos
+           || target.find(filter) != std::string::npos;
+  });
+}
+
+// Lists the files changed since `rev`, including uncommitted and untracked
+// ones, as canonical paths.
+static Result<std::unordered_set<std::string>>
+listChangedFiles(const fs::path& rootPath, const std::string& rev) {
+  std::unordered_set<std::string> changedFiles;
+  try {
+    git2::Repository repo;
+    repo.discover(rootPath.string());
+    const fs::path workdir = repo.workdir();
+    Ensure(!workdir.empty(), "{} is in a bare repository", rootPath.string());
+
+    git2::Diff diff;
+    diff.treeToWorkdirWithIndex(repo, repo.revparseSingle(rev));
+    for (const std::string& path : diff.paths()) {
+      std::error_code ec;
+      changedFiles.insert(fs::weakly_canonical(workdir / path, ec).string());
+    }
+  } catch (const git2::Exception& e) {
+    Bail("failed to list changes since `{}`: {}", rev, e.what());
+  }
+  return Ok(changedFiles);
+}
+
+// Whether any of the [test].data of `manifest` changed, which affects all of
+// its tests.
+static bool
+isTestDataChanged(const Manifest& manifest,
+                  const std::unordered_set<std::string>& changedFiles) {
+  for (const std::string& entry : manifest.test.data) {
+    std::error_code ec;
+    const std::string path =
+        fs::weakly_canonical(manifest.path.parent_path() / entry, ec).string();
+    if (std::ranges::any_of(changedFiles, [&](const std::string& changed) {
+          return changed == path || changed.starts_with(path + '/');
+        })) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Result<void> Test::compileTestTargets() {
   const auto start = std::chrono::steady_clock::now();
 
   const BuildProfile buildProfile = BuildProfile::Test;
-  const BuildConfig config = Try(emitNinja(
-      manifest, buildProfile, /*includeDevDeps=*/true, enableCoverage));
-  outDir = config.outBasePath;
-  unittestTargets = config.getTestTargets();
+  configs.clear();
+  if (workspace.has_value()) {
+    configs = Try(emitWorkspaceNinja(workspace.value(), buildProfile,
+                                     /*includeDevDeps=*/true, enableCoverage));
+  } else {
+    configs.push_back(Try(emitNinja(packages.front(), buildProfile,
+                                    /*includeDevDeps=*/true, enableCoverage)));
+  }
+  outDir = configs.front().outBasePath;
+
+  std::optional<std::unordered_set<std::string>> changedFiles;
+  if (changedSince.has_value()) {
+    changedFiles = Try(listChangedFiles(rootPath, changedSince.value()));
+  }
+
+  // Configs come in the order of `packages`.
+  bool anyTests = false;
+  for (std::size_t i = 0; i < configs.size(); ++i) {
+    const BuildConfig& config = configs[i];
+    const Manifest& manifest = packages[i];
+    const std::uint64_t dataHash =
+        Try(hashTestData(manifest.path.parent_path(), manifest.test.data));
+
+    std::unordered_set<std::string> affected;
+    if (changedFiles.has_value()) {
+      const std::vector<std::string> targets =
+          isTestDataChanged(manifest, changedFiles.value())
+              ? config.getTestTargets()
+              : config.getTestTargetsAffectedBy(changedFiles.value());
+      affected.insert(targets.begin(), targets.end());
+    }
+
+    for (const std::string& target : config.getTestTargets()) {
+      anyTests = true;
+      unittestSources.emplace(target, config.getTestSource(target));
+      unittestDataHashes.emplace(target, dataHash);
+      // Filtered out tests are not even built.
+      if (matchesFilters(target)
+          && (!changedFiles.has_value() || affected.contains(target))) {
+        unittestTargets.push_back(target);
+      }
+    }
+  }
 
   if (unittestTargets.empty()) {
-    Diag::warn("No test targets found");
+    if (!anyTests) {
+      Diag::warn("No test targets found");
+    } else if (!filters.empty()) {
+      Diag::warn("No test targets match {}", fmt::join(filters, ", "));
+    } else {
+      Diag::info("Ok", "No tests affected by changes since `{}`",
+                 changedSince.value());
+    }
     return Ok();
   }
 
@@ -66,9 +224,11 @@ Result<void> Test::compileTestTargets() {
   const bool needsBuild = Try(ninjaNeedsWork(outDir, unittestTargets));
 
   if (needsBuild) {
-    Diag::info("Compiling", "{} v{} ({})", manifest.package.name,
-               manifest.package.version.toString(),
-               manifest.path.parent_path().string());
+    for (const Manifest& manifest : packages) {
+      Diag::info("Compiling", "{} v{} ({})", manifest.package.name,
+                 manifest.package.version.toString(),
+                 manifest.path.parent_path().string());
+    }
 
     Command buildCmd(baseCmd);
     for (const std::string& target : unittestTargets) {
@@ -82,57 +242,218 @@ Result<void> Test::compileTestTargets() {
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
 
-  const Profile& profile = manifest.profiles.at(buildProfile);
+  const Profile& profile = packages.front().profiles.at(buildProfile);
   Diag::info("Finished", "`{}` profile [{}] target(s) in {:.2f}s", buildProfile,
              profile, elapsed.count());
 
   return Ok();
 }
 
-Result<void> Test::runTestTargets() {
-  using std::string_view_literals::operator""sv;
+// The outcome of one test binary, with its output captured.
+struct TestResult {
+  std::string target;
+  std::string sourcePath;
+  TestFingerprint fingerprint;
+  // Whether the test was skipped since it passed last time it ran with the
+  // same fingerprint.
+  bool cached = false;
+  ExitStatus exitStatus;
+  std::string stdOut;
+  std::string stdErr;
+  double duration = 0.0;
+  // The test cases the binary reported, if it uses the cabin test runner.
+  std::vector<TestCaseReport> cases;
+};
+
+static std::vector<TestCaseReport> readTestReport(const fs::path& path) {
+  std::ifstream ifs(path);
+  if (!ifs) {
+    return {};
+  }
+  std::ostringstream oss;
+  oss << ifs.rdbuf();
+  return parseTestReport(oss.str());
+}
 
+static std::string describeCases(const std::vector<TestCaseReport>& cases) {
+  return cases.empty() ? "" : fmt::format("{} tests, ", cases.size());
+}
+
+Result<void> Test::runTestTargets() {
   const auto start = std::chrono::steady_clock::now();
 
-  std::size_t numPassed = 0;
-  std::size_t numFailed = 0;
-  ExitStatus exitStatus;
-  for (const std::string& target : unittestTargets) {
-    static constexpr std::string_view unitPrefix = "unittests/";
-    std::string sourcePath;
-    if (target.starts_with(unitPrefix)) {
-      sourcePath = target.substr(unitPrefix.size());
-    } else {
-      sourcePath = target;
-    }
-    if (sourcePath.ends_with(".test"sv)) {
-      sourcePath.resize(sourcePath.size() - ".test"sv.size());
+  TestHistory history = TestHistory::load(outDir);
+  const std::vector<std::string> scheduled =
+      history.schedule(unittestTargets);
+
+  std::optional<HeapProfiler> heapProfiler;
+  if (heapProfile) {
+    heapProfiler = Try(HeapProfiler::init(outDir));
+  }
+
+  // Each worker takes the next test in the schedule, so the slowest tests
+  // start first and the short ones fill in the gaps.
+  std::vector<TestResult> results;
+  std::optional<std::string> runError;
+  std::mutex mtx;
+  std::atomic<std::size_t> next = 0;
+  // Coverage data and heap profiles are only written when a test actually
+  // runs.
+  const bool useCache = !noCache && !enableCoverage && !heapProfile;
+  // Binaries using tests::runTests() run their test cases on threads of
+  // their own; split the jobs between the binaries running at once.
+  const std::size_t numWorkers = std::min(testThreads, scheduled.size());
+  const std::size_t caseThreads =
+      numWorkers == 0 ? 1
+                      : std::max<std::size_t>(1, getParallelism() / numWorkers);
+  const auto worker = [&] {
+    for (std::size_t i = next++; i < scheduled.size(); i = next++) {
+      const std::string& target = scheduled[i];
+      const std::string sourcePath = sourcePathOf(target);
+
+      // Fingerprinted even with the cache off, for the runs after this one.
+      const Result<TestFingerprint> fingerprint = history.fingerprint(
+          target, outDir / target, unittestDataHashes.at(target));
+      if (fingerprint.is_err()) {
+        const std::lock_guard lock(mtx);
+        runError = fingerprint.unwrap_err()->what();
+        continue;
+      }
+      if (useCache && history.passedWith(target, fingerprint.unwrap())) {
+        const std::lock_guard lock(mtx);
+        Diag::info("Cached", "unittests {}", sourcePath);
+        results.push_back(TestResult{
+            .target = target,
+            .sourcePath = sourcePath,
+            .fingerprint = fingerprint.unwrap(),
+            .cached = true,
+            .exitStatus = ExitStatus(),
+            .stdOut = "",
+            .stdErr = "",
+            .duration = 0.0,
+            .cases = {},
+        });
+        continue;
+      }
+
+      // Binaries using tests::runTests() report their test cases here.
+      const fs::path reportPath = (outDir / target).concat(".report");
+      std::error_code ec;
+      fs::remove(reportPath, ec);
+
+      Command testCmd((outDir / target).string());
+      testCmd.addEnv("CABIN_TEST_REPORT", reportPath.string());
+      testCmd.addEnv("CABIN_TEST_THREADS", std::to_string(caseThreads));
+      if (heapProfiler.has_value()) {
+        heapProfiler->attach(testCmd);
+      }
+
+      const auto testStart = std::chrono::steady_clock::now();
+      const Result<CommandOutput> output = testCmd.output();
+      const std::chrono::duration<double> testElapsed =
+          std::chrono::steady_clock::now() - testStart;
+      std::vector<TestCaseReport> cases = readTestReport(reportPath);
+
+      const std::lock_guard lock(mtx);
+      if (output.is_err()) {
+        runError = fmt::format("failed to run {}: {}", target,
+                                 output.unwrap_err()->what());
+        continue;
+      }
+      TestResult result{
+        .target = target,
+        .sourcePath = sourcePath,
+        .fingerprint = fingerprint.unwrap(),
+        .cached = false,
+        .exitStatus = output.unwrap().exitStatus,
+        .stdOut = output.unwrap().stdOut,
+        .stdErr = output.unwrap().stdErr,
+        .duration = testElapsed.count(),
+        .cases = std::move(cases),
+      };
+      if (result.exitStatus.success()) {
+        Diag::info("Passed", "unittests {} ({}{:.2f}s)", sourcePath,
+                   describeCases(result.cases), result.duration);
+      } else {
+        Diag::warn("unittests {} failed ({}{:.2f}s): {}", sourcePath,
+                   describeCases(result.cases), result.duration,
+                   result.exitStatus);
+      }
+      results.push_back(std::move(result));
     }
-    sourcePath.insert(0, "src/");
+  };
 
-    const fs::path absoluteBinary = outDir / target;
-    const std::string testBinPath =
-        fs::relative(absoluteBinary, manifest.path.parent_path()).string();
-    Diag::info("Running", "unittests {} ({})", sourcePath, testBinPath);
+  std::vector<std::thread> workers;
+  workers.reserve(numWorkers);
+  for (std::size_t i = 0; i < numWorkers; ++i) {
+    workers.emplace_back(worker);
+  }
+  for (std::thread& thread : workers) {
+    thread.join();
+  }
+  if (runError.has_value()) {
+    Bail("{}", runError.value());
+  }
+  if (heapProfiler.has_value()) {
+    Try(heapProfiler->report(rootPath, "unittests"));
+  }
 
-    const ExitStatus curExitStatus =
-        Try(execCmd(Command(absoluteBinary.string())));
-    if (curExitStatus.success()) {
+  std::size_t numPassed = 0;
+  std::size_t numCached = 0;
+  std::vector<const TestResult*> failures;
+  for (const TestResult& result : results) {
+    if (result.cached) {
+      // Keep the duration of the run that was skipped.
+      ++numPassed;
+      ++numCached;
+      continue;
+    }
+    history.records[result.target] = TestRecord{
+      .duration = result.duration,
+      .passed = result.exitStatus.success(),
+      .fingerprint = result.fingerprint,
+    };
+    if (result.exitStatus.success()) {
       ++numPassed;
     } else {
-      ++numFailed;
-      exitStatus = curExitStatus;
+      failures.push_back(&result);
+    }
+  }
+  if (const Result<void> res = history.save(outDir); res.is_err()) {
+    spdlog::debug("Failed to save test history: {}", res.unwrap_err()->what());
+  }
+
+  // Failures are reported together and in a stable order, so that their
+  // output isn't interleaved with the other tests'.
+  std::ranges::sort(failures, [](const TestResult* lhs, const TestResult* rhs) {
+    return lhs->sourcePath < rhs->sourcePath;
+  });
+  for (const TestResult* failure : failures) {
+    fmt::print(stderr, "\n---- {} ({}) ----\n", failure->sourcePath,
+               failure->exitStatus);
+    fmt::print(stderr, "{}{}", failure->stdOut, failure->stdErr);
+  }
+  if (!failures.empty()) {
+    fmt::print(stderr, "\nfailures:\n");
+    for (const TestResult* failure : failures) {
+      fmt::print(stderr, "    {}\n", failure->sourcePath);
+      for (const TestCaseReport& testCase : failure->cases) {
+        if (!testCase.passed) {
+          fmt::print(stderr, "        {}\n", testCase.name);
+        }
+      }
     }
+    fmt::print(stderr, "\n");
   }
 
   const auto end = std::chrono::steady_clock::now();
   const std::chrono::duration<double> elapsed = end - start;
 
-  // TODO: collect stdout/err's of failed tests and print them here.
-  const std::string summary =
-      fmt::format("{} passed; {} failed; finished in {:.2f}s", numPassed,
-                  numFailed, elapsed.count());
-  if (!exitStatus.success()) {
+  const std::string summary = fmt::format(
+      "{} passed{}; {} failed; finished in {:.2f}s", numPassed,
+      numCached > 0 ? fmt::format(" ({} cached)", numCached) : "",
+      failures.size(), elapsed.count());
+  if (!failures.empty()) {
     return Err(anyhow::anyhow(summary));
   }
   Diag::info("Ok", "{}", summary);
@@ -141,6 +462,11 @@ Result<void> Test::runTestTargets() {
 
 Result<void> Test::exec(const CliArgsView cliArgs) {
   bool enableCoverage = false;
+  bool heapProfile = false;
+  bool noCache = false;
+  std::optional<std::size_t> testThreads;
+  std::optional<std::string> changedSince;
+  std::vector<std::string> filters;
 
   for (auto itr = cliArgs.begin(); itr != cliArgs.end(); ++itr) {
     const std::string_view arg = *itr;
@@ -161,16 +487,45 @@ Result<void> Test::exec(const CliArgsView cliArgs) {
           std::from_chars(nextArg.begin(), nextArg.end(), numThreads);
       Ensure(ec == std::errc(), "invalid number of threads: {}", nextArg);
       setParallelism(numThreads);
+    } else if (arg == "--test-threads") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      const std::string_view nextArg = *++itr;
+
+      std::size_t numTests{};
+      auto [ptr, ec] =
+          std::from_chars(nextArg.begin(), nextArg.end(), numTests);
+      Ensure(ec == std::errc() && numTests > 0,
+             "invalid number of test threads: {}", nextArg);
+      testThreads = numTests;
     } else if (arg == "--coverage") {
       enableCoverage = true;
+    } else if (arg == "--heap-profile") {
+      heapProfile = true;
+    } else if (arg == "--no-cache") {
+      noCache = true;
+    } else if (arg == "--changed-since") {
+      if (itr + 1 == cliArgs.end()) {
+        return Subcmd::missingOptArgumentFor(arg);
+      }
+      changedSince = *++itr;
+    } else if (!arg.starts_with('-')) {
+      filters.emplace_back(arg);
     } else {
       return TEST_CMD.noSuchArg(arg);
     }
   }
 
-  Manifest manifest = Try(Manifest::tryParse());
-  Test cmd(std::move(manifest));
+  std::optional<Workspace> workspace = Try(Workspace::tryFind());
+  Test cmd = workspace.has_value() ? Test(std::move(workspace.value()))
+                                   : Test(Try(Manifest::tryParse()));
   cmd.enableCoverage = enableCoverage;
+  cmd.heapProfile = heapProfile;
+  cmd.testThreads = testThreads.value_or(getParallelism());
+  cmd.filters = std::move(filters);
+  cmd.noCache = noCache;
+  cmd.changedSince = std::move(changedSince);
 
   Try(cmd.compileTestTargets());
   if (cmd.unittestTargets.empty()) {
@@ -4,16 +4,22 @@
 
 #include <algorithm>
 #include <array>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <fmt/format.h>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <sys/select.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <vector>
 
+extern char** environ; // NOLINT(readability-redundant-declaration)
+
 namespace cabin {
 
 constexpr std::size_t BUFFER_SIZE = 128;
@@ -155,26 +161,122 @@ Result<CommandOutput> Child::waitWithOutput() const noexcept {
                            .stdErr = stdErrOutput });
 }
 
+#ifndef __linux__
+// Without pipe2(), another thread could fork() between our pipe() and
+// fcntl() and leak the pipe, so pipe creation and fork() are serialized.
+static std::mutex spawnMutex;
+#endif
+
+// Creates a pipe closed on exec, which keeps it from leaking into children
+// spawned concurrently by other threads: they would hold its write end open
+// and delay our EOF.
+static int makePipe(std::array<int, 2>& fds) noexcept {
+#ifdef __linux__
+  return pipe2(fds.data(), O_CLOEXEC);
+#else
+  if (pipe(fds.data()) == -1) {
+    return -1;
+  }
+  for (const int fd : fds) {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+  }
+  return 0;
+#endif
+}
+
+// Closes the ends of a pipe that were opened, if any.
+static void closePipe(const std::array<int, 2>& fds) noexcept {
+  for (const int fd : fds) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
+std::string SpawnError::toString() const {
+  return fmt::format("{}: {}", message, std::strerror(errnum));
+}
+
 Result<Child> Command::spawn() const noexcept {
-  std::array<int, 2> stdOutPipe{};
-  std::array<int, 2> stdErrPipe{};
+  auto child = trySpawn();
+  if (child.is_err()) {
+    Bail("{}", child.unwrap_err().toString());
+  }
+  return Ok(child.unwrap());
+}
+
+Result<Child, SpawnError> Command::trySpawn() const noexcept {
+  std::array<int, 2> stdOutPipe{ -1, -1 };
+  std::array<int, 2> stdErrPipe{ -1, -1 };
+#ifndef __linux__
+  const std::scoped_lock lock(spawnMutex);
+#endif
 
   // Set up stdout pipe if needed
   if (stdOutConfig == IOConfig::Piped) {
-    if (pipe(stdOutPipe.data()) == -1) {
-      Bail("pipe() failed for stdout");
+    if (makePipe(stdOutPipe) == -1) {
+      return Err(SpawnError{ .message = "pipe() failed for stdout",
+                             .errnum = errno });
     }
   }
   // Set up stderr pipe if needed
   if (stdErrConfig == IOConfig::Piped) {
-    if (pipe(stdErrPipe.data()) == -1) {
-      Bail("pipe() failed for stderr");
+    if (makePipe(stdErrPipe) == -1) {
+      const int errnum = errno;
+      closePipe(stdOutPipe);
+      return Err(SpawnError{ .message = "pipe() failed for stderr",
+                             .errnum = errnum });
+    }
+  }
+
+  // Prepare arguments.  This must happen before fork(): other threads may
+  // hold the allocator's locks, so the child must not allocate.
+  std::vector<std::vector<char>> argBuffers;
+  std::vector<char*> args;
+  argBuffers.reserve(arguments.size() + 1);
+
+  // Add command
+  argBuffers.emplace_back(command.begin(), command.end());
+  argBuffers.back().push_back('\0');
+  args.push_back(argBuffers.back().data());
+
+  // Add arguments
+  for (const std::string& arg : arguments) {
+    argBuffers.emplace_back(arg.begin(), arg.end());
+    argBuffers.back().push_back('\0');
+    args.push_back(argBuffers.back().data());
+  }
+  args.push_back(nullptr);
+
+  // Likewise for the environment, which is ours with envVars on top.
+  std::vector<std::string> envEntries;
+  std::vector<char*> envp;
+  if (!envVars.empty()) {
+    for (char** env = environ; *env != nullptr; ++env) { // NOLINT
+      const std::string_view entry = *env;
+      const std::string_view key = entry.substr(0, entry.find('='));
+      if (std::ranges::none_of(envVars, [&](const auto& var) {
+            return var.first == key;
+          })) {
+        envEntries.emplace_back(entry);
+      }
+    }
+    for (const auto& [key, value] : envVars) {
+      envEntries.push_back(key + '=' + value);
+    }
+    for (std::string& entry : envEntries) {
+      envp.push_back(entry.data());
     }
+    envp.push_back(nullptr);
   }
 
   const pid_t pid = fork();
   if (pid == -1) {
-    Bail("fork() failed");
+    const int errnum = errno;
+    closePipe(stdOutPipe);
+    closePipe(stdErrPipe);
+    return Err(SpawnError{ .message = "fork() failed", .errnum = errnum });
   } else if (pid == 0) {
     // Child process
 
@@ -202,23 +304,6 @@ Result<Child> Command::spawn() const noexcept {
       close(nullfd);
     }
 
-    // Prepare arguments
-    std::vector<std::vector<char>> argBuffers;
-    std::vector<char*> args;
-
-    // Add command
-    argBuffers.emplace_back(command.begin(), command.end());
-    argBuffers.back().push_back('\0');
-    args.push_back(argBuffers.back().data());
-
-    // Add arguments
-    for (const std::string& arg : arguments) {
-      argBuffers.emplace_back(arg.begin(), arg.end());
-      argBuffers.back().push_back('\0');
-      args.push_back(argBuffers.back().data());
-    }
-    args.push_back(nullptr);
-
     if (!workingDirectory.empty()) {
       if (chdir(workingDirectory.c_str()) == -1) {
         perror("chdir() failed");
@@ -226,6 +311,10 @@ Result<Child> Command::spawn() const noexcept {
       }
     }
 
+    if (!envp.empty()) {
+      environ = envp.data();
+    }
+
     // Execute the command
     if (execvp(command.c_str(), args.data()) == -1) {
       perror("execvp() failed");
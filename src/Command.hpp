@@ -57,6 +57,15 @@ public:
   Result<CommandOutput> waitWithOutput() const noexcept;
 };
 
+// Why a command couldn't be spawned, with the errno of the call that
+// failed, taken right after it did.
+struct SpawnError {
+  std::string_view message;
+  int errnum = 0;
+
+  std::string toString() const;
+};
+
 struct Command {
   enum class IOConfig : uint8_t {
     Null,
@@ -67,6 +76,8 @@ struct Command {
   std::string command;
   std::vector<std::string> arguments;
   std::filesystem::path workingDirectory;
+  // Set in the child's environment on top of ours.
+  std::vector<std::pair<std::string, std::string>> envVars;
   IOConfig stdOutConfig = IOConfig::Inherit;
   IOConfig stdErrConfig = IOConfig::Inherit;
 
@@ -103,10 +114,15 @@ struct Command {
     workingDirectory = dir;
     return *this;
   }
+  Command& addEnv(const std::string_view key, const std::string_view value) {
+    envVars.emplace_back(key, value);
+    return *this;
+  }
 
   std::string toString() const;
 
   Result<Child> spawn() const noexcept;
+  Result<Child, SpawnError> trySpawn() const noexcept;
   Result<CommandOutput> output() const noexcept;
 };
 
@@ -1,13 +1,25 @@
 #include "Dependency.hpp"
 
+#include "Algos.hpp"
 #include "Builder/Compiler.hpp"
 #include "Diag.hpp"
+#include "FileLock.hpp"
 #include "Git2.hpp"
+#include "GlobalCache.hpp"
+#include "Lockfile.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fmt/core.h>
+#include <semaphore>
 #include <spdlog/spdlog.h>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace cabin {
 
@@ -23,32 +35,199 @@ static fs::path getXdgCacheHome() noexcept {
 
 static const fs::path CACHE_DIR(getXdgCacheHome() / "cabin");
 static const fs::path GIT_DIR(CACHE_DIR / "git");
+static const fs::path GIT_DB_DIR(GIT_DIR / "db");
 static const fs::path GIT_SRC_DIR(GIT_DIR / "src");
 
-Result<CompilerOpts> GitDependency::install() const {
-  fs::path installDir = GIT_SRC_DIR / name;
-  if (target.has_value()) {
-    installDir += '-' + target.value();
+const fs::path& getCacheDir() noexcept { return CACHE_DIR; }
+
+// Where the remote's default branch is recorded in a mirror.
+static constexpr std::string_view REMOTE_HEAD = "refs/remotes/origin/HEAD";
+
+// Dependencies are installed concurrently, but hitting the same hosts with
+// too many simultaneous clones only makes each of them slower.
+static constexpr std::ptrdiff_t MAX_CONCURRENT_FETCHES = 4;
+static std::counting_semaphore<MAX_CONCURRENT_FETCHES>
+    fetchSlots(MAX_CONCURRENT_FETCHES);
+
+class FetchSlot {
+public:
+  FetchSlot() { fetchSlots.acquire(); }
+  FetchSlot(const FetchSlot&) = delete;
+  FetchSlot& operator=(const FetchSlot&) = delete;
+  FetchSlot(FetchSlot&&) noexcept = delete;
+  FetchSlot& operator=(FetchSlot&&) noexcept = delete;
+  ~FetchSlot() noexcept { fetchSlots.release(); }
+};
+
+// One bare mirror is kept per URL so that checking out another revision of
+// the same dependency only downloads the objects the mirror doesn't have.
+static fs::path getDbDir(const std::string_view name,
+                         const std::string_view url) {
+  return GIT_DB_DIR / fmt::format("{}-{:016x}", name, fnv1aHash(url));
+}
+
+static bool hasRevision(const git2::Repository& repo,
+                        const std::string& spec) {
+  try {
+    repo.revparseSingle(spec);
+    return true;
+  } catch (const git2::Exception&) {
+    return false;
   }
+}
 
-  if (fs::exists(installDir) && !fs::is_empty(installDir)) {
-    spdlog::debug("{} is already installed", name);
+static bool isFullCommitHash(const std::string_view str) {
+  constexpr std::size_t hashLen = 40;
+  return str.size() == hashLen
+         && std::ranges::all_of(str, [](const char c) {
+              return std::isxdigit(static_cast<unsigned char>(c)) != 0;
+            });
+}
+
+// Fetch just enough of the remote to check out `target`, or the default
+// branch if there's none.  Only the tip's tree is ever checked out, so the
+// named ref is fetched at depth 1; the whole history is fetched only when
+// the target can't be named by a refspec, e.g., an abbreviated commit hash.
+static void fetchRevision(const git2::Repository& db, const std::string& url,
+                          const std::optional<std::string>& target,
+                          const std::string& spec) {
+  git2::Remote remote;
+  remote.createAnonymous(db, url);
+
+  std::vector<std::string> refspecs;
+  if (!target.has_value()) {
+    refspecs.push_back(fmt::format("+HEAD:{}", REMOTE_HEAD));
+  } else if (isFullCommitHash(target.value())) {
+    refspecs.push_back(fmt::format("+{0}:refs/commits/{0}", target.value()));
   } else {
-    git2::Repository repo;
-    repo.clone(url, installDir.string());
-
-    if (target.has_value()) {
-      // Checkout to target.
-      const std::string target = this->target.value();
-      const git2::Object obj = repo.revparseSingle(target);
-      repo.setHeadDetached(obj.id());
-      repo.checkoutHead(true);
+    refspecs.push_back(
+        fmt::format("+refs/tags/{0}:refs/tags/{0}", target.value()));
+    refspecs.push_back(
+        fmt::format("+refs/heads/{0}:refs/heads/{0}", target.value()));
+  }
+
+  try {
+    remote.fetch(refspecs, /*depth=*/1);
+    if (hasRevision(db, spec)) {
+      return;
     }
+  } catch (const git2::Exception& e) {
+    // Not every server lets clients fetch a commit by its id.
+    spdlog::debug("Shallow fetch of {} failed: {}", url, e.what());
+  }
+
+  spdlog::debug("Fetching the full history of {}", url);
+  remote.fetch(
+      {
+          "+refs/heads/*:refs/heads/*",
+          "+refs/tags/*:refs/tags/*",
+          fmt::format("+HEAD:{}", REMOTE_HEAD),
+      },
+      GIT_FETCH_DEPTH_UNSHALLOW);
+}
+
+fs::path GitDependency::installDir(const std::string_view rev) const {
+  return GIT_SRC_DIR
+         / fmt::format("{}-{}", name, rev.substr(0, git2::SHORT_HASH_LEN));
+}
+
+bool GitDependency::isInstalled(const std::string_view rev) const {
+  const fs::path installDir = this->installDir(rev);
+  return fs::exists(installDir) && !fs::is_empty(installDir);
+}
 
-    Diag::info("Downloaded", "{} {}", name,
-               target.has_value() ? target.value() : url);
+static void openDb(git2::Repository& db, const fs::path& dbDir) {
+  if (fs::exists(dbDir / "HEAD")) {
+    db.openBare(dbDir.string());
+  } else {
+    db.initBare(dbDir.string());
+  }
+}
+
+Result<std::string> GitDependency::resolve() const {
+  const fs::path dbDir = getDbDir(name, url);
+  const std::string_view what = target.has_value() ? target.value() : url;
+  Ensure(!isOffline() || fs::exists(dbDir / "HEAD"),
+         "cannot resolve {} {} with --offline: it has never been fetched",
+         name, what);
+
+  // Concurrent fetches into one mirror would fight over its ref locks.
+  const FileLock dbLock = Try(lockCacheEntry(dbDir));
+  git2::Repository db;
+  openDb(db, dbDir);
+  recordCacheUse(dbDir);
+
+  const std::string spec = target.has_value()
+                               ? target.value() + "^{commit}"
+                               : std::string(REMOTE_HEAD);
+  // Tags and revisions never move, so a mirror that already has them is
+  // up to date.  Branches and the default branch always need a fetch,
+  // unless offline where the last fetched tip is used.
+  const bool isBranch =
+      target.has_value() && hasRevision(db, "refs/heads/" + target.value());
+  const bool needsFetch =
+      !target.has_value() || isBranch || !hasRevision(db, spec);
+  if (needsFetch && !isOffline()) {
+    const FetchSlot slot;
+    fetchRevision(db, url, target, spec);
+    Diag::info("Downloaded", "{} {}", name, what);
+  }
+
+  Ensure(hasRevision(db, spec), "cannot resolve {} {}{}", name, what,
+         isOffline() ? " with --offline" : "");
+  return Ok(db.revparseSingle(spec).id().toString());
+}
+
+static Result<void> checkoutRevision(const GitDependency& dep,
+                                     const std::string& rev,
+                                     const fs::path& installDir) {
+  const fs::path dbDir = getDbDir(dep.name, dep.url);
+  const FileLock dbLock = Try(lockCacheEntry(dbDir));
+  git2::Repository db;
+  openDb(db, dbDir);
+  recordCacheUse(dbDir);
+
+  const std::string spec = rev + "^{commit}";
+  if (!hasRevision(db, spec)) {
+    // The commit comes from cabin.lock and the mirror was never fetched
+    // on this machine, or was cleaned since.
+    Ensure(!isOffline(), "cannot fetch {} {} with --offline", dep.name, rev);
+    const FetchSlot slot;
+    fetchRevision(db, dep.url, rev, spec);
+    Diag::info("Downloaded", "{} {}", dep.name,
+               dep.target.has_value() ? dep.target.value() : rev);
   }
 
+  // Materialize the revision next to its final location and move it into
+  // place, so an interrupted checkout never looks installed.
+  const git2::Object obj = db.revparseSingle(spec);
+  fs::path tmpDir = installDir;
+  tmpDir += ".tmp";
+  fs::remove_all(tmpDir);
+  fs::create_directories(tmpDir);
+  db.checkoutTree(obj, tmpDir.string());
+  fs::remove_all(installDir);
+  fs::rename(tmpDir, installDir);
+  spdlog::debug("Checked out {} {} from {}", dep.name, rev, dbDir.string());
+  return Ok();
+}
+
+Result<CompilerOpts> GitDependency::install(const std::string& rev) const {
+  const fs::path installDir = this->installDir(rev);
+
+  if (isInstalled(rev)) {
+    spdlog::debug("{} is already installed", name);
+  } else {
+    const FileLock lock = Try(lockCacheEntry(installDir));
+    // Another process may have installed it while this one was waiting.
+    if (isInstalled(rev)) {
+      spdlog::debug("{} was installed by another process", name);
+    } else {
+      Try(checkoutRevision(*this, rev, installDir));
+    }
+  }
+  recordCacheUse(installDir);
+
   const fs::path includeDir = installDir / "include";
   fs::path include;
 
@@ -64,8 +243,12 @@ Result<CompilerOpts> GitDependency::install() const {
                          LdFlags()));
 }
 
+fs::path PathDependency::installDir() const {
+  return fs::weakly_canonical(path);
+}
+
 Result<CompilerOpts> PathDependency::install() const {
-  const fs::path installDir = fs::weakly_canonical(path);
+  const fs::path installDir = this->installDir();
   if (fs::exists(installDir) && !fs::is_empty(installDir)) {
     spdlog::debug("{} is already installed", name);
   } else {
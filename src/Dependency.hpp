@@ -4,19 +4,45 @@
 #include "Rustify/Result.hpp"
 #include "VersionReq.hpp"
 
+#include <filesystem>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <variant>
 
 namespace cabin {
 
+namespace fs = std::filesystem;
+
+// ~/.cache/cabin, or $XDG_CACHE_HOME/cabin.
+const fs::path& getCacheDir() noexcept;
+
+// What installing a dependency produced.
+struct InstalledDep {
+  std::string name;
+  CompilerOpts compilerOpts;
+  // Where a git or path dependency lives on disk.  It's built as a static
+  // library if it ships sources under src/.
+  std::optional<fs::path> rootDir;
+};
+
 struct GitDependency {
   const std::string name;
   const std::string url;
   const std::optional<std::string> target;
 
-  Result<CompilerOpts> install() const;
+  // Resolve `target`, or the default branch if there's none, to a commit
+  // id.  Tags and commits already in the local mirror resolve without
+  // touching the network.
+  Result<std::string> resolve() const;
+  // Check out the commit `rev`, as returned by `resolve` or recorded in
+  // cabin.lock, fetching it first if needed.
+  Result<CompilerOpts> install(const std::string& rev) const;
+  // Whether `rev` is already checked out, i.e., `install` won't touch the
+  // network.
+  bool isInstalled(std::string_view rev) const;
+  fs::path installDir(std::string_view rev) const;
 
   GitDependency(std::string name, std::string url,
                 std::optional<std::string> target)
@@ -28,6 +54,7 @@ struct PathDependency {
   const std::string path;
 
   Result<CompilerOpts> install() const;
+  fs::path installDir() const;
 
   PathDependency(std::string name, std::string path)
       : name(std::move(name)), path(std::move(path)) {}
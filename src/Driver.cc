@@ -49,6 +49,13 @@ const Cli& getCli() noexcept {
                       .setPlaceholder("<WHEN>")
                       .setGlobal(true)
                       .setDefault("auto"))
+          .addOpt(Opt{ "--locked" }
+                      .setDesc("Assert that cabin.lock will remain unchanged")
+                      .setGlobal(true))
+          .addOpt(Opt{ "--offline" }
+                      .setDesc("Install dependencies without accessing the "
+                               "network")
+                      .setGlobal(true))
           .addOpt(Opt{ "--help" } //
                       .setShort("-h")
                       .setDesc("Print help")
@@ -62,7 +69,10 @@ const Cli& getCli() noexcept {
                       .setGlobal(false)
                       .setHidden(true))
           .addSubcmd(ADD_CMD)
+          .addSubcmd(ASM_CMD)
+          .addSubcmd(BENCH_CMD)
           .addSubcmd(BUILD_CMD)
+          .addSubcmd(CACHE_CMD)
           .addSubcmd(CLEAN_CMD)
           .addSubcmd(FMT_CMD)
           .addSubcmd(HELP_CMD)
@@ -0,0 +1,127 @@
+#include "FileLock.hpp"
+
+#include "Diag.hpp"
+#include "Rustify/Result.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <sys/file.h>
+#include <system_error>
+#include <unistd.h>
+#include <utility>
+
+namespace cabin {
+
+static Result<int> openLockFile(const fs::path& path) {
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+  const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  Ensure(fd != -1, "failed to open {}: {}", path.string(),
+         std::strerror(errno));
+  return Ok(fd);
+}
+
+// flock(2) locks belong to the open file description, so two threads of
+// the same process also exclude each other as long as each opens the file
+// itself.
+static int lockFile(const int fd, const int operation) {
+  int ret = 0;
+  do {
+    ret = ::flock(fd, operation);
+  } while (ret == -1 && errno == EINTR);
+  return ret;
+}
+
+Result<FileLock> FileLock::acquire(const fs::path& path,
+                                   const std::string_view what) {
+  FileLock lock(Try(openLockFile(path)));
+  if (lockFile(lock.fd, LOCK_EX | LOCK_NB) == 0) {
+    return Ok(std::move(lock));
+  }
+  Ensure(errno == EWOULDBLOCK, "failed to lock {}: {}", path.string(),
+         std::strerror(errno));
+
+  Diag::info("Blocking", "waiting for file lock on {}", what);
+  Ensure(lockFile(lock.fd, LOCK_EX) == 0, "failed to lock {}: {}",
+         path.string(), std::strerror(errno));
+  return Ok(std::move(lock));
+}
+
+Result<std::optional<FileLock>> FileLock::tryAcquire(const fs::path& path) {
+  FileLock lock(Try(openLockFile(path)));
+  if (lockFile(lock.fd, LOCK_EX | LOCK_NB) == 0) {
+    return Ok(std::optional<FileLock>(std::move(lock)));
+  }
+  Ensure(errno == EWOULDBLOCK, "failed to lock {}: {}", path.string(),
+         std::strerror(errno));
+  return Ok(std::nullopt);
+}
+
+FileLock::FileLock(FileLock&& other) noexcept
+    : fd(std::exchange(other.fd, -1)) {}
+
+FileLock& FileLock::operator=(FileLock&& other) noexcept {
+  if (this != &other) {
+    if (fd != -1) {
+      ::close(fd);
+    }
+    fd = std::exchange(other.fd, -1);
+  }
+  return *this;
+}
+
+FileLock::~FileLock() noexcept {
+  // Closing the descriptor releases the lock.
+  if (fd != -1) {
+    ::close(fd);
+  }
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <fmt/format.h>
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testFileLock) {
+  const fs::path dir = fs::temp_directory_path()
+                       / fmt::format("cabin-test-file-lock-{}", getpid());
+  fs::remove_all(dir);
+  const fs::path path = dir / "entry.lock";
+
+  {
+    const FileLock lock = FileLock::acquire(path, "entry").unwrap();
+    assertTrue(fs::exists(path));
+    assertFalse(FileLock::tryAcquire(path).unwrap().has_value());
+
+    // Locks on other files are independent.
+    const auto other = FileLock::tryAcquire(dir / "other.lock").unwrap();
+    assertTrue(other.has_value());
+    assertFalse(FileLock::tryAcquire(dir / "other.lock").unwrap().has_value());
+  }
+  // Both are released on destruction.
+  assertTrue(FileLock::tryAcquire(path).unwrap().has_value());
+  assertTrue(FileLock::tryAcquire(dir / "other.lock").unwrap().has_value());
+
+  fs::remove_all(dir);
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
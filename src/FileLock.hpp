@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Rustify/Result.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// An advisory, exclusive lock on a file, held until destruction.  Cabin
+// processes take one before touching a shared cache entry or output
+// directory, so concurrent runs wait for each other only where they
+// actually overlap.
+class FileLock {
+  int fd = -1;
+
+  explicit FileLock(const int fd) noexcept : fd(fd) {}
+
+public:
+  // Blocks until the lock on `path` is acquired, telling the user what it
+  // waits for if another process holds it.  The file is created if needed.
+  static Result<FileLock> acquire(const fs::path& path, std::string_view what);
+  // Returns nothing if the lock is held by someone else.
+  static Result<std::optional<FileLock>> tryAcquire(const fs::path& path);
+
+  FileLock(const FileLock&) = delete;
+  FileLock& operator=(const FileLock&) = delete;
+  FileLock(FileLock&& other) noexcept;
+  FileLock& operator=(FileLock&& other) noexcept;
+  ~FileLock() noexcept;
+};
+
+} // namespace cabin
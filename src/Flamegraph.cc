@@ -0,0 +1,390 @@
+#include "Flamegraph.hpp"
+
+#include "Algos.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace cabin {
+
+// Parses a frame line of `perf script`:
+//
+//   55d0c1a2b3c4 parse(std::string_view)+0x14 (/path/to/binary)
+static std::string parseFrame(std::string_view line) {
+  line = trim(line);
+  const std::size_t addrEnd = line.find(' ');
+  if (addrEnd == std::string_view::npos) {
+    return "[unknown]";
+  }
+  std::string_view sym = line.substr(addrEnd + 1);
+  std::string_view dso;
+  if (const std::size_t dsoPos = sym.rfind(" ("); dsoPos != sym.npos) {
+    dso = sym.substr(dsoPos + 2);
+    if (dso.ends_with(')')) {
+      dso.remove_suffix(1);
+    }
+    sym = sym.substr(0, dsoPos);
+  }
+  if (const std::size_t offsetPos = sym.rfind("+0x"); offsetPos != sym.npos) {
+    sym = sym.substr(0, offsetPos);
+  }
+
+  std::string frame;
+  if (sym.empty() || sym == "[unknown]") {
+    // At least tell which library the unknown frame is in.
+    const std::size_t slash = dso.rfind('/');
+    frame = fmt::format(
+        "[{}]", slash == dso.npos ? dso : dso.substr(slash + 1));
+  } else {
+    frame = sym;
+  }
+  // ';' separates the frames of a folded stack.
+  std::ranges::replace(frame, ';', ':');
+  return frame;
+}
+
+FoldedStacks foldPerfScript(const std::string_view script) {
+  FoldedStacks stacks;
+  std::string comm;
+  // Innermost first, as perf prints them.
+  std::vector<std::string> frames;
+  bool inSample = false;
+
+  const auto flush = [&] {
+    if (inSample) {
+      std::string stack = comm;
+      for (auto itr = frames.rbegin(); itr != frames.rend(); ++itr) {
+        stack += ';';
+        stack += *itr;
+      }
+      ++stacks[stack];
+    }
+    inSample = false;
+    frames.clear();
+  };
+
+  for (const std::string_view line : splitLines(script)) {
+    if (trim(line).empty()) {
+      flush();
+    } else if (line.starts_with('#')) {
+      continue;
+    } else if (line.front() == ' ' || line.front() == '\t') {
+      if (inSample) {
+        frames.push_back(parseFrame(line));
+      }
+    } else {
+      // A sample header: "<comm> <pid>[/<tid>] ... <event>:".
+      flush();
+      comm = std::string(line.substr(0, line.find_first_of(" \t")));
+      std::ranges::replace(comm, ';', ':');
+      inSample = true;
+    }
+  }
+  flush();
+  return stacks;
+}
+
+std::string formatFoldedStacks(const FoldedStacks& stacks) {
+  std::string folded;
+  for (const auto& [stack, count] : stacks) {
+    folded += fmt::format("{} {}\n", stack, count);
+  }
+  return folded;
+}
+
+FoldedStacks parseFoldedStacks(const std::string_view folded) {
+  FoldedStacks stacks;
+  for (const std::string_view rawLine : splitLines(folded)) {
+    const std::string_view line = trim(rawLine);
+    // Frames can contain spaces, so the count is after the last one.
+    const std::size_t space = line.rfind(' ');
+    if (space == std::string_view::npos) {
+      continue;
+    }
+    std::uint64_t count = 0;
+    const std::string_view countStr = line.substr(space + 1);
+    const auto [ptr, ec] = std::from_chars(
+        countStr.data(), countStr.data() + countStr.size(), count);
+    if (ec == std::errc() && ptr == countStr.data() + countStr.size()) {
+      stacks[std::string(line.substr(0, space))] += count;
+    }
+  }
+  return stacks;
+}
+
+static std::string escapeXml(const std::string_view str) {
+  std::string escaped;
+  escaped.reserve(str.size());
+  for (const char c : str) {
+    switch (c) {
+    case '&':
+      escaped += "&amp;";
+      break;
+    case '<':
+      escaped += "&lt;";
+      break;
+    case '>':
+      escaped += "&gt;";
+      break;
+    case '"':
+      escaped += "&quot;";
+      break;
+    default:
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+namespace {
+
+struct FrameNode {
+  std::uint64_t samples = 0;
+  std::map<std::string, FrameNode> children;
+};
+
+struct FrameBox {
+  std::string name;
+  std::uint64_t start;
+  std::uint64_t samples;
+  std::size_t depth;
+};
+
+} // namespace
+
+// Lays out the frames under `node`, each after its left siblings and above
+// its caller, in samples.
+static void // NOLINTNEXTLINE(misc-no-recursion)
+layoutFrames(const std::string& name, const FrameNode& node,
+             const std::uint64_t start, const std::size_t depth,
+             std::vector<FrameBox>& boxes, std::size_t& maxDepth) {
+  boxes.push_back(FrameBox{
+      .name = name, .start = start, .samples = node.samples, .depth = depth });
+  maxDepth = std::max(maxDepth, depth);
+  std::uint64_t childStart = start;
+  for (const auto& [childName, child] : node.children) {
+    layoutFrames(childName, child, childStart, depth + 1, boxes, maxDepth);
+    childStart += child.samples;
+  }
+}
+
+// Clicking a frame zooms into it: its descendants widen to fill the graph,
+// its callers span the whole width, and everything else is hidden.
+// Clicking the outermost frame zooms back out.
+static constexpr std::string_view ZOOM_SCRIPT = R"(
+const W = +document.documentElement.getAttribute("data-width");
+const frames = [...document.querySelectorAll("g.f")].map((g) => {
+  const r = g.querySelector("rect");
+  return { g, r, t: g.querySelector("text"), x: +r.getAttribute("x"),
+           w: +r.getAttribute("width"), y: +r.getAttribute("y"),
+           name: g.getAttribute("data-name") };
+});
+const PAD = frames.length ? frames[0].x : 0;
+function label(f, w) {
+  const n = Math.floor((w - 6) / 7);
+  f.t.textContent = n < 3 ? "" :
+    f.name.length <= n ? f.name : f.name.slice(0, n - 2) + "..";
+}
+function zoom(z) {
+  const scale = (W - 2 * PAD) / z.w;
+  for (const f of frames) {
+    let x = f.x, w = f.w;
+    if (f.y > z.y) {
+      if (f.x > z.x + 1e-6 || f.x + f.w < z.x + z.w - 1e-6) {
+        f.g.style.display = "none"; continue;
+      }
+      x = PAD; w = W - 2 * PAD;
+    } else if (f.x + 1e-6 < z.x || f.x + f.w > z.x + z.w + 1e-6) {
+      f.g.style.display = "none"; continue;
+    } else {
+      x = PAD + (f.x - z.x) * scale; w = f.w * scale;
+    }
+    f.g.style.display = "";
+    f.r.setAttribute("x", x); f.r.setAttribute("width", w);
+    f.t.setAttribute("x", x + 3); label(f, w);
+  }
+}
+for (const f of frames) f.g.addEventListener("click", () => zoom(f));
+)";
+
+std::string renderFlamegraph(const FoldedStacks& stacks,
+                             const std::string_view title,
+                             const std::string_view unit) {
+  constexpr double width = 1200.0;
+  constexpr double pad = 10.0;
+  constexpr double frameHeight = 16.0;
+  constexpr double titleHeight = 40.0;
+  // Frames narrower than this are left out to keep the file small.
+  constexpr double minFrameWidth = 0.1;
+
+  FrameNode root;
+  for (const auto& [stack, count] : stacks) {
+    root.samples += count;
+    FrameNode* node = &root;
+    std::size_t begin = 0;
+    while (begin <= stack.size()) {
+      std::size_t end = stack.find(';', begin);
+      if (end == std::string::npos) {
+        end = stack.size();
+      }
+      node = &node->children[stack.substr(begin, end - begin)];
+      node->samples += count;
+      begin = end + 1;
+    }
+  }
+
+  std::vector<FrameBox> boxes;
+  std::size_t maxDepth = 0;
+  layoutFrames("all", root, 0, 0, boxes, maxDepth);
+
+  const double height =
+      titleHeight + (static_cast<double>(maxDepth) + 1) * frameHeight + pad;
+  const double pxPerSample =
+      root.samples == 0 ? 0.0
+                        : (width - 2 * pad) / static_cast<double>(root.samples);
+
+  std::string svg = fmt::format(
+      R"(<?xml version="1.0" standalone="no"?>)"
+      "\n"
+      R"(<svg version="1.1" width="{0}" height="{1}" viewBox="0 0 {0} {1}" )"
+      R"(data-width="{0}" xmlns="http://www.w3.org/2000/svg">)"
+      "\n"
+      R"(<style>text {{ font: 12px Verdana, sans-serif; }} )"
+      R"(g.f {{ cursor: pointer; }} g.f:hover rect {{ stroke: #000; }})"
+      "</style>\n"
+      R"(<rect width="100%" height="100%" fill="#f8f8f8"/>)"
+      "\n"
+      R"(<text x="{2}" y="24" text-anchor="middle" )"
+      R"(style="font-size: 17px">{3}</text>)"
+      "\n",
+      width, height, width / 2, escapeXml(title));
+
+  for (const FrameBox& box : boxes) {
+    const double boxWidth = static_cast<double>(box.samples) * pxPerSample;
+    if (boxWidth < minFrameWidth) {
+      continue;
+    }
+    const double x = pad + static_cast<double>(box.start) * pxPerSample;
+    const double y =
+        height - pad - (static_cast<double>(box.depth) + 1) * frameHeight;
+
+    // A warm color from a hash of the name, so a function keeps its color
+    // across graphs.
+    const std::uint64_t hash = fnv1aHash(box.name);
+    const unsigned red = 205 + (hash & 0xff) % 51;
+    const unsigned green = ((hash >> 8) & 0xff) * 230 / 255;
+    const unsigned blue = ((hash >> 16) & 0xff) * 55 / 255;
+
+    const std::size_t maxChars =
+        boxWidth < 6 ? 0 : static_cast<std::size_t>((boxWidth - 6) / 7);
+    std::string label;
+    if (maxChars >= 3) {
+      label = box.name.size() <= maxChars
+                  ? box.name
+                  : box.name.substr(0, maxChars - 2) + "..";
+    }
+
+    const std::string name = escapeXml(box.name);
+    svg += fmt::format(
+        R"(<g class="f" data-name="{}"><title>{} ({} {}, {:.2f}%)</title>)"
+        R"(<rect x="{:.2f}" y="{:.2f}" width="{:.2f}" height="{:.2f}" )"
+        "fill=\"rgb({},{},{})\" rx=\"2\"/>"
+        R"(<text x="{:.2f}" y="{:.2f}">{}</text></g>)"
+        "\n",
+        name, name, box.samples, unit,
+        100.0 * static_cast<double>(box.samples)
+            / static_cast<double>(std::max<std::uint64_t>(root.samples, 1)),
+        x, y, boxWidth, frameHeight - 1, red, green, blue, x + 3,
+        y + frameHeight - 4, escapeXml(label));
+  }
+
+  svg += fmt::format("<script><![CDATA[{}]]></script>\n</svg>\n",
+                     ZOOM_SCRIPT);
+  return svg;
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testFoldPerfScript) {
+  assertTrue(foldPerfScript("").empty());
+
+  const FoldedStacks stacks = foldPerfScript(
+      "hello 12345 1234.567890:     250000 cpu-clock:u: \n"
+      "\t    55d0c1a2b3c4 fib(int)+0x14 (/tmp/hello)\n"
+      "\t    55d0c1a2b3c5 main+0x20 (/tmp/hello)\n"
+      "\t    7f0000000000 [unknown] (/usr/lib/libc.so.6)\n"
+      "\n"
+      "hello 12345 1234.567891:     250000 cpu-clock:u: \n"
+      "\t    55d0c1a2b3c4 fib(int)+0x18 (/tmp/hello)\n"
+      "\t    55d0c1a2b3c5 main+0x20 (/tmp/hello)\n"
+      "\t    7f0000000000 [unknown] (/usr/lib/libc.so.6)\n"
+      "\n"
+      "hello 12345 1234.567892:     250000 cpu-clock:u: \n"
+      "\t    55d0c1a2b3c6 std::map<int, int>::find(int const&)+0x2 (/tmp/h)\n"
+      "\t    55d0c1a2b3c5 a;b+0x20 (/tmp/hello)\n");
+  assertTrue(stacks
+             == FoldedStacks{
+                 { "hello;[libc.so.6];main;fib(int)", 2 },
+                 { "hello;a:b;std::map<int, int>::find(int const&)", 1 },
+             });
+
+  assertEq(formatFoldedStacks(stacks),
+           "hello;[libc.so.6];main;fib(int) 2\n"
+           "hello;a:b;std::map<int, int>::find(int const&) 1\n");
+  assertTrue(parseFoldedStacks(formatFoldedStacks(stacks)) == stacks);
+  assertTrue(parseFoldedStacks("no-count\nmain 2x\n\nmain;f 3\r\nmain;f 1")
+             == FoldedStacks{ { "main;f", 4 } });
+
+  pass();
+}
+
+static bool svgContains(const std::string_view svg,
+                        const std::string_view str) {
+  return svg.find(str) != std::string_view::npos;
+}
+
+CABIN_TEST_CASE(testRenderFlamegraph) {
+  const std::string svg = renderFlamegraph(
+      { { "hello;main;fib", 3 }, { "hello;main;std::vector<int>::push", 1 } },
+      "hello & co");
+  assertTrue(svg.starts_with("<?xml"));
+  assertTrue(svg.ends_with("</svg>\n"));
+  assertTrue(svgContains(svg, "hello &amp; co"));
+  assertTrue(svgContains(svg, "<title>all (4 samples, 100.00%)</title>"));
+  assertTrue(svgContains(svg, "<title>fib (3 samples, 75.00%)</title>"));
+  assertTrue(svgContains(
+      svg, "<title>std::vector&lt;int&gt;::push (1 samples, 25.00%)</title>"));
+
+  assertTrue(svgContains(renderFlamegraph({ { "main;alloc", 64 } }, "heap",
+                                          "bytes"),
+                         "<title>alloc (64 bytes, 100.00%)</title>"));
+
+  // Nothing recorded still gives a valid, if empty, graph.
+  assertTrue(renderFlamegraph({}, "empty").ends_with("</svg>\n"));
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
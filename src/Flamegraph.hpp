@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace cabin {
+
+// How many samples each call stack got, keyed by its frames from the
+// outermost to the innermost joined with ';': the "folded" format of
+// flamegraph.pl, which other flame graph tools read as well.
+using FoldedStacks = std::map<std::string, std::uint64_t>;
+
+// Folds the output of `perf script` for a recording made with `-g`.  The
+// command name of each sample becomes its outermost frame.
+FoldedStacks foldPerfScript(std::string_view script);
+
+// One "<stack> <count>" line per stack.
+std::string formatFoldedStacks(const FoldedStacks& stacks);
+
+// The inverse of formatFoldedStacks(); malformed lines are skipped.
+FoldedStacks parseFoldedStacks(std::string_view folded);
+
+// Renders a flame graph as a standalone SVG.  Hovering a frame shows its
+// count, in `unit`, and clicking it zooms into it.
+std::string renderFlamegraph(const FoldedStacks& stacks,
+                             std::string_view title,
+                             std::string_view unit = "samples");
+
+} // namespace cabin
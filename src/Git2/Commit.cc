@@ -6,6 +6,7 @@
 #include "Time.hpp"
 
 #include <git2/commit.h>
+#include <string>
 
 namespace git2 {
 
@@ -18,4 +19,9 @@ Commit& Commit::lookup(const Repository& repo, const Oid& oid) {
 
 Time Commit::time() const { return { git_commit_time(this->raw) }; }
 
+std::string Commit::summary() const {
+  const char* summary = git_commit_summary(this->raw);
+  return summary != nullptr ? summary : "";
+}
+
 } // namespace git2
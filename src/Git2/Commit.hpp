@@ -6,6 +6,7 @@
 #include "Time.hpp"
 
 #include <git2/commit.h>
+#include <string>
 
 namespace git2 {
 
@@ -25,6 +26,10 @@ struct Commit : public GlobalState {
 
   /// Get the commit time (i.e. committer time) of a commit.
   Time time() const;
+
+  /// Get the short "summary" of the git commit message, i.e. the first
+  /// paragraph with its lines joined.
+  std::string summary() const;
 };
 
 } // namespace git2
@@ -0,0 +1,50 @@
+#include "Diff.hpp"
+
+#include "Exception.hpp"
+#include "Object.hpp"
+#include "Repository.hpp"
+
+#include <cstddef>
+#include <git2/diff.h>
+#include <git2/object.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+Diff::~Diff() { git_diff_free(this->raw); }
+
+Diff& Diff::treeToWorkdirWithIndex(const Repository& repo,
+                                   const Object& treeish) {
+  git_object* tree = nullptr;
+  git2Throw(git_object_peel(&tree, treeish.raw, GIT_OBJECT_TREE));
+
+  git_diff_options opts;
+  git2Throw(git_diff_options_init(&opts, GIT_DIFF_OPTIONS_VERSION));
+  opts.flags |= GIT_DIFF_INCLUDE_UNTRACKED | GIT_DIFF_RECURSE_UNTRACKED_DIRS;
+
+  const int ret = git_diff_tree_to_workdir_with_index(
+      &this->raw, repo.raw,
+      reinterpret_cast<git_tree*>(tree), // NOLINT(*-reinterpret-cast)
+      &opts);
+  git_object_free(tree);
+  git2Throw(ret);
+  return *this;
+}
+
+std::vector<std::string> Diff::paths() const {
+  std::vector<std::string> paths;
+  const std::size_t numDeltas = git_diff_num_deltas(this->raw);
+  for (std::size_t i = 0; i < numDeltas; ++i) {
+    const git_diff_delta* delta = git_diff_get_delta(this->raw, i);
+    const std::string oldPath = delta->old_file.path;
+    const std::string newPath = delta->new_file.path;
+    paths.push_back(newPath);
+    if (oldPath != newPath) {
+      paths.push_back(oldPath);
+    }
+  }
+  return paths;
+}
+
+} // namespace git2
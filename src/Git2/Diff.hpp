@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Global.hpp"
+#include "Object.hpp"
+#include "Repository.hpp"
+
+#include <git2/diff.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+struct Diff : public GlobalState {
+  git_diff* raw = nullptr;
+
+  Diff() = default;
+  ~Diff();
+
+  Diff(const Diff&) = delete;
+  Diff(Diff&&) noexcept = default;
+  Diff& operator=(const Diff&) = delete;
+  Diff& operator=(Diff&&) noexcept = default;
+
+  /// Create a diff between the tree of `treeish` and the working directory,
+  /// using the index for files it has staged changes of.
+  ///
+  /// This is the equivalent of `git diff <treeish>`, except that untracked
+  /// files are included as additions.
+  Diff& treeToWorkdirWithIndex(const Repository& repo, const Object& treeish);
+
+  /// Get the paths of the files the diff touches, relative to the root of the
+  /// working directory.  Renames yield both the old and the new path.
+  std::vector<std::string> paths() const;
+};
+
+} // namespace git2
@@ -0,0 +1,40 @@
+#include "Remote.hpp"
+
+#include "Exception.hpp"
+#include "Repository.hpp"
+
+#include <git2/remote.h>
+#include <git2/strarray.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+Remote::~Remote() { git_remote_free(this->raw); }
+
+Remote& Remote::createAnonymous(const Repository& repo,
+                                const std::string& url) {
+  git2Throw(git_remote_create_anonymous(&this->raw, repo.raw, url.c_str()));
+  return *this;
+}
+
+Remote& Remote::fetch(const std::vector<std::string>& refspecs,
+                      const int depth) {
+  git_fetch_options opts;
+  git2Throw(git_fetch_options_init(&opts, GIT_FETCH_OPTIONS_VERSION));
+  opts.depth = depth;
+
+  std::vector<char*> strings;
+  strings.reserve(refspecs.size());
+  for (const std::string& refspec : refspecs) {
+    // libgit2 takes non-const pointers but doesn't modify them.
+    strings.push_back(const_cast<char*>(refspec.c_str()));
+  }
+  const git_strarray array{ .strings = strings.data(),
+                            .count = strings.size() };
+  git2Throw(git_remote_fetch(this->raw, refspecs.empty() ? nullptr : &array,
+                             &opts, nullptr));
+  return *this;
+}
+
+} // end namespace git2
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Global.hpp"
+#include "Repository.hpp"
+
+#include <git2/remote.h>
+#include <string>
+#include <vector>
+
+namespace git2 {
+
+struct Remote : public GlobalState {
+  git_remote* raw = nullptr;
+
+  Remote() = default;
+  ~Remote();
+
+  Remote(const Remote&) = delete;
+  Remote(Remote&&) noexcept = default;
+  Remote& operator=(const Remote&) = delete;
+  Remote& operator=(Remote&&) noexcept = default;
+
+  /// Create a remote with the given url in-memory.  The remote is not saved
+  /// to the repository's configuration.
+  Remote& createAnonymous(const Repository& repo, const std::string& url);
+
+  /// Download new data and update tips.
+  ///
+  /// Only the given refspecs are fetched; if empty, the refspecs configured
+  /// for the remote are used.  A positive `depth` creates a shallow fetch
+  /// with that many commits of history.
+  Remote& fetch(const std::vector<std::string>& refspecs,
+                int depth = GIT_FETCH_DEPTH_FULL);
+};
+
+} // end namespace git2
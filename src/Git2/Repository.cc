@@ -22,6 +22,10 @@ Repository& Repository::open(const std::string& path) {
   git2Throw(git_repository_open(&this->raw, path.c_str()));
   return *this;
 }
+Repository& Repository::discover(const std::string& path) {
+  git2Throw(git_repository_open_ext(&this->raw, path.c_str(), 0, nullptr));
+  return *this;
+}
 Repository& Repository::openBare(const std::string& path) {
   git2Throw(git_repository_open_bare(&this->raw, path.c_str()));
   return *this;
@@ -36,6 +40,11 @@ Repository& Repository::initBare(const std::string& path) {
   return *this;
 }
 
+std::string Repository::workdir() const {
+  const char* path = git_repository_workdir(this->raw);
+  return path == nullptr ? "" : path;
+}
+
 bool Repository::isIgnored(const std::string& path) const {
   int ignored = 0;
   git2Throw(git_ignore_path_is_ignored(&ignored, this->raw, path.c_str()));
@@ -67,6 +76,16 @@ Repository& Repository::checkoutHead(bool force) {
   return *this;
 }
 
+Repository& Repository::checkoutTree(const Object& treeish,
+                                     const std::string& targetDir) {
+  git_checkout_options opts;
+  git2Throw(git_checkout_options_init(&opts, GIT_CHECKOUT_OPTIONS_VERSION));
+  opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_DONT_UPDATE_INDEX;
+  opts.target_directory = targetDir.c_str();
+  git2Throw(git_checkout_tree(this->raw, treeish.raw, &opts));
+  return *this;
+}
+
 Oid Repository::refNameToId(const std::string& refname) const {
   git_oid oid;
   git2Throw(git_reference_name_to_id(&oid, this->raw, refname.c_str()));
@@ -26,6 +26,9 @@ struct Repository : public GlobalState {
   ///
   /// The path can point to either a normal or bare repository.
   Repository& open(const std::string& path);
+  /// Attempt to open the repository that contains `path`, looking in its
+  /// parent directories too, like git itself does.
+  Repository& discover(const std::string& path);
   /// Attempt to open an already-existing bare repository at `path`.
   ///
   /// The path can point to only a bare repository.
@@ -42,6 +45,10 @@ struct Repository : public GlobalState {
   /// The folder must exist prior to invoking this function.
   Repository& initBare(const std::string& path);
 
+  /// Get the path of the working directory, with a trailing slash.  Empty
+  /// for a bare repository.
+  std::string workdir() const;
+
   /// Check if path is ignored by the ignore rules.
   bool isIgnored(const std::string& path) const;
 
@@ -58,6 +65,11 @@ struct Repository : public GlobalState {
   /// Checkout current HEAD
   Repository& checkoutHead(bool force = false);
 
+  /// Write the files of `treeish` into `targetDir` instead of the working
+  /// directory, leaving HEAD and the index untouched.  This also works for
+  /// bare repositories.
+  Repository& checkoutTree(const Object& treeish, const std::string& targetDir);
+
   /// Lookup a reference by name and resolve immediately to OID.
   Oid refNameToId(const std::string& refname) const;
 
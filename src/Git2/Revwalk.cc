@@ -4,6 +4,7 @@
 #include "Oid.hpp"
 #include "Repository.hpp"
 
+#include <git2/errors.h>
 #include <git2/revwalk.h>
 #include <string>
 
@@ -74,4 +75,13 @@ Revwalk& Revwalk::hideRef(const std::string& reference) {
   return *this;
 }
 
+bool Revwalk::next(git_oid& oid) {
+  const int error = git_revwalk_next(&oid, this->raw);
+  if (error == GIT_ITEROVER) {
+    return false;
+  }
+  git2Throw(error);
+  return true;
+}
+
 } // end namespace git2
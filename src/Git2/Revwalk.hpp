@@ -97,6 +97,11 @@ struct Revwalk : public GlobalState {
   ///
   /// The reference must point to a committish.
   Revwalk& hideRef(const std::string& reference);
+
+  /// Get the next commit from the revision walk into `oid`.
+  ///
+  /// Returns false once every commit has been visited.
+  bool next(git_oid& oid);
 };
 
 } // end namespace git2
@@ -0,0 +1,306 @@
+#include "GlobalCache.hpp"
+
+#include "FileLock.hpp"
+#include "Rustify/Result.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+// The directories whose children are cache entries: bare mirrors and
+// checkouts of git dependencies, and builds of source dependencies.
+static constexpr std::array<std::string_view, 3> ENTRY_PARENTS{
+  "git/db",
+  "git/src",
+  "build",
+};
+
+static constexpr std::string_view LAST_USE_EXT = ".last-use";
+static constexpr std::string_view LOCK_EXT = ".lock";
+static constexpr std::string_view TMP_EXT = ".tmp";
+
+// The last use is the mtime of an empty file next to the entry.  Updating a
+// file's mtime is a single system call, so concurrent runs never see a
+// partially written record.
+static fs::path lastUsePath(const fs::path& entryDir) {
+  fs::path path = entryDir;
+  path += LAST_USE_EXT;
+  return path;
+}
+
+// Lock files are never removed: a process waiting on one that was removed
+// would go on holding a lock on a file nobody else sees.
+static fs::path lockPath(const fs::path& entryDir) {
+  fs::path path = entryDir;
+  path += LOCK_EXT;
+  return path;
+}
+
+Result<FileLock> lockCacheEntry(const fs::path& entryDir) {
+  return FileLock::acquire(lockPath(entryDir), entryDir.filename().string());
+}
+
+void recordCacheUse(const fs::path& entryDir) noexcept {
+  const fs::path path = lastUsePath(entryDir);
+  std::error_code ec;
+  fs::create_directories(path.parent_path(), ec);
+  if (!fs::exists(path, ec)) {
+    // Appending never truncates a record another process just created.
+    std::ofstream(path, std::ios::app);
+  }
+  fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+  if (ec) {
+    spdlog::debug("Failed to record the use of {}: {}", entryDir.string(),
+                  ec.message());
+  }
+}
+
+static std::uintmax_t directorySize(const fs::path& dir) {
+  std::uintmax_t size = 0;
+  std::error_code ec;
+  for (const auto& entry : fs::recursive_directory_iterator(
+           dir, fs::directory_options::skip_permission_denied, ec)) {
+    if (entry.is_regular_file(ec) && !entry.is_symlink(ec)) {
+      size += entry.file_size(ec);
+    }
+  }
+  return size;
+}
+
+// Another process may be moving or evicting entries while they're listed,
+// so those that vanish are skipped rather than reported.
+std::vector<CacheEntry> listCacheEntries(const fs::path& cacheDir) {
+  std::vector<CacheEntry> entries;
+  for (const std::string_view parent : ENTRY_PARENTS) {
+    const fs::path parentDir = cacheDir / parent;
+    std::error_code ec;
+    if (!fs::is_directory(parentDir, ec)) {
+      continue;
+    }
+    for (const auto& dirEntry : fs::directory_iterator(parentDir, ec)) {
+      const fs::path& path = dirEntry.path();
+      // Checkouts in progress are moved into place when done.
+      if (!dirEntry.is_directory(ec) || path.extension() == TMP_EXT) {
+        continue;
+      }
+
+      fs::file_time_type lastUse = fs::last_write_time(lastUsePath(path), ec);
+      if (ec) {
+        lastUse = fs::last_write_time(path, ec);
+        if (ec) {
+          continue;
+        }
+      }
+      entries.push_back(CacheEntry{
+          .path = path,
+          .size = directorySize(path),
+          .lastUse = lastUse,
+      });
+    }
+  }
+  std::ranges::sort(entries, {}, &CacheEntry::lastUse);
+  return entries;
+}
+
+std::vector<CacheEntry>
+selectEvictions(std::vector<CacheEntry> entries,
+                const std::optional<std::uintmax_t> maxSize,
+                const std::optional<std::chrono::seconds> maxAge,
+                const fs::file_time_type now) {
+  std::ranges::sort(entries, {}, &CacheEntry::lastUse);
+
+  std::uintmax_t totalSize = 0;
+  for (const CacheEntry& entry : entries) {
+    totalSize += entry.size;
+  }
+
+  std::vector<CacheEntry> evictions;
+  for (CacheEntry& entry : entries) {
+    const bool tooOld =
+        maxAge.has_value() && now - entry.lastUse > maxAge.value();
+    const bool tooLarge = maxSize.has_value() && totalSize > maxSize.value();
+    if (!tooOld && !tooLarge) {
+      continue;
+    }
+    totalSize -= entry.size;
+    evictions.push_back(std::move(entry));
+  }
+  return evictions;
+}
+
+Result<bool> removeCacheEntry(const CacheEntry& entry) {
+  const auto lock = Try(FileLock::tryAcquire(lockPath(entry.path)));
+  if (!lock.has_value()) {
+    return Ok(false);
+  }
+  fs::remove_all(entry.path);
+  fs::remove(lastUsePath(entry.path));
+  return Ok(true);
+}
+
+// Splits "500M" into 500 and "M".
+static Result<std::pair<std::uintmax_t, std::string_view>>
+splitNumber(const std::string_view str, const std::string_view what) {
+  std::uintmax_t value = 0;
+  const auto [ptr, ec] =
+      std::from_chars(str.data(), str.data() + str.size(), value);
+  Ensure(ec == std::errc() && ptr != str.data(), "invalid {}: `{}`", what,
+         str);
+  return Ok(std::make_pair(
+      value, str.substr(static_cast<std::size_t>(ptr - str.data()))));
+}
+
+Result<std::uintmax_t> parseByteSize(const std::string_view str) {
+  const auto [value, unit] = Try(splitNumber(str, "size"));
+
+  static constexpr std::string_view units = "KMGT";
+  std::uintmax_t multiplier = 1;
+  if (!unit.empty()) {
+    const std::size_t pos = units.find(unit.front());
+    const std::string_view rest = unit.substr(1);
+    Ensure(pos != std::string_view::npos
+               && (rest.empty() || rest == "B" || rest == "iB"),
+           "invalid size: `{}`; expected a number followed by K, M, G, or T",
+           str);
+    for (std::size_t i = 0; i <= pos; ++i) {
+      multiplier *= 1024;
+    }
+  }
+  return Ok(value * multiplier);
+}
+
+Result<std::chrono::seconds> parseAge(const std::string_view str) {
+  const auto [value, unit] = Try(splitNumber(str, "age"));
+  const auto count = static_cast<std::chrono::seconds::rep>(value);
+
+  if (unit == "s") {
+    return Ok(std::chrono::seconds(count));
+  } else if (unit == "m") {
+    return Ok(std::chrono::minutes(count));
+  } else if (unit == "h") {
+    return Ok(std::chrono::hours(count));
+  } else if (unit == "d") {
+    return Ok(std::chrono::days(count));
+  } else if (unit == "w") {
+    return Ok(std::chrono::weeks(count));
+  }
+  Bail("invalid age: `{}`; expected a number followed by s, m, h, d, or w",
+       str);
+}
+
+std::string formatByteSize(const std::uintmax_t size) {
+  static constexpr std::array<std::string_view, 5> units{
+    "B", "KiB", "MiB", "GiB", "TiB",
+  };
+  if (size < 1024) {
+    return fmt::format("{} B", size);
+  }
+
+  auto value = static_cast<double>(size);
+  std::size_t unit = 0;
+  while (value >= 1024 && unit + 1 < units.size()) {
+    value /= 1024;
+    ++unit;
+  }
+  return fmt::format("{:.1f} {}", value, units[unit]);
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+using namespace std::chrono_literals; // NOLINT(build/namespaces)
+
+CABIN_TEST_CASE(testSelectEvictions) {
+  const fs::file_time_type now = fs::file_time_type() + 1000h;
+  const std::vector<CacheEntry> entries{
+    CacheEntry{ .path = "b", .size = 300, .lastUse = now - 24h },
+    CacheEntry{ .path = "a", .size = 100, .lastUse = now - 200h },
+    CacheEntry{ .path = "c", .size = 200, .lastUse = now - 1h },
+  };
+
+  assertTrue(selectEvictions(entries, std::nullopt, std::nullopt, now)
+                 .empty());
+
+  // Least recently used first, until the rest fit.
+  {
+    const auto evictions = selectEvictions(entries, 400, std::nullopt, now);
+    assertEq(evictions.size(), 2UL);
+    assertTrue(evictions[0].path == "a");
+    assertTrue(evictions[1].path == "b");
+  }
+  {
+    const auto evictions = selectEvictions(entries, std::nullopt, 48h, now);
+    assertEq(evictions.size(), 1UL);
+    assertTrue(evictions[0].path == "a");
+  }
+  {
+    const auto evictions = selectEvictions(entries, 500, 48h, now);
+    assertEq(evictions.size(), 1UL);
+    assertTrue(evictions[0].path == "a");
+  }
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseByteSize) {
+  assertEq(parseByteSize("1024").unwrap(), 1024UL);
+  assertEq(parseByteSize("512K").unwrap(), 512UL * 1024);
+  assertEq(parseByteSize("500M").unwrap(), 500UL * 1024 * 1024);
+  assertEq(parseByteSize("2GiB").unwrap(), 2UL * 1024 * 1024 * 1024);
+  assertEq(parseByteSize("2GB").unwrap(), 2UL * 1024 * 1024 * 1024);
+
+  assertEq(parseByteSize("").unwrap_err()->what(), "invalid size: ``");
+  assertEq(parseByteSize("M").unwrap_err()->what(), "invalid size: `M`");
+  assertEq(
+      parseByteSize("5X").unwrap_err()->what(),
+      "invalid size: `5X`; expected a number followed by K, M, G, or T");
+
+  assertEq(formatByteSize(0), "0 B");
+  assertEq(formatByteSize(1023), "1023 B");
+  assertEq(formatByteSize(1536), "1.5 KiB");
+  assertEq(formatByteSize(5UL * 1024 * 1024 * 1024), "5.0 GiB");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseAge) {
+  assertTrue(parseAge("45s").unwrap() == 45s);
+  assertTrue(parseAge("30m").unwrap() == 30min);
+  assertTrue(parseAge("12h").unwrap() == 12h);
+  assertTrue(parseAge("7d").unwrap() == std::chrono::days(7));
+  assertTrue(parseAge("4w").unwrap() == std::chrono::weeks(4));
+
+  assertEq(parseAge("7").unwrap_err()->what(),
+           "invalid age: `7`; expected a number followed by s, m, h, d, or w");
+  assertEq(parseAge("d").unwrap_err()->what(), "invalid age: `d`");
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
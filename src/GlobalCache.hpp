@@ -0,0 +1,55 @@
+#pragma once
+
+#include "FileLock.hpp"
+#include "Rustify/Result.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// A directory in ~/.cache/cabin that is evicted as a whole: a git mirror, a
+// checkout, or the build of a source dependency.
+struct CacheEntry {
+  fs::path path;
+  std::uintmax_t size = 0;
+  fs::file_time_type lastUse;
+};
+
+// Locks `entryDir` against other cabin processes that create, update, or
+// evict it.
+Result<FileLock> lockCacheEntry(const fs::path& entryDir);
+
+// Records that `entryDir` was just used.  An entry that was never recorded
+// counts as last used when it was last modified.
+void recordCacheUse(const fs::path& entryDir) noexcept;
+
+// Lists every entry under `cacheDir`, the least recently used first.
+std::vector<CacheEntry> listCacheEntries(const fs::path& cacheDir);
+
+// Selects the entries to evict so that none is older than `maxAge` and the
+// rest fit in `maxSize`, evicting the least recently used first.
+std::vector<CacheEntry>
+selectEvictions(std::vector<CacheEntry> entries,
+                std::optional<std::uintmax_t> maxSize,
+                std::optional<std::chrono::seconds> maxAge,
+                fs::file_time_type now);
+
+// Removes an entry along with its last-use record.  Returns false without
+// removing anything if another process is using the entry.
+Result<bool> removeCacheEntry(const CacheEntry& entry);
+
+// Parses sizes like `1024`, `512K`, `500M`, or `2G`, in powers of 1024.
+Result<std::uintmax_t> parseByteSize(std::string_view str);
+// Parses ages like `45s`, `30m`, `12h`, `7d`, or `4w`.
+Result<std::chrono::seconds> parseAge(std::string_view str);
+std::string formatByteSize(std::uintmax_t size);
+
+} // namespace cabin
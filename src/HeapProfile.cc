@@ -0,0 +1,793 @@
+#include "HeapProfile.hpp"
+
+#include "Algos.hpp"
+#include "Builder/Compiler.hpp"
+#include "Command.hpp"
+#include "Diag.hpp"
+#include "Flamegraph.hpp"
+#include "GlobalCache.hpp"
+#include "HeapProfilerShim.hpp"
+#include "Rustify/Result.hpp"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <span>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+// A frame of a sampled call stack, as an address relative to where its
+// module was loaded.
+struct HeapFrame {
+  std::size_t module;
+  std::uint64_t address;
+};
+
+// The allocations from one call stack, estimated from the samples.
+struct HeapSite {
+  std::uint64_t allocations;
+  std::uint64_t bytes;
+  // The most bytes from this call stack that were live at once.
+  std::uint64_t peakBytes;
+  // Innermost first.
+  std::vector<HeapFrame> frames;
+};
+
+// What the shim wrote for one process.
+struct HeapProfile {
+  std::string program;
+  std::uint64_t interval = 0;
+  std::uint64_t peakRssKib = 0;
+  // Samples left out since the shim's tables were full.
+  std::uint64_t dropped = 0;
+  std::vector<HeapSite> sites;
+  // Paths indexed by HeapFrame::module.
+  std::map<std::size_t, std::string> modules;
+};
+
+// A source-level frame.  An address has several when calls were inlined.
+struct HeapSymbol {
+  std::string function;
+  std::string file;
+  std::uint64_t line = 0;
+};
+
+// The symbols of each address of each module, innermost first.
+using HeapSymbols =
+    std::map<std::pair<std::string, std::uint64_t>, std::vector<HeapSymbol>>;
+
+struct HeapSiteSummary {
+  std::string site;
+  std::uint64_t allocations = 0;
+  std::uint64_t bytes = 0;
+  std::uint64_t peakBytes = 0;
+};
+
+struct HeapReport {
+  // The most allocated bytes first.
+  std::vector<HeapSiteSummary> sites;
+  // Allocated bytes by call stack, for the flame graph.
+  FoldedStacks stacks;
+  std::size_t numProcesses = 0;
+  std::uint64_t interval = 0;
+  std::uint64_t peakRssKib = 0;
+  std::string peakRssProgram;
+  std::uint64_t dropped = 0;
+};
+
+template <typename T>
+static std::optional<T> parseNumber(const std::string_view str,
+                                    const int base = 10) {
+  T value{};
+  const auto [ptr, ec] =
+      std::from_chars(str.data(), str.data() + str.size(), value, base);
+  if (ec != std::errc() || ptr != str.data() + str.size()) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+static std::vector<std::string_view> splitWords(std::string_view line) {
+  std::vector<std::string_view> words;
+  while (!line.empty()) {
+    const std::size_t begin = line.find_first_not_of(' ');
+    if (begin == std::string_view::npos) {
+      break;
+    }
+    line.remove_prefix(begin);
+    const std::size_t end = std::min(line.find(' '), line.size());
+    words.push_back(line.substr(0, end));
+    line.remove_prefix(end);
+  }
+  return words;
+}
+
+static Result<HeapProfile> parseHeapProfile(const std::string_view contents) {
+  HeapProfile profile;
+  std::istringstream iss{ std::string(contents) };
+  std::string line;
+  bool sawHeader = false;
+  for (std::size_t lineNum = 1; std::getline(iss, line); ++lineNum) {
+    const std::string_view view = line;
+    const std::size_t space = view.find(' ');
+    const std::string_view key = view.substr(0, space);
+    const std::string_view rest =
+        space == std::string_view::npos ? "" : view.substr(space + 1);
+
+    if (!sawHeader) {
+      Ensure(view == "cabin-heap-profile 1", "unknown heap profile format");
+      sawHeader = true;
+    } else if (key == "program") {
+      profile.program = rest;
+    } else if (key == "interval" || key == "peak-rss-kib"
+               || key == "dropped") {
+      const auto value = parseNumber<std::uint64_t>(rest);
+      Ensure(value.has_value(), "line {}: invalid {}: {}", lineNum, key, rest);
+      if (key == "interval") {
+        profile.interval = value.value();
+      } else if (key == "peak-rss-kib") {
+        profile.peakRssKib = value.value();
+      } else {
+        profile.dropped = value.value();
+      }
+    } else if (key == "module") {
+      const std::size_t idEnd = rest.find(' ');
+      const auto id = parseNumber<std::size_t>(rest.substr(0, idEnd));
+      Ensure(id.has_value() && idEnd != std::string_view::npos,
+             "line {}: invalid module: {}", lineNum, rest);
+      profile.modules[id.value()] = rest.substr(idEnd + 1);
+    } else if (key == "site") {
+      const std::vector<std::string_view> words = splitWords(rest);
+      Ensure(words.size() >= 3, "line {}: invalid site", lineNum);
+      HeapSite site{};
+      const auto allocations = parseNumber<std::uint64_t>(words[0]);
+      const auto bytes = parseNumber<std::uint64_t>(words[1]);
+      const auto peakBytes = parseNumber<std::uint64_t>(words[2]);
+      Ensure(allocations.has_value() && bytes.has_value()
+                 && peakBytes.has_value(),
+             "line {}: invalid site", lineNum);
+      site.allocations = allocations.value();
+      site.bytes = bytes.value();
+      site.peakBytes = peakBytes.value();
+      for (std::size_t i = 3; i < words.size(); ++i) {
+        const std::size_t colon = words[i].find(':');
+        const auto module = parseNumber<std::size_t>(words[i].substr(0, colon));
+        const auto address =
+            colon == std::string_view::npos
+                ? std::nullopt
+                : parseNumber<std::uint64_t>(words[i].substr(colon + 1), 16);
+        Ensure(module.has_value() && address.has_value(),
+               "line {}: invalid frame: {}", lineNum, words[i]);
+        site.frames.push_back(HeapFrame{ .module = module.value(),
+                                         .address = address.value() });
+      }
+      profile.sites.push_back(std::move(site));
+    }
+  }
+  Ensure(sawHeader, "empty heap profile");
+
+  for (const HeapSite& site : profile.sites) {
+    for (const HeapFrame& frame : site.frames) {
+      Ensure(profile.modules.contains(frame.module), "unknown module: {}",
+             frame.module);
+    }
+  }
+  return Ok(profile);
+}
+
+// Parses the output of `addr2line -a -i -f -C`: each address followed by a
+// function and its location, once for each inlined call.
+static std::map<std::uint64_t, std::vector<HeapSymbol>>
+parseAddr2line(const std::string_view output) {
+  std::map<std::uint64_t, std::vector<HeapSymbol>> symbols;
+  std::istringstream iss{ std::string(output) };
+  std::string line;
+  std::vector<HeapSymbol>* current = nullptr;
+  while (std::getline(iss, line)) {
+    if (line.starts_with("0x")) {
+      if (const auto address =
+              parseNumber<std::uint64_t>(std::string_view(line).substr(2), 16);
+          address.has_value()) {
+        current = &symbols[address.value()];
+        continue;
+      }
+    }
+    std::string location;
+    if (current == nullptr || !std::getline(iss, location)) {
+      break;
+    }
+
+    HeapSymbol symbol;
+    if (line != "??") {
+      symbol.function = line;
+    }
+    // "file:line", "file:line (discriminator 2)", or "??:0".
+    if (const std::size_t paren = location.find(" ("); paren != location.npos) {
+      location.resize(paren);
+    }
+    if (const std::size_t colon = location.rfind(':');
+        colon != std::string::npos && !location.starts_with("??")) {
+      const std::string_view lineNum =
+          std::string_view(location).substr(colon + 1);
+      symbol.file = location.substr(0, colon);
+      symbol.line = parseNumber<std::uint64_t>(lineNum).value_or(0);
+    }
+    if (!symbol.function.empty() || !symbol.file.empty()) {
+      current->push_back(std::move(symbol));
+    }
+  }
+  return symbols;
+}
+
+static HeapSymbols
+symbolizeHeapProfiles(const std::vector<HeapProfile>& profiles) {
+  if (!commandExists("addr2line")) {
+    Diag::warn("addr2line is not found; allocation sites are shown as "
+               "addresses");
+    return {};
+  }
+
+  std::map<std::string, std::set<std::uint64_t>> addresses;
+  for (const HeapProfile& profile : profiles) {
+    for (const HeapSite& site : profile.sites) {
+      for (const HeapFrame& frame : site.frames) {
+        addresses[profile.modules.at(frame.module)].insert(frame.address);
+      }
+    }
+  }
+
+  // Keeps the command lines short.
+  constexpr std::size_t batchSize = 512;
+  HeapSymbols symbols;
+  for (const auto& [module, moduleAddresses] : addresses) {
+    const std::vector<std::uint64_t> sorted(moduleAddresses.begin(),
+                                            moduleAddresses.end());
+    for (std::size_t i = 0; i < sorted.size(); i += batchSize) {
+      Command addr2line("addr2line", { "-a", "-i", "-f", "-C", "-e", module });
+      for (std::size_t j = i; j < std::min(i + batchSize, sorted.size());
+           ++j) {
+        addr2line.addArg(fmt::format("{:#x}", sorted[j]));
+      }
+      const Result<std::string> output =
+          getCmdOutput(addr2line, RetryPolicy::Never);
+      if (output.is_err()) {
+        // e.g. the vDSO, which has no file.
+        spdlog::debug("Failed to symbolize {}: {}", module,
+                      output.unwrap_err()->what());
+        break;
+      }
+      for (auto& [address, frames] : parseAddr2line(output.unwrap())) {
+        symbols[{ module, address }] = std::move(frames);
+      }
+    }
+  }
+  return symbols;
+}
+
+// The path of `file` relative to `root`, if it's inside it.
+static std::optional<std::string> relativeTo(const std::string& file,
+                                             const fs::path& root) {
+  if (file.empty() || root.empty()) {
+    return std::nullopt;
+  }
+  const fs::path relative =
+      fs::path(file).lexically_normal().lexically_relative(
+          root.lexically_normal());
+  if (relative.empty() || *relative.begin() == "..") {
+    return std::nullopt;
+  }
+  return relative.generic_string();
+}
+
+static bool startsWithAny(const std::string_view function,
+                          const std::span<const std::string_view> prefixes) {
+  return std::ranges::any_of(prefixes, [&](const std::string_view prefix) {
+    return function.starts_with(prefix);
+  });
+}
+
+static bool isAllocatorFrame(const std::string_view function) {
+  static constexpr std::array<std::string_view, 6> prefixes{
+    "operator new", "malloc",        "calloc",
+    "realloc",      "aligned_alloc", "posix_memalign",
+  };
+  return function.empty() || startsWithAny(function, prefixes);
+}
+
+// Standard library frames usually sit between the code that allocated and
+// operator new: a container growing, a string being copied.
+static bool isLibraryFrame(const std::string_view function) {
+  static constexpr std::array<std::string_view, 3> prefixes{
+    "std::",
+    "__gnu_cxx::",
+    "__",
+  };
+  return startsWithAny(function, prefixes);
+}
+
+// The frame that best tells where a call stack allocated: the innermost
+// one in the project, or else outside the standard library, or else
+// outside the allocator.
+static const HeapSymbol* chooseSite(const std::vector<HeapSymbol>& frames,
+                                    const fs::path& projectRoot) {
+  const auto inProject =
+      std::ranges::find_if(frames, [&](const HeapSymbol& frame) {
+        return relativeTo(frame.file, projectRoot).has_value();
+      });
+  if (inProject != frames.end()) {
+    return &*inProject;
+  }
+  const auto inUserCode =
+      std::ranges::find_if(frames, [](const HeapSymbol& frame) {
+        return !isAllocatorFrame(frame.function)
+               && !isLibraryFrame(frame.function);
+      });
+  if (inUserCode != frames.end()) {
+    return &*inUserCode;
+  }
+  const auto outsideAllocator =
+      std::ranges::find_if(frames, [](const HeapSymbol& frame) {
+        return !isAllocatorFrame(frame.function);
+      });
+  if (outsideAllocator != frames.end()) {
+    return &*outsideAllocator;
+  }
+  return frames.empty() ? nullptr : &frames.front();
+}
+
+static HeapReport
+summarizeHeapProfiles(const std::vector<HeapProfile>& profiles,
+                      const HeapSymbols& symbols, const fs::path& projectRoot) {
+  HeapReport report;
+  report.numProcesses = profiles.size();
+  std::map<std::string, HeapSiteSummary> merged;
+
+  for (const HeapProfile& profile : profiles) {
+    report.interval = std::max(report.interval, profile.interval);
+    report.dropped += profile.dropped;
+    if (profile.peakRssKib > report.peakRssKib) {
+      report.peakRssKib = profile.peakRssKib;
+      report.peakRssProgram = fs::path(profile.program).filename().string();
+    }
+
+    // Call stacks that end up at the same site overlap in time, so their
+    // peaks add up within a process.  Processes may not have overlapped,
+    // so the highest peak of any process is taken.
+    std::map<std::string, HeapSiteSummary> local;
+    for (const HeapSite& site : profile.sites) {
+      // Innermost first, with inlined calls expanded.
+      std::vector<HeapSymbol> frames;
+      for (const HeapFrame& frame : site.frames) {
+        const std::string& module = profile.modules.at(frame.module);
+        const auto found = symbols.find({ module, frame.address });
+        if (found != symbols.end() && !found->second.empty()) {
+          frames.insert(frames.end(), found->second.begin(),
+                        found->second.end());
+        } else {
+          frames.push_back(HeapSymbol{
+              .function = fmt::format("{}+{:#x}",
+                                      fs::path(module).filename().string(),
+                                      frame.address),
+              .file = "",
+              .line = 0,
+          });
+        }
+      }
+
+      std::string name = "[unknown]";
+      if (const HeapSymbol* chosen = chooseSite(frames, projectRoot)) {
+        name = chosen->function.empty() ? "??" : chosen->function;
+        const std::string file =
+            relativeTo(chosen->file, projectRoot).value_or(chosen->file);
+        if (!file.empty()) {
+          name += fmt::format(" ({}:{})", file, chosen->line);
+        }
+      }
+      HeapSiteSummary& summary = local[name];
+      summary.site = name;
+      summary.allocations += site.allocations;
+      summary.bytes += site.bytes;
+      summary.peakBytes += site.peakBytes;
+
+      std::string stack = fs::path(profile.program).filename().string();
+      for (auto itr = frames.rbegin(); itr != frames.rend(); ++itr) {
+        std::string function = itr->function.empty() ? "??" : itr->function;
+        std::ranges::replace(function, ';', ':');
+        stack += ';';
+        stack += function;
+      }
+      report.stacks[stack] += site.bytes;
+    }
+
+    for (auto& [name, summary] : local) {
+      HeapSiteSummary& total = merged[name];
+      total.site = name;
+      total.allocations += summary.allocations;
+      total.bytes += summary.bytes;
+      total.peakBytes = std::max(total.peakBytes, summary.peakBytes);
+    }
+  }
+
+  for (auto& [name, summary] : merged) {
+    report.sites.push_back(std::move(summary));
+  }
+  std::ranges::stable_sort(report.sites, [](const HeapSiteSummary& lhs,
+                                            const HeapSiteSummary& rhs) {
+    return lhs.bytes > rhs.bytes;
+  });
+  return report;
+}
+
+// Formats the top `limit` sites of the report, or all of them if 0.
+static std::string formatHeapReport(const HeapReport& report,
+                                    const std::size_t limit) {
+  std::string out = fmt::format(
+      "Heap profile of {} process{}, {}\n", report.numProcesses,
+      report.numProcesses == 1 ? "" : "es",
+      report.interval <= 1
+          ? std::string("every allocation recorded")
+          : fmt::format("sampled every {} on average",
+                        formatByteSize(report.interval)));
+  if (!report.peakRssProgram.empty()) {
+    out += fmt::format("Peak RSS: {} ({})\n",
+                       formatByteSize(report.peakRssKib * 1024),
+                       report.peakRssProgram);
+  }
+  if (report.dropped > 0) {
+    out += fmt::format("{} samples were dropped since the profiler's tables "
+                       "were full\n",
+                       report.dropped);
+  }
+
+  out += fmt::format("\n{:>12}  {:>10}  {:>12}  {}\n", "Allocated", "Allocs",
+                     "Peak live", "Site");
+  const std::size_t numSites =
+      limit == 0 ? report.sites.size() : std::min(limit, report.sites.size());
+  for (std::size_t i = 0; i < numSites; ++i) {
+    const HeapSiteSummary& site = report.sites[i];
+    out += fmt::format("{:>12}  {:>10}  {:>12}  {}\n",
+                       formatByteSize(site.bytes), site.allocations,
+                       formatByteSize(site.peakBytes), site.site);
+  }
+  if (numSites < report.sites.size()) {
+    out += fmt::format("{:>12}  ... and {} more sites\n", "",
+                       report.sites.size() - numSites);
+  }
+  return out;
+}
+
+Result<HeapProfiler> HeapProfiler::init(const fs::path& outDir) {
+#ifndef __linux__
+  Bail("--heap-profile is only supported on Linux");
+#endif
+  const fs::path dir = outDir / "heap-profiler";
+  const fs::path source = dir / "shim.cc";
+  const fs::path library = dir / "libcabin-heap-profiler.so";
+  const fs::path profileDir = outDir / "heap-profile";
+
+  std::error_code ec;
+  fs::remove_all(profileDir, ec);
+  Ensure(!ec, "failed to remove {}: {}", profileDir.string(), ec.message());
+  for (const fs::path& path : { dir, profileDir }) {
+    fs::create_directories(path, ec);
+    Ensure(!ec, "failed to create {}: {}", path.string(), ec.message());
+  }
+
+  // Only rewritten when it changes, so that the timestamp tells whether the
+  // library is up to date.
+  std::string current;
+  if (std::ifstream ifs(source); ifs) {
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    current = oss.str();
+  }
+  if (current != HEAP_PROFILER_SHIM) {
+    Try(writeFileAtomically(source, HEAP_PROFILER_SHIM));
+  }
+  if (!fs::exists(library)
+      || fs::last_write_time(library) < fs::last_write_time(source)) {
+    Diag::info("Compiling", "heap profiler");
+    const Compiler compiler = Try(Compiler::init());
+    const Command compile(
+        compiler.cxx,
+        { "-std=c++17", "-O2", "-fPIC", "-shared", "-pthread", source.string(),
+          "-o", library.string(), "-ldl", "-lm" });
+    Try(getCmdOutput(compile, RetryPolicy::Never)
+            .with_context([] {
+              return anyhow::anyhow("failed to build the heap profiler");
+            }));
+  }
+  return Ok(HeapProfiler(outDir, library, profileDir));
+}
+
+void HeapProfiler::attach(Command& cmd) const {
+  std::string preload = library.string();
+  if (const char* existing = std::getenv("LD_PRELOAD");
+      existing != nullptr && *existing != '\0') {
+    preload += fmt::format(":{}", existing);
+  }
+  cmd.addEnv("LD_PRELOAD", preload);
+  cmd.addEnv("CABIN_HEAP_PROFILE", profileDir.string());
+}
+
+Result<void> HeapProfiler::report(const fs::path& projectRoot,
+                                  const std::string_view title) const {
+  std::vector<fs::path> paths;
+  for (const fs::directory_entry& entry :
+       fs::directory_iterator(profileDir)) {
+    if (entry.path().extension() == ".txt") {
+      paths.push_back(entry.path());
+    }
+  }
+  std::ranges::sort(paths);
+
+  std::vector<HeapProfile> profiles;
+  for (const fs::path& path : paths) {
+    std::ifstream ifs(path);
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    Result<HeapProfile> profile = parseHeapProfile(oss.str());
+    if (profile.is_err()) {
+      Diag::warn("Ignoring {}: {}", path.string(),
+                 profile.unwrap_err()->what());
+      continue;
+    }
+    profiles.push_back(profile.unwrap());
+  }
+  if (profiles.empty()) {
+    // The shim writes the profile from a destructor, which _exit() skips.
+    Diag::warn("No heap profile was written; did the program exit without "
+               "returning from main() or calling exit()?");
+    return Ok();
+  }
+
+  const HeapReport report = summarizeHeapProfiles(
+      profiles, symbolizeHeapProfiles(profiles), projectRoot);
+  const fs::path reportPath = outDir / "heap-profile.txt";
+  const fs::path flamegraphPath = outDir / "heap-flamegraph.svg";
+  Try(writeFileAtomically(reportPath, formatHeapReport(report, 0)));
+  Try(writeFileAtomically(flamegraphPath,
+                          renderFlamegraph(report.stacks, title, "bytes")));
+
+  constexpr std::size_t numTopSites = 10;
+  fmt::print(stderr, "\n{}\n", formatHeapReport(report, numTopSites));
+  Diag::info("Wrote", "{} and {}",
+             fs::relative(reportPath, projectRoot).string(),
+             fs::relative(flamegraphPath, projectRoot).string());
+  return Ok();
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testParseHeapProfile) {
+  const HeapProfile profile = parseHeapProfile("cabin-heap-profile 1\n"
+                                               "program /tmp/app\n"
+                                               "interval 524288\n"
+                                               "peak-rss-kib 2048\n"
+                                               "dropped 3\n"
+                                               "site 10 1024 512 0:1a2b 1:ff\n"
+                                               "site 1 8 8\n"
+                                               "module 0 /tmp/app\n"
+                                               "module 1 /lib/libc.so.6\n")
+                                  .unwrap();
+  assertEq(profile.program, "/tmp/app");
+  assertEq(profile.interval, 524288UL);
+  assertEq(profile.peakRssKib, 2048UL);
+  assertEq(profile.dropped, 3UL);
+  assertEq(profile.sites.size(), 2UL);
+  assertEq(profile.sites[0].allocations, 10UL);
+  assertEq(profile.sites[0].bytes, 1024UL);
+  assertEq(profile.sites[0].peakBytes, 512UL);
+  assertEq(profile.sites[0].frames.size(), 2UL);
+  assertEq(profile.sites[0].frames[0].module, 0UL);
+  assertEq(profile.sites[0].frames[0].address, 0x1a2bUL);
+  assertEq(profile.sites[0].frames[1].module, 1UL);
+  assertEq(profile.sites[0].frames[1].address, 0xffUL);
+  assertTrue(profile.sites[1].frames.empty());
+  assertEq(profile.modules.at(1), "/lib/libc.so.6");
+
+  assertTrue(parseHeapProfile("").is_err());
+  assertTrue(parseHeapProfile("cabin-heap-profile 2\n").is_err());
+  assertTrue(
+      parseHeapProfile("cabin-heap-profile 1\nsite 1 2\n").is_err());
+  assertTrue(
+      parseHeapProfile("cabin-heap-profile 1\nsite 1 2 3 0:zz\n").is_err());
+  // Frames must refer to a module.
+  assertTrue(
+      parseHeapProfile("cabin-heap-profile 1\nsite 1 2 3 0:10\n").is_err());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseAddr2line) {
+  const auto symbols = parseAddr2line("0x0000000000001234\n"
+                                      "std::vector<int>::push_back(int)\n"
+                                      "/usr/include/c++/12/stl_vector.h:1287\n"
+                                      "fill(int)\n"
+                                      "/src/app/main.cc:7 (discriminator 2)\n"
+                                      "0x0000000000005678\n"
+                                      "??\n"
+                                      "??:0\n"
+                                      "0x0000000000009abc\n"
+                                      "stripped\n"
+                                      "??:?\n");
+  assertEq(symbols.size(), 3UL);
+
+  const std::vector<HeapSymbol>& inlined = symbols.at(0x1234);
+  assertEq(inlined.size(), 2UL);
+  assertEq(inlined[0].function, "std::vector<int>::push_back(int)");
+  assertEq(inlined[0].file, "/usr/include/c++/12/stl_vector.h");
+  assertEq(inlined[0].line, 1287UL);
+  assertEq(inlined[1].function, "fill(int)");
+  assertEq(inlined[1].file, "/src/app/main.cc");
+  assertEq(inlined[1].line, 7UL);
+
+  assertTrue(symbols.at(0x5678).empty());
+
+  assertEq(symbols.at(0x9abc).size(), 1UL);
+  assertEq(symbols.at(0x9abc)[0].function, "stripped");
+  assertTrue(symbols.at(0x9abc)[0].file.empty());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testSummarizeHeapProfiles) {
+  HeapProfile first;
+  first.program = "/src/app/cabin-out/dev/app";
+  first.interval = 1;
+  first.peakRssKib = 100;
+  first.modules = { { 0, "/lib/libstdc++.so.6" }, { 1, "/src/app/app" } };
+  first.sites = {
+    // operator new <- fill(int) [inlined push_back] <- main
+    HeapSite{ .allocations = 4,
+              .bytes = 4000,
+              .peakBytes = 3000,
+              .frames = { { 0, 0x10 }, { 1, 0x1234 }, { 1, 0x2000 } } },
+    // Another call stack through the same line.
+    HeapSite{ .allocations = 1,
+              .bytes = 1000,
+              .peakBytes = 1000,
+              .frames = { { 0, 0x10 }, { 1, 0x1234 }, { 1, 0x3000 } } },
+    // Nothing known.
+    HeapSite{ .allocations = 2,
+              .bytes = 200,
+              .peakBytes = 100,
+              .frames = { { 1, 0x4000 } } },
+  };
+  HeapProfile second;
+  second.program = "/src/app/cabin-out/dev/other";
+  second.interval = 1;
+  second.peakRssKib = 300;
+  second.modules = { { 7, "/lib/libstdc++.so.6" }, { 8, "/src/app/app" } };
+  second.sites = {
+    HeapSite{ .allocations = 10,
+              .bytes = 10000,
+              .peakBytes = 2000,
+              .frames = { { 7, 0x10 }, { 8, 0x1234 }, { 8, 0x2000 } } },
+    // Only library code.
+    HeapSite{ .allocations = 1,
+              .bytes = 50,
+              .peakBytes = 50,
+              .frames = { { 7, 0x10 }, { 7, 0x20 } } },
+  };
+
+  const HeapSymbols symbols{
+    { { "/lib/libstdc++.so.6", 0x10 },
+      { HeapSymbol{ .function = "operator new(unsigned long)",
+                    .file = "",
+                    .line = 0 } } },
+    { { "/lib/libstdc++.so.6", 0x20 },
+      { HeapSymbol{ .function = "std::locale::locale()",
+                    .file = "",
+                    .line = 0 } } },
+    { { "/src/app/app", 0x1234 },
+      { HeapSymbol{ .function = "std::vector<int>::push_back(int)",
+                    .file = "/usr/include/c++/12/bits/stl_vector.h",
+                    .line = 1287 },
+        HeapSymbol{ .function = "fill(int)",
+                    .file = "/src/app/cabin-out/dev/../../src/main.cc",
+                    .line = 7 } } },
+    { { "/src/app/app", 0x2000 },
+      { HeapSymbol{
+          .function = "main", .file = "/src/app/src/main.cc", .line = 20 } } },
+    { { "/src/app/app", 0x3000 },
+      { HeapSymbol{
+          .function = "run", .file = "/src/app/src/main.cc", .line = 30 } } },
+  };
+
+  const HeapReport report =
+      summarizeHeapProfiles({ first, second }, symbols, "/src/app");
+  assertEq(report.numProcesses, 2UL);
+  assertEq(report.interval, 1UL);
+  assertEq(report.peakRssKib, 300UL);
+  assertEq(report.peakRssProgram, "other");
+
+  assertEq(report.sites.size(), 3UL);
+  assertEq(report.sites[0].site, "fill(int) (src/main.cc:7)");
+  assertEq(report.sites[0].allocations, 15UL);
+  assertEq(report.sites[0].bytes, 15000UL);
+  // 3000 + 1000 in the first process, more than the 2000 of the second.
+  assertEq(report.sites[0].peakBytes, 4000UL);
+  assertEq(report.sites[1].site, "app+0x4000");
+  assertEq(report.sites[2].site, "std::locale::locale()");
+
+  assertEq(report.stacks.at("app;main;fill(int);"
+                            "std::vector<int>::push_back(int);"
+                            "operator new(unsigned long)"),
+           4000UL);
+  assertEq(report.stacks.at("other;main;fill(int);"
+                            "std::vector<int>::push_back(int);"
+                            "operator new(unsigned long)"),
+           10000UL);
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatHeapReport) {
+  HeapReport report;
+  report.numProcesses = 1;
+  report.interval = 512 * 1024;
+  report.peakRssKib = 2048;
+  report.peakRssProgram = "app";
+  report.sites = {
+    HeapSiteSummary{ .site = "fill(int) (src/main.cc:7)",
+                     .allocations = 1000,
+                     .bytes = 3 * 1024 * 1024,
+                     .peakBytes = 1024 },
+    HeapSiteSummary{
+        .site = "main", .allocations = 1, .bytes = 100, .peakBytes = 100 },
+  };
+
+  assertEq(formatHeapReport(report, 1),
+           "Heap profile of 1 process, sampled every 512.0 KiB on average\n"
+           "Peak RSS: 2.0 MiB (app)\n"
+           "\n"
+           "   Allocated      Allocs     Peak live  Site\n"
+           "     3.0 MiB        1000       1.0 KiB  fill(int) (src/main.cc:7)\n"
+           "              ... and 1 more sites\n");
+
+  report.interval = 1;
+  report.dropped = 2;
+  assertEq(formatHeapReport(report, 0),
+           "Heap profile of 1 process, every allocation recorded\n"
+           "Peak RSS: 2.0 MiB (app)\n"
+           "2 samples were dropped since the profiler's tables were full\n"
+           "\n"
+           "   Allocated      Allocs     Peak live  Site\n"
+           "     3.0 MiB        1000       1.0 KiB  fill(int) (src/main.cc:7)\n"
+           "       100 B           1         100 B  main\n");
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
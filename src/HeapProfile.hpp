@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Command.hpp"
+#include "Rustify/Result.hpp"
+
+#include <filesystem>
+#include <string_view>
+#include <utility>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// Samples the allocations of programs through a malloc() shim that is
+// preloaded into them, and reports where they allocated the most.
+class HeapProfiler {
+  fs::path outDir;
+  fs::path library;
+  // Where each profiled process writes its samples at exit.
+  fs::path profileDir;
+
+  HeapProfiler(fs::path outDir, fs::path library, fs::path profileDir)
+      : outDir(std::move(outDir)), library(std::move(library)),
+        profileDir(std::move(profileDir)) {}
+
+public:
+  // Builds the shim into `outDir` unless it's up to date, and clears the
+  // profiles of the last run.
+  static Result<HeapProfiler> init(const fs::path& outDir);
+
+  // Preloads the shim into `cmd` and the processes it spawns.
+  void attach(Command& cmd) const;
+
+  // Merges the profiles of every process the shim was attached to, writes
+  // the full report and a flame graph of the allocated bytes to `outDir`,
+  // and prints the top allocation sites.  Sites in `projectRoot` are
+  // preferred over the library code they call into.
+  Result<void> report(const fs::path& projectRoot,
+                      std::string_view title) const;
+};
+
+} // namespace cabin
@@ -0,0 +1,511 @@
+#pragma once
+
+#include <string_view>
+
+namespace cabin {
+
+// The source of the library `--heap-profile` preloads into programs.  It's
+// compiled on first use with the same compiler as the package, so it needs
+// nothing but glibc.
+inline constexpr std::string_view HEAP_PROFILER_SHIM = R"shim(
+// Preloaded into the program by `cabin run --heap-profile` and
+// `cabin test --heap-profile`.  Generated by cabin; do not edit.
+//
+// Allocations are sampled about once every CABIN_HEAP_PROFILE_INTERVAL bytes,
+// with the gaps drawn from an exponential distribution so that every byte is
+// equally likely to be sampled.  Each sample stands for the bytes allocated
+// since the previous one, which keeps the estimates unbiased while the common
+// path of malloc() and free() stays a subtraction and a table lookup.  At
+// exit the call stacks of the samples are written to
+// $CABIN_HEAP_PROFILE/heap.<pid>.txt.
+
+#include <atomic>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define CABIN_TLS __attribute__((tls_model("initial-exec"))) thread_local
+#define CABIN_EXPORT extern "C" __attribute__((visibility("default")))
+
+namespace {
+
+using MallocFn = void* (*)(std::size_t);
+using CallocFn = void* (*)(std::size_t, std::size_t);
+using ReallocFn = void* (*)(void*, std::size_t);
+using FreeFn = void (*)(void*);
+using MemalignFn = void* (*)(std::size_t, std::size_t);
+using PosixMemalignFn = int (*)(void**, std::size_t, std::size_t);
+
+MallocFn realMalloc;
+CallocFn realCalloc;
+ReallocFn realRealloc;
+FreeFn realFree;
+MemalignFn realMemalign;
+MemalignFn realAlignedAlloc;
+PosixMemalignFn realPosixMemalign;
+
+// dlsym() may call calloc() before we know the real one.
+alignas(64) char bootstrap[8192];
+std::size_t bootstrapUsed;
+
+bool isBootstrap(const void* ptr) {
+  return ptr >= bootstrap && ptr < bootstrap + sizeof(bootstrap);
+}
+
+void* bootstrapAlloc(std::size_t size) {
+  size = (size + 15) & ~std::size_t{ 15 };
+  if (bootstrapUsed + size > sizeof(bootstrap)) {
+    return nullptr;
+  }
+  void* ptr = bootstrap + bootstrapUsed;
+  bootstrapUsed += size;
+  return ptr;
+}
+
+constexpr int MAX_FRAMES = 48;
+constexpr std::size_t SITE_CAPACITY = std::size_t{ 1 } << 16;
+constexpr std::size_t LIVE_CAPACITY = std::size_t{ 1 } << 20;
+constexpr std::size_t FILTER_SIZE = std::size_t{ 1 } << 16;
+
+struct Site {
+  std::uint64_t hash;
+  int depth;
+  void* frames[MAX_FRAMES];
+  double allocations;
+  double bytes;
+  double live;
+  double peak;
+};
+
+struct Live {
+  const void* ptr;
+  std::uint32_t site;
+  double weight;
+};
+
+Site* sites;
+Live* live;
+std::size_t numLive;
+std::size_t numDropped;
+// How many sampled pointers hash to each slot, so that free() only takes the
+// lock for pointers that may have been sampled.
+std::atomic<std::uint32_t> filter[FILTER_SIZE];
+std::atomic_flag lock = ATOMIC_FLAG_INIT;
+
+double interval = 512.0 * 1024;
+char outPath[4096];
+std::atomic<int> state; // 0: uninitialized, 1: initializing, 2: ready
+
+CABIN_TLS bool inHook;
+CABIN_TLS bool seeded;
+CABIN_TLS std::uint64_t rng;
+CABIN_TLS double untilSample;
+
+void acquire() {
+  while (lock.test_and_set(std::memory_order_acquire)) {
+  }
+}
+void release() { lock.clear(std::memory_order_release); }
+
+std::uint64_t hashPtr(const void* ptr) {
+  return (reinterpret_cast<std::uintptr_t>(ptr) >> 4) * 0x9e3779b97f4a7c15;
+}
+
+double nextGap() {
+  if (!seeded) {
+    rng = hashPtr(&rng) ^ static_cast<std::uint64_t>(getpid());
+    seeded = true;
+  }
+  rng ^= rng << 13;
+  rng ^= rng >> 7;
+  rng ^= rng << 17;
+  // Uniform in (0, 1].
+  const double uniform =
+      static_cast<double>((rng >> 11) + 1) / 9007199254740992.0;
+  return -std::log(uniform) * interval;
+}
+
+void* mapZeroed(std::size_t size) {
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+void init() {
+  int expected = 0;
+  if (!state.compare_exchange_strong(expected, 1)) {
+    return;
+  }
+  realMalloc = reinterpret_cast<MallocFn>(dlsym(RTLD_NEXT, "malloc"));
+  realCalloc = reinterpret_cast<CallocFn>(dlsym(RTLD_NEXT, "calloc"));
+  realRealloc = reinterpret_cast<ReallocFn>(dlsym(RTLD_NEXT, "realloc"));
+  realFree = reinterpret_cast<FreeFn>(dlsym(RTLD_NEXT, "free"));
+  realMemalign = reinterpret_cast<MemalignFn>(dlsym(RTLD_NEXT, "memalign"));
+  realAlignedAlloc =
+      reinterpret_cast<MemalignFn>(dlsym(RTLD_NEXT, "aligned_alloc"));
+  realPosixMemalign =
+      reinterpret_cast<PosixMemalignFn>(dlsym(RTLD_NEXT, "posix_memalign"));
+
+  if (const char* str = std::getenv("CABIN_HEAP_PROFILE_INTERVAL")) {
+    const double value = std::strtod(str, nullptr);
+    if (value >= 1) {
+      interval = value;
+    }
+  }
+  if (const char* dir = std::getenv("CABIN_HEAP_PROFILE")) {
+    std::snprintf(outPath, sizeof(outPath), "%s/heap.%d.txt", dir,
+                  static_cast<int>(getpid()));
+  }
+  sites = static_cast<Site*>(mapZeroed(SITE_CAPACITY * sizeof(Site)));
+  live = static_cast<Live*>(mapZeroed(LIVE_CAPACITY * sizeof(Live)));
+  state.store(2, std::memory_order_release);
+}
+
+bool ready() {
+  if (state.load(std::memory_order_acquire) != 2) {
+    init();
+  }
+  return state.load(std::memory_order_acquire) == 2;
+}
+
+Site* findSite(void* const* frames, const int depth) {
+  std::uint64_t hash = 0xcbf29ce484222325;
+  for (int i = 0; i < depth; ++i) {
+    hash = (hash ^ reinterpret_cast<std::uintptr_t>(frames[i]))
+           * 0x100000001b3;
+  }
+  hash |= 1; // 0 marks an empty slot.
+  for (std::size_t i = 0; i < SITE_CAPACITY; ++i) {
+    Site& site = sites[(hash + i) & (SITE_CAPACITY - 1)];
+    if (site.hash == 0) {
+      site.hash = hash;
+      site.depth = depth;
+      std::memcpy(site.frames, frames, sizeof(void*) * depth);
+      return &site;
+    }
+    if (site.hash == hash && site.depth == depth
+        && std::memcmp(site.frames, frames, sizeof(void*) * depth) == 0) {
+      return &site;
+    }
+  }
+  return nullptr;
+}
+
+std::size_t liveSlot(const void* ptr) {
+  return hashPtr(ptr) >> 44 & (LIVE_CAPACITY - 1);
+}
+std::size_t filterSlot(const void* ptr) {
+  return hashPtr(ptr) >> 48 & (FILTER_SIZE - 1);
+}
+
+// Removes `ptr` from the live samples, with the lock held.
+void forgetLocked(const void* ptr) {
+  std::size_t slot = liveSlot(ptr);
+  while (live[slot].ptr != ptr) {
+    if (live[slot].ptr == nullptr) {
+      return;
+    }
+    slot = (slot + 1) & (LIVE_CAPACITY - 1);
+  }
+  sites[live[slot].site].live -= live[slot].weight;
+  filter[filterSlot(ptr)].fetch_sub(1, std::memory_order_relaxed);
+  --numLive;
+
+  // Shift back the entries that probed past the hole.
+  std::size_t hole = slot;
+  for (std::size_t next = (hole + 1) & (LIVE_CAPACITY - 1);
+       live[next].ptr != nullptr; next = (next + 1) & (LIVE_CAPACITY - 1)) {
+    const std::size_t home = liveSlot(live[next].ptr);
+    if (((next - home) & (LIVE_CAPACITY - 1))
+        >= ((next - hole) & (LIVE_CAPACITY - 1))) {
+      live[hole] = live[next];
+      hole = next;
+    }
+  }
+  live[hole].ptr = nullptr;
+}
+
+void sample(const void* ptr, std::size_t size) {
+  if (size == 0) {
+    size = 1;
+  }
+  const double bytes = static_cast<double>(size);
+  const double weight =
+      interval <= 1 ? bytes : bytes / -std::expm1(-bytes / interval);
+
+  void* frames[MAX_FRAMES];
+  const int depth = backtrace(frames, MAX_FRAMES);
+
+  acquire();
+  Site* site = sites == nullptr ? nullptr : findSite(frames, depth);
+  if (site == nullptr || live == nullptr
+      || numLive >= LIVE_CAPACITY / 4 * 3) {
+    ++numDropped;
+    release();
+    return;
+  }
+  site->allocations += weight / bytes;
+  site->bytes += weight;
+  site->live += weight;
+  if (site->live > site->peak) {
+    site->peak = site->live;
+  }
+  // The allocator may have handed out a sampled pointer that was freed
+  // behind our back, e.g. by a realloc() inside libc.
+  forgetLocked(ptr);
+  std::size_t slot = liveSlot(ptr);
+  while (live[slot].ptr != nullptr) {
+    slot = (slot + 1) & (LIVE_CAPACITY - 1);
+  }
+  live[slot] = Live{ ptr, static_cast<std::uint32_t>(site - sites), weight };
+  filter[filterSlot(ptr)].fetch_add(1, std::memory_order_relaxed);
+  ++numLive;
+  release();
+}
+
+void onAlloc(const void* ptr, const std::size_t size) {
+  if (ptr == nullptr || inHook) {
+    return;
+  }
+  if (interval > 1) {
+    untilSample -= static_cast<double>(size);
+    if (untilSample > 0) {
+      return;
+    }
+    const bool first = !seeded;
+    untilSample = nextGap();
+    if (first) {
+      // Start every thread at a random point instead of on its first
+      // allocation.
+      return;
+    }
+  }
+  inHook = true;
+  sample(ptr, size);
+  inHook = false;
+}
+
+void onFree(const void* ptr) {
+  if (filter[filterSlot(ptr)].load(std::memory_order_relaxed) == 0) {
+    return;
+  }
+  acquire();
+  forgetLocked(ptr);
+  release();
+}
+
+// A small buffered writer that doesn't allocate.
+struct Writer {
+  int fd;
+  char buf[8192];
+  std::size_t len = 0;
+
+  void flush() {
+    std::size_t done = 0;
+    while (done < len) {
+      const ssize_t n = write(fd, buf + done, len - done);
+      if (n <= 0) {
+        break;
+      }
+      done += static_cast<std::size_t>(n);
+    }
+    len = 0;
+  }
+  void put(const char* str) {
+    for (; *str != '\0'; ++str) {
+      if (len == sizeof(buf)) {
+        flush();
+      }
+      buf[len++] = *str;
+    }
+  }
+  template <typename... Args>
+  void print(const char* format, Args... args) {
+    char line[512];
+    std::snprintf(line, sizeof(line), format, args...);
+    put(line);
+  }
+};
+
+constexpr std::size_t MAX_MODULES = 512;
+link_map* modules[MAX_MODULES];
+std::size_t numModules;
+
+__attribute__((destructor)) void dumpProfile() {
+  if (state.load() != 2 || outPath[0] == '\0' || sites == nullptr) {
+    return;
+  }
+  inHook = true;
+  const int fd = open(outPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return;
+  }
+  acquire();
+
+  Writer out{ fd, {} };
+  char exe[4096] = {};
+  if (readlink("/proc/self/exe", exe, sizeof(exe) - 1) < 0) {
+    std::strcpy(exe, "?");
+  }
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  out.print("cabin-heap-profile 1\nprogram %s\ninterval %.0f\n", exe, interval);
+  out.print("peak-rss-kib %ld\ndropped %zu\n", usage.ru_maxrss, numDropped);
+
+  Dl_info info;
+  link_map* self = nullptr;
+  dladdr1(reinterpret_cast<void*>(&dumpProfile), &info,
+          reinterpret_cast<void**>(&self), RTLD_DL_LINKMAP);
+
+  for (std::size_t i = 0; i < SITE_CAPACITY; ++i) {
+    const Site& site = sites[i];
+    if (site.hash == 0) {
+      continue;
+    }
+    out.print("site %.0f %.0f %.0f", site.allocations, site.bytes, site.peak);
+    bool inShim = true;
+    for (int j = 0; j < site.depth; ++j) {
+      link_map* map = nullptr;
+      if (dladdr1(site.frames[j], &info, reinterpret_cast<void**>(&map),
+                  RTLD_DL_LINKMAP)
+              == 0
+          || map == nullptr) {
+        continue;
+      }
+      // Our own frames are the same for every sample.
+      if (inShim && map == self) {
+        continue;
+      }
+      inShim = false;
+      std::size_t id = 0;
+      while (id < numModules && modules[id] != map) {
+        ++id;
+      }
+      if (id == numModules) {
+        if (numModules == MAX_MODULES) {
+          continue;
+        }
+        modules[numModules++] = map;
+      }
+      // A return address points past the call.
+      out.print(" %zu:%lx", id,
+                static_cast<unsigned long>(
+                    reinterpret_cast<std::uintptr_t>(site.frames[j]) - 1
+                    - map->l_addr));
+    }
+    out.put("\n");
+  }
+  for (std::size_t id = 0; id < numModules; ++id) {
+    const char* name = modules[id]->l_name;
+    out.print("module %zu %s\n", id,
+              name == nullptr || name[0] == '\0' ? exe : name);
+  }
+  out.flush();
+  close(fd);
+  release();
+}
+
+void lockForFork() { acquire(); }
+
+__attribute__((constructor)) void warmUp() {
+  ready();
+  pthread_atfork(lockForFork, release, release);
+  // The first backtrace() loads the unwinder, which allocates.
+  void* frames[1];
+  inHook = true;
+  backtrace(frames, 1);
+  inHook = false;
+}
+
+} // namespace
+
+CABIN_EXPORT void* malloc(std::size_t size) {
+  if (!ready()) {
+    return bootstrapAlloc(size);
+  }
+  void* ptr = realMalloc(size);
+  onAlloc(ptr, size);
+  return ptr;
+}
+
+CABIN_EXPORT void* calloc(std::size_t num, std::size_t size) {
+  if (!ready()) {
+    // Already zeroed.
+    return bootstrapAlloc(num * size);
+  }
+  void* ptr = realCalloc(num, size);
+  onAlloc(ptr, num * size);
+  return ptr;
+}
+
+CABIN_EXPORT void* realloc(void* old, std::size_t size) {
+  if (isBootstrap(old) || !ready()) {
+    void* ptr = malloc(size);
+    if (ptr != nullptr && old != nullptr) {
+      const std::size_t avail =
+          static_cast<std::size_t>(bootstrap + sizeof(bootstrap)
+                                   - static_cast<char*>(old));
+      std::memcpy(ptr, old, size < avail ? size : avail);
+    }
+    return ptr;
+  }
+  if (old != nullptr) {
+    onFree(old);
+  }
+  void* ptr = realRealloc(old, size);
+  onAlloc(ptr, size);
+  return ptr;
+}
+
+CABIN_EXPORT void free(void* ptr) {
+  if (ptr == nullptr || isBootstrap(ptr)) {
+    return;
+  }
+  onFree(ptr);
+  realFree(ptr);
+}
+
+CABIN_EXPORT void* memalign(std::size_t alignment, std::size_t size) {
+  if (!ready()) {
+    return nullptr;
+  }
+  void* ptr = realMemalign(alignment, size);
+  onAlloc(ptr, size);
+  return ptr;
+}
+
+CABIN_EXPORT void* aligned_alloc(std::size_t alignment, std::size_t size) {
+  if (!ready()) {
+    return nullptr;
+  }
+  void* ptr = realAlignedAlloc(alignment, size);
+  onAlloc(ptr, size);
+  return ptr;
+}
+
+CABIN_EXPORT int posix_memalign(void** out, std::size_t alignment,
+                                std::size_t size) {
+  if (!ready()) {
+    return ENOMEM;
+  }
+  const int err = realPosixMemalign(out, alignment, size);
+  if (err == 0) {
+    onAlloc(*out, size);
+  }
+  return err;
+}
+)shim";
+
+} // namespace cabin
@@ -0,0 +1,292 @@
+#include "Lockfile.hpp"
+
+#include "Algos.hpp"
+#include "Builder/Compiler.hpp"
+#include "Dependency.hpp"
+#include "Rustify/Result.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <toml.hpp>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static bool lockedFlag = false;
+static bool offlineFlag = false;
+
+void setLocked(const bool locked) noexcept { lockedFlag = locked; }
+bool isLocked() noexcept { return lockedFlag; }
+void setOffline(const bool offline) noexcept { offlineFlag = offline; }
+bool isOffline() noexcept { return offlineFlag; }
+
+static std::string quoteTomlString(const std::string_view str) {
+  std::string quoted = "\"";
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+Result<Lockfile> Lockfile::tryParse(const fs::path& path) noexcept {
+  if (!fs::exists(path)) {
+    return Ok(Lockfile{});
+  }
+  const auto context = [&path] {
+    return anyhow::anyhow(fmt::format("failed to parse {}", path.string()));
+  };
+  // A lockfile left with merge conflict markers is not valid TOML.
+  const toml::value val =
+      Try(toml::try_parse_file(path).with_context(context));
+  return tryFromToml(val).with_context(context);
+}
+
+Result<Lockfile> Lockfile::tryFromToml(const toml::value& val) noexcept {
+  const auto version = Try(toml::try_find<int>(val, "version"));
+  Ensure(version == VERSION, "unsupported lockfile version: {}", version);
+
+  Lockfile lockfile;
+  for (const toml::value& entry :
+       toml::find_or_default<toml::array>(val, "git")) {
+    std::optional<std::string> target;
+    if (entry.contains("target")) {
+      target = Try(toml::try_find<std::string>(entry, "target"));
+    }
+    lockfile.gitDeps.push_back(LockedGitDep{
+        .name = Try(toml::try_find<std::string>(entry, "name")),
+        .url = Try(toml::try_find<std::string>(entry, "url")),
+        .target = std::move(target),
+        .rev = Try(toml::try_find<std::string>(entry, "rev")),
+    });
+  }
+  for (const toml::value& entry :
+       toml::find_or_default<toml::array>(val, "system")) {
+    lockfile.systemDeps.push_back(LockedSystemDep{
+        .name = Try(toml::try_find<std::string>(entry, "name")),
+        .versionReq = Try(toml::try_find<std::string>(entry, "version-req")),
+        .hash = Try(toml::try_find<std::string>(entry, "hash")),
+    });
+  }
+  return Ok(lockfile);
+}
+
+std::string Lockfile::toString() const {
+  std::string str = "# This file is automatically generated by cabin.\n"
+                    "# It is not intended for manual editing.\n";
+  str += fmt::format("version = {}\n", VERSION);
+
+  for (const LockedGitDep& dep : gitDeps) {
+    str += "\n[[git]]\n";
+    str += fmt::format("name = {}\n", quoteTomlString(dep.name));
+    str += fmt::format("url = {}\n", quoteTomlString(dep.url));
+    if (dep.target.has_value()) {
+      str += fmt::format("target = {}\n", quoteTomlString(dep.target.value()));
+    }
+    str += fmt::format("rev = {}\n", quoteTomlString(dep.rev));
+  }
+  for (const LockedSystemDep& dep : systemDeps) {
+    str += "\n[[system]]\n";
+    str += fmt::format("name = {}\n", quoteTomlString(dep.name));
+    str += fmt::format("version-req = {}\n", quoteTomlString(dep.versionReq));
+    str += fmt::format("hash = {}\n", quoteTomlString(dep.hash));
+  }
+  return str;
+}
+
+Result<void> Lockfile::save(const fs::path& path) const {
+  // An interrupted or concurrent write never leaves a truncated lockfile.
+  return writeFileAtomically(path, toString());
+}
+
+const LockedGitDep*
+Lockfile::find(const GitDependency& dep) const noexcept {
+  for (const LockedGitDep& locked : gitDeps) {
+    // An entry whose source changed in the manifest is stale.
+    if (locked.name == dep.name && locked.url == dep.url
+        && locked.target == dep.target) {
+      return &locked;
+    }
+  }
+  return nullptr;
+}
+
+const LockedSystemDep*
+Lockfile::find(const SystemDependency& dep) const noexcept {
+  const std::string versionReq = dep.versionReq.toString();
+  for (const LockedSystemDep& locked : systemDeps) {
+    if (locked.name == dep.name && locked.versionReq == versionReq) {
+      return &locked;
+    }
+  }
+  return nullptr;
+}
+
+std::string hashCompilerOpts(const CompilerOpts& opts) {
+  return fmt::format("{:016x}", fnv1aHash(fmt::format("{}", opts)));
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <fstream>
+#  include <toml11/fwd/literal_fwd.hpp>
+#  include <unistd.h>
+
+namespace tests {
+
+// NOLINTBEGIN
+using namespace cabin;
+using namespace toml::literals::toml_literals;
+// NOLINTEND
+
+CABIN_TEST_CASE(testLockfileToString) {
+  Lockfile lockfile;
+  lockfile.gitDeps.push_back(LockedGitDep{
+      .name = "fmt",
+      .url = "https://github.com/fmtlib/fmt.git",
+      .target = "10.2.1",
+      .rev = "e69e5f977d458f2650bb346dadf2ad30c5320281",
+  });
+  lockfile.gitDeps.push_back(LockedGitDep{
+      .name = "toml11",
+      .url = "https://github.com/ToruNiina/toml11.git",
+      .target = std::nullopt,
+      .rev = "be08ba2be2a964edcdb3d3e3ea8d100abc26f286",
+  });
+  lockfile.systemDeps.push_back(LockedSystemDep{
+      .name = "libcurl",
+      .versionReq = ">=7.79.1",
+      .hash = "0123456789abcdef",
+  });
+
+  assertEq(lockfile.toString(),
+           R"(# This file is automatically generated by cabin.
+# It is not intended for manual editing.
+version = 1
+
+[[git]]
+name = "fmt"
+url = "https://github.com/fmtlib/fmt.git"
+target = "10.2.1"
+rev = "e69e5f977d458f2650bb346dadf2ad30c5320281"
+
+[[git]]
+name = "toml11"
+url = "https://github.com/ToruNiina/toml11.git"
+rev = "be08ba2be2a964edcdb3d3e3ea8d100abc26f286"
+
+[[system]]
+name = "libcurl"
+version-req = ">=7.79.1"
+hash = "0123456789abcdef"
+)");
+
+  assertEq(quoteTomlString(R"(a"b\c)"), R"("a\"b\\c")");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testLockfileTryFromToml) {
+  {
+    const toml::value val = R"(
+      version = 1
+
+      [[git]]
+      name = "fmt"
+      url = "https://github.com/fmtlib/fmt.git"
+      target = "10.2.1"
+      rev = "e69e5f977d458f2650bb346dadf2ad30c5320281"
+
+      [[system]]
+      name = "libcurl"
+      version-req = ">=7.79.1"
+      hash = "0123456789abcdef"
+    )"_toml;
+
+    const Lockfile lockfile = Lockfile::tryFromToml(val).unwrap();
+    assertEq(lockfile.gitDeps.size(), 1UL);
+    assertEq(lockfile.gitDeps[0].name, "fmt");
+    assertTrue(lockfile.gitDeps[0].target == "10.2.1");
+    assertEq(lockfile.gitDeps[0].rev,
+             "e69e5f977d458f2650bb346dadf2ad30c5320281");
+    assertEq(lockfile.systemDeps.size(), 1UL);
+    assertEq(lockfile.systemDeps[0].versionReq, ">=7.79.1");
+
+    const GitDependency sameDep("fmt", "https://github.com/fmtlib/fmt.git",
+                                "10.2.1");
+    assertTrue(lockfile.find(sameDep) == lockfile.gitDeps.data());
+    const GitDependency bumpedDep("fmt", "https://github.com/fmtlib/fmt.git",
+                                  "11.0.0");
+    assertTrue(lockfile.find(bumpedDep) == nullptr);
+  }
+  {
+    const toml::value val = R"(
+      version = 2
+    )"_toml;
+    assertEq(Lockfile::tryFromToml(val).unwrap_err()->what(),
+             "unsupported lockfile version: 2");
+  }
+  {
+    // A hand-edited entry is an error, not a crash.
+    const toml::value val = R"(
+      version = 1
+
+      [[git]]
+      name = "fmt"
+      rev = 42
+    )"_toml;
+    assertTrue(Lockfile::tryFromToml(val).is_err());
+  }
+  {
+    const toml::value val = R"(
+      [[system]]
+      name = "libcurl"
+    )"_toml;
+    assertTrue(Lockfile::tryFromToml(val).is_err());
+  }
+
+  pass();
+}
+
+CABIN_TEST_CASE(testLockfileTryParseConflicted) {
+  const fs::path path =
+      fs::temp_directory_path()
+      / fmt::format("cabin-test-lockfile-{}.lock", getpid());
+  {
+    std::ofstream ofs(path);
+    ofs << "version = 1\n"
+           "<<<<<<< HEAD\n"
+           "[[git]]\n"
+           "=======\n"
+           ">>>>>>> topic\n";
+  }
+  const auto lockfile = Lockfile::tryParse(path);
+  fs::remove(path);
+  assertTrue(lockfile.is_err());
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
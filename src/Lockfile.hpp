@@ -0,0 +1,70 @@
+#pragma once
+
+#include "Builder/Compiler.hpp"
+#include "Dependency.hpp"
+#include "Rustify/Result.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <toml.hpp>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// --locked: fail instead of updating cabin.lock.
+void setLocked(bool locked) noexcept;
+bool isLocked() noexcept;
+// --offline: never touch the network while installing dependencies.
+void setOffline(bool offline) noexcept;
+bool isOffline() noexcept;
+
+struct LockedGitDep {
+  std::string name;
+  std::string url;
+  std::optional<std::string> target;
+  // The commit `target` resolved to.
+  std::string rev;
+
+  bool operator==(const LockedGitDep&) const = default;
+};
+
+struct LockedSystemDep {
+  std::string name;
+  std::string versionReq;
+  // Hash of the compiler options pkg-config resolved the dependency to.
+  std::string hash;
+
+  bool operator==(const LockedSystemDep&) const = default;
+};
+
+// cabin.lock pins every git dependency to the commit it resolved to, so that
+// later builds skip resolving revisions altogether and branch-pinned
+// dependencies don't move silently.  System dependencies are recorded by a
+// hash of their flags to detect changes on the host.
+struct Lockfile {
+  static constexpr std::string_view FILE_NAME = "cabin.lock";
+  static constexpr int VERSION = 1;
+
+  std::vector<LockedGitDep> gitDeps;
+  std::vector<LockedSystemDep> systemDeps;
+
+  /// Read the lockfile at `path`.  A missing lockfile is an empty one.
+  static Result<Lockfile> tryParse(const fs::path& path) noexcept;
+  static Result<Lockfile> tryFromToml(const toml::value& val) noexcept;
+
+  std::string toString() const;
+  Result<void> save(const fs::path& path) const;
+
+  const LockedGitDep* find(const GitDependency& dep) const noexcept;
+  const LockedSystemDep* find(const SystemDependency& dep) const noexcept;
+
+  bool operator==(const Lockfile&) const = default;
+};
+
+std::string hashCompilerOpts(const CompilerOpts& opts);
+
+} // namespace cabin
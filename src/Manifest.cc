@@ -2,24 +2,35 @@
 
 #include "Builder/BuildProfile.hpp"
 #include "Builder/Compiler.hpp"
+#include "Builder/PkgConfig.hpp"
+#include "Diag.hpp"
+#include "Git2/Oid.hpp"
+#include "Lockfile.hpp"
 #include "Rustify/Result.hpp"
 #include "Semver.hpp"
 #include "VersionReq.hpp"
 
+#include <algorithm>
+#include <atomic>
 #include <cctype>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <filesystem>
 #include <fmt/core.h>
 #include <optional>
 #include <ranges>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <string_view>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
 #include <toml.hpp>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
+#include <variant>
 #include <vector>
 
 namespace cabin {
@@ -211,30 +222,28 @@ inheritFlags(const InheritMode inheritMode,
   }
 }
 
-// Inherits from `dev`.
-static Result<Profile> parseTestProfile(const toml::value& val,
-                                        const Profile& devProfile) noexcept {
-  static constexpr const char* key = "test";
-
+// `test` inherits from `dev`, and `bench` and `profiling` from `release`.
+static Result<Profile> parseInheritingProfile(const toml::value& val,
+                                              const char* key,
+                                              const Profile& parent) noexcept {
   const InheritMode inheritMode =
       Try(parseInheritMode(toml::find_or<std::string>(
           val, "profile", key, "inherit-mode", "append")));
   std::vector<std::string> cxxflags = inheritFlags(
-      inheritMode, devProfile.cxxflags,
+      inheritMode, parent.cxxflags,
       Try(validateFlags("cxxflags",
                         toml::find_or_default<std::vector<std::string>>(
                             val, "profile", key, "cxxflags"))));
   std::vector<std::string> ldflags = inheritFlags(
-      inheritMode, devProfile.ldflags,
+      inheritMode, parent.ldflags,
       Try(validateFlags("ldflags",
                         toml::find_or_default<std::vector<std::string>>(
                             val, "profile", key, "ldflags"))));
-  const auto lto =
-      toml::find_or<bool>(val, "profile", key, "lto", devProfile.lto);
+  const auto lto = toml::find_or<bool>(val, "profile", key, "lto", parent.lto);
   const auto debug =
-      toml::find_or<bool>(val, "profile", key, "debug", devProfile.debug);
+      toml::find_or<bool>(val, "profile", key, "debug", parent.debug);
   const auto optLevel = Try(validateOptLevel(toml::find_or<std::uint8_t>(
-      val, "profile", key, "opt-level", devProfile.optLevel)));
+      val, "profile", key, "opt-level", parent.optLevel)));
 
   return Ok(
       Profile(std::move(cxxflags), std::move(ldflags), lto, debug, optLevel));
@@ -245,10 +254,16 @@ parseProfiles(const toml::value& val) noexcept {
   std::unordered_map<BuildProfile, Profile> profiles;
   const BaseProfile baseProfile = Try(parseBaseProfile(val));
   Profile devProfile = Try(parseDevProfile(val, baseProfile));
-  profiles.emplace(BuildProfile::Test, Try(parseTestProfile(val, devProfile)));
+  profiles.emplace(BuildProfile::Test,
+                   Try(parseInheritingProfile(val, "test", devProfile)));
   profiles.emplace(BuildProfile::Dev, std::move(devProfile));
-  profiles.emplace(BuildProfile::Release,
-                   Try(parseReleaseProfile(val, baseProfile)));
+  Profile releaseProfile = Try(parseReleaseProfile(val, baseProfile));
+  profiles.emplace(BuildProfile::Bench,
+                   Try(parseInheritingProfile(val, "bench", releaseProfile)));
+  profiles.emplace(
+      BuildProfile::Profiling,
+      Try(parseInheritingProfile(val, "profiling", releaseProfile)));
+  profiles.emplace(BuildProfile::Release, std::move(releaseProfile));
   return Ok(profiles);
 }
 
@@ -263,6 +278,16 @@ Result<Lint> Lint::tryFromToml(const toml::value& val) noexcept {
   return Ok(Lint(std::move(cpplint)));
 }
 
+Result<TestConfig> TestConfig::tryFromToml(const toml::value& val) noexcept {
+  auto data = toml::find_or_default<std::vector<std::string>>(val, "test",
+                                                              "data");
+  for (const std::string& entry : data) {
+    Ensure(fs::path(entry).is_relative(),
+           "test data `{}` must be relative to the package root", entry);
+  }
+  return Ok(TestConfig(std::move(data)));
+}
+
 static Result<void> validateDepName(const std::string_view name) noexcept {
   Ensure(!name.empty(), "dependency name must not be empty");
   Ensure(std::isalnum(name.front()),
@@ -394,7 +419,8 @@ Result<Manifest> Manifest::tryParse(fs::path path,
   if (findParents) {
     path = Try(findPath(path.parent_path()));
   }
-  return tryFromToml(toml::parse(path), path);
+  const toml::value data = Try(toml::try_parse_file(path));
+  return tryFromToml(data, path);
 }
 
 Result<Manifest> Manifest::tryFromToml(const toml::value& data,
@@ -406,10 +432,11 @@ Result<Manifest> Manifest::tryFromToml(const toml::value& data,
       Try(parseDependencies(data, "dev-dependencies"));
   std::unordered_map<BuildProfile, Profile> profiles = Try(parseProfiles(data));
   auto lint = Try(Lint::tryFromToml(data));
+  auto test = Try(TestConfig::tryFromToml(data));
 
   return Ok(Manifest(std::move(path), std::move(package),
                      std::move(dependencies), std::move(devDependencies),
-                     std::move(profiles), std::move(lint)));
+                     std::move(profiles), std::move(lint), std::move(test)));
 }
 
 Result<fs::path> Manifest::findPath(fs::path candidateDir) noexcept {
@@ -433,25 +460,243 @@ Result<fs::path> Manifest::findPath(fs::path candidateDir) noexcept {
   Bail("{} not find in `{}` and its parents", FILE_NAME, origCandDir.string());
 }
 
-Result<std::vector<CompilerOpts>>
-Manifest::installDeps(const bool includeDevDeps) const {
-  std::vector<CompilerOpts> installed;
-  const auto install = [&](const auto& arg) -> Result<void> {
-    installed.emplace_back(Try(arg.install()));
-    return Ok();
-  };
+static Result<CompilerOpts>
+installGitDep(const GitDependency& dep,
+              const std::optional<std::string>& lockedRev, std::string& rev) {
+  rev = lockedRev.has_value() ? lockedRev.value() : Try(dep.resolve());
+  return dep.install(rev);
+}
 
-  for (const auto& dep : dependencies) {
-    Try(std::visit(install, dep));
+Result<std::vector<InstalledDep>>
+Manifest::installDeps(const bool includeDevDeps) const {
+  std::vector<const Dependency*> deps;
+  for (const Dependency& dep : dependencies) {
+    deps.push_back(&dep);
   }
   if (includeDevDeps) {
-    for (const auto& dep : devDependencies) {
-      Try(std::visit(install, dep));
+    for (const Dependency& dep : devDependencies) {
+      deps.push_back(&dep);
+    }
+  }
+
+  const fs::path lockfilePath = path.parent_path() / Lockfile::FILE_NAME;
+  const Lockfile lockfile = Try(Lockfile::tryParse(lockfilePath));
+
+  // Git dependencies locked to a commit that's already checked out need no
+  // work at all.
+  std::vector<std::optional<std::string>> lockedRevs(deps.size());
+  std::vector<bool> pending(deps.size(), false);
+  std::size_t numPending = 0;
+  for (std::size_t i = 0; i < deps.size(); ++i) {
+    const auto* gitDep = std::get_if<GitDependency>(deps[i]);
+    if (gitDep == nullptr) {
+      continue;
+    }
+    if (const LockedGitDep* locked = lockfile.find(*gitDep)) {
+      lockedRevs[i] = locked->rev;
+    } else {
+      Ensure(!isLocked(),
+             "{} needs to be updated for `{}` but --locked was passed",
+             Lockfile::FILE_NAME, gitDep->name);
+    }
+    if (!lockedRevs[i].has_value()
+        || !gitDep->isInstalled(lockedRevs[i].value())) {
+      pending[i] = true;
+      ++numPending;
+    }
+  }
+  const auto start = std::chrono::steady_clock::now();
+  if (numPending > 0) {
+    Diag::info("Installing", "{} git dependenc{}", numPending,
+               numPending == 1 ? "y" : "ies");
+  }
+
+  // System dependencies are resolved together so that .pc files shared
+  // between them are read only once.
+  std::vector<SystemDependency> systemDeps;
+  std::vector<std::size_t> systemDepIndices;
+  std::vector<std::size_t> otherDepIndices;
+  for (std::size_t i = 0; i < deps.size(); ++i) {
+    if (const auto* systemDep = std::get_if<SystemDependency>(deps[i])) {
+      systemDeps.push_back(*systemDep);
+      systemDepIndices.push_back(i);
+    } else {
+      otherDepIndices.push_back(i);
     }
   }
+
+  // Install everything concurrently; each task writes only to its own slot
+  // so the results stay in manifest order regardless of completion order.
+  std::vector<Result<CompilerOpts>> results(deps.size(), Ok(CompilerOpts()));
+  std::vector<std::string> revs(deps.size());
+  std::atomic<std::size_t> numDone = 0;
+  tbb::parallel_invoke(
+      [&] {
+        tbb::parallel_for(
+            std::size_t{ 0 }, otherDepIndices.size(), [&](std::size_t i) {
+              const std::size_t idx = otherDepIndices[i];
+              if (const auto* gitDep = std::get_if<GitDependency>(deps[idx])) {
+                if (pending[idx]) {
+                  Diag::info("Installing", "{}", gitDep->name);
+                }
+                results[idx] =
+                    installGitDep(*gitDep, lockedRevs[idx], revs[idx]);
+                if (pending[idx] && results[idx].is_ok()) {
+                  Diag::info("Installed", "{} {} ({}/{})", gitDep->name,
+                             revs[idx].substr(0, git2::SHORT_HASH_LEN),
+                             ++numDone, numPending);
+                }
+              } else {
+                results[idx] = std::get<PathDependency>(*deps[idx]).install();
+              }
+            });
+      },
+      [&] {
+        Result<std::vector<CompilerOpts>> resolved = resolveSystemDeps(
+            systemDeps, path.parent_path() / "cabin-out");
+        if (resolved.is_err()) {
+          // Report the failure on the first system dependency, the rest
+          // are left untouched.
+          if (!systemDepIndices.empty()) {
+            results[systemDepIndices.front()] =
+                Err(std::move(resolved).unwrap_err());
+          }
+          return;
+        }
+        std::vector<CompilerOpts> opts = std::move(resolved).unwrap();
+        for (std::size_t i = 0; i < opts.size(); ++i) {
+          results[systemDepIndices[i]] = Ok(std::move(opts[i]));
+        }
+      });
+
+  std::vector<InstalledDep> installed;
+  installed.reserve(deps.size());
+  for (std::size_t i = 0; i < deps.size(); ++i) {
+    InstalledDep& dep = installed.emplace_back();
+    dep.compilerOpts = Try(std::move(results[i]));
+    if (const auto* gitDep = std::get_if<GitDependency>(deps[i])) {
+      dep.name = gitDep->name;
+      dep.rootDir = gitDep->installDir(revs[i]);
+    } else if (const auto* pathDep = std::get_if<PathDependency>(deps[i])) {
+      dep.name = pathDep->name;
+      dep.rootDir = pathDep->installDir();
+    } else {
+      dep.name = std::get<SystemDependency>(*deps[i]).name;
+    }
+  }
+
+  if (numPending > 0) {
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    Diag::info("Installed", "{} dependenc{} in {:.2f}s", deps.size(),
+               deps.size() == 1 ? "y" : "ies", elapsed.count());
+  }
+
+  Lockfile newLockfile;
+  for (std::size_t i = 0; i < deps.size(); ++i) {
+    if (const auto* gitDep = std::get_if<GitDependency>(deps[i])) {
+      newLockfile.gitDeps.push_back(LockedGitDep{ .name = gitDep->name,
+                                                  .url = gitDep->url,
+                                                  .target = gitDep->target,
+                                                  .rev = revs[i] });
+    } else if (const auto* systemDep = std::get_if<SystemDependency>(deps[i])) {
+      newLockfile.systemDeps.push_back(LockedSystemDep{
+          .name = systemDep->name,
+          .versionReq = systemDep->versionReq.toString(),
+          .hash = hashCompilerOpts(installed[i].compilerOpts) });
+    }
+  }
+  if (!includeDevDeps) {
+    // Keep the entries of dev-dependencies that weren't installed this time
+    // so that building and testing don't keep rewriting the lockfile.
+    for (const Dependency& dep : devDependencies) {
+      if (const auto* gitDep = std::get_if<GitDependency>(&dep)) {
+        if (const LockedGitDep* locked = lockfile.find(*gitDep)) {
+          newLockfile.gitDeps.push_back(*locked);
+        }
+      } else if (const auto* systemDep = std::get_if<SystemDependency>(&dep)) {
+        if (const LockedSystemDep* locked = lockfile.find(*systemDep)) {
+          newLockfile.systemDeps.push_back(*locked);
+        }
+      }
+    }
+  }
+
+  if (newLockfile != lockfile) {
+    Ensure(!isLocked(), "{} needs to be updated but --locked was passed",
+           Lockfile::FILE_NAME);
+    Try(newLockfile.save(lockfilePath));
+  }
   return Ok(installed);
 }
 
+Result<std::optional<Workspace>>
+Workspace::tryFind(const fs::path& candidateDir) noexcept {
+  const fs::path manifestPath = Try(Manifest::findPath(candidateDir));
+  const toml::value data = Try(toml::try_parse_file(manifestPath));
+  if (!data.contains("workspace")) {
+    return Ok(std::nullopt);
+  }
+
+  Workspace workspace;
+  workspace.rootPath = manifestPath.parent_path();
+  if (data.contains("package")) {
+    workspace.members.push_back(
+        Try(Manifest::tryFromToml(data, manifestPath)));
+  }
+  for (const fs::path& memberDir :
+       Try(parseMembers(data, workspace.rootPath))) {
+    workspace.members.push_back(Try(Manifest::tryParse(
+        memberDir / Manifest::FILE_NAME, /*findParents=*/false)));
+  }
+  Ensure(!workspace.members.empty(), "workspace `{}` has no members",
+         workspace.rootPath.string());
+
+  // Outputs in the shared directory are named after their package.
+  std::unordered_set<std::string_view> names;
+  for (const Manifest& member : workspace.members) {
+    Ensure(names.insert(member.package.name).second,
+           "multiple workspace members are named `{}`", member.package.name);
+  }
+  return Ok(workspace);
+}
+
+Result<std::vector<fs::path>>
+Workspace::parseMembers(const toml::value& data,
+                        const fs::path& rootPath) noexcept {
+  const auto members = Try(
+      toml::try_find<std::vector<std::string>>(data, "workspace", "members"));
+
+  std::vector<fs::path> memberDirs;
+  for (const std::string& member : members) {
+    if (member.ends_with("/*")) {
+      const fs::path parentDir =
+          rootPath / member.substr(0, member.size() - 2);
+      Ensure(fs::is_directory(parentDir),
+             "workspace member `{}` was not found", member);
+
+      std::vector<fs::path> dirs;
+      for (const auto& entry : fs::directory_iterator(parentDir)) {
+        if (fs::exists(entry.path() / Manifest::FILE_NAME)) {
+          dirs.push_back(entry.path());
+        }
+      }
+      std::ranges::sort(dirs);
+      memberDirs.insert(memberDirs.end(), dirs.begin(), dirs.end());
+    } else {
+      const fs::path memberDir = rootPath / member;
+      Ensure(fs::exists(memberDir / Manifest::FILE_NAME),
+             "workspace member `{}` has no {}", member, Manifest::FILE_NAME);
+      memberDirs.push_back(memberDir);
+    }
+  }
+  return Ok(memberDirs);
+}
+
+fs::path Workspace::outBasePath(const BuildProfile& buildProfile) const {
+  return rootPath / "cabin-out" / fmt::format("{}", buildProfile);
+}
+
 // Returns an error message if the package name is invalid.
 Result<void> validatePackageName(const std::string_view name) noexcept {
   Ensure(!name.empty(), "package name must not be empty");
@@ -485,7 +730,9 @@ Result<void> validatePackageName(const std::string_view name) noexcept {
 
 #  include <climits>
 #  include <fmt/ranges.h>
+#  include <fstream>
 #  include <toml11/fwd/literal_fwd.hpp>
+#  include <unistd.h>
 
 namespace tests {
 
@@ -505,7 +752,7 @@ inline static void assertEditionEq(
   assertEditionEq(left.edition, right, loc);
 }
 
-static void testEditionTryFromString() { // Valid editions
+CABIN_TEST_CASE(testEditionTryFromString) { // Valid editions
   assertEditionEq(Edition::tryFromString("98").unwrap(), Edition::Cpp98);
   assertEditionEq(Edition::tryFromString("03").unwrap(), Edition::Cpp03);
   assertEditionEq(Edition::tryFromString("0x").unwrap(), Edition::Cpp11);
@@ -532,7 +779,7 @@ static void testEditionTryFromString() { // Valid editions
   pass();
 }
 
-static void testEditionComparison() {
+CABIN_TEST_CASE(testEditionComparison) {
   assertTrue(Edition::tryFromString("98").unwrap()
              <= Edition::tryFromString("03").unwrap());
   assertTrue(Edition::tryFromString("03").unwrap()
@@ -625,7 +872,7 @@ static void testEditionComparison() {
   pass();
 }
 
-static void testPackageTryFromToml() {
+CABIN_TEST_CASE(testPackageTryFromToml) {
   // Valid package
   {
     const toml::value val = R"(
@@ -710,7 +957,7 @@ invalid
   pass();
 }
 
-static void testParseProfiles() {
+CABIN_TEST_CASE(testParseProfiles) {
   const Profile devProfileDefault(
       /*cxxflags=*/{}, /*ldflags=*/{}, /*lto=*/false, /*debug=*/true,
       /*optLevel=*/0);
@@ -722,18 +969,21 @@ static void testParseProfiles() {
     const toml::value empty = ""_toml;
 
     const auto profiles = parseProfiles(empty).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devProfileDefault);
     assertEq(profiles.at(BuildProfile::Release), relProfileDefault);
+    assertEq(profiles.at(BuildProfile::Bench), relProfileDefault);
     assertEq(profiles.at(BuildProfile::Test), devProfileDefault);
+    assertEq(profiles.at(BuildProfile::Profiling), relProfileDefault);
   }
   {
     const toml::value profOnly = "[profile]"_toml;
 
     const auto profiles = parseProfiles(profOnly).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devProfileDefault);
     assertEq(profiles.at(BuildProfile::Release), relProfileDefault);
+    assertEq(profiles.at(BuildProfile::Bench), relProfileDefault);
     assertEq(profiles.at(BuildProfile::Test), devProfileDefault);
   }
   {
@@ -752,9 +1002,10 @@ static void testParseProfiles() {
         /*optLevel=*/2);
 
     const auto profiles = parseProfiles(baseOnly).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), expected);
     assertEq(profiles.at(BuildProfile::Release), expected);
+    assertEq(profiles.at(BuildProfile::Bench), expected);
     assertEq(profiles.at(BuildProfile::Test), expected);
   }
   {
@@ -770,9 +1021,10 @@ static void testParseProfiles() {
     )"_toml;
 
     const auto profiles = parseProfiles(overwrite).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devProfileDefault);
     assertEq(profiles.at(BuildProfile::Release), relProfileDefault);
+    assertEq(profiles.at(BuildProfile::Bench), relProfileDefault);
     assertEq(profiles.at(BuildProfile::Test), devProfileDefault);
   }
   {
@@ -802,9 +1054,10 @@ static void testParseProfiles() {
         /*optLevel=*/3);
 
     const auto profiles = parseProfiles(overwrite).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devExpected);
     assertEq(profiles.at(BuildProfile::Release), relExpected);
+    assertEq(profiles.at(BuildProfile::Bench), relExpected);
     assertEq(profiles.at(BuildProfile::Test), testExpected);
   }
   {
@@ -826,9 +1079,10 @@ static void testParseProfiles() {
         /*optLevel=*/0);
 
     const auto profiles = parseProfiles(append).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devExpected);
     assertEq(profiles.at(BuildProfile::Release), relProfileDefault);
+    assertEq(profiles.at(BuildProfile::Bench), relProfileDefault);
     assertEq(profiles.at(BuildProfile::Test), testExpected);
   }
   {
@@ -851,11 +1105,53 @@ static void testParseProfiles() {
         /*optLevel=*/0);
 
     const auto profiles = parseProfiles(overwrite).unwrap();
-    assertEq(profiles.size(), 3UL);
+    assertEq(profiles.size(), 5UL);
     assertEq(profiles.at(BuildProfile::Dev), devExpected);
     assertEq(profiles.at(BuildProfile::Release), relProfileDefault);
+    assertEq(profiles.at(BuildProfile::Bench), relProfileDefault);
     assertEq(profiles.at(BuildProfile::Test), testExpected);
   }
+  {
+    const toml::value bench = R"(
+      [profile.release]
+      cxxflags = ["-A"]
+
+      [profile.bench]
+      cxxflags = ["-B"]
+      debug = true
+    )"_toml;
+
+    const Profile relExpected(
+        /*cxxflags=*/{ "-A" }, /*ldflags=*/{}, /*lto=*/false,
+        /*debug=*/false,
+        /*optLevel=*/3);
+    const Profile benchExpected(
+        /*cxxflags=*/{ "-A", "-B" }, /*ldflags=*/{}, /*lto=*/false,
+        /*debug=*/true,
+        /*optLevel=*/3);
+
+    const auto profiles = parseProfiles(bench).unwrap();
+    assertEq(profiles.size(), 5UL);
+    assertEq(profiles.at(BuildProfile::Dev), devProfileDefault);
+    assertEq(profiles.at(BuildProfile::Release), relExpected);
+    assertEq(profiles.at(BuildProfile::Bench), benchExpected);
+    assertEq(profiles.at(BuildProfile::Test), devProfileDefault);
+  }
+  {
+    const toml::value profiling = R"(
+      [profile.release]
+      cxxflags = ["-A"]
+
+      [profile.profiling]
+      cxxflags = ["-B"]
+      opt-level = 2
+    )"_toml;
+
+    const auto profiles = parseProfiles(profiling).unwrap();
+    assertEq(profiles.at(BuildProfile::Profiling),
+             Profile(/*cxxflags=*/{ "-A", "-B" }, /*ldflags=*/{},
+                     /*lto=*/false, /*debug=*/false, /*optLevel=*/2));
+  }
   {
     const toml::value incorrect = R"(
       [profile.test]
@@ -867,7 +1163,7 @@ static void testParseProfiles() {
   }
 }
 
-static void testLintTryFromToml() {
+CABIN_TEST_CASE(testLintTryFromToml) {
   // Basic lint config
   {
     const toml::value val = R"(
@@ -895,7 +1191,35 @@ static void testLintTryFromToml() {
   pass();
 }
 
-static void testValidateDepName() {
+CABIN_TEST_CASE(testTestConfigTryFromToml) {
+  {
+    const toml::value val = R"(
+      [test]
+      data = ["tests/data", "fixture.json"]
+    )"_toml;
+
+    auto test = TestConfig::tryFromToml(val).unwrap();
+    assertEq(fmt::format("{}", fmt::join(test.data, ",")),
+             "tests/data,fixture.json");
+  }
+  {
+    const toml::value val{};
+    assertTrue(TestConfig::tryFromToml(val).unwrap().data.empty());
+  }
+  {
+    const toml::value val = R"(
+      [test]
+      data = ["/etc/passwd"]
+    )"_toml;
+
+    assertEq(TestConfig::tryFromToml(val).unwrap_err()->what(),
+             "test data `/etc/passwd` must be relative to the package root");
+  }
+
+  pass();
+}
+
+CABIN_TEST_CASE(testValidateDepName) {
   assertEq(validateDepName("").unwrap_err()->what(),
            "dependency name must not be empty");
   assertEq(validateDepName("-").unwrap_err()->what(),
@@ -941,7 +1265,7 @@ static void testValidateDepName() {
   pass();
 }
 
-static void testValidateFlag() {
+CABIN_TEST_CASE(testValidateFlag) {
   assertTrue(validateFlag("cxxflags", "-fsanitize=address,undefined").is_ok());
 
   // issue #1183
@@ -955,18 +1279,49 @@ static void testValidateFlag() {
   pass();
 }
 
+CABIN_TEST_CASE(testWorkspaceParseMembers) {
+  const fs::path root = fs::temp_directory_path()
+                        / fmt::format("cabin-test-workspace-{}", getpid());
+  fs::remove_all(root);
+  for (const char* dir : { "tool", "crates/b", "crates/a" }) {
+    fs::create_directories(root / dir);
+    std::ofstream(root / dir / Manifest::FILE_NAME);
+  }
+  // Not a package, so not a member.
+  fs::create_directories(root / "crates" / "docs");
+
+  {
+    const toml::value val = R"(
+      [workspace]
+      members = ["tool", "crates/*"]
+    )"_toml;
+
+    const auto dirs = Workspace::parseMembers(val, root).unwrap();
+    assertEq(dirs.size(), 3UL);
+    assertTrue(dirs[0] == root / "tool");
+    assertTrue(dirs[1] == root / "crates" / "a");
+    assertTrue(dirs[2] == root / "crates" / "b");
+  }
+  {
+    const toml::value val = R"(
+      [workspace]
+      members = ["crates/docs"]
+    )"_toml;
+
+    assertEq(Workspace::parseMembers(val, root).unwrap_err()->what(),
+             "workspace member `crates/docs` has no cabin.toml");
+  }
+
+  fs::remove_all(root);
+  pass();
+}
+
 } // namespace tests
 
-int main() {
+int main(int argc, char* argv[]) {
   cabin::setColorMode("never");
 
-  tests::testEditionTryFromString();
-  tests::testEditionComparison();
-  tests::testPackageTryFromToml();
-  tests::testParseProfiles();
-  tests::testLintTryFromToml();
-  tests::testValidateDepName();
-  tests::testValidateFlag();
+  return tests::runTests(argc, argv);
 }
 
 #endif
@@ -11,6 +11,7 @@
 #include <filesystem>
 #include <fmt/ostream.h>
 #include <fmt/ranges.h>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <toml.hpp>
@@ -111,6 +112,19 @@ private:
   explicit Lint(Cpplint cpplint) noexcept : cpplint(std::move(cpplint)) {}
 };
 
+// The [test] table.
+struct TestConfig {
+  // Files and directories, relative to the package root, that the tests
+  // read.  A change to any of them invalidates cached test results.
+  const std::vector<std::string> data;
+
+  static Result<TestConfig> tryFromToml(const toml::value& val) noexcept;
+
+private:
+  explicit TestConfig(std::vector<std::string> data) noexcept
+      : data(std::move(data)) {}
+};
+
 class Manifest {
 public:
   static constexpr const char* FILE_NAME = "cabin.toml";
@@ -121,6 +135,7 @@ public:
   const std::vector<Dependency> devDependencies;
   const std::unordered_map<BuildProfile, Profile> profiles;
   const Lint lint;
+  const TestConfig test;
 
   static Result<Manifest> tryParse(fs::path path = fs::current_path()
                                                    / FILE_NAME,
@@ -131,17 +146,37 @@ public:
   static Result<fs::path>
   findPath(fs::path candidateDir = fs::current_path()) noexcept;
 
-  Result<std::vector<CompilerOpts>> installDeps(bool includeDevDeps) const;
+  Result<std::vector<InstalledDep>> installDeps(bool includeDevDeps) const;
 
 private:
   Manifest(fs::path path, Package package, std::vector<Dependency> dependencies,
            std::vector<Dependency> devDependencies,
-           std::unordered_map<BuildProfile, Profile> profiles,
-           Lint lint) noexcept
+           std::unordered_map<BuildProfile, Profile> profiles, Lint lint,
+           TestConfig test) noexcept
       : path(std::move(path)), package(std::move(package)),
         dependencies(std::move(dependencies)),
         devDependencies(std::move(devDependencies)),
-        profiles(std::move(profiles)), lint(std::move(lint)) {}
+        profiles(std::move(profiles)), lint(std::move(lint)),
+        test(std::move(test)) {}
+};
+
+// The [workspace] table of a root cabin.toml groups member packages so that
+// they are built in one ninja graph with a shared output directory.  The
+// root manifest may also have a [package] of its own, which then is a member
+// too.
+struct Workspace {
+  fs::path rootPath;
+  std::vector<Manifest> members;
+
+  // Returns the workspace whose root manifest is the nearest one from
+  // `candidateDir`, if that manifest has a [workspace] table.
+  static Result<std::optional<Workspace>>
+  tryFind(const fs::path& candidateDir = fs::current_path()) noexcept;
+  // Resolves the member directories, expanding a trailing `/*`.
+  static Result<std::vector<fs::path>>
+  parseMembers(const toml::value& data, const fs::path& rootPath) noexcept;
+
+  fs::path outBasePath(const BuildProfile& buildProfile) const;
 };
 
 Result<void> validatePackageName(std::string_view name) noexcept;
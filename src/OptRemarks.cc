@@ -0,0 +1,702 @@
+#include "OptRemarks.hpp"
+
+#include "Algos.hpp"
+#include "AsmListing.hpp"
+#include "Flamegraph.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static std::size_t parseNumber(const std::string_view str) {
+  std::size_t number = 0;
+  std::from_chars(str.data(), str.data() + str.size(), number);
+  return number;
+}
+
+// Consumes a YAML scalar from the front of `str`: quoted, or plain up to the
+// end or, inside a flow mapping, up to the next ',' or '}'.
+static std::string readScalar(std::string_view& str, const bool inFlow) {
+  str = trim(str);
+  std::string value;
+  if (str.starts_with('\'')) {
+    std::size_t pos = 1;
+    for (; pos < str.size(); ++pos) {
+      if (str[pos] == '\'') {
+        // '' is an escaped quote.
+        if (pos + 1 < str.size() && str[pos + 1] == '\'') {
+          value += '\'';
+          ++pos;
+          continue;
+        }
+        break;
+      }
+      value += str[pos];
+    }
+    str.remove_prefix(std::min(pos + 1, str.size()));
+  } else if (str.starts_with('"')) {
+    std::size_t pos = 1;
+    for (; pos < str.size() && str[pos] != '"'; ++pos) {
+      if (str[pos] == '\\' && pos + 1 < str.size()) {
+        ++pos;
+        value += str[pos] == 'n' ? '\n' : str[pos];
+      } else {
+        value += str[pos];
+      }
+    }
+    str.remove_prefix(std::min(pos + 1, str.size()));
+  } else {
+    const std::size_t end =
+        inFlow ? std::min(str.find_first_of(",}"), str.size()) : str.size();
+    value = trim(str.substr(0, end));
+    str.remove_prefix(end);
+  }
+  return value;
+}
+
+// Parses `{ File: 'src/main.cc', Line: 6, Column: 19 }`.
+static void parseDebugLoc(std::string_view loc, OptRemark& remark) {
+  loc = trim(loc);
+  if (!loc.starts_with('{')) {
+    return;
+  }
+  loc.remove_prefix(1);
+  while (true) {
+    const std::size_t colon = loc.find(':');
+    if (colon == std::string_view::npos) {
+      return;
+    }
+    const std::string_view key = trim(loc.substr(0, colon));
+    loc.remove_prefix(colon + 1);
+    const std::string value = readScalar(loc, /*inFlow=*/true);
+    if (key == "File") {
+      remark.file = value;
+    } else if (key == "Line") {
+      remark.line = parseNumber(value);
+    } else if (key == "Column") {
+      remark.column = parseNumber(value);
+    }
+    if (!loc.starts_with(',')) {
+      return;
+    }
+    loc.remove_prefix(1);
+  }
+}
+
+std::vector<OptRemark> parseClangRemarks(const std::string_view yaml) {
+  std::vector<OptRemark> remarks;
+  // The record being read, if it's one of missed optimization.
+  std::optional<OptRemark> remark;
+  bool inArgs = false;
+
+  const auto flush = [&] {
+    // Without a location, there's nothing to point at.
+    if (remark.has_value() && !remark->file.empty()) {
+      remarks.push_back(std::move(*remark));
+    }
+    remark.reset();
+    inArgs = false;
+  };
+
+  for (const std::string_view line : splitLines(yaml)) {
+    if (line.starts_with("---")) {
+      flush();
+      if (trim(line) == "--- !Missed") {
+        remark.emplace();
+      }
+      continue;
+    } else if (line.starts_with("...")) {
+      flush();
+      continue;
+    } else if (!remark.has_value()) {
+      continue;
+    }
+
+    if (line.starts_with("  - ")) {
+      // The message is the concatenation of the arguments.
+      std::string_view arg = line.substr(4);
+      const std::size_t colon = arg.find(':');
+      if (!inArgs || colon == std::string_view::npos) {
+        continue;
+      }
+      const std::string_view key = arg.substr(0, colon);
+      arg.remove_prefix(colon + 1);
+      const std::string value = readScalar(arg, /*inFlow=*/false);
+      remark->message += key == "Callee" || key == "Caller"
+                             ? demangleSymbols(value)
+                             : value;
+      continue;
+    } else if (line.starts_with(' ')) {
+      // Like the location of an argument.
+      continue;
+    }
+
+    const std::size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+      continue;
+    }
+    const std::string_view key = line.substr(0, colon);
+    std::string_view value = line.substr(colon + 1);
+    inArgs = key == "Args";
+    if (key == "Pass") {
+      remark->pass = readScalar(value, /*inFlow=*/false);
+    } else if (key == "Function") {
+      remark->function = demangleSymbols(readScalar(value, /*inFlow=*/false));
+    } else if (key == "DebugLoc") {
+      parseDebugLoc(value, *remark);
+    }
+  }
+  flush();
+  return remarks;
+}
+
+static std::string guessGccPass(const std::string_view message) {
+  if (message.find("inlin") != std::string_view::npos) {
+    return "inline";
+  } else if (message.find("vectori") != std::string_view::npos) {
+    return "vectorize";
+  } else if (message.find("unroll") != std::string_view::npos) {
+    return "unroll";
+  }
+  return "other";
+}
+
+// Splits GCC's "CALLER/12 -> CALLEE/34, reason", where the numbers identify
+// call graph nodes.
+static bool splitGccCall(const std::string_view call, std::string& caller,
+                         std::string& callee, std::string& reason) {
+  const auto endsWithNode = [](std::string_view str) -> std::size_t {
+    str = trim(str);
+    const std::size_t slash = str.rfind('/');
+    if (slash == std::string_view::npos || slash + 1 == str.size()
+        || str.find_first_not_of("0123456789", slash + 1)
+               != std::string_view::npos) {
+      return std::string_view::npos;
+    }
+    return slash;
+  };
+
+  for (std::size_t arrow = call.find("->"); arrow != std::string_view::npos;
+       arrow = call.find("->", arrow + 2)) {
+    const std::string_view lhs = trim(call.substr(0, arrow));
+    const std::size_t callerEnd = endsWithNode(lhs);
+    if (callerEnd == std::string_view::npos) {
+      continue;
+    }
+    // Template arguments contain ", " as well.
+    const std::string_view rhs = trim(call.substr(arrow + 2));
+    std::size_t comma = rhs.find(", ");
+    while (comma != std::string_view::npos
+           && endsWithNode(rhs.substr(0, comma)) == std::string_view::npos) {
+      comma = rhs.find(", ", comma + 2);
+    }
+    const std::string_view calleeNode = rhs.substr(0, comma);
+    const std::size_t calleeEnd = endsWithNode(calleeNode);
+    if (calleeEnd == std::string_view::npos) {
+      return false;
+    }
+    caller = lhs.substr(0, callerEnd);
+    callee = calleeNode.substr(0, calleeEnd);
+    reason = comma == std::string_view::npos ? "" : rhs.substr(comma + 2);
+    return true;
+  }
+  return false;
+}
+
+std::vector<OptRemark> parseGccRemarks(const std::string_view optInfo) {
+  static constexpr std::string_view marker = ": missed: ";
+
+  std::vector<OptRemark> remarks;
+  for (const std::string_view line : splitLines(optInfo)) {
+    // Lines starting with a space continue the previous message.
+    const std::size_t markerPos = line.find(marker);
+    if (line.empty() || line.front() == ' '
+        || markerPos == std::string_view::npos) {
+      continue;
+    }
+    const std::string_view location = line.substr(0, markerPos);
+    const std::size_t columnColon = location.rfind(':');
+    if (columnColon == std::string_view::npos || columnColon == 0) {
+      continue;
+    }
+    const std::size_t lineColon = location.rfind(':', columnColon - 1);
+    if (lineColon == std::string_view::npos) {
+      continue;
+    }
+
+    OptRemark remark;
+    remark.file = location.substr(0, lineColon);
+    remark.line = parseNumber(
+        location.substr(lineColon + 1, columnColon - lineColon - 1));
+    remark.column = parseNumber(location.substr(columnColon + 1));
+    remark.message = trim(line.substr(markerPos + marker.size()));
+    remark.pass = guessGccPass(remark.message);
+
+    // "not inlinable: CALLER/1 -> CALLEE/2, reason"
+    const std::size_t colon = remark.message.find(": ");
+    std::string caller;
+    std::string callee;
+    std::string reason;
+    if (remark.pass == "inline" && colon != std::string::npos
+        && splitGccCall(std::string_view(remark.message).substr(colon + 2),
+                        caller, callee, reason)) {
+      remark.function = std::move(caller);
+      remark.message = fmt::format("{}: {}, {}",
+                                   remark.message.substr(0, colon), callee,
+                                   reason);
+    }
+    remarks.push_back(std::move(remark));
+  }
+  return remarks;
+}
+
+// The qualified name of a function without its return type, parameters,
+// and the suffixes of its clones: what perf, Clang, and GCC agree on.
+static std::string_view functionKey(std::string_view name) {
+  if (const std::size_t clone = name.find(" [clone ");
+      clone != std::string_view::npos) {
+    name = name.substr(0, clone);
+  }
+
+  int depth = 0;
+  for (std::size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '<') {
+      ++depth;
+    } else if (name[i] == '>') {
+      --depth;
+    } else if (name[i] == '(' && depth == 0) {
+      if (name.substr(0, i).ends_with("operator")
+          && name.substr(i).starts_with("()")) {
+        ++i;
+        continue;
+      }
+      name = name.substr(0, i);
+      break;
+    }
+  }
+
+  std::size_t start = 0;
+  depth = 0;
+  for (std::size_t i = 0; i < name.size(); ++i) {
+    if (name[i] == '<') {
+      ++depth;
+    } else if (name[i] == '>') {
+      --depth;
+    } else if (name[i] == ' ' && depth == 0
+               && !name.substr(0, i).ends_with("operator")) {
+      start = i + 1;
+    }
+  }
+  return name.substr(start);
+}
+
+namespace {
+
+// The share of the samples of a profile spent in each function itself.
+class SelfTime {
+  std::unordered_map<std::string, std::uint64_t> samples;
+  std::uint64_t total = 0;
+
+public:
+  explicit SelfTime(const FoldedStacks& profile) {
+    for (const auto& [stack, count] : profile) {
+      const std::size_t leaf = stack.rfind(';');
+      const std::string_view frame =
+          std::string_view(stack).substr(leaf == std::string::npos ? 0
+                                                                   : leaf + 1);
+      samples[std::string(functionKey(frame))] += count;
+      total += count;
+    }
+  }
+
+  bool empty() const { return total == 0; }
+  std::uint64_t totalSamples() const { return total; }
+
+  double share(const std::string_view function) const {
+    if (function.empty() || total == 0) {
+      return 0.0;
+    }
+    const auto itr = samples.find(std::string(functionKey(function)));
+    return itr == samples.end() ? 0.0
+                                : static_cast<double>(itr->second)
+                                      / static_cast<double>(total);
+  }
+};
+
+struct RemarkGroup {
+  std::string name;
+  std::size_t count = 0;
+  std::map<std::string, std::size_t> passes;
+  std::set<std::string> functions;
+  double hot = 0.0;
+};
+
+} // namespace
+
+static std::vector<RemarkGroup>
+groupRemarks(const std::vector<OptRemark>& remarks, const SelfTime& selfTime,
+             const bool byFunction) {
+  std::map<std::string, RemarkGroup> groups;
+  for (const OptRemark& remark : remarks) {
+    if (byFunction && remark.function.empty()) {
+      continue;
+    }
+    const std::string& name = byFunction ? remark.function : remark.file;
+    RemarkGroup& group = groups[name];
+    group.name = name;
+    ++group.count;
+    ++group.passes[remark.pass];
+    if (!remark.function.empty()) {
+      group.functions.insert(remark.function);
+    }
+  }
+
+  std::vector<RemarkGroup> sorted;
+  sorted.reserve(groups.size());
+  for (auto& [name, group] : groups) {
+    for (const std::string& function : group.functions) {
+      group.hot += selfTime.share(function);
+    }
+    sorted.push_back(std::move(group));
+  }
+  std::ranges::stable_sort(sorted, [](const RemarkGroup& lhs,
+                                      const RemarkGroup& rhs) {
+    if (lhs.hot != rhs.hot) {
+      return lhs.hot > rhs.hot;
+    }
+    return lhs.count > rhs.count;
+  });
+  return sorted;
+}
+
+// The passes with the most remarks, like "inline 20, loop-vectorize 3".
+static std::string
+formatPasses(const std::map<std::string, std::size_t>& passes) {
+  std::vector<std::pair<std::string, std::size_t>> sorted(passes.begin(),
+                                                          passes.end());
+  std::ranges::stable_sort(sorted, [](const auto& lhs, const auto& rhs) {
+    return lhs.second > rhs.second;
+  });
+  std::string formatted;
+  for (std::size_t i = 0; i < sorted.size() && i < 3; ++i) {
+    if (i > 0) {
+      formatted += ", ";
+    }
+    formatted += fmt::format("{} {}", sorted[i].first, sorted[i].second);
+  }
+  if (sorted.size() > 3) {
+    formatted += ", ...";
+  }
+  return formatted;
+}
+
+static std::string formatGroups(const std::vector<RemarkGroup>& groups,
+                                const std::string_view title,
+                                const bool weighted, const std::size_t limit) {
+  std::string table;
+  if (weighted) {
+    table += fmt::format("{:>8}  {:>6}  {}\n", "Remarks", "Self", title);
+  } else {
+    table += fmt::format("{:>8}  {}\n", "Remarks", title);
+  }
+  for (std::size_t i = 0; i < groups.size() && i < limit; ++i) {
+    const RemarkGroup& group = groups[i];
+    if (weighted) {
+      table += fmt::format("{:>8}  {:>5.1f}%  ", group.count, group.hot * 100);
+    } else {
+      table += fmt::format("{:>8}  ", group.count);
+    }
+    table += fmt::format("{} ({})\n", group.name, formatPasses(group.passes));
+  }
+  if (groups.size() > limit) {
+    table += fmt::format("{:>8}  ... and {} more\n", "", groups.size() - limit);
+  }
+  return table;
+}
+
+static std::string plural(const std::size_t count,
+                          const std::string_view noun) {
+  return fmt::format("{} {}{}", count, noun, count == 1 ? "" : "s");
+}
+
+std::string formatRemarksSummary(const std::vector<OptRemark>& remarks,
+                                 const FoldedStacks& profile,
+                                 const std::size_t limit) {
+  const SelfTime selfTime(profile);
+  const std::vector<RemarkGroup> files =
+      groupRemarks(remarks, selfTime, /*byFunction=*/false);
+  const std::vector<RemarkGroup> functions =
+      groupRemarks(remarks, selfTime, /*byFunction=*/true);
+
+  std::string summary = fmt::format(
+      "{} in {}", plural(remarks.size(), "missed optimization"),
+      plural(files.size(), "file"));
+  if (!selfTime.empty()) {
+    summary += fmt::format(", ranked by self time in {}",
+                           plural(selfTime.totalSamples(), "sample"));
+  }
+  summary += '\n';
+  if (remarks.empty()) {
+    return summary;
+  }
+  summary += '\n';
+  summary += formatGroups(files, "File", !selfTime.empty(), limit);
+  if (!functions.empty()) {
+    summary += '\n';
+    summary += formatGroups(functions, "Function", !selfTime.empty(), limit);
+  }
+  return summary;
+}
+
+std::string formatRemarks(const std::vector<OptRemark>& remarks,
+                          const FoldedStacks& profile) {
+  const SelfTime selfTime(profile);
+  std::vector<std::pair<double, const OptRemark*>> sorted;
+  sorted.reserve(remarks.size());
+  for (const OptRemark& remark : remarks) {
+    sorted.emplace_back(selfTime.share(remark.function), &remark);
+  }
+  std::ranges::stable_sort(sorted, [](const auto& lhs, const auto& rhs) {
+    if (lhs.first != rhs.first) {
+      return lhs.first > rhs.first;
+    }
+    return *lhs.second < *rhs.second;
+  });
+
+  std::string formatted;
+  for (const auto& [share, remark] : sorted) {
+    if (!selfTime.empty()) {
+      formatted += fmt::format("{:>5.1f}%  ", share * 100);
+    }
+    formatted += fmt::format("{}:{}:{}: [{}] ", remark->file, remark->line,
+                             remark->column, remark->pass);
+    if (!remark->function.empty()) {
+      formatted += fmt::format("in {}: ", remark->function);
+    }
+    formatted += remark->message;
+    formatted += '\n';
+  }
+  return formatted;
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testParseClangRemarks) {
+  const std::vector<OptRemark> remarks = parseClangRemarks(R"(--- !Passed
+Pass:            inline
+Name:            Inlined
+DebugLoc:        { File: src/main.cc, Line: 11, Column: 10 }
+Function:        main
+Args:
+  - Callee:          _Z5scalePfPKfiPi
+  - String:          ' inlined into '
+  - Caller:          main
+...
+--- !Missed
+Pass:            inline
+Name:            NoDefinition
+DebugLoc:        { File: 'src/it''s.cc', Line: 6, Column: 19 }
+Function:        _Z4normRKSt6vectorIdSaIdEE
+Args:
+  - Callee:          sqrt
+  - String:          ' will not be inlined into '
+  - Caller:          _Z4normRKSt6vectorIdSaIdEE
+    DebugLoc:        { File: src/main.cc, Line: 3, Column: 0 }
+  - String:          ' because its definition is unavailable'
+...
+--- !Analysis
+Pass:            loop-vectorize
+Name:            CantVectorizeInstructionReturnType
+DebugLoc:        { File: src/main.cc, Line: 5, Column: 3 }
+Function:        _Z4normRKSt6vectorIdSaIdEE
+Args:
+  - String:          'loop not vectorized: '
+...
+--- !Missed
+Pass:            loop-vectorize
+Name:            MissedDetails
+DebugLoc:        { File: src/main.cc, Line: 5, Column: 3 }
+Function:        _Z4normRKSt6vectorIdSaIdEE
+Args:
+  - String:          loop not vectorized
+...
+--- !Missed
+Pass:            regalloc
+Name:            SpillReload
+Function:        main
+Args:
+  - NumSpills:       '1'
+...
+)");
+  assertEq(remarks.size(), 2UL);
+
+  assertEq(remarks[0].file, "src/it's.cc");
+  assertEq(remarks[0].line, 6UL);
+  assertEq(remarks[0].column, 19UL);
+  assertEq(remarks[0].pass, "inline");
+  assertEq(remarks[0].function,
+           "norm(std::vector<double, std::allocator<double> > const&)");
+  assertEq(remarks[0].message,
+           "sqrt will not be inlined into norm(std::vector<double, "
+           "std::allocator<double> > const&) because its definition is "
+           "unavailable");
+
+  assertEq(remarks[1].file, "src/main.cc");
+  assertEq(remarks[1].line, 5UL);
+  assertEq(remarks[1].pass, "loop-vectorize");
+  assertEq(remarks[1].message, "loop not vectorized");
+
+  assertTrue(parseClangRemarks("").empty());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testParseGccRemarks) {
+  const std::vector<OptRemark> remarks = parseGccRemarks(
+      "r.cc:6:19: missed:   not inlinable: double norm(const "
+      "std::vector<double>&)/1240 -> double sqrt(double)/1474, function body "
+      "not available\n"
+      "r.cc:11:103: missed:   will not early inline: int main()/1287->double "
+      "norm(const std::vector<double>&)/1240, call is cold and code would "
+      "grow at least by 7\n"
+      "new.h:120:22: missed:   not inlinable: T* alloc(T, U) [with T = "
+      "int; U = long]/1491 -> void f(std::pair<int, int>)/1477, body not "
+      "available\n"
+      "r.cc:5:19: missed: couldn't vectorize loop\n"
+      "r.cc:5:19: missed: not vectorized: no vectype for stmt: x_13 = "
+      "*SR.55_26;\n"
+      " scalar_type: const double\n"
+      "/usr/include/c++/12/bits/new_allocator.h:158:26: missed: statement "
+      "clobbers memory: operator delete (_2, _12);\n"
+      "r.cc:1:1: note: not a missed optimization\n");
+  assertEq(remarks.size(), 6UL);
+
+  assertEq(remarks[0].file, "r.cc");
+  assertEq(remarks[0].line, 6UL);
+  assertEq(remarks[0].column, 19UL);
+  assertEq(remarks[0].pass, "inline");
+  assertEq(remarks[0].function, "double norm(const std::vector<double>&)");
+  assertEq(remarks[0].message,
+           "not inlinable: double sqrt(double), function body not available");
+
+  assertEq(remarks[1].function, "int main()");
+  assertEq(remarks[1].message,
+           "will not early inline: double norm(const std::vector<double>&), "
+           "call is cold and code would grow at least by 7");
+
+  assertEq(remarks[2].function, "T* alloc(T, U) [with T = int; U = long]");
+  assertEq(remarks[2].message,
+           "not inlinable: void f(std::pair<int, int>), body not available");
+
+  assertEq(remarks[3].pass, "vectorize");
+  assertEq(remarks[3].function, "");
+  assertEq(remarks[3].message, "couldn't vectorize loop");
+  assertEq(remarks[4].pass, "vectorize");
+
+  assertEq(remarks[5].file, "/usr/include/c++/12/bits/new_allocator.h");
+  assertEq(remarks[5].line, 158UL);
+  assertEq(remarks[5].pass, "other");
+
+  pass();
+}
+
+static std::vector<OptRemark> sampleRemarks() {
+  const auto remark = [](std::string file, std::size_t line, std::string pass,
+                         std::string function, std::string message) {
+    return OptRemark{ .file = std::move(file),
+                      .line = line,
+                      .column = 3,
+                      .pass = std::move(pass),
+                      .function = std::move(function),
+                      .message = std::move(message) };
+  };
+  return {
+    remark("src/a.cc", 10, "inline", "app::cold(int)", "f not inlined"),
+    remark("src/a.cc", 11, "inline", "app::cold(int)", "g not inlined"),
+    remark("src/a.cc", 12, "licm", "app::cold(int)", "load not hoisted"),
+    remark("src/b.cc", 5, "loop-vectorize", "double hot(Vec const&)",
+           "loop not vectorized"),
+    remark("src/b.cc", 9, "vectorize", "", "couldn't vectorize loop"),
+  };
+}
+
+CABIN_TEST_CASE(testFormatRemarksSummary) {
+  const std::vector<OptRemark> remarks = sampleRemarks();
+
+  assertEq(formatRemarksSummary(remarks, {}, 10),
+           "5 missed optimizations in 2 files\n"
+           "\n"
+           " Remarks  File\n"
+           "       3  src/a.cc (inline 2, licm 1)\n"
+           "       2  src/b.cc (loop-vectorize 1, vectorize 1)\n"
+           "\n"
+           " Remarks  Function\n"
+           "       3  app::cold(int) (inline 2, licm 1)\n"
+           "       1  double hot(Vec const&) (loop-vectorize 1)\n");
+
+  // Frames name functions the way perf demangles them.
+  const FoldedStacks profile{
+    { "app;main;hot(Vec const&)", 3 },
+    { "app;main;app::cold(int)", 1 },
+  };
+  assertEq(formatRemarksSummary(remarks, profile, 1),
+           "5 missed optimizations in 2 files, ranked by self time in 4 "
+           "samples\n"
+           "\n"
+           " Remarks    Self  File\n"
+           "       2   75.0%  src/b.cc (loop-vectorize 1, vectorize 1)\n"
+           "          ... and 1 more\n"
+           "\n"
+           " Remarks    Self  Function\n"
+           "       1   75.0%  double hot(Vec const&) (loop-vectorize 1)\n"
+           "          ... and 1 more\n");
+
+  assertEq(formatRemarksSummary({}, {}, 10),
+           "0 missed optimizations in 0 files\n");
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatRemarks) {
+  const std::vector<OptRemark> remarks = sampleRemarks();
+  assertEq(formatRemarks({ remarks[4], remarks[0] }, {}),
+           "src/a.cc:10:3: [inline] in app::cold(int): f not inlined\n"
+           "src/b.cc:9:3: [vectorize] couldn't vectorize loop\n");
+  assertEq(formatRemarks({ remarks[0], remarks[3] },
+                         { { "app;hot(Vec const&)", 1 } }),
+           "100.0%  src/b.cc:5:3: [loop-vectorize] in double hot(Vec "
+           "const&): loop not vectorized\n"
+           "  0.0%  src/a.cc:10:3: [inline] in app::cold(int): f not "
+           "inlined\n");
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Flamegraph.hpp"
+
+#include <compare>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace cabin {
+
+// An optimization the compiler tried and gave up on.
+struct OptRemark {
+  std::string file;
+  std::size_t line = 0;
+  std::size_t column = 0;
+  // Like "inline" or "loop-vectorize".
+  std::string pass;
+  // Demangled, or empty when the compiler doesn't say.
+  std::string function;
+  std::string message;
+
+  auto operator<=>(const OptRemark&) const = default;
+};
+
+// The missed remarks in a file written by Clang's
+// `-fsave-optimization-record`.
+std::vector<OptRemark> parseClangRemarks(std::string_view yaml);
+
+// The remarks in a file written by GCC's `-fopt-info-missed=<file>`.  GCC
+// doesn't name the pass, so it's guessed from the message, and only names
+// the function for inlining.
+std::vector<OptRemark> parseGccRemarks(std::string_view optInfo);
+
+// Ranks the files and the functions with the most remarks, `limit` of
+// each.  With a `profile`, they are ranked by the share of its samples
+// spent in the functions instead, so that the remarks in hot code come
+// first.
+std::string formatRemarksSummary(const std::vector<OptRemark>& remarks,
+                                 const FoldedStacks& profile,
+                                 std::size_t limit);
+
+// Every remark on its own line, in the order of formatRemarksSummary().
+std::string formatRemarks(const std::vector<OptRemark>& remarks,
+                          const FoldedStacks& profile);
+
+} // namespace cabin
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "PerfCounters.hpp"
+#include "Tests.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <fmt/ranges.h>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#  include <sched.h>
+#endif
+
+namespace bench {
+
+// Keeps the compiler from optimizing away the computation of `value`.
+template <typename T>
+inline void doNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+class Bencher {
+  std::uint64_t iterations = 1;
+  std::uint64_t bytes = 0;
+  std::chrono::nanoseconds elapsed{ 0 };
+  bool measured = false;
+  // Counts only the timed loop, if set.
+  perf::Counters* counters = nullptr;
+
+  friend double runBatch(void (*fn)(Bencher&), std::uint64_t iterations,
+                         std::uint64_t& bytes, perf::Counters* counters);
+
+public:
+  // Times `fn` over as many iterations as the runner asks for.  Only the
+  // loop is timed, so a benchmark can set up its input before calling this.
+  template <typename F>
+  void iter(F&& fn) {
+    if (counters != nullptr) {
+      counters->enable();
+    }
+    const auto start = std::chrono::steady_clock::now();
+    for (std::uint64_t i = 0; i < iterations; ++i) {
+      if constexpr (std::is_void_v<std::invoke_result_t<F&>>) {
+        fn();
+      } else {
+        doNotOptimize(fn());
+      }
+    }
+    elapsed = std::chrono::steady_clock::now() - start;
+    if (counters != nullptr) {
+      counters->disable();
+    }
+    measured = true;
+  }
+
+  // Reports throughput: the number of bytes one iteration processes.
+  void setBytes(const std::uint64_t bytesPerIter) { bytes = bytesPerIter; }
+};
+
+// Runs `fn` for `iterations` iterations and returns the nanoseconds it took.
+inline double runBatch(void (*fn)(Bencher&), const std::uint64_t iterations,
+                       std::uint64_t& bytes,
+                       perf::Counters* counters = nullptr) {
+  Bencher bencher;
+  bencher.iterations = iterations;
+  bencher.counters = counters;
+  fn(bencher);
+  if (!bencher.measured) {
+    throw std::logic_error("the benchmark never called Bencher::iter()");
+  }
+  bytes = bencher.bytes;
+  return static_cast<double>(bencher.elapsed.count());
+}
+
+struct BenchCase {
+  std::string_view name;
+  std::string_view file;
+  void (*fn)(Bencher&);
+};
+
+// Benchmarks defined with CABIN_BENCH_CASE, in the order of definition.
+inline std::vector<BenchCase>& benchRegistry() {
+  static std::vector<BenchCase> registry;
+  return registry;
+}
+
+struct BenchRegistrar {
+  BenchRegistrar(const std::string_view name, const std::string_view file,
+                 void (*fn)(Bencher&)) {
+    benchRegistry().push_back(
+        BenchCase{ .name = name, .file = file, .fn = fn });
+  }
+};
+
+// Defines a benchmark that runBenches() picks up:
+//
+//   CABIN_BENCH_CASE(parseVersion) {
+//     b.iter([] { return Version::parse("1.2.3"); });
+//   }
+//
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define CABIN_BENCH_CASE(name)                                               \
+  static void name(::bench::Bencher& b);                                     \
+  static const ::bench::BenchRegistrar name##Registrar(#name, __FILE__,      \
+                                                       name);                \
+  static void name([[maybe_unused]] ::bench::Bencher& b)
+
+inline double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  const std::size_t mid = values.size() / 2;
+  std::ranges::nth_element(values, values.begin() + mid);
+  if (values.size() % 2 == 1) {
+    return values[mid];
+  }
+  const double upper = values[mid];
+  return (*std::ranges::max_element(values.begin(), values.begin() + mid)
+          + upper)
+         / 2;
+}
+
+// Runs the registered benchmarks one after another and returns the exit
+// status for main().
+//
+//   <binary> [FILTER]... [--samples <NUM>] [--list]
+//
+// Each benchmark is first run for a warm-up period, doubling the number of
+// iterations until it has run long enough to settle caches and clocks.  The
+// iteration count of a sample is calibrated from the warm-up so that every
+// sample takes about the same time, and the median and the median absolute
+// deviation (MAD) of the samples are reported.  The process is pinned to the
+// CPU it starts on so that the samples don't pay for migrations.  When
+// CABIN_BENCH_REPORT is set, the samples of each benchmark are also written
+// to that file, one JSON object per line, for `cabin bench` to compare.
+// When CABIN_BENCH_COUNTERS is set too, the report also has the performance
+// counters of the measured loops, per iteration.
+inline int runBenches(const int argc, char* argv[]) {
+  using namespace std::chrono_literals;
+  constexpr std::chrono::nanoseconds warmUpTime = 500ms;
+  constexpr std::chrono::nanoseconds measurementTime = 2s;
+
+  std::vector<std::string_view> filters;
+  std::size_t numSamples = 50;
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i]; // NOLINT(*-pointer-arithmetic)
+    if (arg == "--samples" && i + 1 < argc) {
+      // NOLINTNEXTLINE(*-pointer-arithmetic)
+      numSamples = std::max(2UL, std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      filters.push_back(arg);
+    }
+  }
+
+  std::vector<const BenchCase*> selected;
+  for (const BenchCase& benchCase : benchRegistry()) {
+    if (filters.empty()
+        || std::ranges::any_of(filters, [&](const std::string_view filter) {
+             return benchCase.name.find(filter) != std::string_view::npos;
+           })) {
+      selected.push_back(&benchCase);
+    }
+  }
+  if (list) {
+    for (const BenchCase* benchCase : selected) {
+      fmt::print("{}::{}\n", tests::getModName(benchCase->file),
+                 benchCase->name);
+    }
+    return EXIT_SUCCESS;
+  }
+
+#ifdef __linux__
+  if (const int cpu = sched_getcpu(); cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    sched_setaffinity(0, sizeof(cpus), &cpus);
+  }
+#endif
+
+  std::FILE* report = nullptr;
+  if (const char* reportPath = std::getenv("CABIN_BENCH_REPORT")) {
+    report = std::fopen(reportPath, "w");
+  }
+  std::optional<perf::Counters> counters;
+  if (report != nullptr && std::getenv("CABIN_BENCH_COUNTERS") != nullptr) {
+    counters.emplace();
+  }
+
+  int status = EXIT_SUCCESS;
+  for (const BenchCase* benchCase : selected) {
+    const std::string_view modName = tests::getModName(benchCase->file);
+    try {
+      std::uint64_t bytes = 0;
+      std::uint64_t iterations = 1;
+      double nsPerIter = 0.0;
+      for (double total = 0.0;
+           total < static_cast<double>(warmUpTime.count());
+           iterations *= 2) {
+        const double elapsed = runBatch(benchCase->fn, iterations, bytes);
+        total += elapsed;
+        nsPerIter = elapsed / static_cast<double>(iterations);
+      }
+
+      const double sampleTime = static_cast<double>(measurementTime.count())
+                                / static_cast<double>(numSamples);
+      iterations = std::max<std::uint64_t>(
+          1, static_cast<std::uint64_t>(
+                 std::llround(sampleTime / std::max(nsPerIter, 1.0))));
+
+      if (counters.has_value()) {
+        counters->reset();
+      }
+      std::vector<double> samples;
+      samples.reserve(numSamples);
+      for (std::size_t i = 0; i < numSamples; ++i) {
+        samples.push_back(runBatch(benchCase->fn, iterations, bytes,
+                                   counters ? &counters.value() : nullptr)
+                          / static_cast<double>(iterations));
+      }
+
+      const double med = median(samples);
+      std::vector<double> deviations;
+      deviations.reserve(samples.size());
+      for (const double sample : samples) {
+        deviations.push_back(std::abs(sample - med));
+      }
+      std::string throughput;
+      if (bytes > 0 && med > 0.0) {
+        throughput = fmt::format(
+            " {:.2f} MiB/s",
+            static_cast<double>(bytes) / med * 1e9 / (1024.0 * 1024.0));
+      }
+      fmt::print("        bench {}::{} ... {:.2f} ns/iter (+/- {:.2f}){}\n",
+                 modName, benchCase->name, med, median(deviations),
+                 throughput);
+
+      if (report != nullptr) {
+        std::vector<std::string> perIter;
+        if (counters.has_value()) {
+          const double totalIters =
+              static_cast<double>(iterations * numSamples);
+          for (const auto& [name, count] : counters->read()) {
+            perIter.push_back(
+                fmt::format(R"("{}":{})", name, count / totalIters));
+          }
+        }
+        fmt::print(report,
+                   R"({{"name":"{}","bytes":{},"iterations":{},)"
+                   R"("samples":[{}],"counters":{{{}}}}})"
+                   "\n",
+                   tests::escapeJson(benchCase->name), bytes, iterations,
+                   fmt::join(samples, ","), fmt::join(perIter, ","));
+      }
+    } catch (const std::exception& e) {
+      fmt::print(stderr, "        bench {}::{} ... {}FAILED{}\n\n{}\n",
+                 modName, benchCase->name, tests::RED, tests::RESET,
+                 e.what());
+      status = EXIT_FAILURE;
+    }
+  }
+
+  if (report != nullptr) {
+    std::fclose(report);
+  }
+  return status;
+}
+
+} // namespace bench
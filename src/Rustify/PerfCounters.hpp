@@ -0,0 +1,184 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+namespace perf {
+
+// The counters, in the order they are reported.
+inline constexpr std::array<std::string_view, 6> COUNTER_NAMES = {
+  "cycles",     "instructions", "branch-misses",
+  "l1d-misses", "llc-misses",   "context-switches",
+};
+
+// Hardware and software counters of this process from perf_event_open(2).
+// The counters are inherited, so they also count in the processes it spawns
+// while they are enabled, from the moment those exit.  A counter the kernel
+// refuses is left out: a strict kernel.perf_event_paranoid limits counting
+// to user space, and a VM often has no hardware counters at all.
+class Counters {
+  std::array<int, COUNTER_NAMES.size()> fds{};
+  // The errno of the first counter that couldn't be opened.
+  int error = 0;
+
+public:
+  Counters() noexcept {
+    fds.fill(-1);
+#ifdef __linux__
+    const auto hwCache = [](const std::uint64_t cache) {
+      return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+             | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    };
+    const std::array<std::pair<std::uint32_t, std::uint64_t>,
+                     COUNTER_NAMES.size()>
+        events = { {
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+            { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+            { PERF_TYPE_HW_CACHE, hwCache(PERF_COUNT_HW_CACHE_L1D) },
+            { PERF_TYPE_HW_CACHE, hwCache(PERF_COUNT_HW_CACHE_LL) },
+            { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+        } };
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      perf_event_attr attr{};
+      attr.size = sizeof(attr);
+      attr.type = events[i].first;
+      attr.config = events[i].second;
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_hv = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds[i] = open(attr);
+      // Context switches happen in the kernel, so counting them only in user
+      // space would always give zero.
+      if (fds[i] < 0 && (errno == EACCES || errno == EPERM)
+          && attr.type != PERF_TYPE_SOFTWARE) {
+        attr.exclude_kernel = 1;
+        fds[i] = open(attr);
+      }
+      if (fds[i] < 0 && error == 0) {
+        error = errno;
+      }
+    }
+#else
+    error = ENOSYS;
+#endif
+  }
+
+  ~Counters() {
+#ifdef __linux__
+    for (const int fd : fds) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+#endif
+  }
+
+  Counters(const Counters&) = delete;
+  Counters(Counters&&) = delete;
+  Counters& operator=(const Counters&) = delete;
+  Counters& operator=(Counters&&) = delete;
+
+  bool available() const noexcept {
+    for (const int fd : fds) {
+      if (fd >= 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Whether every counter could be opened.
+  bool complete() const noexcept { return error == 0; }
+
+  // Why some counters couldn't be opened, for a hint to the user.
+  std::string unavailableReason() const {
+    if (error == EACCES || error == EPERM) {
+      std::ifstream ifs("/proc/sys/kernel/perf_event_paranoid");
+      std::string level;
+      if (ifs >> level) {
+        return "permission denied (kernel.perf_event_paranoid = " + level
+               + ")";
+      }
+      return "permission denied";
+    } else if (error == ENOENT || error == EOPNOTSUPP) {
+      return "not supported by this CPU or kernel";
+    }
+    return std::strerror(error);
+  }
+
+  void reset() noexcept { control(Op::Reset); }
+  void enable() noexcept { control(Op::Enable); }
+  void disable() noexcept { control(Op::Disable); }
+
+  // The counts since the last reset(), keyed by COUNTER_NAMES.  When the
+  // kernel had to multiplex the counters, the counts are scaled up to the
+  // whole time they were enabled.
+  std::map<std::string, double> read() const {
+    std::map<std::string, double> counts;
+#ifdef __linux__
+    for (std::size_t i = 0; i < fds.size(); ++i) {
+      struct {
+        std::uint64_t value;
+        std::uint64_t enabled;
+        std::uint64_t running;
+      } data{};
+      if (fds[i] < 0 || ::read(fds[i], &data, sizeof(data)) != sizeof(data)
+          || data.running == 0) {
+        continue;
+      }
+      counts.emplace(COUNTER_NAMES[i],
+                     static_cast<double>(data.value)
+                         * static_cast<double>(data.enabled)
+                         / static_cast<double>(data.running));
+    }
+#endif
+    return counts;
+  }
+
+private:
+  enum class Op : std::uint8_t { Reset, Enable, Disable };
+
+  void control([[maybe_unused]] const Op op) noexcept {
+#ifdef __linux__
+    unsigned long request = PERF_EVENT_IOC_RESET;
+    if (op == Op::Enable) {
+      request = PERF_EVENT_IOC_ENABLE;
+    } else if (op == Op::Disable) {
+      request = PERF_EVENT_IOC_DISABLE;
+    }
+    for (const int fd : fds) {
+      if (fd >= 0) {
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+        ioctl(fd, request, 0);
+      }
+    }
+#endif
+  }
+
+#ifdef __linux__
+  static int open(perf_event_attr& attr) noexcept {
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-vararg)
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                                    PERF_FLAG_FD_CLOEXEC));
+  }
+#endif
+};
+
+} // namespace perf
@@ -3,6 +3,7 @@
 #include "TermColor.hpp"
 
 #include <exception>
+#include <filesystem>
 #include <fmt/core.h>
 #include <memory>
 #include <mitama/anyhow/anyhow.hpp>
@@ -55,35 +56,54 @@ inline constexpr auto to_anyhow = [](auto... xs) {
 
 namespace toml {
 
-template <typename T, typename... U>
-inline Result<T> try_find(const toml::value& v, const U&... u) noexcept {
-  using std::string_view_literals::operator""sv;
-
+// toml11 formats its errors in color if stderr is colored.  They start with
+// `[error] ` and end with a newline, which Diag::error would repeat.
+inline void syncErrorColor() noexcept {
   if (cabin::shouldColorStderr()) {
     color::enable();
   } else {
     color::disable();
   }
+}
+
+inline std::string stripErrorPrefix(std::string what) {
+  using std::string_view_literals::operator""sv;
+
+  // Errors that don't come from the TOML itself, like a file that cannot be
+  // opened, have no prefix.
+  for (const std::string_view prefix :
+       { "[error] "sv, "\033[31m\033[01m[error]\033[00m "sv }) {
+    if (what.starts_with(prefix)) {
+      what.erase(0, prefix.size());
+      break;
+    }
+  }
 
+  if (!what.empty() && what.back() == '\n') {
+    what.pop_back(); // remove the last '\n' since Diag::error adds one.
+  }
+  return what;
+}
+
+template <typename T, typename... U>
+inline Result<T> try_find(const toml::value& v, const U&... u) noexcept {
+  syncErrorColor();
   try {
     return Ok(toml::find<T>(v, u...));
   } catch (const std::exception& e) {
-    std::string what = e.what();
-
-    static constexpr std::size_t errorPrefixSize = "[error] "sv.size();
-    static constexpr std::size_t colorErrorPrefixSize =
-        "\033[31m\033[01m[error]\033[00m "sv.size();
-
-    if (cabin::shouldColorStderr()) {
-      what = what.substr(colorErrorPrefixSize);
-    } else {
-      what = what.substr(errorPrefixSize);
-    }
+    return Err(anyhow::anyhow(stripErrorPrefix(e.what())));
+  }
+}
 
-    if (what.back() == '\n') {
-      what.pop_back(); // remove the last '\n' since Diag::error adds one.
-    }
-    return Err(anyhow::anyhow(what));
+// Like toml::parse, but reports a file that cannot be read or is not valid
+// TOML as an error instead of throwing.
+inline Result<toml::value>
+try_parse_file(const std::filesystem::path& path) noexcept {
+  syncErrorColor();
+  try {
+    return Ok(toml::parse(path));
+  } catch (const std::exception& e) {
+    return Err(anyhow::anyhow(stripErrorPrefix(e.what())));
   }
 }
 
@@ -1,16 +1,23 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <concepts>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <exception>
 #include <fmt/core.h>
 #include <fmt/std.h>
+#include <mutex>
 #include <source_location>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 namespace tests {
 
@@ -79,20 +86,31 @@ constexpr std::string_view prettifyFuncName(std::string_view func) noexcept {
   return func.substr(start + 1);
 }
 
+// Whether the calling thread is running a test case for runTests(), which
+// reports the outcome itself.
+inline thread_local bool inTestRunner = false;
+
 inline void pass(const std::source_location& loc =
                      std::source_location::current()) noexcept {
+  if (inTestRunner) {
+    return;
+  }
   fmt::print("        test {}::{} ... {}ok{}\n", getModName(loc.file_name()),
              prettifyFuncName(loc.function_name()), GREEN, RESET);
 }
 
 [[noreturn]] inline void error(const std::source_location& loc,
                                const std::string_view msg) {
-  fmt::print(stderr,
-             "\n        test {}::{} ... {}FAILED{}\n\n"
-             "'{}' failed at '{}', {}:{}\n",
+  const std::string details =
+      fmt::format("'{}' failed at '{}', {}:{}\n",
+                  prettifyFuncName(loc.function_name()), msg, loc.file_name(),
+                  loc.line());
+  if (inTestRunner) {
+    throw std::logic_error(details);
+  }
+  fmt::print(stderr, "\n        test {}::{} ... {}FAILED{}\n\n{}",
              getModName(loc.file_name()), prettifyFuncName(loc.function_name()),
-             RED, RESET, prettifyFuncName(loc.function_name()), msg,
-             loc.file_name(), loc.line());
+             RED, RESET, details);
   throw std::logic_error("test failed");
 }
 
@@ -211,4 +229,176 @@ assertLt(Lhs&& lhs, Rhs&& rhs, const std::string_view msg = "",
   }
 }
 
+struct TestCase {
+  std::string_view name;
+  std::string_view file;
+  void (*fn)();
+};
+
+// Test cases defined with CABIN_TEST_CASE, in the order of definition.
+inline std::vector<TestCase>& testRegistry() {
+  static std::vector<TestCase> registry;
+  return registry;
+}
+
+struct TestRegistrar {
+  TestRegistrar(const std::string_view name, const std::string_view file,
+                void (*fn)()) {
+    testRegistry().push_back(TestCase{ .name = name, .file = file, .fn = fn });
+  }
+};
+
+// Defines a test case that runTests() picks up, without listing it in
+// main():
+//
+//   CABIN_TEST_CASE(testFoo) {
+//     assertEq(foo(), 42);
+//   }
+//
+// NOLINTNEXTLINE(cppcoreguidelines-macro-usage)
+#define CABIN_TEST_CASE(name)                                                 \
+  static void name();                                                         \
+  static const ::tests::TestRegistrar name##Registrar(#name, __FILE__, name); \
+  static void name()
+
+struct TestOutcome {
+  bool passed = false;
+  double duration = 0.0; // in seconds
+  std::string message;
+};
+
+inline std::string escapeJson(const std::string_view str) {
+  std::string escaped;
+  for (const char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      escaped += fmt::format("\\u{:04x}", static_cast<unsigned char>(c));
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+// Runs the registered test cases and returns the exit status for main().
+//
+//   <binary> [FILTER]... [--test-threads <NUM>] [--list]
+//
+// Only the test cases whose name contains one of the filters run, on up to
+// --test-threads threads, each as soon as a thread is free.  Test cases must
+// not depend on each other; pass `--test-threads 1` for ones that do.  The
+// number of threads defaults to CABIN_TEST_THREADS, which `cabin test` sets
+// so that the binaries it runs at once share the jobs, or else to the
+// number of cores.  When CABIN_TEST_REPORT is set, the outcome of each test
+// case is also written to that file, one JSON object per line, for
+// `cabin test` to aggregate.
+inline int runTests(const int argc, char* argv[]) {
+  std::vector<std::string_view> filters;
+  std::size_t numThreads = std::max(1U, std::thread::hardware_concurrency());
+  if (const char* env = std::getenv("CABIN_TEST_THREADS")) {
+    numThreads = std::max(1UL, std::strtoul(env, nullptr, 10));
+  }
+  bool list = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i]; // NOLINT(*-pointer-arithmetic)
+    if (arg == "--test-threads" && i + 1 < argc) {
+      // NOLINTNEXTLINE(*-pointer-arithmetic)
+      numThreads = std::max(1UL, std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      filters.push_back(arg);
+    }
+  }
+
+  std::vector<const TestCase*> selected;
+  for (const TestCase& testCase : testRegistry()) {
+    if (filters.empty()
+        || std::ranges::any_of(filters, [&](const std::string_view filter) {
+             return testCase.name.find(filter) != std::string_view::npos;
+           })) {
+      selected.push_back(&testCase);
+    }
+  }
+  if (list) {
+    for (const TestCase* testCase : selected) {
+      fmt::print("{}::{}\n", getModName(testCase->file), testCase->name);
+    }
+    return EXIT_SUCCESS;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<TestOutcome> outcomes(selected.size());
+  std::atomic<std::size_t> next = 0;
+  std::mutex mtx;
+  const auto worker = [&] {
+    inTestRunner = true;
+    for (std::size_t i = next++; i < selected.size(); i = next++) {
+      const TestCase& testCase = *selected[i];
+      TestOutcome& outcome = outcomes[i];
+
+      const auto testStart = std::chrono::steady_clock::now();
+      try {
+        testCase.fn();
+        outcome.passed = true;
+      } catch (const std::exception& e) {
+        outcome.message = e.what();
+      } catch (...) {
+        outcome.message = "unknown exception\n";
+      }
+      const std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - testStart;
+      outcome.duration = elapsed.count();
+
+      const std::lock_guard lock(mtx);
+      if (outcome.passed) {
+        fmt::print("        test {}::{} ... {}ok{} ({:.3f}s)\n",
+                   getModName(testCase.file), testCase.name, GREEN, RESET,
+                   outcome.duration);
+      } else {
+        fmt::print(stderr,
+                   "\n        test {}::{} ... {}FAILED{} ({:.3f}s)\n\n{}",
+                   getModName(testCase.file), testCase.name, RED, RESET,
+                   outcome.duration, outcome.message);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < std::min(numThreads, selected.size()); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  const auto numFailed = static_cast<std::size_t>(std::ranges::count_if(
+      outcomes, [](const TestOutcome& outcome) { return !outcome.passed; }));
+
+  if (const char* reportPath = std::getenv("CABIN_TEST_REPORT")) {
+    if (std::FILE* report = std::fopen(reportPath, "w")) {
+      for (std::size_t i = 0; i < selected.size(); ++i) {
+        fmt::print(report,
+                   R"({{"name":"{}","passed":{},"duration":{},"message":"{}"}})"
+                   "\n",
+                   escapeJson(selected[i]->name), outcomes[i].passed,
+                   outcomes[i].duration, escapeJson(outcomes[i].message));
+      }
+      std::fclose(report);
+    }
+  }
+
+  if (numFailed > 0) {
+    fmt::print(stderr, "\n{} passed; {} failed; finished in {:.2f}s\n",
+               selected.size() - numFailed, numFailed, elapsed.count());
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
 } // namespace tests
@@ -443,7 +443,7 @@ namespace tests {
 // Thanks to:
 // https://github.com/dtolnay/semver/blob/55fa2cadd6ec95be02e5a2a87b24355304e44d40/tests/test_version.rs#L13
 
-static void testParse() {
+CABIN_TEST_CASE(testParse) {
   assertEq(Version::parse("").unwrap_err()->what(),
            "invalid semver:\n"
            "empty string is not a valid semver");
@@ -561,7 +561,7 @@ static void testParse() {
   pass();
 }
 
-static void testEq() {
+CABIN_TEST_CASE(testEq) {
   assertEq(Version::parse("1.2.3").unwrap(), Version::parse("1.2.3").unwrap());
   assertEq(Version::parse("1.2.3-alpha1").unwrap(),
            Version::parse("1.2.3-alpha1").unwrap());
@@ -573,7 +573,7 @@ static void testEq() {
   pass();
 }
 
-static void testNe() {
+CABIN_TEST_CASE(testNe) {
   assertNe(Version::parse("0.0.0").unwrap(), Version::parse("0.0.1").unwrap());
   assertNe(Version::parse("0.0.0").unwrap(), Version::parse("0.1.0").unwrap());
   assertNe(Version::parse("0.0.0").unwrap(), Version::parse("1.0.0").unwrap());
@@ -585,7 +585,7 @@ static void testNe() {
   pass();
 }
 
-static void testDisplay() {
+CABIN_TEST_CASE(testDisplay) {
   {
     std::ostringstream oss;
     oss << Version::parse("1.2.3").unwrap();
@@ -610,7 +610,7 @@ static void testDisplay() {
   pass();
 }
 
-static void testLt() {
+CABIN_TEST_CASE(testLt) {
   assertLt(Version::parse("0.0.0").unwrap(),
            Version::parse("1.2.3-alpha2").unwrap());
   assertLt(Version::parse("1.0.0").unwrap(),
@@ -629,7 +629,7 @@ static void testLt() {
   pass();
 }
 
-static void testLe() {
+CABIN_TEST_CASE(testLe) {
   assertTrue(Version::parse("0.0.0") <= Version::parse("1.2.3-alpha2"));
   assertTrue(Version::parse("1.0.0") <= Version::parse("1.2.3-alpha2"));
   assertTrue(Version::parse("1.2.0") <= Version::parse("1.2.3-alpha2"));
@@ -640,7 +640,7 @@ static void testLe() {
   pass();
 }
 
-static void testGt() {
+CABIN_TEST_CASE(testGt) {
   assertTrue(Version::parse("1.2.3-alpha2") > Version::parse("0.0.0"));
   assertTrue(Version::parse("1.2.3-alpha2") > Version::parse("1.0.0"));
   assertTrue(Version::parse("1.2.3-alpha2") > Version::parse("1.2.0"));
@@ -652,7 +652,7 @@ static void testGt() {
   pass();
 }
 
-static void testGe() {
+CABIN_TEST_CASE(testGe) {
   assertTrue(Version::parse("1.2.3-alpha2") >= Version::parse("0.0.0"));
   assertTrue(Version::parse("1.2.3-alpha2") >= Version::parse("1.0.0"));
   assertTrue(Version::parse("1.2.3-alpha2") >= Version::parse("1.2.0"));
@@ -663,7 +663,7 @@ static void testGe() {
   pass();
 }
 
-static void testSpecOrder() {
+CABIN_TEST_CASE(testSpecOrder) {
   const std::vector<std::string> vers = {
     "1.0.0-alpha",  "1.0.0-alpha.1", "1.0.0-alpha.beta", "1.0.0-beta",
     "1.0.0-beta.2", "1.0.0-beta.11", "1.0.0-rc.1",       "1.0.0",
@@ -678,16 +678,36 @@ static void testSpecOrder() {
 
 } // namespace tests
 
-int main() {
-  tests::testParse();
-  tests::testEq();
-  tests::testNe();
-  tests::testDisplay();
-  tests::testLt();
-  tests::testLe();
-  tests::testGt();
-  tests::testGe();
-  tests::testSpecOrder();
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
+
+#ifdef CABIN_BENCH
+
+#  include "Rustify/Bench.hpp"
+
+namespace benches {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_BENCH_CASE(parseVersion) {
+  constexpr std::string_view version = "1.0.0-beta.11+exp.sha.5114f85";
+  b.setBytes(version.size());
+  b.iter([&] { return Version::parse(version).is_ok(); });
+}
+
+CABIN_BENCH_CASE(compareVersions) {
+  const Version lhs = Version::parse("1.0.0-alpha.beta").unwrap();
+  const Version rhs = Version::parse("1.0.0-alpha.1").unwrap();
+  b.iter([&] { return lhs < rhs; });
+}
+
+} // namespace benches
+
+int main(int argc, char* argv[]) {
+  return bench::runBenches(argc, argv);
 }
 
 #endif
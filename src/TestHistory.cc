@@ -0,0 +1,330 @@
+#include "TestHistory.hpp"
+
+#include "Algos.hpp"
+#include "Rustify/Result.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <limits>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+TestHistory TestHistory::load(const fs::path& outDir) noexcept {
+  std::ifstream ifs(outDir / FILE_NAME);
+  if (!ifs) {
+    return {};
+  }
+
+  TestHistory history;
+  try {
+    const nlohmann::json json = nlohmann::json::parse(ifs);
+    for (const auto& item : json.at("tests").items()) {
+      const nlohmann::json& test = item.value();
+      history.records.emplace(
+          item.key(),
+          TestRecord{
+              .duration = test.at("duration").get<double>(),
+              .passed = test.at("passed").get<bool>(),
+              .fingerprint =
+                  TestFingerprint{
+                      .binaryHash = test.at("binary-hash").get<std::uint64_t>(),
+                      .dataHash = test.at("data-hash").get<std::uint64_t>(),
+                      .binarySize =
+                          test.at("binary-size").get<std::uintmax_t>(),
+                      .binaryMtime =
+                          test.at("binary-mtime").get<std::int64_t>(),
+                  },
+          });
+    }
+  } catch (const std::exception& e) {
+    spdlog::debug("Ignoring corrupted test history: {}", e.what());
+    return {};
+  }
+  return history;
+}
+
+Result<void> TestHistory::save(const fs::path& outDir) const {
+  nlohmann::json json;
+  json["tests"] = nlohmann::json::object();
+  for (const auto& [target, record] : records) {
+    const TestFingerprint& fingerprint = record.fingerprint;
+    json["tests"][target] = {
+      { "duration", record.duration },
+      { "passed", record.passed },
+      { "binary-hash", fingerprint.binaryHash },
+      { "data-hash", fingerprint.dataHash },
+      { "binary-size", fingerprint.binarySize },
+      { "binary-mtime", fingerprint.binaryMtime },
+    };
+  }
+  return writeFileAtomically(outDir / FILE_NAME, json.dump(2) + '\n');
+}
+
+std::vector<std::string>
+TestHistory::schedule(std::vector<std::string> targets) const {
+  const auto rank = [this](const std::string& target) {
+    const auto itr = records.find(target);
+    if (itr == records.end()) {
+      return std::make_pair(true, std::numeric_limits<double>::infinity());
+    }
+    return std::make_pair(itr->second.passed, itr->second.duration);
+  };
+  std::ranges::stable_sort(targets, [&](const std::string& lhs,
+                                        const std::string& rhs) {
+    const auto [lhsPassed, lhsDuration] = rank(lhs);
+    const auto [rhsPassed, rhsDuration] = rank(rhs);
+    if (lhsPassed != rhsPassed) {
+      return !lhsPassed;
+    }
+    return lhsDuration > rhsDuration;
+  });
+  return targets;
+}
+
+Result<TestFingerprint> TestHistory::fingerprint(const std::string& target,
+                                                 const fs::path& binary,
+                                                 std::uint64_t dataHash) const {
+  std::error_code ec;
+  const std::uintmax_t size = fs::file_size(binary, ec);
+  Ensure(!ec, "failed to stat {}: {}", binary.string(), ec.message());
+  const fs::file_time_type mtime = fs::last_write_time(binary, ec);
+  Ensure(!ec, "failed to stat {}: {}", binary.string(), ec.message());
+
+  TestFingerprint fingerprint{
+    .binaryHash = 0,
+    .dataHash = dataHash,
+    .binarySize = size,
+    .binaryMtime = static_cast<std::int64_t>(mtime.time_since_epoch().count()),
+  };
+  const auto itr = records.find(target);
+  if (itr != records.end()
+      && itr->second.fingerprint.binarySize == fingerprint.binarySize
+      && itr->second.fingerprint.binaryMtime == fingerprint.binaryMtime) {
+    fingerprint.binaryHash = itr->second.fingerprint.binaryHash;
+  } else {
+    fingerprint.binaryHash = Try(hashFile(binary));
+  }
+  return Ok(fingerprint);
+}
+
+bool TestHistory::passedWith(const std::string& target,
+                             const TestFingerprint& fingerprint) const {
+  const auto itr = records.find(target);
+  // A relink that leaves the binary byte-identical only changes its mtime.
+  return itr != records.end() && itr->second.passed
+         && itr->second.fingerprint.binaryHash == fingerprint.binaryHash
+         && itr->second.fingerprint.dataHash == fingerprint.dataHash;
+}
+
+std::vector<TestCaseReport> parseTestReport(const std::string_view report) {
+  std::vector<TestCaseReport> cases;
+  for (const std::string_view line : splitLines(report)) {
+    const nlohmann::json json =
+        nlohmann::json::parse(line, nullptr, /*allow_exceptions=*/false);
+    if (!json.is_object() || !json.contains("name")
+        || !json.contains("passed") || !json.contains("duration")) {
+      continue;
+    }
+    cases.push_back(TestCaseReport{
+        .name = json["name"].get<std::string>(),
+        .passed = json["passed"].get<bool>(),
+        .duration = json["duration"].get<double>(),
+    });
+  }
+  return cases;
+}
+
+Result<std::uint64_t> hashFile(const fs::path& path) {
+  std::ifstream ifs(path, std::ios::binary);
+  Ensure(ifs, "failed to open {}", path.string());
+
+  constexpr std::size_t bufferSize = 64 * 1024;
+  std::vector<char> buffer(bufferSize);
+  std::uint64_t hash = FNV1A_OFFSET_BASIS;
+  while (ifs) {
+    ifs.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    hash = fnv1aHash(
+        std::string_view(buffer.data(), static_cast<std::size_t>(ifs.gcount())),
+        hash);
+  }
+  Ensure(ifs.eof(), "failed to read {}", path.string());
+  return Ok(hash);
+}
+
+Result<std::uint64_t> hashTestData(const fs::path& pkgRoot,
+                                   const std::vector<std::string>& data) {
+  std::vector<fs::path> files;
+  for (const std::string& entry : data) {
+    const fs::path path = pkgRoot / entry;
+    Ensure(fs::exists(path), "test data `{}` does not exist", entry);
+    if (fs::is_directory(path)) {
+      for (const auto& file : fs::recursive_directory_iterator(path)) {
+        if (file.is_regular_file()) {
+          files.push_back(file.path());
+        }
+      }
+    } else {
+      files.push_back(path);
+    }
+  }
+  // Directory iteration order is unspecified.
+  std::ranges::sort(files);
+
+  std::uint64_t hash = FNV1A_OFFSET_BASIS;
+  for (const fs::path& file : files) {
+    const std::string name =
+        fs::relative(file, pkgRoot).generic_string() + '\0';
+    hash = fnv1aHash(name, hash);
+    hash = fnv1aHash(fmt::format("{:016x}", Try(hashFile(file))), hash);
+  }
+  return Ok(hash);
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+#  include <unistd.h>
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+CABIN_TEST_CASE(testSchedule) {
+  TestHistory history;
+  history.records["fast"].duration = 0.1;
+  history.records["slow"].duration = 3.0;
+  history.records["broken"].duration = 0.2;
+  history.records["broken"].passed = false;
+
+  assertTrue(history.schedule({ "fast", "slow", "broken", "new" })
+             == std::vector<std::string>{ "broken", "new", "slow", "fast" });
+  assertTrue(history.schedule({ "fast", "slow" })
+             == std::vector<std::string>{ "slow", "fast" });
+  assertTrue(history.schedule({}).empty());
+
+  // Without a history, tests run in the given order.
+  assertTrue(TestHistory{}.schedule({ "b", "a", "c" })
+             == std::vector<std::string>{ "b", "a", "c" });
+
+  pass();
+}
+
+CABIN_TEST_CASE(testSaveAndLoad) {
+  const fs::path outDir = fs::temp_directory_path()
+                          / fmt::format("cabin-test-history-{}", getpid());
+  fs::create_directories(outDir);
+
+  assertTrue(TestHistory::load(outDir).records.empty());
+
+  TestHistory history;
+  history.records["unittests/src/Foo.test"] = TestRecord{
+    .duration = 1.5,
+    .passed = false,
+    .fingerprint = TestFingerprint{ .binaryHash = 0xfedcba9876543210,
+                                    .dataHash = 1,
+                                    .binarySize = 2,
+                                    .binaryMtime = -3 },
+  };
+  assertTrue(history.save(outDir).is_ok());
+  assertTrue(TestHistory::load(outDir).records == history.records);
+
+  std::ofstream(outDir / TestHistory::FILE_NAME) << "{ not json";
+  assertTrue(TestHistory::load(outDir).records.empty());
+
+  fs::remove_all(outDir);
+  pass();
+}
+
+CABIN_TEST_CASE(testFingerprint) {
+  const fs::path dir = fs::temp_directory_path()
+                       / fmt::format("cabin-test-fingerprint-{}", getpid());
+  fs::remove_all(dir);
+  fs::create_directories(dir / "data" / "nested");
+  const fs::path binary = dir / "foo.test";
+  std::ofstream(binary) << "binary";
+  std::ofstream(dir / "data" / "a.txt") << "a";
+  std::ofstream(dir / "data" / "nested" / "b.txt") << "b";
+
+  assertEq(hashFile(binary).unwrap(), fnv1aHash("binary"));
+
+  const std::uint64_t dataHash = hashTestData(dir, { "data" }).unwrap();
+  assertEq(hashTestData(dir, { "data" }).unwrap(), dataHash);
+  assertNe(hashTestData(dir, { "data/a.txt" }).unwrap(), dataHash);
+  assertEq(hashTestData(dir, {}).unwrap(), FNV1A_OFFSET_BASIS);
+  assertEq(hashTestData(dir, { "missing" }).unwrap_err()->what(),
+           "test data `missing` does not exist");
+
+  TestHistory history;
+  const TestFingerprint fingerprint =
+      history.fingerprint("foo", binary, dataHash).unwrap();
+  assertEq(fingerprint.binaryHash, fnv1aHash("binary"));
+  assertFalse(history.passedWith("foo", fingerprint));
+
+  history.records["foo"] =
+      TestRecord{ .duration = 1.0, .passed = true, .fingerprint = fingerprint };
+  assertTrue(history.passedWith("foo", fingerprint));
+
+  // A byte-identical relink is still a hit; changed data is not.
+  TestFingerprint relinked = fingerprint;
+  relinked.binaryMtime += 1;
+  assertTrue(history.passedWith("foo", relinked));
+  TestFingerprint newData = fingerprint;
+  newData.dataHash += 1;
+  assertFalse(history.passedWith("foo", newData));
+
+  // An unchanged size and mtime reuses the recorded hash.
+  history.records["foo"].fingerprint.binaryHash = 42;
+  assertEq(history.fingerprint("foo", binary, dataHash).unwrap().binaryHash,
+           42UL);
+
+  history.records["foo"].passed = false;
+  assertFalse(history.passedWith("foo", fingerprint));
+
+  fs::remove_all(dir);
+  pass();
+}
+
+CABIN_TEST_CASE(testParseTestReport) {
+  assertTrue(parseTestReport("").empty());
+
+  const std::vector<TestCaseReport> cases = parseTestReport(
+      R"({"name":"testFoo","passed":true,"duration":0.5,"message":""})"
+      "\n"
+      R"({"name":"testBar","passed":false,"duration":1e-06,"message":"x"})"
+      "\n"
+      R"({"name":"testBaz","pas)");
+  assertEq(cases.size(), 2UL);
+  assertTrue(cases[0]
+             == TestCaseReport{ .name = "testFoo",
+                                .passed = true,
+                                .duration = 0.5 });
+  assertTrue(cases[1]
+             == TestCaseReport{ .name = "testBar",
+                                .passed = false,
+                                .duration = 1e-06 });
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
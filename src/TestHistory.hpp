@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Rustify/Result.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace cabin {
+
+namespace fs = std::filesystem;
+
+// Identifies what a test ran: the content of its binary and of the data
+// files its package declares.
+struct TestFingerprint {
+  std::uint64_t binaryHash = 0;
+  std::uint64_t dataHash = 0;
+  // The binary's size and mtime when it was hashed.  While they stay the
+  // same, the binary is not hashed again.
+  std::uintmax_t binarySize = 0;
+  std::int64_t binaryMtime = 0;
+
+  bool operator==(const TestFingerprint&) const = default;
+};
+
+// The outcome of the last run of a test binary.
+struct TestRecord {
+  double duration = 0.0; // in seconds
+  bool passed = true;
+  TestFingerprint fingerprint;
+
+  bool operator==(const TestRecord&) const = default;
+};
+
+// Results of previous `cabin test` runs, kept in the test profile's out
+// directory and keyed by test target.
+struct TestHistory {
+  static constexpr std::string_view FILE_NAME = "test-history.json";
+
+  std::unordered_map<std::string, TestRecord> records;
+
+  // A missing or corrupted history is an empty one.
+  static TestHistory load(const fs::path& outDir) noexcept;
+  Result<void> save(const fs::path& outDir) const;
+
+  // Orders `targets` so that the tests that failed last time run first, then
+  // the slowest ones, so that a long test doesn't start last and hold up the
+  // whole run.  Tests never run before are assumed to be slow.
+  std::vector<std::string> schedule(std::vector<std::string> targets) const;
+
+  // Fingerprints the test binary `binary` built for `target`.
+  Result<TestFingerprint> fingerprint(const std::string& target,
+                                      const fs::path& binary,
+                                      std::uint64_t dataHash) const;
+  // Whether `target` passed last time it ran with the same fingerprint, so
+  // running it again would tell nothing new.
+  bool passedWith(const std::string& target,
+                  const TestFingerprint& fingerprint) const;
+};
+
+// A test case in the report a test binary writes to $CABIN_TEST_REPORT, one
+// JSON object per line.  See tests::runTests().
+struct TestCaseReport {
+  std::string name;
+  bool passed = false;
+  double duration = 0.0; // in seconds
+
+  bool operator==(const TestCaseReport&) const = default;
+};
+
+// Parses a test report.  Lines that can't be parsed, e.g., a line cut short
+// by a crash, are skipped.
+std::vector<TestCaseReport> parseTestReport(std::string_view report);
+
+Result<std::uint64_t> hashFile(const fs::path& path);
+// Hashes the files and directories listed in [test].data, relative to
+// `pkgRoot`, along with their names.
+Result<std::uint64_t> hashTestData(const fs::path& pkgRoot,
+                                   const std::vector<std::string>& data);
+
+} // namespace cabin
@@ -0,0 +1,337 @@
+#include "TimeTrace.hpp"
+
+#include "Algos.hpp"
+#include "AsmListing.hpp"
+#include "Rustify/Result.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <fmt/core.h>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace cabin {
+
+static void addTime(std::map<std::string, TimeSpent>& spent,
+                    const std::string& name, const std::uint64_t micros,
+                    const std::size_t count = 1) {
+  TimeSpent& time = spent[name];
+  time.micros += micros;
+  time.count += count;
+}
+
+Result<void> addClangTimeTrace(CompileTimes& times, const std::string& unit,
+                               const std::string_view json) {
+  try {
+    const nlohmann::json trace = nlohmann::json::parse(json);
+    ++times.numUnits;
+    for (const nlohmann::json& event : trace.at("traceEvents")) {
+      if (event.value("ph", "") != "X" || !event.contains("dur")) {
+        continue;
+      }
+      const std::string name = event.value("name", "");
+      const auto micros = event.at("dur").get<std::uint64_t>();
+      std::string detail;
+      if (event.contains("args") && event["args"].contains("detail")) {
+        detail = event["args"]["detail"].get<std::string>();
+      }
+
+      if (name == "Frontend") {
+        addTime(times.frontend, unit, micros);
+      } else if (name == "Backend") {
+        addTime(times.backend, unit, micros);
+      } else if (name == "Source") {
+        addTime(times.headers, detail, micros);
+      } else if (name == "InstantiateClass"
+                 || name == "InstantiateFunction") {
+        addTime(times.templates, detail, micros);
+      } else if (name == "OptFunction") {
+        addTime(times.functions, demangleSymbols(detail), micros);
+      } else if (name.starts_with("Total ")
+                 && name != "Total ExecuteCompiler") {
+        // Sums Clang made of each kind of event, with how many there were.
+        std::size_t count = 1;
+        if (event.contains("args") && event["args"].contains("count")) {
+          count = event["args"]["count"].get<std::size_t>();
+        }
+        addTime(times.activities, name.substr(6), micros, count);
+      }
+    }
+  } catch (const std::exception& e) {
+    Bail("failed to parse the time trace of {}: {}", unit, e.what());
+  }
+  return Ok();
+}
+
+// The wall time, in microseconds, of a line of `-ftime-report`:
+//
+//    phase parsing   :   0.25 ( 76%)   0.16 ( 84%)   0.43 ( 81%)    38M ( 86%)
+//
+// The first three times are the user, system, and wall time in seconds.
+static std::optional<std::uint64_t> parseWallTime(std::string_view columns) {
+  std::vector<double> seconds;
+  while (seconds.size() < 3) {
+    columns = trim(columns);
+    if (columns.empty()) {
+      return std::nullopt;
+    }
+    const std::size_t end =
+        std::min(columns.find_first_of(" \t"), columns.size());
+    const std::string_view token = columns.substr(0, end);
+    columns.remove_prefix(end);
+    if (token.find('.') != std::string_view::npos
+        && std::ranges::all_of(token, [](const char c) {
+             return std::isdigit(static_cast<unsigned char>(c)) || c == '.';
+           })) {
+      seconds.push_back(std::stod(std::string(token)));
+    }
+  }
+  return static_cast<std::uint64_t>(seconds[2] * 1e6 + 0.5);
+}
+
+void addGccTimeReport(CompileTimes& times, const std::string& unit,
+                      const std::string_view report) {
+  ++times.numUnits;
+  bool inReport = false;
+  for (const std::string_view line : splitLines(report)) {
+    if (line.starts_with("Time variable")) {
+      inReport = true;
+      continue;
+    }
+    const std::size_t colon = line.find(" : ");
+    if (!inReport || colon == std::string_view::npos) {
+      continue;
+    }
+    const std::string_view name = trim(line.substr(0, colon));
+    const std::optional<std::uint64_t> micros =
+        parseWallTime(line.substr(colon + 3));
+    // Names starting with '|' are timed within others, and TOTAL is the sum.
+    if (!micros.has_value() || name.starts_with('|') || name == "TOTAL") {
+      continue;
+    }
+
+    if (name == "phase parsing" || name == "phase lang. deferred") {
+      // Deferred is mostly instantiating templates, which the frontend does.
+      addTime(times.frontend, unit, *micros, 0);
+    } else if (name == "phase opt and generate") {
+      addTime(times.backend, unit, *micros, 0);
+    } else if (!name.starts_with("phase ")) {
+      addTime(times.activities, std::string(name), *micros);
+    }
+  }
+  // Each unit has one frontend and one backend, whatever it's made of.
+  for (auto* spent : { &times.frontend, &times.backend }) {
+    if (const auto itr = spent->find(unit); itr != spent->end()) {
+      itr->second.count = 1;
+    }
+  }
+}
+
+static std::string formatMillis(const std::uint64_t micros) {
+  return fmt::format("{:>8} ms", (micros + 500) / 1000);
+}
+
+static std::uint64_t
+totalMicros(const std::map<std::string, TimeSpent>& spent) {
+  std::uint64_t total = 0;
+  for (const auto& [name, time] : spent) {
+    total += time.micros;
+  }
+  return total;
+}
+
+static std::string formatSection(const std::string_view title,
+                                 const std::map<std::string, TimeSpent>& spent,
+                                 const std::size_t limit,
+                                 const bool withCounts) {
+  if (spent.empty()) {
+    return "";
+  }
+  std::vector<std::pair<std::string, TimeSpent>> sorted(spent.begin(),
+                                                        spent.end());
+  std::ranges::stable_sort(sorted, [](const auto& lhs, const auto& rhs) {
+    return lhs.second.micros > rhs.second.micros;
+  });
+
+  std::string section = fmt::format("\n{}:\n", title);
+  for (std::size_t i = 0; i < sorted.size() && i < limit; ++i) {
+    const auto& [name, time] = sorted[i];
+    section += formatMillis(time.micros);
+    if (withCounts) {
+      section += fmt::format(
+          "  {:>6}x  avg {}", time.count,
+          formatMillis(time.micros / std::max<std::size_t>(time.count, 1)));
+    }
+    section += fmt::format("  {}\n", name);
+  }
+  if (sorted.size() > limit) {
+    section += fmt::format("{:>11}  ... and {} more\n", "",
+                           sorted.size() - limit);
+  }
+  return section;
+}
+
+std::string formatCompileTimes(const CompileTimes& times,
+                               const std::size_t limit) {
+  std::string report = fmt::format(
+      "{} translation unit{}: {} ms in the frontend, {} ms in the backend\n",
+      times.numUnits, times.numUnits == 1 ? "" : "s",
+      (totalMicros(times.frontend) + 500) / 1000,
+      (totalMicros(times.backend) + 500) / 1000);
+  report += formatSection("Slowest to parse (frontend)", times.frontend,
+                          limit, /*withCounts=*/false);
+  report += formatSection("Slowest to generate code for (backend)",
+                          times.backend, limit, /*withCounts=*/false);
+  report += formatSection("Most expensive headers, with what they include",
+                          times.headers, limit, /*withCounts=*/true);
+  report += formatSection("Most expensive template instantiations",
+                          times.templates, limit, /*withCounts=*/true);
+  report += formatSection("Slowest functions to optimize and generate",
+                          times.functions, limit, /*withCounts=*/true);
+  report += formatSection("Time by activity", times.activities, limit,
+                          /*withCounts=*/true);
+  return report;
+}
+
+} // namespace cabin
+
+#ifdef CABIN_TEST
+
+#  include "Rustify/Tests.hpp"
+
+namespace tests {
+
+using namespace cabin; // NOLINT(build/namespaces,google-build-using-namespace)
+
+static constexpr std::string_view CLANG_TRACE = R"({"traceEvents":[
+{"pid":1,"tid":1,"ph":"X","ts":10,"dur":3000,"name":"Source",
+ "args":{"detail":"/usr/include/c++/v1/vector"}},
+{"pid":1,"tid":1,"ph":"X","ts":20,"dur":1000,"name":"Source",
+ "args":{"detail":"/usr/include/c++/v1/string"}},
+{"pid":1,"tid":1,"ph":"X","ts":4000,"dur":2000,"name":"InstantiateClass",
+ "args":{"detail":"std::vector<int>"}},
+{"pid":1,"tid":1,"ph":"X","ts":6000,"dur":500,"name":"InstantiateFunction",
+ "args":{"detail":"std::vector<int>::push_back"}},
+{"pid":1,"tid":1,"ph":"X","ts":0,"dur":7000,"name":"Frontend"},
+{"pid":1,"tid":1,"ph":"X","ts":7000,"dur":800,"name":"OptFunction",
+ "args":{"detail":"_Z3sumRKSt6vectorIiSaIiEE"}},
+{"pid":1,"tid":1,"ph":"X","ts":7000,"dur":1500,"name":"Backend"},
+{"pid":1,"tid":1,"ph":"X","ts":0,"dur":8500,"name":"ExecuteCompiler"},
+{"pid":1,"tid":2,"ph":"X","ts":0,"dur":2500,"name":"Total InstantiateClass",
+ "args":{"count":3,"avg ms":0}},
+{"pid":1,"tid":3,"ph":"X","ts":0,"dur":8500,"name":"Total ExecuteCompiler",
+ "args":{"count":1,"avg ms":8}},
+{"cat":"","pid":1,"tid":0,"ts":0,"ph":"M","name":"process_name",
+ "args":{"name":"clang"}}
+],"beginningOfTime":1700000000000000})";
+
+CABIN_TEST_CASE(testAddClangTimeTrace) {
+  CompileTimes times;
+  assertTrue(addClangTimeTrace(times, "src/a.cc", CLANG_TRACE).is_ok());
+  assertTrue(addClangTimeTrace(times, "src/b.cc", CLANG_TRACE).is_ok());
+
+  assertEq(times.numUnits, 2UL);
+  assertEq(times.frontend.at("src/a.cc").micros, 7000UL);
+  assertEq(times.backend.at("src/b.cc").micros, 1500UL);
+  assertEq(times.headers.at("/usr/include/c++/v1/vector").micros, 6000UL);
+  assertEq(times.headers.at("/usr/include/c++/v1/vector").count, 2UL);
+  assertEq(times.templates.at("std::vector<int>").micros, 4000UL);
+  assertEq(times.templates.size(), 2UL);
+  assertEq(
+      times.functions
+          .at("sum(std::vector<int, std::allocator<int> > const&)")
+          .micros,
+      1600UL);
+  assertEq(times.activities.size(), 1UL);
+  assertEq(times.activities.at("InstantiateClass").count, 6UL);
+
+  assertTrue(addClangTimeTrace(times, "src/c.cc", "{").is_err());
+  assertTrue(addClangTimeTrace(times, "src/c.cc", "{}").is_err());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testAddGccTimeReport) {
+  CompileTimes times;
+  addGccTimeReport(
+      times, "src/main.cc",
+      "src/main.cc:3:5: warning: unused variable 'x'\n"
+      "\n"
+      "Time variable                                   usr           sys  "
+      "        wall           GGC\n"
+      " phase setup                        :   0.01 (  3%)   0.00 (  0%)   "
+      "0.01 (  2%)  1448k (  3%)\n"
+      " phase parsing                      :   0.25 ( 76%)   0.16 ( 84%)   "
+      "0.43 ( 81%)    38M ( 86%)\n"
+      " phase lang. deferred               :   0.03 (  9%)   0.02 ( 11%)   "
+      "0.04 (  8%)  3415k (  7%)\n"
+      " phase opt and generate             :   0.04 ( 12%)   0.01 (  5%)   "
+      "0.05 (  9%)  1770k (  4%)\n"
+      " |name lookup                       :   0.02 (  6%)   0.03 ( 16%)   "
+      "0.09 ( 17%)  1577k (  3%)\n"
+      " template instantiation             :   0.08 ( 24%)   0.04 ( 21%)   "
+      "0.10 (100%)  9572k ( 21%)\n"
+      " TOTAL                              :   0.33          0.19          "
+      "0.53           44M\n");
+
+  assertEq(times.numUnits, 1UL);
+  assertEq(times.frontend.at("src/main.cc").micros, 470000UL);
+  assertEq(times.frontend.at("src/main.cc").count, 1UL);
+  assertEq(times.backend.at("src/main.cc").micros, 50000UL);
+  assertEq(times.activities.size(), 1UL);
+  assertEq(times.activities.at("template instantiation").micros, 100000UL);
+  assertTrue(times.headers.empty());
+
+  pass();
+}
+
+CABIN_TEST_CASE(testFormatCompileTimes) {
+  CompileTimes times;
+  assertTrue(addClangTimeTrace(times, "src/a.cc", CLANG_TRACE).is_ok());
+
+  assertEq(formatCompileTimes(times, 1),
+           "1 translation unit: 7 ms in the frontend, 2 ms in the backend\n"
+           "\n"
+           "Slowest to parse (frontend):\n"
+           "       7 ms  src/a.cc\n"
+           "\n"
+           "Slowest to generate code for (backend):\n"
+           "       2 ms  src/a.cc\n"
+           "\n"
+           "Most expensive headers, with what they include:\n"
+           "       3 ms       1x  avg        3 ms  "
+           "/usr/include/c++/v1/vector\n"
+           "             ... and 1 more\n"
+           "\n"
+           "Most expensive template instantiations:\n"
+           "       2 ms       1x  avg        2 ms  std::vector<int>\n"
+           "             ... and 1 more\n"
+           "\n"
+           "Slowest functions to optimize and generate:\n"
+           "       1 ms       1x  avg        1 ms  "
+           "sum(std::vector<int, std::allocator<int> > const&)\n"
+           "\n"
+           "Time by activity:\n"
+           "       3 ms       3x  avg        1 ms  InstantiateClass\n");
+
+  assertEq(formatCompileTimes(CompileTimes{}, 10),
+           "0 translation units: 0 ms in the frontend, 0 ms in the backend\n");
+
+  pass();
+}
+
+} // namespace tests
+
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
+}
+
+#endif
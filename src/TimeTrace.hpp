@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Rustify/Result.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+
+namespace cabin {
+
+// How long something took to compile, summed over every time it was.
+struct TimeSpent {
+  std::uint64_t micros = 0;
+  std::size_t count = 0;
+};
+
+// What the compiler spent its time on, merged across translation units.
+struct CompileTimes {
+  std::size_t numUnits = 0;
+  // By translation unit.
+  std::map<std::string, TimeSpent> frontend;
+  std::map<std::string, TimeSpent> backend;
+  // Parsing each header, including the headers it includes.
+  std::map<std::string, TimeSpent> headers;
+  std::map<std::string, TimeSpent> templates;
+  // Optimizing each function and generating its code.
+  std::map<std::string, TimeSpent> functions;
+  // The compiler's own breakdown, like "template instantiation".
+  std::map<std::string, TimeSpent> activities;
+};
+
+// Adds what Clang's `-ftime-trace` wrote for `unit`.
+Result<void> addClangTimeTrace(CompileTimes& times, const std::string& unit,
+                               std::string_view json);
+
+// Adds what GCC's `-ftime-report` printed for `unit`.  It only breaks the
+// time down by phase and by activity.
+void addGccTimeReport(CompileTimes& times, const std::string& unit,
+                      std::string_view report);
+
+// A report like ClangBuildAnalyzer's: the slowest translation units to
+// parse and to generate code for, and the most expensive headers, template
+// instantiations, and functions, `limit` of each.
+std::string formatCompileTimes(const CompileTimes& times, std::size_t limit);
+
+} // namespace cabin
@@ -876,7 +876,7 @@ inline static void assertMatchNone(
   }
 }
 
-static void testBasic() {
+CABIN_TEST_CASE(testBasic) {
   const auto req = VersionReq::parse("1.0.0").unwrap();
   assertEq(req.toString(), "1.0.0");
   assertMatchAll(req, { { "1.0.0", "1.1.0", "1.0.1" } });
@@ -886,7 +886,7 @@ static void testBasic() {
   pass();
 }
 
-static void testExact() {
+CABIN_TEST_CASE(testExact) {
   const auto ver1 = VersionReq::parse("=1.0.0").unwrap();
   assertEq(ver1.toString(), "=1.0.0");
   assertMatchAll(ver1, { { "1.0.0" } });
@@ -916,7 +916,7 @@ static void testExact() {
   pass();
 }
 
-static void testGreaterThan() {
+CABIN_TEST_CASE(testGreaterThan) {
   const auto ver1 = VersionReq::parse(">=1.0.0").unwrap();
   assertEq(ver1.toString(), ">=1.0.0");
   assertMatchAll(ver1, { { "1.0.0", "2.0.0" } });
@@ -932,7 +932,7 @@ static void testGreaterThan() {
   pass();
 }
 
-static void testLessThan() {
+CABIN_TEST_CASE(testLessThan) {
   const auto ver1 = VersionReq::parse("<1.0.0").unwrap();
   assertEq(ver1.toString(), "<1.0.0");
   assertMatchAll(ver1, { { "0.1.0", "0.0.1" } });
@@ -957,7 +957,7 @@ static void testLessThan() {
 }
 
 // same as caret
-static void testNoOp() {
+CABIN_TEST_CASE(testNoOp) {
   const auto ver1 = VersionReq::parse("1").unwrap();
   assertMatchAll(ver1, { { "1.1.2", "1.1.0", "1.2.1", "1.0.1" } });
   assertMatchNone(ver1, { { "0.9.1", "2.9.0", "0.1.4" } });
@@ -1004,7 +1004,7 @@ static void testNoOp() {
   pass();
 }
 
-static void testMultiple() {
+CABIN_TEST_CASE(testMultiple) {
   const auto ver1 = VersionReq::parse(">0.0.9 && <=2.5.3").unwrap();
   assertEq(ver1.toString(), ">0.0.9 && <=2.5.3");
   assertMatchAll(ver1, { { "0.0.10", "1.0.0", "2.5.3" } });
@@ -1042,14 +1042,14 @@ static void testMultiple() {
   pass();
 }
 
-static void testPre() {
+CABIN_TEST_CASE(testPre) {
   const auto ver = VersionReq::parse("=2.1.1-really.0").unwrap();
   assertMatchAll(ver, { { "2.1.1-really.0" } });
 
   pass();
 }
 
-static void testCanonicalizeNoOp() {
+CABIN_TEST_CASE(testCanonicalizeNoOp) {
   // 1.1. `A.B.C` (where A > 0) is equivalent to `>=A.B.C && <(A+1).0.0`
   assertEq(VersionReq::parse("1.2.3").unwrap().canonicalize().toString(),
            ">=1.2.3 && <2.0.0");
@@ -1077,7 +1077,7 @@ static void testCanonicalizeNoOp() {
   pass();
 }
 
-static void testCanonicalizeExact() {
+CABIN_TEST_CASE(testCanonicalizeExact) {
   // 2.1. `=A.B.C` is exactly the version `A.B.C`
   assertEq(VersionReq::parse("=1.2.3").unwrap().canonicalize().toString(),
            "=1.2.3");
@@ -1093,7 +1093,7 @@ static void testCanonicalizeExact() {
   pass();
 }
 
-static void testCanonicalizeGt() {
+CABIN_TEST_CASE(testCanonicalizeGt) {
   // 3.1. `>A.B.C` is equivalent to `>=A.B.(C+1)`
   assertEq(VersionReq::parse(">1.2.3").unwrap().canonicalize().toString(),
            ">=1.2.4");
@@ -1109,7 +1109,7 @@ static void testCanonicalizeGt() {
   pass();
 }
 
-static void testCanonicalizeGte() {
+CABIN_TEST_CASE(testCanonicalizeGte) {
   // 4.1. `>=A.B.C`
   assertEq(VersionReq::parse(">=1.2.3").unwrap().canonicalize().toString(),
            ">=1.2.3");
@@ -1125,7 +1125,7 @@ static void testCanonicalizeGte() {
   pass();
 }
 
-static void testCanonicalizeLt() {
+CABIN_TEST_CASE(testCanonicalizeLt) {
   // 5.1. `<A.B.C`
   assertEq(VersionReq::parse("<1.2.3").unwrap().canonicalize().toString(),
            "<1.2.3");
@@ -1141,7 +1141,7 @@ static void testCanonicalizeLt() {
   pass();
 }
 
-static void testCanonicalizeLte() {
+CABIN_TEST_CASE(testCanonicalizeLte) {
   // 6.1. `<=A.B.C` is equivalent to `<A.B.(C+1)`
   assertEq(VersionReq::parse("<=1.2.3").unwrap().canonicalize().toString(),
            "<1.2.4");
@@ -1157,7 +1157,7 @@ static void testCanonicalizeLte() {
   pass();
 }
 
-static void testParse() {
+CABIN_TEST_CASE(testParse) {
   assertEq(VersionReq::parse("\0").unwrap_err()->what(),
            "invalid version requirement:\n"
            "\n"
@@ -1186,7 +1186,7 @@ static void testParse() {
   pass();
 }
 
-static void testComparatorParse() {
+CABIN_TEST_CASE(testComparatorParse) {
   assertEq(Comparator::parse("1.2.3-01").unwrap_err()->what(),
            "invalid semver:\n"
            "1.2.3-01\n"
@@ -1209,7 +1209,7 @@ static void testComparatorParse() {
   pass();
 }
 
-static void testLeadingDigitInPreAndBuild() {
+CABIN_TEST_CASE(testLeadingDigitInPreAndBuild) {
   for (const auto& cmp : { "", "<", "<=", ">", ">=" }) {
     // digit then alpha
     assertTrue(VersionReq::parse(cmp + "1.2.3-1a"s).is_ok());
@@ -1229,7 +1229,7 @@ static void testLeadingDigitInPreAndBuild() {
   pass();
 }
 
-static void testValidSpaces() {
+CABIN_TEST_CASE(testValidSpaces) {
   assertTrue(VersionReq::parse("   1.2    ").is_ok());
   assertTrue(VersionReq::parse(">   1.2.3    ").is_ok());
   assertTrue(VersionReq::parse("  <1.2.3 &&>= 1.2.3").is_ok());
@@ -1242,7 +1242,7 @@ static void testValidSpaces() {
   pass();
 }
 
-static void testInvalidSpaces() {
+CABIN_TEST_CASE(testInvalidSpaces) {
   assertEq(VersionReq::parse(" <  =   1.2.3").unwrap_err()->what(),
            "invalid comparator:\n"
            " <  =   1.2.3\n"
@@ -1255,7 +1255,7 @@ static void testInvalidSpaces() {
   pass();
 }
 
-static void testInvalidConjunction() {
+CABIN_TEST_CASE(testInvalidConjunction) {
   assertEq(VersionReq::parse("<1.2.3 &&").unwrap_err()->what(),
            "invalid version requirement:\n"
            "<1.2.3 &&\n"
@@ -1276,7 +1276,7 @@ static void testInvalidConjunction() {
   pass();
 }
 
-static void testNonComparatorChain() {
+CABIN_TEST_CASE(testNonComparatorChain) {
   assertEq(VersionReq::parse("1.2.3 && 4.5.6").unwrap_err()->what(),
            "invalid version requirement:\n"
            "1.2.3 && 4.5.6\n"
@@ -1305,14 +1305,14 @@ static void testNonComparatorChain() {
   pass();
 }
 
-static void testToString() {
+CABIN_TEST_CASE(testToString) {
   assertEq(VersionReq::parse("  <1.2.3  &&>=1.0 ").unwrap().toString(),
            "<1.2.3 && >=1.0");
 
   pass();
 }
 
-static void testToPkgConfigString() {
+CABIN_TEST_CASE(testToPkgConfigString) {
   assertEq(
       VersionReq::parse("  <1.2.3  &&>=1.0 ").unwrap().toPkgConfigString("foo"),
       "foo < 1.2.3, foo >= 1.0.0");
@@ -1335,7 +1335,7 @@ static void testToPkgConfigString() {
   pass();
 }
 
-static void testCanSimplify() {
+CABIN_TEST_CASE(testCanSimplify) {
   assertFalse(VersionReq::parse("1.2.3").unwrap().canSimplify());
   assertFalse(VersionReq::parse("=1.2.3").unwrap().canSimplify());
 
@@ -1367,30 +1367,8 @@ static void testCanSimplify() {
 
 } // namespace tests
 
-int main() {
-  tests::testBasic();
-  tests::testExact();
-  tests::testGreaterThan();
-  tests::testLessThan();
-  tests::testNoOp();
-  tests::testMultiple();
-  tests::testPre();
-  tests::testParse();
-  tests::testCanonicalizeNoOp();
-  tests::testCanonicalizeExact();
-  tests::testCanonicalizeGt();
-  tests::testCanonicalizeGte();
-  tests::testCanonicalizeLt();
-  tests::testCanonicalizeLte();
-  tests::testComparatorParse();
-  tests::testLeadingDigitInPreAndBuild();
-  tests::testValidSpaces();
-  tests::testInvalidSpaces();
-  tests::testInvalidConjunction();
-  tests::testNonComparatorChain();
-  tests::testToString();
-  tests::testToPkgConfigString();
-  tests::testCanSimplify();
+int main(int argc, char* argv[]) {
+  return tests::runTests(argc, argv);
 }
 
 #endif